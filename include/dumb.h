@@ -38,10 +38,10 @@ extern "C" {
  * When you bump major, minor, or patch, bump both the number and the string.
  * When you bump major or minor version, bump them in CMakeLists.txt, too.
  */
-#define DUMB_MAJOR_VERSION 2
+#define DUMB_MAJOR_VERSION 3
 #define DUMB_MINOR_VERSION 0
-#define DUMB_REVISION_VERSION 2
-#define DUMB_VERSION_STR "2.0.2"
+#define DUMB_REVISION_VERSION 0
+#define DUMB_VERSION_STR "3.0.0"
 
 #define DUMB_VERSION                                                           \
     (DUMB_MAJOR_VERSION * 10000 + DUMB_MINOR_VERSION * 100 +                   \
@@ -83,9 +83,20 @@ extern "C" {
 #define DUMB_DEPRECATED
 #endif
 
-/* Basic Sample Type. Normal range is -0x800000 to 0x7FFFFF. */
+/* Basic Sample Type. Normal range is -0x800000 to 0x7FFFFF.
+ *
+ * If the library was built with DUMB_FLOAT_SAMPLES defined, samples are
+ * floats covering the same range, and everything from the resamplers to
+ * duh_render_float() works without converting to fixed point. Programs
+ * using such a build must define DUMB_FLOAT_SAMPLES too; pkg-config does
+ * this for you.
+ */
 
+#ifdef DUMB_FLOAT_SAMPLES
+typedef float sample_t;
+#else
 typedef int sample_t;
+#endif
 
 /* Library Clean-up Management */
 
@@ -241,6 +252,21 @@ DUMBFILE *dumbfile_open_stdfile(FILE *p);
 
 DUMBFILE *dumbfile_open_memory(const char *data, size_t size);
 
+/* Memory-Mapped File Input Module
+ *
+ * Maps the whole file into memory instead of reading it. Where a module's
+ * samples are stored uncompressed, signed and in the machine's byte order,
+ * the loaders point the samples straight into the mapping instead of
+ * copying them, and the DUH keeps the mapping until it is unloaded, so
+ * every process playing the same file shares its pages. Mapped samples are
+ * never given float copies; see dumb_it_max_float_sample_memory. Files that
+ * cannot be mapped fail to open, so fall back on the stdio module for those.
+ */
+
+void dumb_register_mmapfiles(void);
+
+DUMBFILE *dumbfile_open_mmap(const char *filename);
+
 /* DUH Management */
 
 typedef struct DUH DUH;
@@ -279,6 +305,14 @@ long duh_sigrenderer_get_position(DUH_SIGRENDERER *sigrenderer);
 void duh_sigrenderer_set_sigparam(DUH_SIGRENDERER *sigrenderer,
                                   unsigned char id, long value);
 
+/* Moves the sigrenderer to pos, counted from the start of the signal as for
+ * duh_start_sigrenderer(), keeping its allocations, sample analyser callback
+ * and any settings made on it. Returns 0 on success, or -1 if the signal
+ * type cannot seek or the seek fails; in that case the sigrenderer may have
+ * been left anywhere, and the caller should end it and start a new one.
+ */
+int duh_sigrenderer_seek(DUH_SIGRENDERER *sigrenderer, long pos);
+
 long duh_sigrenderer_generate_samples(DUH_SIGRENDERER *sigrenderer,
                                       float volume, float delta, long size,
                                       sample_t **samples);
@@ -319,6 +353,39 @@ long duh_render(DUH_SIGRENDERER *sigrenderer, int bits, int unsign,
 
 extern int dumb_it_max_to_mix;
 
+/* The first time a module is rendered, which the loaders do for you, its
+ * samples can be converted to floats, so that the resampler does not have to
+ * convert them every time they are played. A float copy takes two to four
+ * times the memory of the sample, so this is off by default. Set
+ * dumb_it_max_float_sample_memory to the most bytes to spend on float copies
+ * per module; samples that do not fit are played from their original data.
+ *
+ * Loops in the float copies shorter than dumb_it_min_unrolled_loop frames
+ * are copied out end to end until they are at least that long, ping-pong
+ * loops forwards and backwards, so that voices play every loop forwards and
+ * straight from the float copy. This does not change the output. No more
+ * than dumb_it_max_unroll_memory extra bytes are spent doing this per module.
+ * Set dumb_it_min_unrolled_loop to 0 to turn it off. Like
+ * dumb_it_default_panning_separation, these must be set before loading.
+ */
+extern long dumb_it_max_float_sample_memory; /* in bytes, default 0 */
+extern int dumb_it_min_unrolled_loop;        /* in frames, default 1024 */
+extern long dumb_it_max_unroll_memory;       /* in bytes, default 1 MiB */
+
+/* dumb_it_build_checkpoints(), which the loaders call for you, keeps a
+ * snapshot of the playback state every dumb_it_checkpoint_interval, so that
+ * starting part way through never has to simulate more than that. Whenever
+ * there would be more than dumb_it_max_checkpoints, every other one is
+ * dropped and the interval doubles. These must be set before loading too.
+ *
+ * With dumb_it_checkpoint_interval set to 0, no checkpoints are kept, and
+ * the runthrough only follows the patterns to find the length. That is much
+ * quicker if the length is all you want, but starting part way through then
+ * has to simulate everything from the start.
+ */
+extern long dumb_it_checkpoint_interval; /* in 65536ths of a second, 2 s */
+extern int dumb_it_max_checkpoints;      /* default 512 */
+
 typedef struct DUMB_IT_SIGDATA DUMB_IT_SIGDATA;
 typedef struct DUMB_IT_SIGRENDERER DUMB_IT_SIGRENDERER;
 
@@ -335,6 +402,40 @@ int dumb_it_scan_for_playable_orders(DUMB_IT_SIGDATA *sigdata,
                                      dumb_scan_callback callback,
                                      void *callback_data);
 
+/* Runs job(job_data, i) for every i from 0 to n - 1, in any order and on any
+ * threads, and returns once they have all finished.
+ */
+typedef void (*dumb_parallel_for)(void *pool_data, int n,
+                                  void (*job)(void *job_data, int i),
+                                  void *job_data);
+
+/* Works like dumb_it_scan_for_playable_orders(), calling callback with the
+ * same subsongs in the same order on the calling thread, but plays up to
+ * batch subsongs at once by handing them to parallel_for, which might share
+ * them out over a thread pool. Which order the next subsong starts at is
+ * only known once the one before has been played, so some of each batch may
+ * turn out to be part of an earlier subsong, and will have been played for
+ * nothing. A batch about as big as the number of threads is best.
+ */
+int dumb_it_scan_for_playable_orders_parallel(DUMB_IT_SIGDATA *sigdata,
+                                              dumb_scan_callback callback,
+                                              void *callback_data,
+                                              dumb_parallel_for parallel_for,
+                                              void *pool_data, int batch);
+
+/* With dumb_it_load_parallel_for set, the IT, XM and S3M loaders read all
+ * the samples from the file before decoding any of them, and then decode
+ * them by handing one job per sample to dumb_it_load_parallel_for, along
+ * with dumb_it_load_pool_data. The padding added to the end of each sample
+ * the first time a module is played is shared out the same way. Everything
+ * else is still read one step at a time on the calling thread. Like
+ * dumb_it_checkpoint_interval, these must be set before loading. By default
+ * dumb_it_load_parallel_for is NULL, and each sample is decoded as soon as
+ * it is read.
+ */
+extern dumb_parallel_for dumb_it_load_parallel_for;
+extern void *dumb_it_load_pool_data;
+
 DUH_SIGRENDERER *dumb_it_start_at_order(DUH *duh, int n_channels,
                                         int startorder);
 
@@ -441,6 +542,67 @@ DUH *dumb_load_any(const char *filename, int restrict_, int subsong);
 long dumb_it_build_checkpoints(DUMB_IT_SIGDATA *sigdata, int startorder);
 void dumb_it_do_initial_runthrough(DUH *duh);
 
+/* A module loaded with one of the _quick functions can have its runthrough
+ * done a bit at a time instead, for instance whenever the program is idle,
+ * so that playback can start straight away. Each call to
+ * dumb_it_do_initial_runthrough_step() plays through at least budget more of
+ * the module, in 65536ths of a second, returning 1 while there is more to
+ * do, 0 once the DUH has its length and -1 if memory runs out. Starting or
+ * seeking to a position it has not reached yet plays it on that far first.
+ * dumb_it_build_checkpoints_step() does the same for a bare sigdata, giving
+ * the length so far in *length. After -1, the runthrough can be stepped
+ * again once there is memory to spare.
+ *
+ * Neither is thread-safe. The runthrough plays the module, which changes
+ * it until it is frozen, and adds the checkpoints that starting and
+ * seeking read. To do the runthrough on a background thread, hold one lock
+ * around each step and around everything that starts, renders or seeks the
+ * module, and keep the budget small so that playback is not held up.
+ */
+int dumb_it_build_checkpoints_step(DUMB_IT_SIGDATA *sigdata, long budget,
+                                   long *length);
+int dumb_it_do_initial_runthrough_step(DUH *duh, long budget);
+
+/* Once a module has been loaded, and its runthrough done if it is wanted,
+ * dumb_it_freeze() does everything DUMB would otherwise do to the module the
+ * first time it is played, and marks it frozen. Nothing changes a frozen
+ * module, so any number of threads may play it at once, each with its own
+ * sigrenderers, sharing one copy of the samples. A sigrenderer playing the
+ * MOD effect EFx, which inverts a sample's loop as it plays, inverts its own
+ * copy of that sample instead. A runthrough being done a step at a time is
+ * finished first.
+ *
+ * A frozen module cannot be unfrozen. Its runthrough can no longer be done,
+ * stepped or loaded. dumb_it_build_checkpoints() returns -1 for it,
+ * dumb_it_trim_silent_patterns() fails, and the dumb_it_sd_set_*()
+ * functions do nothing. dumb_it_freeze() returns -1 if memory runs out.
+ */
+int dumb_it_freeze(DUH *duh);
+
+/* The initial runthrough takes a while for long modules, so what it finds,
+ * together with what dumb_it_scan_for_playable_orders() finds, can be saved
+ * and given to a later copy of the module loaded with one of the _quick
+ * functions. dumb_it_sd_get_hash() fills in eight bytes identifying the
+ * module, for use as the key to store the data under. It covers everything
+ * the runthrough depends on, including dumb_it_max_float_sample_memory,
+ * dumb_it_min_unrolled_loop and dumb_it_max_unroll_memory, but not the
+ * sample data itself. It returns -1 if memory runs out.
+ *
+ * dumb_it_save_runthrough() returns *size bytes, to be free()d once you have
+ * stored them, or NULL if memory runs out. Only a build of DUMB which keeps
+ * the same playback state, on the same kind of machine, can read them back.
+ * dumb_it_load_runthrough() restores the checkpoints, row times and length
+ * from them, then passes each subsong the scan found to callback, unless
+ * that is NULL. It returns -1, leaving the DUH as it was, if the data is
+ * damaged or is for another module or build; do the runthrough instead in
+ * that case. It also returns -1 if callback does, by which time the DUH has
+ * been restored.
+ */
+int dumb_it_sd_get_hash(DUMB_IT_SIGDATA *sd, unsigned char *hash);
+void *dumb_it_save_runthrough(DUH *duh, long *size);
+int dumb_it_load_runthrough(DUH *duh, const void *data, long size,
+                            dumb_scan_callback callback, void *callback_data);
+
 int dumb_get_psm_subsong_count(DUMBFILE *f);
 
 const unsigned char *dumb_it_sd_get_song_message(DUMB_IT_SIGDATA *sd);
@@ -449,6 +611,21 @@ int dumb_it_sd_get_n_orders(DUMB_IT_SIGDATA *sd);
 int dumb_it_sd_get_n_samples(DUMB_IT_SIGDATA *sd);
 int dumb_it_sd_get_n_instruments(DUMB_IT_SIGDATA *sd);
 
+/* The initial runthrough notes when it first reaches each row. This gives
+ * the time, in 65536ths of a second from the start, at which the row in the
+ * given order is first played, ready to pass to duh_start_sigrenderer() or
+ * duh_sigrenderer_seek(). It returns -1 for rows the music never reaches,
+ * or if there has been no runthrough.
+ */
+long dumb_it_sd_get_row_time(DUMB_IT_SIGDATA *sd, int order, int row);
+
+/* The other way round, this finds the row which was playing at the given
+ * time, as long as the music has not looped by then. It returns -1 if there
+ * is no such row or there has been no runthrough, and 0 otherwise.
+ */
+int dumb_it_sd_get_row_at_time(DUMB_IT_SIGDATA *sd, long time, int *order,
+                               int *row);
+
 const unsigned char *dumb_it_sd_get_sample_name(DUMB_IT_SIGDATA *sd, int i);
 const unsigned char *dumb_it_sd_get_sample_filename(DUMB_IT_SIGDATA *sd, int i);
 const unsigned char *dumb_it_sd_get_instrument_name(DUMB_IT_SIGDATA *sd, int i);
@@ -519,6 +696,26 @@ struct DUMB_IT_CHANNEL_STATE {
 void dumb_it_sr_get_channel_state(DUMB_IT_SIGRENDERER *sr, int channel,
                                   DUMB_IT_CHANNEL_STATE *state);
 
+typedef struct DUMB_IT_VOICE_STATS DUMB_IT_VOICE_STATS;
+
+struct DUMB_IT_VOICE_STATS {
+    int active;         /* voices currently in use */
+    int active_peak;    /* most voices ever in use at once */
+    int pooled;         /* retired voices held for reuse */
+    int pooled_peak;    /* most retired voices ever held at once */
+    long allocated;     /* voices obtained from malloc() over the lifetime */
+    long mix_slices;    /* stretches of output rendered with voices playing */
+    long culled_slices; /* how many of those had to silence voices */
+    long culled;        /* voices silenced, summed over culled_slices */
+};
+
+/* Voices are recycled through a pool owned by the sigrenderer. These are its
+ * counters, mainly of interest for sizing and profiling. Voices are culled,
+ * quietest first, when more than dumb_it_max_to_mix are playing at once.
+ */
+void dumb_it_sr_get_voice_stats(DUMB_IT_SIGRENDERER *sr,
+                                DUMB_IT_VOICE_STATS *stats);
+
 /* Signal Design Helper Values */
 
 /* Use pow(DUMB_SEMITONE_BASE, n) to get the 'delta' value to transpose up by
@@ -564,6 +761,8 @@ typedef void (*DUH_END_SIGRENDERER)(sigrenderer_t *sigrenderer);
 
 typedef void (*DUH_UNLOAD_SIGDATA)(sigdata_t *sigdata);
 
+typedef int (*DUH_SIGRENDERER_SEEK)(sigrenderer_t *sigrenderer, long pos);
+
 /* Signal Design Function Registration */
 
 typedef struct DUH_SIGTYPE_DESC {
@@ -576,6 +775,7 @@ typedef struct DUH_SIGTYPE_DESC {
     DUH_SIGRENDERER_GET_POSITION sigrenderer_get_position;
     DUH_END_SIGRENDERER end_sigrenderer;
     DUH_UNLOAD_SIGDATA unload_sigdata;
+    DUH_SIGRENDERER_SEEK sigrenderer_seek; /* May be NULL */
 } DUH_SIGTYPE_DESC;
 
 void dumb_register_sigtype(DUH_SIGTYPE_DESC *desc);
@@ -640,6 +840,21 @@ extern int dumb_resampling_quality; /* This specifies the default */
 void dumb_it_set_resampling_quality(DUMB_IT_SIGRENDERER *sigrenderer,
                                     int quality); /* This overrides it */
 
+/* Which SIMD kernels the resamplers use. DUMB_SIMD_AUTO, the default, picks
+ * the best the CPU supports. dumb_resampler_set_simd() returns the level
+ * actually in effect, which is lower than asked for if the CPU or build lacks
+ * it. It affects every resampler, including those already rendering in other
+ * threads, which switch kernels from their next block on.
+ */
+#define DUMB_SIMD_AUTO (-1)
+#define DUMB_SIMD_NONE 0
+#define DUMB_SIMD_SSE 1
+#define DUMB_SIMD_AVX2 2
+#define DUMB_SIMD_AVX512 3
+
+int dumb_resampler_set_simd(int level);
+int dumb_resampler_get_simd(void);
+
 typedef struct DUMB_RESAMPLER DUMB_RESAMPLER;
 
 typedef struct DUMB_VOLUME_RAMP_INFO DUMB_VOLUME_RAMP_INFO;
@@ -660,10 +875,11 @@ struct DUMB_RESAMPLER {
         sample_t x24[3 * 2];
         short x16[3 * 2];
         signed char x8[3 * 2];
+        float xf[3 * 2];
     } x;
     int overshot;
     double fir_resampler_ratio;
-    void *fir_resampler[2];
+    void *fir_resampler;
 };
 
 struct DUMB_VOLUME_RAMP_INFO {
@@ -773,6 +989,44 @@ void dumb_resample_get_current_sample_8_2_2(DUMB_RESAMPLER *resampler,
                                             sample_t *dst);
 void dumb_end_resampler_8(DUMB_RESAMPLER *resampler);
 
+/* Float sources hold samples in the range -1 to 1, as 8-bit ones divided by
+ * 256 and 16-bit ones by 32768 would be.
+ */
+void dumb_reset_resampler_float(DUMB_RESAMPLER *resampler, float *src,
+                                int src_channels, long pos, long start,
+                                long end, int quality);
+DUMB_RESAMPLER *dumb_start_resampler_float(float *src, int src_channels,
+                                           long pos, long start, long end,
+                                           int quality);
+long dumb_resample_float_1_1(DUMB_RESAMPLER *resampler, sample_t *dst,
+                             long dst_size, DUMB_VOLUME_RAMP_INFO *volume,
+                             float delta);
+long dumb_resample_float_1_2(DUMB_RESAMPLER *resampler, sample_t *dst,
+                             long dst_size, DUMB_VOLUME_RAMP_INFO *volume_left,
+                             DUMB_VOLUME_RAMP_INFO *volume_right, float delta);
+long dumb_resample_float_2_1(DUMB_RESAMPLER *resampler, sample_t *dst,
+                             long dst_size, DUMB_VOLUME_RAMP_INFO *volume_left,
+                             DUMB_VOLUME_RAMP_INFO *volume_right, float delta);
+long dumb_resample_float_2_2(DUMB_RESAMPLER *resampler, sample_t *dst,
+                             long dst_size, DUMB_VOLUME_RAMP_INFO *volume_left,
+                             DUMB_VOLUME_RAMP_INFO *volume_right, float delta);
+void dumb_resample_get_current_sample_float_1_1(DUMB_RESAMPLER *resampler,
+                                                DUMB_VOLUME_RAMP_INFO *volume,
+                                                sample_t *dst);
+void dumb_resample_get_current_sample_float_1_2(
+    DUMB_RESAMPLER *resampler, DUMB_VOLUME_RAMP_INFO *volume_left,
+    DUMB_VOLUME_RAMP_INFO *volume_right, sample_t *dst);
+void dumb_resample_get_current_sample_float_2_1(
+    DUMB_RESAMPLER *resampler, DUMB_VOLUME_RAMP_INFO *volume_left,
+    DUMB_VOLUME_RAMP_INFO *volume_right, sample_t *dst);
+void dumb_resample_get_current_sample_float_2_2(
+    DUMB_RESAMPLER *resampler, DUMB_VOLUME_RAMP_INFO *volume_left,
+    DUMB_VOLUME_RAMP_INFO *volume_right, sample_t *dst);
+void dumb_end_resampler_float(DUMB_RESAMPLER *resampler);
+
+/* For the _n functions, n is 8 or 16 for those sources, 32 for float sources
+ * and anything else for sample_t.
+ */
 void dumb_reset_resampler_n(int n, DUMB_RESAMPLER *resampler, void *src,
                             int src_channels, long pos, long start, long end,
                             int quality);
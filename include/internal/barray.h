@@ -16,6 +16,8 @@
 #define bit_array_set_range EVALUATE(BARRAY_DECORATE, _bit_array_set_range)
 #define bit_array_test EVALUATE(BARRAY_DECORATE, _bit_array_test)
 #define bit_array_test_range EVALUATE(BARRAY_DECORATE, _bit_array_test_range)
+#define bit_array_find_set EVALUATE(BARRAY_DECORATE, _bit_array_find_set)
+#define bit_array_find_clear EVALUATE(BARRAY_DECORATE, _bit_array_find_clear)
 #define bit_array_clear EVALUATE(BARRAY_DECORATE, _bit_array_clear)
 #define bit_array_clear_range EVALUATE(BARRAY_DECORATE, _bit_array_clear_range)
 #define bit_array_merge EVALUATE(BARRAY_DECORATE, _bit_array_merge)
@@ -34,6 +36,12 @@ void bit_array_set_range(void *array, size_t bit, size_t count);
 int bit_array_test(void *array, size_t bit);
 int bit_array_test_range(void *array, size_t bit, size_t count);
 
+/* These return the first set or clear bit at or after bit, or the size of
+ * the array if there is none.
+ */
+size_t bit_array_find_set(void *array, size_t bit);
+size_t bit_array_find_clear(void *array, size_t bit);
+
 void bit_array_clear(void *array, size_t bit);
 void bit_array_clear_range(void *array, size_t bit, size_t count);
 
@@ -68,6 +68,11 @@ struct DUH {
 
     int n_signals;
     DUH_SIGNAL **signal;
+
+    /* Set by dumb_it_freeze(). The DUH may be shared between threads, so it
+     * must only be read.
+     */
+    int frozen;
 };
 
 DUH_SIGTYPE_DESC *_dumb_get_sigtype_desc(long type);
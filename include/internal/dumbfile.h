@@ -3,10 +3,43 @@
 
 #include "../dumb.h"
 
+#define DUMBFILE_BUFFER_SIZE 4096
+
+/* The file system is read a buffer at a time. pos is where the user of the
+ * DUMBFILE has got to, with the bytes from buffer_ptr to buffer_end read
+ * ahead of it.
+ */
 struct DUMBFILE {
     const DUMBFILE_SYSTEM *dfs;
     void *file;
     long pos;
+    unsigned char *buffer_ptr, *buffer_end;
+    unsigned char buffer[DUMBFILE_BUFFER_SIZE];
 };
 
+/* Forgets what was read ahead, for when the file underneath has been moved
+ * without the DUMBFILE knowing.
+ */
+void _dumbfile_drop_buffer(DUMBFILE *f);
+
+/* A file mapped into memory by dumbfile_open_mmap(). Loaders may point
+ * sample data straight into it rather than copying them, as long as they
+ * hold a reference for as long as the data are in use and never write to
+ * them.
+ */
+typedef struct DUMBFILE_MAPPING DUMBFILE_MAPPING;
+
+struct DUMBFILE_MAPPING {
+    const char *data;
+    size_t size;
+    int refs;
+};
+
+const void *_dumbfile_peek_mapped(DUMBFILE *f, size_t n);
+
+DUMBFILE_MAPPING *_dumbfile_ref_mapping(DUMBFILE *f);
+void _dumbfile_unref_mapping(DUMBFILE_MAPPING *mapping);
+int _dumbfile_mapping_contains(const DUMBFILE_MAPPING *mapping,
+                               const void *ptr);
+
 #endif // DUMBFILE_H
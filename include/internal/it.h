@@ -88,8 +88,13 @@ typedef struct IT_ENTRY IT_ENTRY;
 typedef struct IT_PATTERN IT_PATTERN;
 typedef struct IT_PLAYING_ENVELOPE IT_PLAYING_ENVELOPE;
 typedef struct IT_PLAYING IT_PLAYING;
+typedef struct IT_PLAYING_POOL IT_PLAYING_POOL;
 typedef struct IT_CHANNEL IT_CHANNEL;
+typedef struct IT_SNAPSHOT IT_SNAPSHOT;
 typedef struct IT_CHECKPOINT IT_CHECKPOINT;
+typedef struct IT_ROW_TIME IT_ROW_TIME;
+typedef struct IT_ROW_INDEX IT_ROW_INDEX;
+typedef struct IT_RUNTHROUGH IT_RUNTHROUGH;
 typedef struct IT_CALLBACKS IT_CALLBACKS;
 
 struct IT_MIDI {
@@ -208,6 +213,14 @@ struct IT_SAMPLE {
     signed short finetune;
 
     void *data;
+    /* The same data as floats for the FIR resampler, which voices feed from
+     * directly when it is present. Only valid once IT_WAS_PROCESSED is set.
+     */
+    float *fir_data;
+    /* If nonzero, the loop has been unrolled in fir_data and is played
+     * forwards, one copy at a time, from loop_start to here.
+     */
+    long fir_loop_end;
 
     int max_resampling_quality;
 };
@@ -383,6 +396,8 @@ struct IT_PATTERN {
     8192 /* Will be set the first time a sigdata passes through a sigrenderer  \
           */
 
+#define IT_WAS_FROZEN 16384 /* Set by dumb_it_freeze(); nothing changes after */
+
 #define IT_ORDER_END 255
 #define IT_ORDER_SKIP 254
 
@@ -417,7 +432,23 @@ struct DUMB_IT_SIGDATA {
 
     IT_MIDI *midi;
 
+    /* Sorted by time. n_checkpoints is only valid while this is not NULL. */
     IT_CHECKPOINT *checkpoint;
+    int n_checkpoints;
+
+    /* Built alongside the checkpoints, and freed with them. */
+    IT_ROW_INDEX *row_index;
+
+    /* The initial runthrough, while it is being done a step at a time. */
+    IT_RUNTHROUGH *runthrough;
+
+    /* The mapped file some of the samples point into, if any. */
+    struct DUMBFILE_MAPPING *mapping;
+
+    /* Samples read while loading but not decoded yet. See
+     * _dumb_it_decode_sample_data().
+     */
+    struct IT_SAMPLE_JOBS *sample_jobs;
 };
 
 struct IT_PLAYING_ENVELOPE {
@@ -451,6 +482,11 @@ struct IT_PLAYING {
     float ramp_volume[2];
     float ramp_delta[2];
 
+    /* Volume as of the last tick, used to pick which voices to drop when
+     * there are more than dumb_it_max_to_mix.
+     */
+    float mix_volume;
+
     unsigned char channel_volume;
 
     unsigned char volume;
@@ -496,6 +532,13 @@ struct IT_PLAYING {
     float delta;
     int finetune;
 
+    /* What sample vibrato and the pitch envelope do to delta, and the pitch
+     * envelope's filter multiplier, or -1 if it is not a filter envelope.
+     * process_playing() works these out once per tick.
+     */
+    float pitch_factor;
+    int filter_envelope;
+
     IT_PLAYING_ENVELOPE volume_envelope;
     IT_PLAYING_ENVELOPE pan_envelope;
     IT_PLAYING_ENVELOPE pitch_envelope;
@@ -638,11 +681,29 @@ struct IT_CHANNEL {
     // int output;
 };
 
+/* Retired voices are kept here, resampler and all, so that note-heavy music
+ * does not hit malloc() on every note. A sigrenderer never has more than
+ * DUMB_IT_TOTAL_CHANNELS voices live, so that also bounds the pool.
+ */
+struct IT_PLAYING_POOL {
+    IT_PLAYING *free[DUMB_IT_TOTAL_CHANNELS];
+    int n_free;
+    int n_active;
+    int peak_free;
+    int peak_active;
+    long n_allocated;
+};
+
 struct DUMB_IT_SIGRENDERER {
     DUMB_IT_SIGDATA *sigdata;
 
     int n_channels;
 
+    /* Set to follow the patterns only, for working out timings. Voices are
+     * left where they are, so nothing this renders afterwards is right.
+     */
+    int timing_only;
+
     int resampling_quality;
 
     unsigned char globalvolume;
@@ -655,6 +716,20 @@ struct DUMB_IT_SIGRENDERER {
 
     IT_PLAYING *playing[DUMB_IT_N_NNA_CHANNELS];
 
+    /* Allocated on its own, since copies of the sigrenderer start with an
+     * empty pool.
+     */
+    IT_PLAYING_POOL *voice_pool;
+
+    /* This sigrenderer's own copies of samples that EFx has inverted in a
+     * frozen sigdata, indexed by sample number. NULL until EFx needs one.
+     */
+    IT_SAMPLE **own_sample;
+
+    long n_mix_slices;    /* Calls to render() with voices to mix */
+    long n_culled_slices; /* ... of which had to drop voices */
+    long n_culled_voices; /* Voices silenced, summed over those calls */
+
     int tick;
     int speed;
     int rowcount;
@@ -707,10 +782,92 @@ struct DUMB_IT_SIGRENDERER {
     // int max_output;
 };
 
+/* What a checkpoint keeps of a sigrenderer: the song position and the
+ * channels and voices, but none of the sigrenderer's own allocations or
+ * statistics. The voices carry no FIR resamplers. See save_snapshot() and
+ * restore_snapshot().
+ */
+struct IT_SNAPSHOT {
+    int resampling_quality;
+    int ramp_style;
+
+    unsigned char globalvolume;
+    signed char globalvolslide;
+
+    int tempo;
+    signed char temposlide;
+
+    IT_CHANNEL channel[DUMB_IT_N_CHANNELS];
+
+    /* The NNA voices up to the last one there was, or NULL if none. */
+    IT_PLAYING **playing;
+    int n_playing;
+
+    int tick;
+    int speed;
+    int rowcount;
+
+    int order;
+    int row;
+    int processorder;
+    int processrow;
+    int breakrow;
+
+    int restart_position;
+
+    int n_rows;
+
+    IT_ENTRY *entry_start;
+    IT_ENTRY *entry;
+    IT_ENTRY *entry_end;
+
+    long time_left;
+    int sub_time_left;
+
+#ifdef BIT_ARRAY_BULLSHIT
+    void *played;
+    int looped;
+    LONG_LONG time_played;
+    void *row_timekeeper;
+#endif
+
+    long gvz_time;
+    int gvz_sub_time;
+};
+
 struct IT_CHECKPOINT {
-    IT_CHECKPOINT *next;
     long time;
+    IT_SNAPSHOT *snapshot;
+};
+
+struct IT_ROW_TIME {
+    long time;
+    int order;
+    int row;
+};
+
+/* When the initial runthrough first reached each row. time has a slot for
+ * every row of every order, starting at order_start[order], holding -1 for
+ * rows never reached. The rows which were reached are also listed in
+ * by_time, sorted by time, for looking them up the other way round.
+ */
+struct IT_ROW_INDEX {
+    int n_orders;
+    int n_rows;
+    int n_reached;
+    int *order_start; /* n_orders + 1 entries */
+    long *time;
+    IT_ROW_TIME *by_time;
+};
+
+/* A runthrough in progress. sigrenderer has played up to time, and is NULL
+ * once the end has been found, leaving the length in time.
+ */
+struct IT_RUNTHROUGH {
     DUMB_IT_SIGRENDERER *sigrenderer;
+    long interval;
+    long time;
+    int size; /* Slots allocated in the sigdata's checkpoint array */
 };
 
 struct IT_CALLBACKS {
@@ -741,6 +898,27 @@ struct IT_CALLBACKS {
 };
 
 void _dumb_it_end_sigrenderer(sigrenderer_t *sigrenderer);
+void _dumb_it_free_checkpoints(DUMB_IT_SIGDATA *sigdata);
+void _dumb_it_destroy_snapshot(IT_SNAPSHOT *snapshot);
+int _dumb_it_process_sigdata(DUMB_IT_SIGDATA *sigdata);
+
+/* Creates a row index laid out for the sigdata's orders, with no rows
+ * reached yet. Fill in time, then call _dumb_it_sort_row_index(), which
+ * returns -1 if memory runs out.
+ */
+IT_ROW_INDEX *_dumb_it_create_row_index(DUMB_IT_SIGDATA *sigdata);
+int _dumb_it_sort_row_index(IT_ROW_INDEX *index);
+void _dumb_it_destroy_row_index(IT_ROW_INDEX *index);
+
+/* Every pickup and arpeggio table the renderer points voices and channels
+ * at, starting with NULL, so that saved checkpoints can refer to them by
+ * index.
+ */
+#define IT_N_PICKUPS 6
+#define IT_N_ARPEGGIO_TABLES 6
+extern const DUMB_RESAMPLE_PICKUP _dumb_it_pickups[IT_N_PICKUPS];
+extern const unsigned char *const
+    _dumb_it_arpeggio_tables[IT_N_ARPEGGIO_TABLES];
 void _dumb_it_unload_sigdata(sigdata_t *vsigdata);
 
 extern DUH_SIGTYPE_DESC _dumb_sigtype_it;
@@ -863,6 +1041,24 @@ void _dumb_it_ptm_convert_effect(int effect, int value, IT_ENTRY *entry);
 
 long _dumb_it_read_sample_data_adpcm4(IT_SAMPLE *sample, DUMBFILE *f);
 
+/* How uncompressed sample data are stored, for the functions below. */
+#define IT_PCM_16BIT 1
+#define IT_PCM_BIG_ENDIAN 2
+#define IT_PCM_UNSIGNED 4
+#define IT_PCM_DELTA 8
+
+void _dumb_it_convert_sample_data(void *data, long n, int format);
+
+long _dumb_it_read_sample_data_pcm(DUMB_IT_SIGDATA *sigdata,
+                                   IT_SAMPLE *sample, long stored_length,
+                                   int format, DUMBFILE *f);
+
+int _dumb_it_map_sample_data(DUMB_IT_SIGDATA *sigdata, IT_SAMPLE *sample,
+                             long size, DUMBFILE *f);
+
+int _dumb_it_decode_sample_data(DUMB_IT_SIGDATA *sigdata);
+void _dumb_it_free_sample_jobs(DUMB_IT_SIGDATA *sigdata);
+
 void _dumb_it_interleave_stereo_sample(IT_SAMPLE *sample);
 
 /* Calling either of these is optional */
@@ -8,13 +8,19 @@
 #define PASTE(a, b) a##b
 #define EVALUATE(a, b) PASTE(a, b)
 #define resampler_init EVALUATE(RESAMPLER_DECORATE, _resampler_init)
+#define resampler_exit EVALUATE(RESAMPLER_DECORATE, _resampler_exit)
 #define resampler_create EVALUATE(RESAMPLER_DECORATE, _resampler_create)
 #define resampler_delete EVALUATE(RESAMPLER_DECORATE, _resampler_delete)
+#define resampler_reset EVALUATE(RESAMPLER_DECORATE, _resampler_reset)
 #define resampler_dup EVALUATE(RESAMPLER_DECORATE, _resampler_dup)
 #define resampler_dup_inplace                                                  \
     EVALUATE(RESAMPLER_DECORATE, _resampler_dup_inplace)
 #define resampler_set_quality                                                  \
     EVALUATE(RESAMPLER_DECORATE, _resampler_set_quality)
+#define resampler_set_channels                                                 \
+    EVALUATE(RESAMPLER_DECORATE, _resampler_set_channels)
+#define resampler_get_channels                                                 \
+    EVALUATE(RESAMPLER_DECORATE, _resampler_get_channels)
 #define resampler_get_free_count                                               \
     EVALUATE(RESAMPLER_DECORATE, _resampler_get_free_count)
 #define resampler_write_sample                                                 \
@@ -23,6 +29,8 @@
     EVALUATE(RESAMPLER_DECORATE, _resampler_write_sample_fixed)
 #define resampler_write_sample_float                                           \
     EVALUATE(RESAMPLER_DECORATE, _resampler_write_sample_float)
+#define resampler_write_block                                                  \
+    EVALUATE(RESAMPLER_DECORATE, _resampler_write_block)
 #define resampler_set_rate EVALUATE(RESAMPLER_DECORATE, _resampler_set_rate)
 #define resampler_ready EVALUATE(RESAMPLER_DECORATE, _resampler_ready)
 #define resampler_clear EVALUATE(RESAMPLER_DECORATE, _resampler_clear)
@@ -31,14 +39,23 @@
 #define resampler_get_sample EVALUATE(RESAMPLER_DECORATE, _resampler_get_sample)
 #define resampler_get_sample_float                                             \
     EVALUATE(RESAMPLER_DECORATE, _resampler_get_sample_float)
+#define resampler_get_frame_float                                              \
+    EVALUATE(RESAMPLER_DECORATE, _resampler_get_frame_float)
 #define resampler_remove_sample                                                \
     EVALUATE(RESAMPLER_DECORATE, _resampler_remove_sample)
+#define resampler_read_block EVALUATE(RESAMPLER_DECORATE, _resampler_read_block)
+#define resampler_set_simd EVALUATE(RESAMPLER_DECORATE, _resampler_set_simd)
+#define resampler_get_simd EVALUATE(RESAMPLER_DECORATE, _resampler_get_simd)
 #endif
 
 void resampler_init(void);
+/* Frees the tables shared by the sinc resamplers. None may be in use. */
+void resampler_exit(void);
 
 void *resampler_create(void);
 void resampler_delete(void *);
+/* Returns a resampler to the state resampler_create() leaves it in. */
+void resampler_reset(void *);
 void *resampler_dup(const void *);
 void resampler_dup_inplace(void *, const void *);
 
@@ -55,16 +72,53 @@ enum {
 
 void resampler_set_quality(void *, int quality);
 
+/* A resampler filters one channel, or two interleaved channels sharing the
+ * same phase and kernels. Changing the count clears the resampler.
+ */
+void resampler_set_channels(void *, int channels);
+int resampler_get_channels(void *);
+
+enum {
+    RESAMPLER_SIMD_AUTO = -1,
+    RESAMPLER_SIMD_NONE = 0,
+    RESAMPLER_SIMD_SSE = 1,
+    RESAMPLER_SIMD_AVX2 = 2,
+    RESAMPLER_SIMD_AVX512 = 3
+};
+
+/* Selects the kernels used by every resampler, mainly for benchmarking.
+ * RESAMPLER_SIMD_AUTO picks the best the CPU supports, which is also what
+ * resampler_init() does unless this was called first. Returns the level
+ * actually in effect, which is lower than asked for if the CPU or build
+ * lacks it. Resamplers running in other threads switch kernels the next
+ * time they fill their output buffers.
+ */
+int resampler_set_simd(int level);
+int resampler_get_simd(void);
+
+/* Counts below are in frames. The single-sample calls only suit mono. */
 int resampler_get_free_count(void *);
 void resampler_write_sample(void *, short sample);
 void resampler_write_sample_fixed(void *, int sample, unsigned char depth);
 void resampler_write_sample_float(void *, float sample);
+/* Writes up to count frames, limited by resampler_get_free_count(), and
+ * returns the number actually accepted.
+ */
+int resampler_write_block(void *, const float *samples, int count);
 void resampler_set_rate(void *, double new_factor);
 int resampler_ready(void *);
 void resampler_clear(void *);
 int resampler_get_sample_count(void *);
 int resampler_get_sample(void *);
 float resampler_get_sample_float(void *);
+/* Stores the current frame, one float per channel. */
+void resampler_get_frame_float(void *, float *out);
 void resampler_remove_sample(void *, int decay);
+/* Equivalent to up to count rounds of resampler_get_frame_float() and
+ * resampler_remove_sample(r, 1), running the filter as needed. Returns the
+ * number of frames stored in out, which is short only when more input is
+ * required.
+ */
+int resampler_read_block(void *, float *out, int count);
 
 #endif
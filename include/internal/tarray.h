@@ -17,4 +17,17 @@ unsigned int timekeeping_array_get_count(void *array, size_t index);
 
 LONG_LONG timekeeping_array_get_item(void *array, size_t index);
 
+/* For saving and restoring arrays. Returns the first row at or after index
+ * which has been played, filling in its counts and first play time, or the
+ * size of the array if there is none. Setting a count of zero marks a row as
+ * never played.
+ */
+size_t timekeeping_array_get_row(void *array, size_t index,
+                                 unsigned int *count,
+                                 unsigned int *restart_count,
+                                 LONG_LONG *first_time);
+void timekeeping_array_set_row(void *array, size_t index, unsigned int count,
+                               unsigned int restart_count,
+                               LONG_LONG first_time);
+
 #endif
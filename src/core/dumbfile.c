@@ -36,6 +36,47 @@ void register_dumbfile_system(const DUMBFILE_SYSTEM *dfs) {
 
 #include "internal/dumbfile.h"
 
+#include <string.h>
+
+/* Reads up to n bytes straight from the file system, returning how many it
+ * got before the end of the file or an error.
+ */
+static dumb_ssize_t dumbfile_read(DUMBFILE *f, char *ptr, size_t n) {
+    dumb_ssize_t rv;
+
+    if (f->dfs->getnc) {
+        for (rv = 0; rv < (dumb_ssize_t)n;) {
+            dumb_ssize_t got = (*f->dfs->getnc)(ptr + rv, n - rv, f->file);
+            if (got <= 0)
+                break;
+            rv += got;
+        }
+        return rv;
+    }
+
+    for (rv = 0; rv < (dumb_ssize_t)n; rv++) {
+        int c = (*f->dfs->getc)(f->file);
+        if (c < 0)
+            break;
+        *ptr++ = c;
+    }
+
+    return rv;
+}
+
+/* Refills the empty buffer. Returns -1 if nothing more could be read. */
+static int dumbfile_fill(DUMBFILE *f) {
+    dumb_ssize_t rv =
+        dumbfile_read(f, (char *)f->buffer, DUMBFILE_BUFFER_SIZE);
+    f->buffer_ptr = f->buffer;
+    f->buffer_end = f->buffer + rv;
+    return rv > 0 ? 0 : -1;
+}
+
+void _dumbfile_drop_buffer(DUMBFILE *f) {
+    f->buffer_ptr = f->buffer_end = f->buffer;
+}
+
 DUMBFILE *dumbfile_open(const char *filename) {
     DUMBFILE *f;
 
@@ -56,6 +97,7 @@ DUMBFILE *dumbfile_open(const char *filename) {
     }
 
     f->pos = 0;
+    _dumbfile_drop_buffer(f);
 
     return f;
 }
@@ -79,6 +121,7 @@ DUMBFILE *dumbfile_open_ex(void *file, const DUMBFILE_SYSTEM *dfs) {
     f->file = file;
 
     f->pos = 0;
+    _dumbfile_drop_buffer(f);
 
     return f;
 }
@@ -91,6 +134,7 @@ dumb_off_t dumbfile_pos(DUMBFILE *f) {
 
 /* Move forward in the file from the current position by n bytes. */
 int dumbfile_skip(DUMBFILE *f, dumb_off_t n) {
+    dumb_off_t buffered;
     int rv;
 
     ASSERT(f);
@@ -101,6 +145,14 @@ int dumbfile_skip(DUMBFILE *f, dumb_off_t n) {
 
     f->pos += n;
 
+    buffered = f->buffer_end - f->buffer_ptr;
+    if (n <= buffered) {
+        f->buffer_ptr += n;
+        return 0;
+    }
+    n -= buffered;
+    _dumbfile_drop_buffer(f);
+
     if (f->dfs->skip) {
         rv = (*f->dfs->skip)(f->file, n);
         if (rv) {
@@ -122,154 +174,103 @@ int dumbfile_skip(DUMBFILE *f, dumb_off_t n) {
 }
 
 int dumbfile_getc(DUMBFILE *f) {
-    int rv;
-
     ASSERT(f);
 
     if (f->pos < 0)
         return -1;
 
-    rv = (*f->dfs->getc)(f->file);
-
-    if (rv < 0) {
+    if (f->buffer_ptr == f->buffer_end && dumbfile_fill(f) < 0) {
         f->pos = -1;
-        return rv;
+        return -1;
     }
 
     f->pos++;
 
-    return rv;
+    return *f->buffer_ptr++;
 }
 
-int dumbfile_igetw(DUMBFILE *f) {
-    int l, h;
-
-    ASSERT(f);
+/* Returns the next n bytes, which must be no more than the buffer holds, in
+ * place in the buffer, or NULL at the end of the file.
+ */
+static const unsigned char *dumbfile_peek(DUMBFILE *f, int n) {
+    const unsigned char *p;
 
     if (f->pos < 0)
-        return -1;
-
-    l = (*f->dfs->getc)(f->file);
-    if (l < 0) {
-        f->pos = -1;
-        return l;
-    }
+        return NULL;
 
-    h = (*f->dfs->getc)(f->file);
-    if (h < 0) {
-        f->pos = -1;
-        return h;
+    if (f->buffer_end - f->buffer_ptr < n) {
+        /* Move what is left to the start and top it up. */
+        dumb_ssize_t left = f->buffer_end - f->buffer_ptr;
+        memmove(f->buffer, f->buffer_ptr, left);
+        f->buffer_ptr = f->buffer;
+        f->buffer_end = f->buffer + left;
+        while (left < n) {
+            dumb_ssize_t rv =
+                dumbfile_read(f, (char *)f->buffer_end,
+                              DUMBFILE_BUFFER_SIZE - left);
+            if (rv <= 0) {
+                f->pos = -1;
+                return NULL;
+            }
+            f->buffer_end += rv;
+            left += rv;
+        }
     }
 
-    f->pos += 2;
-
-    return l | (h << 8);
+    p = f->buffer_ptr;
+    f->buffer_ptr += n;
+    f->pos += n;
+    return p;
 }
 
-int dumbfile_mgetw(DUMBFILE *f) {
-    int l, h;
+int dumbfile_igetw(DUMBFILE *f) {
+    const unsigned char *p;
 
     ASSERT(f);
 
-    if (f->pos < 0)
+    p = dumbfile_peek(f, 2);
+    if (!p)
         return -1;
 
-    h = (*f->dfs->getc)(f->file);
-    if (h < 0) {
-        f->pos = -1;
-        return h;
-    }
-
-    l = (*f->dfs->getc)(f->file);
-    if (l < 0) {
-        f->pos = -1;
-        return l;
-    }
-
-    f->pos += 2;
-
-    return l | (h << 8);
+    return p[0] | (p[1] << 8);
 }
 
-long dumbfile_igetl(DUMBFILE *f) {
-    unsigned long rv, b;
+int dumbfile_mgetw(DUMBFILE *f) {
+    const unsigned char *p;
 
     ASSERT(f);
 
-    if (f->pos < 0)
+    p = dumbfile_peek(f, 2);
+    if (!p)
         return -1;
 
-    rv = (*f->dfs->getc)(f->file);
-    if ((signed long)rv < 0) {
-        f->pos = -1;
-        return rv;
-    }
-
-    b = (*f->dfs->getc)(f->file);
-    if ((signed long)b < 0) {
-        f->pos = -1;
-        return b;
-    }
-    rv |= b << 8;
+    return (p[0] << 8) | p[1];
+}
 
-    b = (*f->dfs->getc)(f->file);
-    if ((signed long)b < 0) {
-        f->pos = -1;
-        return b;
-    }
-    rv |= b << 16;
+long dumbfile_igetl(DUMBFILE *f) {
+    const unsigned char *p;
 
-    b = (*f->dfs->getc)(f->file);
-    if ((signed long)b < 0) {
-        f->pos = -1;
-        return b;
-    }
-    rv |= b << 24;
+    ASSERT(f);
 
-    f->pos += 4;
+    p = dumbfile_peek(f, 4);
+    if (!p)
+        return -1;
 
-    return rv;
+    return (long)((unsigned long)p[0] | ((unsigned long)p[1] << 8) |
+                  ((unsigned long)p[2] << 16) | ((unsigned long)p[3] << 24));
 }
 
 long dumbfile_mgetl(DUMBFILE *f) {
-    unsigned long rv, b;
+    const unsigned char *p;
 
     ASSERT(f);
 
-    if (f->pos < 0)
+    p = dumbfile_peek(f, 4);
+    if (!p)
         return -1;
 
-    rv = (*f->dfs->getc)(f->file);
-    if ((signed long)rv < 0) {
-        f->pos = -1;
-        return rv;
-    }
-    rv <<= 24;
-
-    b = (*f->dfs->getc)(f->file);
-    if ((signed long)b < 0) {
-        f->pos = -1;
-        return b;
-    }
-    rv |= b << 16;
-
-    b = (*f->dfs->getc)(f->file);
-    if ((signed long)b < 0) {
-        f->pos = -1;
-        return b;
-    }
-    rv |= b << 8;
-
-    b = (*f->dfs->getc)(f->file);
-    if ((signed long)b < 0) {
-        f->pos = -1;
-        return b;
-    }
-    rv |= b;
-
-    f->pos += 4;
-
-    return rv;
+    return (long)(((unsigned long)p[0] << 24) | ((unsigned long)p[1] << 16) |
+                  ((unsigned long)p[2] << 8) | (unsigned long)p[3]);
 }
 
 unsigned long dumbfile_cgetul(DUMBFILE *f) {
@@ -299,7 +300,7 @@ signed long dumbfile_cgetsl(DUMBFILE *f) {
 }
 
 dumb_ssize_t dumbfile_getnc(char *ptr, size_t n, DUMBFILE *f) {
-    dumb_ssize_t rv;
+    dumb_ssize_t rv, buffered;
 
     ASSERT(f);
     ASSERT(n >= 0);
@@ -307,23 +308,36 @@ dumb_ssize_t dumbfile_getnc(char *ptr, size_t n, DUMBFILE *f) {
     if (f->pos < 0)
         return -1;
 
-    if (f->dfs->getnc) {
-        rv = (*f->dfs->getnc)(ptr, n, f->file);
-        if (rv < (dumb_ssize_t)n) {
-            f->pos = -1;
-            return MAX(rv, 0);
-        }
-    } else {
-        for (rv = 0; rv < (dumb_ssize_t)n; rv++) {
-            int c = (*f->dfs->getc)(f->file);
-            if (c < 0) {
-                f->pos = -1;
-                return rv;
-            }
-            *ptr++ = c;
+    buffered = f->buffer_end - f->buffer_ptr;
+    if ((dumb_ssize_t)n <= buffered) {
+        memcpy(ptr, f->buffer_ptr, n);
+        f->buffer_ptr += n;
+        f->pos += n;
+        return n;
+    }
+
+    memcpy(ptr, f->buffer_ptr, buffered);
+    _dumbfile_drop_buffer(f);
+    rv = buffered;
+
+    /* Big reads go straight into ptr, small ones through the buffer. */
+    if (n - rv >= DUMBFILE_BUFFER_SIZE)
+        rv += dumbfile_read(f, ptr + rv, n - rv);
+    else {
+        while (rv < (dumb_ssize_t)n && dumbfile_fill(f) == 0) {
+            dumb_ssize_t todo =
+                MIN((dumb_ssize_t)n - rv, f->buffer_end - f->buffer_ptr);
+            memcpy(ptr + rv, f->buffer_ptr, todo);
+            f->buffer_ptr += todo;
+            rv += todo;
         }
     }
 
+    if (rv < (dumb_ssize_t)n) {
+        f->pos = -1;
+        return rv;
+    }
+
     f->pos += rv;
 
     return rv;
@@ -343,6 +357,18 @@ int dumbfile_seek(DUMBFILE *f, dumb_off_t n, int origin) {
     default:
         break; /* keep n, seek position from beginning of file */
     }
+
+    /* Stay in the buffer if it holds position n. */
+    if (f->pos >= 0) {
+        dumb_off_t start = f->pos - (f->buffer_ptr - f->buffer);
+        if (n >= start && n <= f->pos + (f->buffer_end - f->buffer_ptr)) {
+            f->buffer_ptr = f->buffer + (n - start);
+            f->pos = n;
+            return 0;
+        }
+    }
+
+    _dumbfile_drop_buffer(f);
     f->pos = n;
     return (*f->dfs->seek)(f->file, n);
 }
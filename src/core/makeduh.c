@@ -73,6 +73,7 @@ DUH *make_duh(dumb_off_t length, int n_tags, const char *const tags[][2],
 
     duh->n_tags = 0;
     duh->tag = NULL;
+    duh->frozen = 0;
 
     fail = 0;
 
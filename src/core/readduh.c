@@ -69,6 +69,8 @@ DUH *read_duh(DUMBFILE *f) {
     if (!duh)
         return NULL;
 
+    duh->frozen = 0;
+
     duh->length = dumbfile_igetl(f);
     if (dumbfile_error(f) || duh->length <= 0) {
         free(duh);
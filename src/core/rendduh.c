@@ -23,6 +23,48 @@
 #include "dumb.h"
 #include "internal/dumb.h"
 
+#ifdef DUMB_FLOAT_SAMPLES
+
+/* Samples are already floats. Clamp, then add an offset that makes the value
+ * positive so that the conversion to int rounds to nearest.
+ */
+#define CONVERT8(src, pos, signconv)                                           \
+    {                                                                          \
+        float f = (src) * (1.0f / 65536.0f);                                   \
+        f = MID(-128.0f, f, 127.0f);                                           \
+        ((char *)sptr)[pos] = (char)((int)(f + 128.5f) - 128) ^ signconv;      \
+    }
+
+#define CONVERT16(src, pos, signconv)                                          \
+    {                                                                          \
+        float f = (src) * (1.0f / 256.0f);                                     \
+        f = MID(-32768.0f, f, 32767.0f);                                       \
+        ((short *)sptr)[pos] = (short)(((int)(f + 32768.5f) - 32768) ^         \
+                                       signconv);                              \
+    }
+
+#define CONVERT24(src, pos)                                                    \
+    {                                                                          \
+        double d = MID(-8388608.0, (double)(src), 8388607.0);                  \
+        signed int f = (int)(d + 8388608.5) - 8388608;                         \
+        ((unsigned char *)sptr)[pos] = (f)&0xFF;                               \
+        ((unsigned char *)sptr)[pos + 1] = (f >> 8) & 0xFF;                    \
+        ((unsigned char *)sptr)[pos + 2] = (f >> 16) & 0xFF;                   \
+    }
+
+#define CONVERT32F(src, pos)                                                   \
+    {                                                                          \
+        ((float *)sptr)[pos] = (src) * (1.0f / (float)(0xffffff / 2 + 1));     \
+    }
+
+#define CONVERT64F(src, pos)                                                   \
+    {                                                                          \
+        ((double *)sptr)[pos] =                                                \
+            (double)(src) * (1.0 / (double)(0xffffff / 2 + 1));                \
+    }
+
+#else
+
 /* On the x86, we can use some tricks to speed stuff up */
 #if (defined _MSC_VER) || (defined __DJGPP__) || (defined __MINGW__)
 // Can't we detect Linux and other x86 platforms here? :/
@@ -90,6 +132,8 @@
             (double)((signed int)src) * (1.0 / (double)(0xffffff / 2 + 1));    \
     }
 
+#endif
+
 /* This is the only deprecated function in 2.0.0. */
 /* DEPRECATED */
 long duh_render(DUH_SIGRENDERER *sigrenderer, int bits, int unsign,
@@ -62,10 +62,19 @@ DUH_SIGRENDERER *duh_start_sigrenderer(DUH *duh, int sig, int n_channels,
     proc = sigrenderer->desc->start_sigrenderer;
 
     if (proc) {
-        duh->signal[sig] = NULL;
-        sigrenderer->sigrenderer =
-            (*proc)(duh, signal->sigdata, n_channels, pos);
-        duh->signal[sig] = signal;
+        /* Blanking the signal stops it from starting itself. A frozen DUH is
+         * only read, so that several threads may start sigrenderers for it
+         * at once.
+         */
+        if (duh->frozen)
+            sigrenderer->sigrenderer =
+                (*proc)(duh, signal->sigdata, n_channels, pos);
+        else {
+            duh->signal[sig] = NULL;
+            sigrenderer->sigrenderer =
+                (*proc)(duh, signal->sigdata, n_channels, pos);
+            duh->signal[sig] = signal;
+        }
 
         if (!sigrenderer->sigrenderer) {
             free(sigrenderer);
@@ -129,6 +138,25 @@ void duh_sigrenderer_set_sigparam(DUH_SIGRENDERER *sigrenderer,
               (int)(sigrenderer->desc->type));
 }
 
+int duh_sigrenderer_seek(DUH_SIGRENDERER *sigrenderer, long pos) {
+    DUH_SIGRENDERER_SEEK proc;
+
+    if (!sigrenderer || pos < 0)
+        return -1;
+
+    proc = sigrenderer->desc->sigrenderer_seek;
+    if (!proc || !sigrenderer->sigrenderer)
+        return -1;
+
+    if ((*proc)(sigrenderer->sigrenderer, pos))
+        return -1;
+
+    sigrenderer->pos = pos;
+    sigrenderer->subpos = 0;
+
+    return 0;
+}
+
 long duh_sigrenderer_generate_samples(DUH_SIGRENDERER *sigrenderer,
                                       float volume, float delta, long size,
                                       sample_t **samples) {
@@ -1,27 +1,205 @@
 #include "internal/barray.h"
+#include "internal/dumb.h"
 
+#include <stddef.h>
 #include <string.h>
 
+/*
+   Bit arrays are split into pages which are shared between duplicates and
+   only copied when one of the owners writes to them, so that checkpoints and
+   the sigrenderers started from them cost little more than the pages which
+   actually change. Pages which are entirely clear are not allocated at all.
+
+   Reference counts may be changed by several threads at once, when more than
+   one sigrenderer is started from the same checkpoint, so they are atomic. A
+   page with a single reference belongs to one array and may be written
+   freely.
+
+   Pages are made of 64-bit words, and everything but bit_array_set(),
+   bit_array_test() and bit_array_clear() works a word at a time. Bits past
+   the end of the array are always clear.
+*/
+
+#if defined(_MSC_VER)
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#define bit_array_atomic_add(p, v)                                             \
+    (InterlockedExchangeAdd((volatile LONG *)(p), (v)) + (v))
+#elif defined(__GNUC__) || defined(__clang__)
+#define bit_array_atomic_add(p, v) __sync_add_and_fetch((p), (v))
+#else
+#define bit_array_atomic_add(p, v) (*(p) += (v))
+#endif
+
+typedef unsigned LONG_LONG bit_array_word;
+
+enum { BIT_ARRAY_WORD_BITS = 64 };
+enum { BIT_ARRAY_PAGE_BITS = 4096 };
+
+#define BIT_ARRAY_ALL ((bit_array_word)-1)
+
+/* Returns the number of clear bits below the lowest set bit of w, which must
+ * not be 0.
+ */
+#if defined(__GNUC__) || defined(__clang__)
+#define bit_array_ctz(w) __builtin_ctzll(w)
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_ARM64))
+static int bit_array_ctz(bit_array_word w) {
+    unsigned long index;
+    _BitScanForward64(&index, w);
+    return (int)index;
+}
+#else
+static int bit_array_ctz(bit_array_word w) {
+    int n = 0;
+    while (!(w & 0xFF)) {
+        w >>= 8;
+        n += 8;
+    }
+    while (!(w & 1)) {
+        w >>= 1;
+        n++;
+    }
+    return n;
+}
+#endif
+
+/* The last page is only as long as it needs to be. */
+typedef struct bit_array_page {
+    long refs;
+    bit_array_word bits[1];
+} bit_array_page;
+
+typedef struct bit_array {
+    size_t size;
+    size_t n_pages;
+    bit_array_page *page[1];
+} bit_array;
+
+static void bit_array_page_release(bit_array_page *page) {
+    if (page && bit_array_atomic_add(&page->refs, -1) == 0)
+        free(page);
+}
+
+/* Returns count bits starting at shift, which must add up to no more than a
+ * word.
+ */
+static bit_array_word bit_array_span(size_t shift, size_t count) {
+    if (count >= BIT_ARRAY_WORD_BITS)
+        return BIT_ARRAY_ALL;
+    return (((bit_array_word)1 << count) - 1) << shift;
+}
+
+/* Returns the word holding bit, which must be in range, or 0 if its page is
+ * not allocated.
+ */
+static bit_array_word bit_array_read_word(bit_array *ba, size_t bit) {
+    bit_array_page *page = ba->page[bit / BIT_ARRAY_PAGE_BITS];
+    if (!page)
+        return 0;
+    return page->bits[bit % BIT_ARRAY_PAGE_BITS / BIT_ARRAY_WORD_BITS];
+}
+
+/* Returns the 64 bits starting at bit, which need not be on a word boundary.
+ * Bits past the end read as clear.
+ */
+static bit_array_word bit_array_read_bits(bit_array *ba, size_t bit) {
+    size_t shift = bit % BIT_ARRAY_WORD_BITS;
+    bit_array_word w;
+
+    if (bit >= ba->size)
+        return 0;
+
+    w = bit_array_read_word(ba, bit) >> shift;
+    bit += BIT_ARRAY_WORD_BITS - shift;
+    if (shift && bit < ba->size)
+        w |= bit_array_read_word(ba, bit) << (BIT_ARRAY_WORD_BITS - shift);
+    return w;
+}
+
+/* Returns the word holding bit, ready to be written to, or NULL if memory
+ * runs out.
+ */
+static bit_array_word *bit_array_write_word(bit_array *ba, size_t bit) {
+    bit_array_page **slot = &ba->page[bit / BIT_ARRAY_PAGE_BITS];
+    bit_array_page *page = *slot;
+    size_t bits = ba->size - (bit - bit % BIT_ARRAY_PAGE_BITS);
+    size_t bsize;
+
+    if (bits > BIT_ARRAY_PAGE_BITS)
+        bits = BIT_ARRAY_PAGE_BITS;
+    bsize = (bits + BIT_ARRAY_WORD_BITS - 1) / BIT_ARRAY_WORD_BITS *
+            sizeof(bit_array_word);
+
+    if (!page) {
+        page = calloc(1, offsetof(bit_array_page, bits) + bsize);
+        if (!page)
+            return NULL;
+        page->refs = 1;
+        *slot = page;
+    } else if (bit_array_atomic_add(&page->refs, 0) > 1) {
+        page = malloc(offsetof(bit_array_page, bits) + bsize);
+        if (!page)
+            return NULL;
+        page->refs = 1;
+        memcpy(page->bits, (*slot)->bits, bsize);
+        bit_array_page_release(*slot);
+        *slot = page;
+    }
+
+    return &page->bits[bit % BIT_ARRAY_PAGE_BITS / BIT_ARRAY_WORD_BITS];
+}
+
+/* Sets the bits of set in the word holding bit, then clears those of
+ * clear. Pages are only written to if that changes something.
+ */
+static void bit_array_update_word(bit_array *ba, size_t bit,
+                                  bit_array_word set, bit_array_word clear) {
+    bit_array_word w = bit_array_read_word(ba, bit);
+    if (((w | set) & ~clear) != w) {
+        bit_array_word *ptr = bit_array_write_word(ba, bit);
+        if (ptr)
+            *ptr = (*ptr | set) & ~clear;
+    }
+}
+
 void *bit_array_create(size_t size) {
-    size_t bsize = ((size + 7) >> 3) + sizeof(size_t);
-    void *ret = calloc(1, bsize);
-    if (ret)
-        *(size_t *)ret = size;
-    return ret;
+    size_t n_pages = (size + BIT_ARRAY_PAGE_BITS - 1) / BIT_ARRAY_PAGE_BITS;
+    bit_array *ba = calloc(1, sizeof(*ba) + n_pages * sizeof(ba->page[0]));
+    if (ba) {
+        ba->size = size;
+        ba->n_pages = n_pages;
+    }
+    return ba;
 }
 
 void bit_array_destroy(void *array) {
-    if (array)
+    if (array) {
+        bit_array *ba = (bit_array *)array;
+        size_t i;
+        for (i = 0; i < ba->n_pages; i++)
+            bit_array_page_release(ba->page[i]);
         free(array);
+    }
 }
 
 void *bit_array_dup(void *array) {
     if (array) {
-        size_t *size = (size_t *)array;
-        size_t bsize = ((*size + 7) >> 3) + sizeof(*size);
-        void *ret = malloc(bsize);
-        if (ret)
-            memcpy(ret, array, bsize);
+        bit_array *ba = (bit_array *)array;
+        size_t i;
+        bit_array *ret =
+            malloc(sizeof(*ba) + ba->n_pages * sizeof(ba->page[0]));
+        if (ret) {
+            ret->size = ba->size;
+            ret->n_pages = ba->n_pages;
+            for (i = 0; i < ba->n_pages; i++) {
+                ret->page[i] = ba->page[i];
+                if (ret->page[i])
+                    bit_array_atomic_add(&ret->page[i]->refs, 1);
+            }
+        }
         return ret;
     }
     return NULL;
@@ -29,127 +207,178 @@ void *bit_array_dup(void *array) {
 
 void bit_array_reset(void *array) {
     if (array) {
-        size_t *size = (size_t *)array;
-        size_t bsize = (*size + 7) >> 3;
-        memset(size + 1, 0, bsize);
+        bit_array *ba = (bit_array *)array;
+        size_t i;
+        for (i = 0; i < ba->n_pages; i++) {
+            bit_array_page_release(ba->page[i]);
+            ba->page[i] = NULL;
+        }
     }
 }
 
 void bit_array_set(void *array, size_t bit) {
     if (array) {
-        size_t *size = (size_t *)array;
-        if (bit < *size) {
-            unsigned char *ptr = (unsigned char *)(size + 1);
-            ptr[bit >> 3] |= (1U << (bit & 7));
-        }
+        bit_array *ba = (bit_array *)array;
+        if (bit < ba->size)
+            bit_array_update_word(
+                ba, bit, (bit_array_word)1 << (bit % BIT_ARRAY_WORD_BITS), 0);
     }
 }
 
 void bit_array_set_range(void *array, size_t bit, size_t count) {
-    if (array && count) {
-        size_t *size = (size_t *)array;
-        if (bit < *size) {
-            unsigned char *ptr = (unsigned char *)(size + 1);
-            size_t i;
-            for (i = bit; i < *size && i < bit + count; ++i)
-                ptr[i >> 3] |= (1U << (i & 7));
+    if (array) {
+        bit_array *ba = (bit_array *)array;
+        if (bit >= ba->size)
+            return;
+        if (count > ba->size - bit)
+            count = ba->size - bit;
+        while (count) {
+            size_t shift = bit % BIT_ARRAY_WORD_BITS;
+            size_t todo = BIT_ARRAY_WORD_BITS - shift;
+            if (todo > count)
+                todo = count;
+            bit_array_update_word(ba, bit, bit_array_span(shift, todo), 0);
+            bit += todo;
+            count -= todo;
         }
     }
 }
 
 int bit_array_test(void *array, size_t bit) {
     if (array) {
-        size_t *size = (size_t *)array;
-        if (bit < *size) {
-            unsigned char *ptr = (unsigned char *)(size + 1);
-            if (ptr[bit >> 3] & (1U << (bit & 7))) {
-                return 1;
-            }
-        }
+        bit_array *ba = (bit_array *)array;
+        if (bit < ba->size)
+            return (int)(bit_array_read_word(ba, bit) >>
+                         (bit % BIT_ARRAY_WORD_BITS)) &
+                   1;
     }
     return 0;
 }
 
 int bit_array_test_range(void *array, size_t bit, size_t count) {
     if (array) {
-        size_t *size = (size_t *)array;
-        if (bit < *size) {
-            unsigned char *ptr = (unsigned char *)(size + 1);
-            if ((bit & 7) && (count > 8)) {
-                while ((bit < *size) && count && (bit & 7)) {
-                    if (ptr[bit >> 3] & (1U << (bit & 7)))
-                        return 1;
-                    bit++;
-                    count--;
-                }
-            }
-            if (!(bit & 7)) {
-                while (((*size - bit) >= 8) && (count >= 8)) {
-                    if (ptr[bit >> 3])
-                        return 1;
-                    bit += 8;
-                    count -= 8;
-                }
-            }
-            while ((bit < *size) && count) {
-                if (ptr[bit >> 3] & (1U << (bit & 7)))
-                    return 1;
-                bit++;
-                count--;
-            }
+        bit_array *ba = (bit_array *)array;
+        if (bit >= ba->size)
+            return 0;
+        if (count > ba->size - bit)
+            count = ba->size - bit;
+        while (count) {
+            size_t shift = bit % BIT_ARRAY_WORD_BITS;
+            size_t todo = BIT_ARRAY_WORD_BITS - shift;
+            if (todo > count)
+                todo = count;
+            if (bit_array_read_word(ba, bit) & bit_array_span(shift, todo))
+                return 1;
+            bit += todo;
+            count -= todo;
         }
     }
     return 0;
 }
 
+size_t bit_array_find_set(void *array, size_t bit) {
+    bit_array *ba = (bit_array *)array;
+    if (!array)
+        return 0;
+    while (bit < ba->size) {
+        size_t shift = bit % BIT_ARRAY_WORD_BITS;
+        bit_array_word w;
+        if (!ba->page[bit / BIT_ARRAY_PAGE_BITS]) {
+            bit += BIT_ARRAY_PAGE_BITS - bit % BIT_ARRAY_PAGE_BITS;
+            continue;
+        }
+        w = bit_array_read_word(ba, bit) >> shift;
+        if (w)
+            return bit + bit_array_ctz(w);
+        bit += BIT_ARRAY_WORD_BITS - shift;
+    }
+    return ba->size;
+}
+
+size_t bit_array_find_clear(void *array, size_t bit) {
+    bit_array *ba = (bit_array *)array;
+    if (!array)
+        return 0;
+    while (bit < ba->size) {
+        size_t shift = bit % BIT_ARRAY_WORD_BITS;
+        bit_array_word w;
+        if (!ba->page[bit / BIT_ARRAY_PAGE_BITS])
+            return bit;
+        w = ~bit_array_read_word(ba, bit) >> shift;
+        if (w) {
+            bit += bit_array_ctz(w);
+            return bit < ba->size ? bit : ba->size;
+        }
+        bit += BIT_ARRAY_WORD_BITS - shift;
+    }
+    return ba->size;
+}
+
 void bit_array_clear(void *array, size_t bit) {
     if (array) {
-        size_t *size = (size_t *)array;
-        if (bit < *size) {
-            unsigned char *ptr = (unsigned char *)(size + 1);
-            ptr[bit >> 3] &= ~(1U << (bit & 7));
-        }
+        bit_array *ba = (bit_array *)array;
+        if (bit < ba->size)
+            bit_array_update_word(
+                ba, bit, 0, (bit_array_word)1 << (bit % BIT_ARRAY_WORD_BITS));
     }
 }
 
 void bit_array_clear_range(void *array, size_t bit, size_t count) {
-    if (array && count) {
-        size_t *size = (size_t *)array;
-        if (bit < *size) {
-            unsigned char *ptr = (unsigned char *)(size + 1);
-            size_t i;
-            for (i = bit; i < *size && i < bit + count; ++i)
-                ptr[i >> 3] &= ~(1U << (i & 7));
+    if (array) {
+        bit_array *ba = (bit_array *)array;
+        if (bit >= ba->size)
+            return;
+        if (count > ba->size - bit)
+            count = ba->size - bit;
+        while (count) {
+            size_t shift = bit % BIT_ARRAY_WORD_BITS;
+            size_t todo = BIT_ARRAY_WORD_BITS - shift;
+            if (todo > count)
+                todo = count;
+            bit_array_update_word(ba, bit, 0, bit_array_span(shift, todo));
+            bit += todo;
+            count -= todo;
         }
     }
 }
 
-void bit_array_merge(void *dest, void *source, size_t offset) {
-    if (dest && source) {
-        size_t *dsize = (size_t *)dest;
-        size_t *ssize = (size_t *)source;
-        size_t soffset = 0;
-        while (offset < *dsize && soffset < *ssize) {
-            if (bit_array_test(source, soffset)) {
-                bit_array_set(dest, offset);
-            }
-            soffset++;
-            offset++;
+/* Sets (or with clear, clears) every bit of dest from offset on whose
+ * counterpart in source, from its start, is set.
+ */
+static void bit_array_combine(bit_array *dest, bit_array *source,
+                              size_t offset, int clear) {
+    size_t bit = offset;
+    size_t end;
+
+    if (offset >= dest->size)
+        return;
+    end = dest->size - offset < source->size ? dest->size
+                                              : offset + source->size;
+
+    while (bit < end) {
+        size_t shift = bit % BIT_ARRAY_WORD_BITS;
+        size_t todo = BIT_ARRAY_WORD_BITS - shift;
+        bit_array_word w;
+        if (todo > end - bit)
+            todo = end - bit;
+        w = (bit_array_read_bits(source, bit - offset) << shift) &
+            bit_array_span(shift, todo);
+        if (w) {
+            if (clear)
+                bit_array_update_word(dest, bit, 0, w);
+            else
+                bit_array_update_word(dest, bit, w, 0);
         }
+        bit += todo;
     }
 }
 
+void bit_array_merge(void *dest, void *source, size_t offset) {
+    if (dest && source)
+        bit_array_combine((bit_array *)dest, (bit_array *)source, offset, 0);
+}
+
 void bit_array_mask(void *dest, void *source, size_t offset) {
-    if (dest && source) {
-        size_t *dsize = (size_t *)dest;
-        size_t *ssize = (size_t *)source;
-        size_t soffset = 0;
-        while (offset < *dsize && soffset < *ssize) {
-            if (bit_array_test(source, soffset)) {
-                bit_array_clear(dest, offset);
-            }
-            soffset++;
-            offset++;
-        }
-    }
+    if (dest && source)
+        bit_array_combine((bit_array *)dest, (bit_array *)source, offset, 1);
 }
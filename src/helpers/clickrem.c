@@ -28,7 +28,7 @@ struct DUMB_CLICK_REMOVER {
     DUMB_CLICK *click;
     int n_clicks;
 
-    int offset;
+    sample_t offset;
 };
 
 struct DUMB_CLICK {
@@ -114,17 +114,71 @@ static DUMB_CLICK *dumb_click_mergesort(DUMB_CLICK *click, int n_clicks) {
     return click;
 }
 
+#ifdef DUMB_FLOAT_SAMPLES
+
+typedef float click_factor_t;
+
+#define CLICK_FACTOR(halflife) ((float)pow(0.5, 1.0 / (halflife)))
+
+/* Adds the decaying offset to samples[*pos] onwards, up to end. */
+static sample_t dumb_apply_click_offset(sample_t *samples, long *pos, long end,
+                                        int step, sample_t offset,
+                                        click_factor_t factor) {
+    long p = *pos;
+    while (p < end) {
+        samples[p] += offset;
+        offset *= factor;
+        p += step;
+    }
+    *pos = p;
+    return offset;
+}
+
+#else
+
+typedef int click_factor_t;
+
+#define CLICK_FACTOR(halflife)                                                 \
+    ((int)floor(pow(0.5, 1.0 / (halflife)) * (1U << 31)))
+
+/* Adds the decaying offset to samples[*pos] onwards, up to end. The decay is
+ * done on the magnitude so that it rounds towards zero either way.
+ */
+static sample_t dumb_apply_click_offset(sample_t *samples, long *pos, long end,
+                                        int step, sample_t offset,
+                                        click_factor_t factor) {
+    long p = *pos;
+    if (offset < 0) {
+        offset = -offset;
+        while (p < end) {
+            samples[p] -= offset;
+            offset = (int)(((LONG_LONG)(offset << 1) * factor) >> 32);
+            p += step;
+        }
+        offset = -offset;
+    } else {
+        while (p < end) {
+            samples[p] += offset;
+            offset = (int)(((LONG_LONG)(offset << 1) * factor) >> 32);
+            p += step;
+        }
+    }
+    *pos = p;
+    return offset;
+}
+
+#endif
+
 void dumb_remove_clicks(DUMB_CLICK_REMOVER *cr, sample_t *samples, long length,
                         int step, float halflife) {
     DUMB_CLICK *click;
     long pos = 0;
-    int offset;
-    int factor;
+    click_factor_t factor;
 
     if (!cr)
         return;
 
-    factor = (int)floor(pow(0.5, 1.0 / halflife) * (1U << 31));
+    factor = CLICK_FACTOR(halflife);
 
     click = dumb_click_mergesort(cr->click, cr->n_clicks);
     cr->click = NULL;
@@ -136,44 +190,15 @@ void dumb_remove_clicks(DUMB_CLICK_REMOVER *cr, sample_t *samples, long length,
         DUMB_CLICK *next = click->next;
         long end = click->pos * step;
         ASSERT(end <= length);
-        offset = cr->offset;
-        if (offset < 0) {
-            offset = -offset;
-            while (pos < end) {
-                samples[pos] -= offset;
-                offset = (int)(((LONG_LONG)(offset << 1) * factor) >> 32);
-                pos += step;
-            }
-            offset = -offset;
-        } else {
-            while (pos < end) {
-                samples[pos] += offset;
-                offset = (int)(((LONG_LONG)(offset << 1) * factor) >> 32);
-                pos += step;
-            }
-        }
-        cr->offset = offset - click->step;
+        cr->offset = dumb_apply_click_offset(samples, &pos, end, step,
+                                             cr->offset, factor) -
+                     click->step;
         free(click);
         click = next;
     }
 
-    offset = cr->offset;
-    if (offset < 0) {
-        offset = -offset;
-        while (pos < length) {
-            samples[pos] -= offset;
-            offset = (int)((LONG_LONG)(offset << 1) * factor >> 32);
-            pos += step;
-        }
-        offset = -offset;
-    } else {
-        while (pos < length) {
-            samples[pos] += offset;
-            offset = (int)((LONG_LONG)(offset << 1) * factor >> 32);
-            pos += step;
-        }
-    }
-    cr->offset = offset;
+    cr->offset = dumb_apply_click_offset(samples, &pos, length, step,
+                                         cr->offset, factor);
 }
 
 sample_t dumb_click_remover_get_offset(DUMB_CLICK_REMOVER *cr) {
@@ -161,6 +161,7 @@ static void vorbis_lpc_predict(float *coeff, float *prime, long m, float *data,
 
 #include "dumb.h"
 #include "internal/dumb.h"
+#include "internal/dumbfile.h"
 #include "internal/it.h"
 
 enum {
@@ -172,7 +173,33 @@ enum { lpc_extra = 64 }; /* How many samples of padding to predict or silence */
 /* This extra sample padding is really only needed by the FIR resampler, but it
  * helps the other resamplers as well. */
 
-int dumb_it_add_lpc(struct DUMB_IT_SIGDATA *sigdata) {
+/* Like realloc() on the sample's data, except that data mapped straight from
+ * a file are copied instead, leaving the file alone. Call it before updating
+ * sample->length. */
+static void *resize_sample_data(struct DUMB_IT_SIGDATA *sigdata,
+                                IT_SAMPLE *sample, size_t size) {
+    size_t old_size;
+    void *data;
+
+    if (!_dumbfile_mapping_contains(sigdata->mapping, sample->data))
+        return realloc(sample->data, size);
+
+    old_size = sample->length;
+    if (sample->flags & IT_SAMPLE_STEREO)
+        old_size *= 2;
+    if (sample->flags & IT_SAMPLE_16BIT)
+        old_size *= 2;
+
+    data = malloc(size);
+    if (data)
+        memcpy(data, sample->data, MIN(old_size, size));
+    return data;
+}
+
+/* Pads the end of the sample, unless it loops. Returns -1 if memory runs
+ * out.
+ */
+static int add_lpc(struct DUMB_IT_SIGDATA *sigdata, IT_SAMPLE *sample) {
     float lpc[lpc_order * 2];
     float lpc_input[lpc_max * 2];
     float lpc_output[lpc_extra * 2];
@@ -182,159 +209,197 @@ int dumb_it_add_lpc(struct DUMB_IT_SIGDATA *sigdata) {
 
     long n, o, offset, lpc_samples;
 
-    for (n = 0; n < sigdata->n_samples; n++) {
-        IT_SAMPLE *sample = sigdata->sample + n;
-        if ((sample->flags & (IT_SAMPLE_EXISTS | IT_SAMPLE_LOOP)) ==
-                IT_SAMPLE_EXISTS &&
-            sample->data != NULL) {
-            /* If we have enough sample data to train the filter, use the filter
-             * to generate the padding */
-            if (sample->length >= lpc_order) {
-                lpc_samples = sample->length;
-                if (lpc_samples > lpc_max)
-                    lpc_samples = lpc_max;
-                offset = sample->length - lpc_samples;
-
-                if (sample->flags & IT_SAMPLE_STEREO) {
-                    if (sample->flags & IT_SAMPLE_16BIT) {
-                        s16 = (signed short *)sample->data;
-                        s16 += offset * 2;
-                        for (o = 0; o < lpc_samples; o++) {
-                            lpc_input[o] = s16[o * 2 + 0];
-                            lpc_input[o + lpc_max] = s16[o * 2 + 1];
-                        }
-                    } else {
-                        s8 = (signed char *)sample->data;
-                        s8 += offset * 2;
-                        for (o = 0; o < lpc_samples; o++) {
-                            lpc_input[o] = s8[o * 2 + 0];
-                            lpc_input[o + lpc_max] = s8[o * 2 + 1];
-                        }
-                    }
-
-                    vorbis_lpc_from_data(lpc_input, lpc, lpc_samples,
-                                         lpc_order);
-                    vorbis_lpc_from_data(lpc_input + lpc_max, lpc + lpc_order,
-                                         lpc_samples, lpc_order);
-
-                    vorbis_lpc_predict(lpc, lpc_input + lpc_samples - lpc_order,
-                                       lpc_order, lpc_output, lpc_extra);
-                    vorbis_lpc_predict(
-                        lpc + lpc_order,
-                        lpc_input + lpc_max + lpc_samples - lpc_order,
-                        lpc_order, lpc_output + lpc_extra, lpc_extra);
-
-                    if (sample->flags & IT_SAMPLE_16BIT) {
-                        s16 = (signed short *)realloc(
-                            sample->data,
-                            (sample->length + lpc_extra) * 2 * sizeof(short));
-                        if (!s16)
-                            return -1;
-
-                        sample->data = s16;
-
-                        s16 += sample->length * 2;
-                        sample->length += lpc_extra;
-
-                        for (o = 0; o < lpc_extra; o++) {
-                            s16[o * 2 + 0] = lpc_output[o];
-                            s16[o * 2 + 1] = lpc_output[o + lpc_extra];
-                        }
-                    } else {
-                        s8 = (signed char *)realloc(
-                            sample->data, (sample->length + lpc_extra) * 2);
-                        if (!s8)
-                            return -1;
-
-                        sample->data = s8;
-
-                        s8 += sample->length * 2;
-                        sample->length += lpc_extra;
-
-                        for (o = 0; o < lpc_extra; o++) {
-                            s8[o * 2 + 0] = lpc_output[o];
-                            s8[o * 2 + 1] = lpc_output[o + lpc_extra];
-                        }
-                    }
-                } else {
-                    if (sample->flags & IT_SAMPLE_16BIT) {
-                        s16 = (signed short *)sample->data;
-                        s16 += offset;
-                        for (o = 0; o < lpc_samples; o++) {
-                            lpc_input[o] = s16[o];
-                        }
-                    } else {
-                        s8 = (signed char *)sample->data;
-                        s8 += offset;
-                        for (o = 0; o < lpc_samples; o++) {
-                            lpc_input[o] = s8[o];
-                        }
-                    }
-
-                    vorbis_lpc_from_data(lpc_input, lpc, lpc_samples,
-                                         lpc_order);
-
-                    vorbis_lpc_predict(lpc, lpc_input + lpc_samples - lpc_order,
-                                       lpc_order, lpc_output, lpc_extra);
-
-                    if (sample->flags & IT_SAMPLE_16BIT) {
-                        s16 = (signed short *)realloc(
-                            sample->data,
-                            (sample->length + lpc_extra) * sizeof(short));
-                        if (!s16)
-                            return -1;
-
-                        sample->data = s16;
-
-                        s16 += sample->length;
-                        sample->length += lpc_extra;
-
-                        for (o = 0; o < lpc_extra; o++) {
-                            s16[o] = lpc_output[o];
-                        }
-                    } else {
-                        s8 = (signed char *)realloc(sample->data,
-                                                    sample->length + lpc_extra);
-                        if (!s8)
-                            return -1;
-
-                        sample->data = s8;
-
-                        s8 += sample->length;
-                        sample->length += lpc_extra;
-
-                        for (o = 0; o < lpc_extra; o++) {
-                            s8[o] = lpc_output[o];
-                        }
-                    }
+    if ((sample->flags & (IT_SAMPLE_EXISTS | IT_SAMPLE_LOOP)) !=
+            IT_SAMPLE_EXISTS ||
+        sample->data == NULL)
+        return 0;
+
+    /* If we have enough sample data to train the filter, use the filter
+     * to generate the padding */
+    if (sample->length >= lpc_order) {
+        lpc_samples = sample->length;
+        if (lpc_samples > lpc_max)
+            lpc_samples = lpc_max;
+        offset = sample->length - lpc_samples;
+
+        if (sample->flags & IT_SAMPLE_STEREO) {
+            if (sample->flags & IT_SAMPLE_16BIT) {
+                s16 = (signed short *)sample->data;
+                s16 += offset * 2;
+                for (o = 0; o < lpc_samples; o++) {
+                    lpc_input[o] = s16[o * 2 + 0];
+                    lpc_input[o + lpc_max] = s16[o * 2 + 1];
+                }
+            } else {
+                s8 = (signed char *)sample->data;
+                s8 += offset * 2;
+                for (o = 0; o < lpc_samples; o++) {
+                    lpc_input[o] = s8[o * 2 + 0];
+                    lpc_input[o + lpc_max] = s8[o * 2 + 1];
+                }
+            }
+
+            vorbis_lpc_from_data(lpc_input, lpc, lpc_samples, lpc_order);
+            vorbis_lpc_from_data(lpc_input + lpc_max, lpc + lpc_order,
+                                 lpc_samples, lpc_order);
+
+            vorbis_lpc_predict(lpc, lpc_input + lpc_samples - lpc_order,
+                               lpc_order, lpc_output, lpc_extra);
+            vorbis_lpc_predict(lpc + lpc_order,
+                               lpc_input + lpc_max + lpc_samples - lpc_order,
+                               lpc_order, lpc_output + lpc_extra, lpc_extra);
+
+            if (sample->flags & IT_SAMPLE_16BIT) {
+                s16 = (signed short *)resize_sample_data(
+                    sigdata, sample,
+                    (sample->length + lpc_extra) * 2 * sizeof(short));
+                if (!s16)
+                    return -1;
+
+                sample->data = s16;
+
+                s16 += sample->length * 2;
+                sample->length += lpc_extra;
+
+                for (o = 0; o < lpc_extra; o++) {
+                    s16[o * 2 + 0] = lpc_output[o];
+                    s16[o * 2 + 1] = lpc_output[o + lpc_extra];
+                }
+            } else {
+                s8 = (signed char *)resize_sample_data(
+                    sigdata, sample, (sample->length + lpc_extra) * 2);
+                if (!s8)
+                    return -1;
+
+                sample->data = s8;
+
+                s8 += sample->length * 2;
+                sample->length += lpc_extra;
+
+                for (o = 0; o < lpc_extra; o++) {
+                    s8[o * 2 + 0] = lpc_output[o];
+                    s8[o * 2 + 1] = lpc_output[o + lpc_extra];
+                }
+            }
+        } else {
+            if (sample->flags & IT_SAMPLE_16BIT) {
+                s16 = (signed short *)sample->data;
+                s16 += offset;
+                for (o = 0; o < lpc_samples; o++) {
+                    lpc_input[o] = s16[o];
+                }
+            } else {
+                s8 = (signed char *)sample->data;
+                s8 += offset;
+                for (o = 0; o < lpc_samples; o++) {
+                    lpc_input[o] = s8[o];
+                }
+            }
+
+            vorbis_lpc_from_data(lpc_input, lpc, lpc_samples, lpc_order);
+
+            vorbis_lpc_predict(lpc, lpc_input + lpc_samples - lpc_order,
+                               lpc_order, lpc_output, lpc_extra);
+
+            if (sample->flags & IT_SAMPLE_16BIT) {
+                s16 = (signed short *)resize_sample_data(
+                    sigdata, sample,
+                    (sample->length + lpc_extra) * sizeof(short));
+                if (!s16)
+                    return -1;
+
+                sample->data = s16;
+
+                s16 += sample->length;
+                sample->length += lpc_extra;
+
+                for (o = 0; o < lpc_extra; o++) {
+                    s16[o] = lpc_output[o];
                 }
-            } else
-            /* Otherwise, pad with silence. */
-            {
-                void *data;
-                offset = sample->length;
-                lpc_samples = lpc_extra;
-
-                sample->length += lpc_samples;
-
-                n = 1;
-                if (sample->flags & IT_SAMPLE_STEREO)
-                    n *= 2;
-                if (sample->flags & IT_SAMPLE_16BIT)
-                    n *= 2;
-
-                offset *= n;
-                lpc_samples *= n;
-
-                data = realloc(sample->data, offset + lpc_samples);
-                if (!data)
+            } else {
+                s8 = (signed char *)resize_sample_data(
+                    sigdata, sample, sample->length + lpc_extra);
+                if (!s8)
                     return -1;
-                sample->data = data;
 
-                memset((char *)data + offset, 0, lpc_samples);
+                sample->data = s8;
+
+                s8 += sample->length;
+                sample->length += lpc_extra;
+
+                for (o = 0; o < lpc_extra; o++) {
+                    s8[o] = lpc_output[o];
+                }
             }
         }
+    } else
+    /* Otherwise, pad with silence. */
+    {
+        void *data;
+        offset = sample->length;
+        lpc_samples = lpc_extra;
+
+        n = 1;
+        if (sample->flags & IT_SAMPLE_STEREO)
+            n *= 2;
+        if (sample->flags & IT_SAMPLE_16BIT)
+            n *= 2;
+
+        offset *= n;
+        lpc_samples *= n;
+
+        data = resize_sample_data(sigdata, sample, offset + lpc_samples);
+        if (!data)
+            return -1;
+        sample->data = data;
+        sample->length += lpc_extra;
+
+        memset((char *)data + offset, 0, lpc_samples);
     }
 
     return 0;
 }
+
+typedef struct LPC_JOBS {
+    struct DUMB_IT_SIGDATA *sigdata;
+    signed char *ret;
+} LPC_JOBS;
+
+static void add_lpc_job(void *data, int n) {
+    LPC_JOBS *jobs = data;
+    jobs->ret[n] = (signed char)add_lpc(jobs->sigdata,
+                                        jobs->sigdata->sample + n);
+}
+
+/* Pads every sample, one at a time, or all at once through
+ * dumb_it_load_parallel_for if it is set.
+ */
+int dumb_it_add_lpc(struct DUMB_IT_SIGDATA *sigdata) {
+    LPC_JOBS jobs;
+    int n, ret = 0;
+
+    if (!dumb_it_load_parallel_for) {
+        for (n = 0; n < sigdata->n_samples; n++)
+            if (add_lpc(sigdata, sigdata->sample + n) < 0)
+                return -1;
+        return 0;
+    }
+
+    if (sigdata->n_samples <= 0)
+        return 0;
+
+    jobs.sigdata = sigdata;
+    jobs.ret = malloc(sigdata->n_samples);
+    if (!jobs.ret)
+        return -1;
+
+    (*dumb_it_load_parallel_for)(dumb_it_load_pool_data, sigdata->n_samples,
+                                 &add_lpc_job, &jobs);
+
+    for (n = 0; n < sigdata->n_samples; n++)
+        if (jobs.ret[n] < 0)
+            ret = -1;
+
+    free(jobs.ret);
+    return ret;
+}
@@ -0,0 +1,252 @@
+/*  _______         ____    __         ___    ___
+ * \    _  \       \    /  \  /       \   \  /   /       '   '  '
+ *  |  | \  \       |  |    ||         |   \/   |         .      .
+ *  |  |  |  |      |  |    ||         ||\  /|  |
+ *  |  |  |  |      |  |    ||         || \/ |  |         '  '  '
+ *  |  |  |  |      |  |    ||         ||    |  |         .      .
+ *  |  |_/  /        \  \__//          ||    |  |
+ * /_______/ynamic    \____/niversal  /__\  /____\usic   /|  .  . ibliotheque
+ *                                                      /  \
+ *                                                     / .  \
+ * mmapfile.c - Module for reading files mapped       / / \  \
+ *              into memory using a DUMBFILE.        | <  /   \_
+ *                                                   |  \/ /\   /
+ *                                                    \_  /  > /
+ *                                                      | \ / /
+ *                                                      |  ' /
+ *                                                       \__/
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(_WIN32)
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "dumb.h"
+#include "internal/dumb.h"
+#include "internal/dumbfile.h"
+
+#if defined(_MSC_VER)
+#define mapping_atomic_add(p, v)                                               \
+    (InterlockedExchangeAdd((volatile LONG *)(p), (v)) + (v))
+#elif defined(__GNUC__) || defined(__clang__)
+#define mapping_atomic_add(p, v) __sync_add_and_fetch((p), (v))
+#else
+#define mapping_atomic_add(p, v) (*(p) += (v))
+#endif
+
+typedef struct MMAPFILE MMAPFILE;
+
+struct MMAPFILE {
+    DUMBFILE_MAPPING *mapping;
+    size_t pos;
+};
+
+static DUMBFILE_MAPPING *map_file(const char *filename) {
+    DUMBFILE_MAPPING *mapping = malloc(sizeof(*mapping));
+#if defined(_WIN32)
+    HANDLE file, view;
+    LARGE_INTEGER size;
+#else
+    int fd;
+    struct stat st;
+#endif
+
+    if (!mapping)
+        return NULL;
+
+    mapping->data = NULL;
+    mapping->refs = 1;
+
+#if defined(_WIN32)
+    file = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, NULL,
+                       OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE)
+        goto error;
+
+    if (!GetFileSizeEx(file, &size) ||
+        (unsigned LONG_LONG)size.QuadPart > (size_t)-1) {
+        CloseHandle(file);
+        goto error;
+    }
+    mapping->size = (size_t)size.QuadPart;
+
+    /* Empty files cannot be mapped, and need not be. */
+    if (mapping->size) {
+        view = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+        if (view) {
+            mapping->data = MapViewOfFile(view, FILE_MAP_READ, 0, 0, 0);
+            CloseHandle(view);
+        }
+    }
+    CloseHandle(file);
+
+    if (mapping->size && !mapping->data)
+        goto error;
+#else
+    fd = open(filename, O_RDONLY);
+    if (fd < 0)
+        goto error;
+
+    if (fstat(fd, &st) < 0 || !S_ISREG(st.st_mode) ||
+        (unsigned LONG_LONG)st.st_size > (size_t)-1) {
+        close(fd);
+        goto error;
+    }
+    mapping->size = (size_t)st.st_size;
+
+    /* Empty files cannot be mapped, and need not be. */
+    if (mapping->size) {
+        void *data =
+            mmap(NULL, mapping->size, PROT_READ, MAP_SHARED, fd, 0);
+        if (data != MAP_FAILED)
+            mapping->data = data;
+    }
+    close(fd);
+
+    if (mapping->size && !mapping->data)
+        goto error;
+#endif
+
+    return mapping;
+
+error:
+    free(mapping);
+    return NULL;
+}
+
+static void *dumb_mmapfile_open(const char *filename) {
+    MMAPFILE *m = malloc(sizeof(*m));
+    if (!m)
+        return NULL;
+
+    m->mapping = map_file(filename);
+    if (!m->mapping) {
+        free(m);
+        return NULL;
+    }
+    m->pos = 0;
+
+    return m;
+}
+
+static int dumb_mmapfile_skip(void *f, dumb_off_t n) {
+    MMAPFILE *m = f;
+    if (n < 0 || (unsigned LONG_LONG)n > m->mapping->size - m->pos)
+        return -1;
+    m->pos += (size_t)n;
+    return 0;
+}
+
+static int dumb_mmapfile_getc(void *f) {
+    MMAPFILE *m = f;
+    if (m->pos >= m->mapping->size)
+        return -1;
+    return (unsigned char)m->mapping->data[m->pos++];
+}
+
+static dumb_ssize_t dumb_mmapfile_getnc(char *ptr, size_t n, void *f) {
+    MMAPFILE *m = f;
+    if (n > m->mapping->size - m->pos)
+        n = m->mapping->size - m->pos;
+    if (n) {
+        memcpy(ptr, m->mapping->data + m->pos, n);
+        m->pos += n;
+    }
+    return n;
+}
+
+static void dumb_mmapfile_close(void *f) {
+    MMAPFILE *m = f;
+    _dumbfile_unref_mapping(m->mapping);
+    free(m);
+}
+
+static int dumb_mmapfile_seek(void *f, dumb_off_t n) {
+    MMAPFILE *m = f;
+    if (n < 0 || (unsigned LONG_LONG)n > m->mapping->size)
+        return -1;
+    m->pos = (size_t)n;
+    return 0;
+}
+
+static dumb_off_t dumb_mmapfile_get_size(void *f) {
+    MMAPFILE *m = f;
+    return m->mapping->size;
+}
+
+static const DUMBFILE_SYSTEM mmapfile_dfs = {
+    &dumb_mmapfile_open,  &dumb_mmapfile_skip,  &dumb_mmapfile_getc,
+    &dumb_mmapfile_getnc, &dumb_mmapfile_close, &dumb_mmapfile_seek,
+    &dumb_mmapfile_get_size};
+
+void dumb_register_mmapfiles(void) { register_dumbfile_system(&mmapfile_dfs); }
+
+DUMBFILE *dumbfile_open_mmap(const char *filename) {
+    void *m = dumb_mmapfile_open(filename);
+    if (!m)
+        return NULL;
+
+    return dumbfile_open_ex(m, &mmapfile_dfs);
+}
+
+/* Returns the next n bytes of f, without moving past them, if f is a mapped
+ * file and they are all there. Returns NULL otherwise.
+ */
+const void *_dumbfile_peek_mapped(DUMBFILE *f, size_t n) {
+    DUMBFILE_MAPPING *mapping;
+
+    if (f->dfs != &mmapfile_dfs || f->pos < 0)
+        return NULL;
+
+    mapping = ((MMAPFILE *)f->file)->mapping;
+    if ((size_t)f->pos > mapping->size || n > mapping->size - f->pos)
+        return NULL;
+
+    return mapping->data + f->pos;
+}
+
+/* Returns a new reference to the mapping f reads from, or NULL if f is not a
+ * mapped file.
+ */
+DUMBFILE_MAPPING *_dumbfile_ref_mapping(DUMBFILE *f) {
+    DUMBFILE_MAPPING *mapping;
+
+    if (f->dfs != &mmapfile_dfs)
+        return NULL;
+
+    mapping = ((MMAPFILE *)f->file)->mapping;
+    mapping_atomic_add(&mapping->refs, 1);
+    return mapping;
+}
+
+void _dumbfile_unref_mapping(DUMBFILE_MAPPING *mapping) {
+    if (!mapping || mapping_atomic_add(&mapping->refs, -1) > 0)
+        return;
+
+    if (mapping->data) {
+#if defined(_WIN32)
+        UnmapViewOfFile(mapping->data);
+#else
+        munmap((void *)mapping->data, mapping->size);
+#endif
+    }
+    free(mapping);
+}
+
+int _dumbfile_mapping_contains(const DUMBFILE_MAPPING *mapping,
+                               const void *ptr) {
+    const char *p = ptr;
+    return mapping && p >= mapping->data &&
+           p < mapping->data + mapping->size;
+}
@@ -46,6 +46,19 @@
 #include "internal/resampler.h"
 #include "internal/dumb.h"
 
+#if defined(_MSC_VER)
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#define resampler_tables_cas(p, o, n)                                          \
+    InterlockedCompareExchange((volatile LONG *)(p), (n), (o))
+#elif defined(__GNUC__) || defined(__clang__)
+#define resampler_tables_cas(p, o, n) __sync_val_compare_and_swap((p), (o), (n))
+#else
+#define resampler_tables_cas(p, o, n) (*(p) == (o) ? (*(p) = (n), (o)) : *(p))
+#endif
+
 /* Compile with -DHEAVYDEBUG if you want to make sure the pick-up function is
  * called when it should be. There will be a considerable performance hit,
  * since at least one condition has to be tested for every sample generated.
@@ -83,6 +96,57 @@ int dumb_resampling_quality = DUMB_RQ_CUBIC;
 #define MULSC(a, b) ((int)((LONG_LONG)((a) << 4) * ((b) << 12) >> 32))
 #define MULSC16(a, b) ((int)((LONG_LONG)((a) << 12) * ((b) << 12) >> 32))
 
+/* Number of frames staged per resampler_write_block() or
+ * resampler_read_block() call. Matches the FIR resampler's ring size, so one
+ * write can always fill it.
+ */
+#define FIR_BLOCK_SIZE 64
+
+/* Block transfers between 'fir_block', which holds interleaved frames, and
+ * the FIR resampler.
+ */
+#define WRITE_FIR(n)                                                           \
+    n = resampler_write_block(resampler->fir_resampler, fir_block, n)
+#define COUNT_FIR(n) n = resampler_get_sample_count(resampler->fir_resampler)
+#define READ_FIR(n)                                                            \
+    n = resampler_read_block(resampler->fir_resampler, fir_block, n)
+
+/* Tops up the FIR resampler's input from the source, stepping through it in
+ * the given direction until either the resampler is full or 'avail' frames
+ * have been consumed. Expects 'x' and 'pos' in scope.
+ */
+#define FIR_WRITE_AHEAD(avail, step)                                           \
+    for (;;) {                                                                 \
+        int fir_n = resampler_get_free_count(resampler->fir_resampler);        \
+        int fir_i;                                                             \
+        if (fir_n > FIR_BLOCK_SIZE)                                            \
+            fir_n = FIR_BLOCK_SIZE;                                            \
+        if (fir_n > (avail))                                                   \
+            fir_n = (int)(avail);                                              \
+        if (fir_n <= 0)                                                        \
+            break;                                                             \
+        for (fir_i = 0; fir_i < fir_n; fir_i++)                                \
+            POKE_FIR(fir_i, (step)*fir_i);                                     \
+        WRITE_FIR(fir_n);                                                      \
+        pos += (step)*fir_n;                                                   \
+        x += (step)*fir_n * SRC_CHANNELS;                                      \
+    }
+
+/* As FIR_WRITE_AHEAD going forwards, but for float sources, which the FIR
+ * resampler can take straight from the sample data without staging.
+ */
+#define FIR_WRITE_DIRECT(avail)                                                \
+    for (;;) {                                                                 \
+        int fir_n = resampler_get_free_count(resampler->fir_resampler);        \
+        if (fir_n > (avail))                                                   \
+            fir_n = (int)(avail);                                              \
+        if (fir_n <= 0)                                                        \
+            break;                                                             \
+        fir_n = resampler_write_block(resampler->fir_resampler, x, fir_n);     \
+        pos += fir_n;                                                          \
+        x += fir_n * SRC_CHANNELS;                                             \
+    }
+
 /* Executes the content 'iterator' times.
  * Clobbers the 'iterator' variable.
  * The loop is unrolled by four.
@@ -121,14 +185,42 @@ int dumb_resampling_quality = DUMB_RQ_CUBIC;
 
 #define X PASTE(x.x, SRCBITS)
 
+/* The first thread to start a resampler builds the tables, and any others
+ * starting one meanwhile wait until they are ready.
+ */
+enum { TABLES_NONE, TABLES_BUILDING, TABLES_READY };
+static volatile long resampler_tables_state = TABLES_NONE;
+
+static void destroy_resampler_tables(void) {
+    resampler_exit();
+    resampler_tables_state = TABLES_NONE;
+}
+
 void _dumb_init_cubic(void) {
-    static int done = 0;
-    if (done)
+    long state = resampler_tables_cas(&resampler_tables_state, TABLES_NONE,
+                                      TABLES_BUILDING);
+
+    if (state == TABLES_NONE) {
+        resampler_init();
+        dumb_atexit(&destroy_resampler_tables);
+        resampler_tables_cas(&resampler_tables_state, TABLES_BUILDING,
+                             TABLES_READY);
         return;
+    }
+
+    while (state != TABLES_READY)
+        state = resampler_tables_cas(&resampler_tables_state, TABLES_READY,
+                                     TABLES_READY);
+}
 
-    resampler_init();
+int dumb_resampler_set_simd(int level) {
+    _dumb_init_cubic();
+    return resampler_set_simd(level);
+}
 
-    done = 1;
+int dumb_resampler_get_simd(void) {
+    _dumb_init_cubic();
+    return resampler_get_simd();
 }
 
 /* Create resamplers for 24-in-32-bit source samples. */
@@ -145,7 +237,11 @@ void _dumb_init_cubic(void) {
 
 #define SRCTYPE sample_t
 #define SRCBITS 24
+#ifdef DUMB_FLOAT_SAMPLES
+#define FIR(x) (x * (1.0f / 256.0f))
+#else
 #define FIR(x) (x >> 8)
+#endif
 #include "resample.inc"
 
 /* Undefine the simplified macros. */
@@ -178,6 +274,16 @@ void _dumb_init_cubic(void) {
 #define FIR(x) (x * (1.0f / 256.0f))
 #include "resample.inc"
 
+/* Create resamplers for float source samples, already scaled the way the FIR
+ * resampler wants them.
+ */
+#define SUFFIX _float
+#define SRCTYPE float
+#define SRCBITS f
+#define FIR(x) (x)
+#define FIR_DIRECT
+#include "resample.inc"
+
 #undef dumb_reset_resampler
 #undef dumb_start_resampler
 #undef process_pickup
@@ -194,6 +300,9 @@ void dumb_reset_resampler_n(int n, DUMB_RESAMPLER *resampler, void *src,
     else if (n == 16)
         dumb_reset_resampler_16(resampler, src, src_channels, pos, start, end,
                                 quality);
+    else if (n == 32)
+        dumb_reset_resampler_float(resampler, src, src_channels, pos, start,
+                                   end, quality);
     else
         dumb_reset_resampler(resampler, src, src_channels, pos, start, end,
                              quality);
@@ -208,6 +317,9 @@ DUMB_RESAMPLER *dumb_start_resampler_n(int n, void *src, int src_channels,
     else if (n == 16)
         return dumb_start_resampler_16(src, src_channels, pos, start, end,
                                        quality);
+    else if (n == 32)
+        return dumb_start_resampler_float(src, src_channels, pos, start, end,
+                                          quality);
     else
         return dumb_start_resampler(src, src_channels, pos, start, end,
                                     quality);
@@ -220,6 +332,9 @@ long dumb_resample_n_1_1(int n, DUMB_RESAMPLER *resampler, sample_t *dst,
         return dumb_resample_8_1_1(resampler, dst, dst_size, volume, delta);
     else if (n == 16)
         return dumb_resample_16_1_1(resampler, dst, dst_size, volume, delta);
+    else if (n == 32)
+        return dumb_resample_float_1_1(resampler, dst, dst_size, volume,
+                                       delta);
     else
         return dumb_resample_1_1(resampler, dst, dst_size, volume, delta);
 }
@@ -233,6 +348,9 @@ long dumb_resample_n_1_2(int n, DUMB_RESAMPLER *resampler, sample_t *dst,
     else if (n == 16)
         return dumb_resample_16_1_2(resampler, dst, dst_size, volume_left,
                                     volume_right, delta);
+    else if (n == 32)
+        return dumb_resample_float_1_2(resampler, dst, dst_size, volume_left,
+                                       volume_right, delta);
     else
         return dumb_resample_1_2(resampler, dst, dst_size, volume_left,
                                  volume_right, delta);
@@ -247,6 +365,9 @@ long dumb_resample_n_2_1(int n, DUMB_RESAMPLER *resampler, sample_t *dst,
     else if (n == 16)
         return dumb_resample_16_2_1(resampler, dst, dst_size, volume_left,
                                     volume_right, delta);
+    else if (n == 32)
+        return dumb_resample_float_2_1(resampler, dst, dst_size, volume_left,
+                                       volume_right, delta);
     else
         return dumb_resample_2_1(resampler, dst, dst_size, volume_left,
                                  volume_right, delta);
@@ -261,6 +382,9 @@ long dumb_resample_n_2_2(int n, DUMB_RESAMPLER *resampler, sample_t *dst,
     else if (n == 16)
         return dumb_resample_16_2_2(resampler, dst, dst_size, volume_left,
                                     volume_right, delta);
+    else if (n == 32)
+        return dumb_resample_float_2_2(resampler, dst, dst_size, volume_left,
+                                       volume_right, delta);
     else
         return dumb_resample_2_2(resampler, dst, dst_size, volume_left,
                                  volume_right, delta);
@@ -273,6 +397,8 @@ void dumb_resample_get_current_sample_n_1_1(int n, DUMB_RESAMPLER *resampler,
         dumb_resample_get_current_sample_8_1_1(resampler, volume, dst);
     else if (n == 16)
         dumb_resample_get_current_sample_16_1_1(resampler, volume, dst);
+    else if (n == 32)
+        dumb_resample_get_current_sample_float_1_1(resampler, volume, dst);
     else
         dumb_resample_get_current_sample_1_1(resampler, volume, dst);
 }
@@ -287,6 +413,9 @@ void dumb_resample_get_current_sample_n_1_2(int n, DUMB_RESAMPLER *resampler,
     else if (n == 16)
         dumb_resample_get_current_sample_16_1_2(resampler, volume_left,
                                                 volume_right, dst);
+    else if (n == 32)
+        dumb_resample_get_current_sample_float_1_2(resampler, volume_left,
+                                                   volume_right, dst);
     else
         dumb_resample_get_current_sample_1_2(resampler, volume_left,
                                              volume_right, dst);
@@ -302,6 +431,9 @@ void dumb_resample_get_current_sample_n_2_1(int n, DUMB_RESAMPLER *resampler,
     else if (n == 16)
         dumb_resample_get_current_sample_16_2_1(resampler, volume_left,
                                                 volume_right, dst);
+    else if (n == 32)
+        dumb_resample_get_current_sample_float_2_1(resampler, volume_left,
+                                                   volume_right, dst);
     else
         dumb_resample_get_current_sample_2_1(resampler, volume_left,
                                              volume_right, dst);
@@ -317,6 +449,9 @@ void dumb_resample_get_current_sample_n_2_2(int n, DUMB_RESAMPLER *resampler,
     else if (n == 16)
         dumb_resample_get_current_sample_16_2_2(resampler, volume_left,
                                                 volume_right, dst);
+    else if (n == 32)
+        dumb_resample_get_current_sample_float_2_2(resampler, volume_left,
+                                                   volume_right, dst);
     else
         dumb_resample_get_current_sample_2_2(resampler, volume_left,
                                              volume_right, dst);
@@ -327,6 +462,8 @@ void dumb_end_resampler_n(int n, DUMB_RESAMPLER *resampler) {
         dumb_end_resampler_8(resampler);
     else if (n == 16)
         dumb_end_resampler_16(resampler);
+    else if (n == 32)
+        dumb_end_resampler_float(resampler);
     else
         dumb_end_resampler(resampler);
 }
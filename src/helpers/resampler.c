@@ -6,6 +6,24 @@
                           defined(_M_X64) || defined(__amd64__))
 #include <xmmintrin.h>
 #define RESAMPLER_SSE
+/* The AVX2 and AVX-512 kernels are compiled per function, so the library
+ * itself still only requires SSE; they are picked at run time.
+ */
+#if (defined(_MSC_VER) && _MSC_VER >= 1900) ||                                 \
+    (defined(__GNUC__) && !defined(__clang__) &&                               \
+     (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9))) ||              \
+    (defined(__clang__) && (__clang_major__ > 3 ||                             \
+                            (__clang_major__ == 3 && __clang_minor__ >= 8)))
+#include <immintrin.h>
+#define RESAMPLER_AVX
+#ifdef _MSC_VER
+#define RESAMPLER_TARGET_AVX2
+#define RESAMPLER_TARGET_AVX512
+#else
+#define RESAMPLER_TARGET_AVX2 __attribute__((target("avx2,fma")))
+#define RESAMPLER_TARGET_AVX512 __attribute__((target("avx512f,avx2,fma")))
+#endif
+#endif
 #endif
 #ifdef __APPLE__
 #include <TargetConditionals.h>
@@ -23,8 +41,36 @@
 
 #ifdef _MSC_VER
 #define ALIGNED _declspec(align(16))
+#define NOINLINE _declspec(noinline)
 #else
 #define ALIGNED __attribute__((aligned(16)))
+#define NOINLINE __attribute__((noinline))
+#endif
+
+/* Just enough of a lock to share the sinc tables between threads, and of
+ * atomics to switch kernels under running resamplers.
+ */
+#if defined(_MSC_VER)
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#define resampler_try_lock(p)                                                  \
+    (InterlockedCompareExchange((volatile LONG *)(p), 1, 0) == 0)
+#define resampler_unlock(p) InterlockedExchange((volatile LONG *)(p), 0)
+#define resampler_load_ptr(p) (*(p))
+#define resampler_store_ptr(p, v)                                              \
+    InterlockedExchangePointer((PVOID volatile *)(p), (PVOID)(v))
+#elif defined(__GNUC__) || defined(__clang__)
+#define resampler_try_lock(p) __sync_bool_compare_and_swap((p), 0, 1)
+#define resampler_unlock(p) __sync_lock_release(p)
+#define resampler_load_ptr(p) __atomic_load_n((p), __ATOMIC_ACQUIRE)
+#define resampler_store_ptr(p, v) __atomic_store_n((p), (v), __ATOMIC_RELEASE)
+#else
+#define resampler_try_lock(p) (*(p) ? 0 : (*(p) = 1, 1))
+#define resampler_unlock(p) (*(p) = 0)
+#define resampler_load_ptr(p) (*(p))
+#define resampler_store_ptr(p, v) (*(p) = (v))
 #endif
 
 #ifndef M_PI
@@ -63,37 +109,75 @@ static float sinc(float x) {
 #ifdef RESAMPLER_SSE
 #ifdef _MSC_VER
 #include <intrin.h>
+#define resampler_cpuid(data, leaf) __cpuidex((data), (leaf), 0)
 #elif defined(__clang__) || defined(__GNUC__)
-static inline void __cpuid(int *data, int selector) {
+static inline void resampler_cpuid(int *data, int leaf) {
 #if defined(__PIC__) && defined(__i386__)
     __asm("xchgl %%ebx, %%esi; cpuid; xchgl %%ebx, %%esi"
           : "=a"(data[0]), "=S"(data[1]), "=c"(data[2]), "=d"(data[3])
-          : "0"(selector));
+          : "0"(leaf), "2"(0));
 #elif defined(__PIC__) && defined(__amd64__)
     __asm("xchg{q} {%%}rbx, %q1; cpuid; xchg{q} {%%}rbx, %q1"
           : "=a"(data[0]), "=&r"(data[1]), "=c"(data[2]), "=d"(data[3])
-          : "0"(selector));
+          : "0"(leaf), "2"(0));
 #else
     __asm("cpuid"
           : "=a"(data[0]), "=b"(data[1]), "=c"(data[2]), "=d"(data[3])
-          : "0"(selector));
+          : "0"(leaf), "2"(0));
 #endif
 }
 #else
-#define __cpuid(a, b) memset((a), 0, sizeof(int) * 4)
+#define resampler_cpuid(a, b) memset((a), 0, sizeof(int) * 4)
 #endif
 
-static int query_cpu_feature_sse() {
+#ifdef RESAMPLER_AVX
+/* Which register states the OS saves on context switch */
+static unsigned resampler_xgetbv(void) {
+#ifdef _MSC_VER
+    return (unsigned)_xgetbv(0);
+#else
+    unsigned eax, edx;
+    __asm(".byte 0x0f, 0x01, 0xd0" : "=a"(eax), "=d"(edx) : "c"(0));
+    return eax;
+#endif
+}
+#endif
+
+static int query_cpu_simd(void) {
     int buffer[4];
-    __cpuid(buffer, 1);
+    int max_leaf;
+    resampler_cpuid(buffer, 0);
+    max_leaf = buffer[0];
+    if (max_leaf < 1)
+        return RESAMPLER_SIMD_NONE;
+    resampler_cpuid(buffer, 1);
     if ((buffer[3] & (1 << 25)) == 0)
-        return 0;
-    return 1;
+        return RESAMPLER_SIMD_NONE;
+#ifdef RESAMPLER_AVX
+    {
+        /* FMA and OSXSAVE, then AVX2 in leaf 7 */
+        const int fma_osxsave = (1 << 12) | (1 << 27);
+        unsigned xcr0;
+        if ((buffer[2] & fma_osxsave) != fma_osxsave || max_leaf < 7)
+            return RESAMPLER_SIMD_SSE;
+        xcr0 = resampler_xgetbv();
+        if ((xcr0 & 0x06) != 0x06)
+            return RESAMPLER_SIMD_SSE;
+        resampler_cpuid(buffer, 7);
+        if ((buffer[1] & (1 << 5)) == 0)
+            return RESAMPLER_SIMD_SSE;
+        if ((buffer[1] & (1 << 16)) == 0 || (xcr0 & 0xe0) != 0xe0)
+            return RESAMPLER_SIMD_AVX2;
+        return RESAMPLER_SIMD_AVX512;
+    }
+#else
+    return RESAMPLER_SIMD_SSE;
+#endif
 }
-
-static int resampler_has_sse = 0;
 #endif
 
+static int resampler_simd_request = RESAMPLER_SIMD_AUTO;
+
 void resampler_init(void) {
     unsigned i;
     double dx = (float)(SINC_WIDTH) / SINC_SAMPLES, x = 0.0;
@@ -126,9 +210,7 @@ void resampler_init(void) {
             (float)(-1.5 * x * x * x + 2.0 * x * x + 0.5 * x);
         cubic_lut[i * 4 + 3] = (float)(0.5 * x * x * x - 0.5 * x * x);
     }
-#ifdef RESAMPLER_SSE
-    resampler_has_sse = query_cpu_feature_sse();
-#endif
+    resampler_set_simd(resampler_simd_request);
 }
 
 typedef struct resampler {
@@ -139,12 +221,16 @@ typedef struct resampler {
     float inv_phase;
     float inv_phase_inc;
     unsigned char quality;
+    unsigned char channels;
     signed char delay_added;
     signed char delay_removed;
-    float last_amp;
-    float accumulator;
-    float buffer_in[resampler_buffer_size * 2];
-    float buffer_out[resampler_buffer_size + SINC_WIDTH * 2 - 1];
+    float last_amp[2];
+    float accumulator[2];
+    /* Frames are interleaved when there are two channels; a mono resampler
+     * only uses the first half of each buffer.
+     */
+    float buffer_in[resampler_buffer_size * 2 * 2];
+    float buffer_out[(resampler_buffer_size + SINC_WIDTH * 2 - 1) * 2];
 } resampler;
 
 void *resampler_create(void) {
@@ -152,6 +238,14 @@ void *resampler_create(void) {
     if (!r)
         return 0;
 
+    resampler_reset(r);
+
+    return r;
+}
+
+void resampler_reset(void *_r) {
+    resampler *r = (resampler *)_r;
+
     r->write_pos = SINC_WIDTH - 1;
     r->write_filled = 0;
     r->read_pos = 0;
@@ -161,14 +255,13 @@ void *resampler_create(void) {
     r->inv_phase = 0;
     r->inv_phase_inc = 0;
     r->quality = RESAMPLER_QUALITY_MAX;
+    r->channels = 1;
     r->delay_added = -1;
     r->delay_removed = -1;
-    r->last_amp = 0;
-    r->accumulator = 0;
+    r->last_amp[0] = r->last_amp[1] = 0;
+    r->accumulator[0] = r->accumulator[1] = 0;
     memset(r->buffer_in, 0, sizeof(r->buffer_in));
     memset(r->buffer_out, 0, sizeof(r->buffer_out));
-
-    return r;
 }
 
 void resampler_delete(void *_r) { free(_r); }
@@ -196,10 +289,13 @@ void resampler_dup_inplace(void *_d, const void *_s) {
     r_out->inv_phase = r_in->inv_phase;
     r_out->inv_phase_inc = r_in->inv_phase_inc;
     r_out->quality = r_in->quality;
+    r_out->channels = r_in->channels;
     r_out->delay_added = r_in->delay_added;
     r_out->delay_removed = r_in->delay_removed;
-    r_out->last_amp = r_in->last_amp;
-    r_out->accumulator = r_in->accumulator;
+    r_out->last_amp[0] = r_in->last_amp[0];
+    r_out->last_amp[1] = r_in->last_amp[1];
+    r_out->accumulator[0] = r_in->accumulator[0];
+    r_out->accumulator[1] = r_in->accumulator[1];
     memcpy(r_out->buffer_in, r_in->buffer_in, sizeof(r_in->buffer_in));
     memcpy(r_out->buffer_out, r_in->buffer_out, sizeof(r_in->buffer_out));
 }
@@ -217,8 +313,8 @@ void resampler_set_quality(void *_r, int quality) {
             r->quality == RESAMPLER_QUALITY_BLAM) {
             r->read_pos = 0;
             r->read_filled = 0;
-            r->last_amp = 0;
-            r->accumulator = 0;
+            r->last_amp[0] = r->last_amp[1] = 0;
+            r->accumulator[0] = r->accumulator[1] = 0;
             memset(r->buffer_out, 0, sizeof(r->buffer_out));
         }
         r->delay_added = -1;
@@ -227,6 +323,27 @@ void resampler_set_quality(void *_r, int quality) {
     r->quality = (unsigned char)quality;
 }
 
+void resampler_set_channels(void *_r, int channels) {
+    resampler *r = (resampler *)_r;
+    if (channels < 1)
+        channels = 1;
+    else if (channels > 2)
+        channels = 2;
+    if (r->channels != channels) {
+        r->channels = (unsigned char)channels;
+        r->inv_phase = 0;
+        r->last_amp[0] = r->last_amp[1] = 0;
+        r->accumulator[0] = r->accumulator[1] = 0;
+        memset(r->buffer_out, 0, sizeof(r->buffer_out));
+        resampler_clear(r);
+    }
+}
+
+int resampler_get_channels(void *_r) {
+    resampler *r = (resampler *)_r;
+    return r->channels;
+}
+
 int resampler_get_free_count(void *_r) {
     resampler *r = (resampler *)_r;
     return resampler_buffer_size - r->write_filled;
@@ -297,14 +414,15 @@ void resampler_clear(void *_r) {
     r->phase = 0;
     r->delay_added = -1;
     r->delay_removed = -1;
-    memset(r->buffer_in, 0, (SINC_WIDTH - 1) * sizeof(r->buffer_in[0]));
-    memset(r->buffer_in + resampler_buffer_size, 0,
-           (SINC_WIDTH - 1) * sizeof(r->buffer_in[0]));
+    memset(r->buffer_in, 0,
+           (SINC_WIDTH - 1) * r->channels * sizeof(r->buffer_in[0]));
+    memset(r->buffer_in + resampler_buffer_size * r->channels, 0,
+           (SINC_WIDTH - 1) * r->channels * sizeof(r->buffer_in[0]));
     if (r->quality == RESAMPLER_QUALITY_BLEP ||
         r->quality == RESAMPLER_QUALITY_BLAM) {
         r->inv_phase = 0;
-        r->last_amp = 0;
-        r->accumulator = 0;
+        r->last_amp[0] = r->last_amp[1] = 0;
+        r->accumulator[0] = r->accumulator[1] = 0;
         memset(r->buffer_out, 0, sizeof(r->buffer_out));
     }
 }
@@ -376,6 +494,39 @@ void resampler_write_sample_float(void *_r, float s) {
     }
 }
 
+int resampler_write_block(void *_r, const float *s, int count) {
+    resampler *r = (resampler *)_r;
+    int channels = r->channels;
+    int written = 0;
+
+    if (r->delay_added < 0) {
+        r->delay_added = 0;
+        r->write_filled = resampler_input_delay(r);
+    }
+
+    if (count > resampler_buffer_size - r->write_filled)
+        count = resampler_buffer_size - r->write_filled;
+
+    while (written < count) {
+        int todo = resampler_buffer_size - r->write_pos;
+        if (todo > count - written)
+            todo = count - written;
+
+        memcpy(r->buffer_in + r->write_pos * channels, s + written * channels,
+               todo * channels * sizeof(r->buffer_in[0]));
+        memcpy(r->buffer_in + (r->write_pos + resampler_buffer_size) * channels,
+               s + written * channels,
+               todo * channels * sizeof(r->buffer_in[0]));
+
+        written += todo;
+        r->write_pos = (r->write_pos + todo) % resampler_buffer_size;
+    }
+
+    r->write_filled += count;
+
+    return count;
+}
+
 static int resampler_run_zoh(resampler *r, float **out_, float *out_end) {
     int in_size = r->write_filled;
     float const *in_ =
@@ -427,7 +578,7 @@ static int resampler_run_blep(resampler *r, float **out_, float *out_end) {
         float *out = *out_;
         float const *in = in_;
         float const *const in_end = in + in_size;
-        float last_amp = r->last_amp;
+        float last_amp = r->last_amp[0];
         float inv_phase = r->inv_phase;
         float inv_phase_inc = r->inv_phase_inc;
 
@@ -469,7 +620,7 @@ static int resampler_run_blep(resampler *r, float **out_, float *out_end) {
         } while (in < in_end);
 
         r->inv_phase = inv_phase;
-        r->last_amp = last_amp;
+        r->last_amp[0] = last_amp;
         *out_ = out;
 
         used = (int)(in - in_);
@@ -492,7 +643,7 @@ static int resampler_run_blep_sse(resampler *r, float **out_, float *out_end) {
         float *out = *out_;
         float const *in = in_;
         float const *const in_end = in + in_size;
-        float last_amp = r->last_amp;
+        float last_amp = r->last_amp[0];
         float inv_phase = r->inv_phase;
         float inv_phase_inc = r->inv_phase_inc;
 
@@ -544,7 +695,7 @@ static int resampler_run_blep_sse(resampler *r, float **out_, float *out_end) {
         } while (in < in_end);
 
         r->inv_phase = inv_phase;
-        r->last_amp = last_amp;
+        r->last_amp[0] = last_amp;
         *out_ = out;
 
         used = (int)(in - in_);
@@ -567,7 +718,7 @@ static int resampler_run_blep(resampler *r, float **out_, float *out_end) {
         float *out = *out_;
         float const *in = in_;
         float const *const in_end = in + in_size;
-        float last_amp = r->last_amp;
+        float last_amp = r->last_amp[0];
         float inv_phase = r->inv_phase;
         float inv_phase_inc = r->inv_phase_inc;
 
@@ -618,7 +769,7 @@ static int resampler_run_blep(resampler *r, float **out_, float *out_end) {
         } while (in < in_end);
 
         r->inv_phase = inv_phase;
-        r->last_amp = last_amp;
+        r->last_amp[0] = last_amp;
         *out_ = out;
 
         used = (int)(in - in_);
@@ -681,7 +832,7 @@ static int resampler_run_blam(resampler *r, float **out_, float *out_end) {
         float *out = *out_;
         float const *in = in_;
         float const *const in_end = in + in_size;
-        float last_amp = r->last_amp;
+        float last_amp = r->last_amp[0];
         float phase = r->phase;
         float phase_inc = r->phase_inc;
         float inv_phase = r->inv_phase;
@@ -735,7 +886,7 @@ static int resampler_run_blam(resampler *r, float **out_, float *out_end) {
 
         r->phase = phase;
         r->inv_phase = inv_phase;
-        r->last_amp = last_amp;
+        r->last_amp[0] = last_amp;
         *out_ = out;
 
         used = (int)(in - in_);
@@ -758,7 +909,7 @@ static int resampler_run_blam_sse(resampler *r, float **out_, float *out_end) {
         float *out = *out_;
         float const *in = in_;
         float const *const in_end = in + in_size;
-        float last_amp = r->last_amp;
+        float last_amp = r->last_amp[0];
         float phase = r->phase;
         float phase_inc = r->phase_inc;
         float inv_phase = r->inv_phase;
@@ -826,7 +977,7 @@ static int resampler_run_blam_sse(resampler *r, float **out_, float *out_end) {
 
         r->phase = phase;
         r->inv_phase = inv_phase;
-        r->last_amp = last_amp;
+        r->last_amp[0] = last_amp;
         *out_ = out;
 
         used = (int)(in - in_);
@@ -849,7 +1000,7 @@ static int resampler_run_blam(resampler *r, float **out_, float *out_end) {
         float *out = *out_;
         float const *in = in_;
         float const *const in_end = in + in_size;
-        float last_amp = r->last_amp;
+        float last_amp = r->last_amp[0];
         float phase = r->phase;
         float phase_inc = r->phase_inc;
         float inv_phase = r->inv_phase;
@@ -915,7 +1066,7 @@ static int resampler_run_blam(resampler *r, float **out_, float *out_end) {
 
         r->phase = phase;
         r->inv_phase = inv_phase;
-        r->last_amp = last_amp;
+        r->last_amp[0] = last_amp;
         *out_ = out;
 
         used = (int)(in - in_);
@@ -1076,6 +1227,161 @@ static int resampler_run_cubic(resampler *r, float **out_, float *out_end) {
 }
 #endif
 
+/* Polyphase sinc bank. Each table holds RESAMPLER_RESOLUTION normalised,
+ * windowed kernels for one cutoff step, SINC_BANK_TAPS floats apiece (128KB
+ * per table). Upsampling always uses the same step, while downsampling uses
+ * one per pitch, so only SINC_BANK_SLOTS tables are kept, and the least
+ * recently used table that no resampler holds is rebuilt for a new step. A
+ * resampler holds its table from resampler_sinc_bank_get() to
+ * resampler_sinc_bank_put() within one run. When every table is held or
+ * being built, kernels are built per output sample as before.
+ */
+enum { SINC_BANK_TAPS = SINC_WIDTH * 2 };
+enum { SINC_BANK_SLOTS = 8 };
+
+typedef struct sinc_bank_slot {
+    int in_use;
+    int step;
+    int users; /* resamplers holding the table, or the one building it */
+    unsigned long last_used;
+    char *block;
+    float *table; /* aligned within block, and NULL until built */
+} sinc_bank_slot;
+
+static sinc_bank_slot sinc_bank[SINC_BANK_SLOTS];
+static unsigned long sinc_bank_clock = 0;
+static volatile long sinc_bank_lock = 0;
+
+static void resampler_lock_sinc_bank(void) {
+    while (!resampler_try_lock(&sinc_bank_lock))
+        ;
+}
+
+/* Builds the unnormalised windowed sinc kernel for one phase and returns the
+ * sum of its taps.
+ */
+static float resampler_build_kernel(float *kernel, int phase_reduced,
+                                   int step) {
+    float kernel_sum = 0.0f;
+    int phase_adj = phase_reduced * step / RESAMPLER_RESOLUTION;
+    int i = SINC_WIDTH;
+
+    for (; i >= -SINC_WIDTH + 1; --i) {
+        int pos = i * step;
+        int window_pos = i * RESAMPLER_RESOLUTION;
+        kernel_sum += kernel[i + SINC_WIDTH - 1] =
+            sinc_lut[abs(phase_adj - pos)] *
+            window_lut[abs(phase_reduced - window_pos)];
+    }
+
+    return kernel_sum;
+}
+
+/* Never inlined, so that kernels built on the fly in the AVX2 runs, where FMA
+ * is allowed, come out exactly as the bank holds them. The runs fall back on
+ * it when the bank has no table for them, which must not change the output.
+ */
+static NOINLINE void resampler_sinc_kernel(float *kernel, int phase_reduced,
+                                           int step) {
+    float kernel_sum =
+        1.0f / resampler_build_kernel(kernel, phase_reduced, step);
+    int i;
+
+    for (i = 0; i < SINC_BANK_TAPS; ++i)
+        kernel[i] *= kernel_sum;
+}
+
+static const float *resampler_sinc_bank_get(int step) {
+    sinc_bank_slot *slot = NULL;
+    char *block;
+    float *table;
+    int i;
+
+    if (step < 0 || step >= RESAMPLER_RESOLUTION)
+        return NULL;
+
+    resampler_lock_sinc_bank();
+    for (i = 0; i < SINC_BANK_SLOTS; ++i) {
+        sinc_bank_slot *s = &sinc_bank[i];
+        if (s->in_use && s->step == step) {
+            table = s->table;
+            if (table) {
+                ++s->users;
+                s->last_used = ++sinc_bank_clock;
+            }
+            resampler_unlock(&sinc_bank_lock);
+            return table;
+        }
+        if (!s->in_use)
+            slot = s;
+        else if (!s->users &&
+                 (!slot || (slot->in_use && s->last_used < slot->last_used)))
+            slot = s;
+    }
+    if (!slot) {
+        resampler_unlock(&sinc_bank_lock);
+        return NULL;
+    }
+    slot->in_use = 1;
+    slot->step = step;
+    slot->users = 1;
+    slot->table = NULL;
+    block = slot->block;
+    resampler_unlock(&sinc_bank_lock);
+
+    /* Aligned for the vector loads. A slot keeps its block when it is
+     * reused for another step.
+     */
+    if (!block)
+        block = malloc(sizeof(float) * SINC_BANK_TAPS * RESAMPLER_RESOLUTION +
+                       63);
+    table = block ? (float *)(((size_t)block + 63) & ~(size_t)63) : NULL;
+    for (i = 0; table && i < RESAMPLER_RESOLUTION; ++i)
+        resampler_sinc_kernel(table + i * SINC_BANK_TAPS, i, step);
+
+    resampler_lock_sinc_bank();
+    slot->block = block;
+    slot->table = table;
+    slot->last_used = ++sinc_bank_clock;
+    if (!table) {
+        slot->in_use = 0;
+        slot->users = 0;
+    }
+    resampler_unlock(&sinc_bank_lock);
+
+    return table;
+}
+
+static void resampler_sinc_bank_put(const float *table) {
+    int i;
+
+    if (!table)
+        return;
+
+    resampler_lock_sinc_bank();
+    for (i = 0; i < SINC_BANK_SLOTS; ++i) {
+        if (sinc_bank[i].table == table) {
+            --sinc_bank[i].users;
+            break;
+        }
+    }
+    resampler_unlock(&sinc_bank_lock);
+}
+
+static int resampler_sinc_step(float phase_inc) {
+    return phase_inc > 1.0f
+               ? (int)(RESAMPLER_RESOLUTION / phase_inc * RESAMPLER_SINC_CUTOFF)
+               : (int)(RESAMPLER_RESOLUTION * RESAMPLER_SINC_CUTOFF);
+}
+
+void resampler_exit(void) {
+    int i;
+
+    for (i = 0; i < SINC_BANK_SLOTS; ++i)
+        free(sinc_bank[i].block);
+    memset(sinc_bank, 0, sizeof(sinc_bank));
+}
+
 #ifndef RESAMPLER_NEON
 static int resampler_run_sinc(resampler *r, float **out_, float *out_end) {
     int in_size = r->write_filled;
@@ -1090,38 +1396,34 @@ static int resampler_run_sinc(resampler *r, float **out_, float *out_end) {
         float phase = r->phase;
         float phase_inc = r->phase_inc;
 
-        int step = phase_inc > 1.0f
-                       ? (int)(RESAMPLER_RESOLUTION / phase_inc *
-                               RESAMPLER_SINC_CUTOFF)
-                       : (int)(RESAMPLER_RESOLUTION * RESAMPLER_SINC_CUTOFF);
-        int window_step = RESAMPLER_RESOLUTION;
+        int step = resampler_sinc_step(phase_inc);
+        const float *bank = resampler_sinc_bank_get(step);
 
         do {
-            float kernel[SINC_WIDTH * 2], kernel_sum = 0.0;
-            int i = SINC_WIDTH;
+            float kernel_temp[SINC_BANK_TAPS];
+            const float *kernel;
+            int i;
             int phase_reduced = (int)(phase * RESAMPLER_RESOLUTION);
-            int phase_adj = phase_reduced * step / RESAMPLER_RESOLUTION;
             float sample;
 
             if (out >= out_end)
                 break;
 
-            for (; i >= -SINC_WIDTH + 1; --i) {
-                int pos = i * step;
-                int window_pos = i * window_step;
-                kernel_sum += kernel[i + SINC_WIDTH - 1] =
-                    sinc_lut[abs(phase_adj - pos)] *
-                    window_lut[abs(phase_reduced - window_pos)];
+            if (bank)
+                kernel = bank + phase_reduced * SINC_BANK_TAPS;
+            else {
+                resampler_sinc_kernel(kernel_temp, phase_reduced, step);
+                kernel = kernel_temp;
             }
-            for (sample = 0, i = 0; i < SINC_WIDTH * 2; ++i)
+            for (sample = 0, i = 0; i < SINC_BANK_TAPS; ++i)
                 sample += in[i] * kernel[i];
-            *out++ = (float)(sample / kernel_sum);
+            *out++ = sample;
 
             phase += phase_inc;
 
             in += (int)phase;
 
-            phase = fmod(phase, 1.0f);
+            phase -= (int)phase;
         } while (in < in_end);
 
         r->phase = phase;
@@ -1130,6 +1432,8 @@ static int resampler_run_sinc(resampler *r, float **out_, float *out_end) {
         used = (int)(in - in_);
 
         r->write_filled -= used;
+
+        resampler_sinc_bank_put(bank);
     }
 
     return used;
@@ -1150,55 +1454,50 @@ static int resampler_run_sinc_sse(resampler *r, float **out_, float *out_end) {
         float phase = r->phase;
         float phase_inc = r->phase_inc;
 
-        int step = phase_inc > 1.0f
-                       ? (int)(RESAMPLER_RESOLUTION / phase_inc *
-                               RESAMPLER_SINC_CUTOFF)
-                       : (int)(RESAMPLER_RESOLUTION * RESAMPLER_SINC_CUTOFF);
-        int window_step = RESAMPLER_RESOLUTION;
+        int step = resampler_sinc_step(phase_inc);
+        const float *bank = resampler_sinc_bank_get(step);
 
         do {
-            // accumulate in extended precision
-            float kernel_sum = 0.0;
-            __m128 kernel[SINC_WIDTH / 2];
+            __m128 kernel_temp[SINC_BANK_TAPS / 4];
+            const __m128 *kernel;
             __m128 temp1, temp2;
-            __m128 samplex = _mm_setzero_ps();
-            float *kernelf = (float *)(&kernel);
-            int i = SINC_WIDTH;
+            __m128 sample1 = _mm_setzero_ps();
+            __m128 sample2 = _mm_setzero_ps();
+            int i;
             int phase_reduced = (int)(phase * RESAMPLER_RESOLUTION);
-            int phase_adj = phase_reduced * step / RESAMPLER_RESOLUTION;
 
             if (out >= out_end)
                 break;
 
-            for (; i >= -SINC_WIDTH + 1; --i) {
-                int pos = i * step;
-                int window_pos = i * window_step;
-                kernel_sum += kernelf[i + SINC_WIDTH - 1] =
-                    sinc_lut[abs(phase_adj - pos)] *
-                    window_lut[abs(phase_reduced - window_pos)];
+            if (bank)
+                kernel =
+                    (const __m128 *)(bank + phase_reduced * SINC_BANK_TAPS);
+            else {
+                resampler_sinc_kernel((float *)kernel_temp, phase_reduced,
+                                      step);
+                kernel = kernel_temp;
             }
-            for (i = 0; i < SINC_WIDTH / 2; ++i) {
-                temp1 = _mm_loadu_ps((const float *)(in + i * 4));
-                temp2 = _mm_load_ps((const float *)(kernel + i));
-                temp1 = _mm_mul_ps(temp1, temp2);
-                samplex = _mm_add_ps(samplex, temp1);
+            /* Two accumulators to keep the adds from serialising */
+            for (i = 0; i < SINC_BANK_TAPS / 4; i += 2) {
+                temp1 = _mm_loadu_ps(in + i * 4);
+                temp2 = _mm_loadu_ps(in + i * 4 + 4);
+                sample1 = _mm_add_ps(sample1, _mm_mul_ps(temp1, kernel[i]));
+                sample2 =
+                    _mm_add_ps(sample2, _mm_mul_ps(temp2, kernel[i + 1]));
             }
-            kernel_sum = 1.0 / kernel_sum;
-            temp1 = _mm_movehl_ps(temp1, samplex);
-            samplex = _mm_add_ps(samplex, temp1);
-            temp1 = samplex;
-            temp1 = _mm_shuffle_ps(temp1, samplex, _MM_SHUFFLE(0, 0, 0, 1));
-            samplex = _mm_add_ps(samplex, temp1);
-            temp1 = _mm_set_ss(kernel_sum);
-            samplex = _mm_mul_ps(samplex, temp1);
-            _mm_store_ss(out, samplex);
+            sample1 = _mm_add_ps(sample1, sample2);
+            temp1 = _mm_movehl_ps(sample2, sample1);
+            sample1 = _mm_add_ps(sample1, temp1);
+            temp1 = _mm_shuffle_ps(sample1, sample1, _MM_SHUFFLE(0, 0, 0, 1));
+            sample1 = _mm_add_ss(sample1, temp1);
+            _mm_store_ss(out, sample1);
             ++out;
 
             phase += phase_inc;
 
             in += (int)phase;
 
-            phase = fmod(phase, 1.0f);
+            phase -= (int)phase;
         } while (in < in_end);
 
         r->phase = phase;
@@ -1207,6 +1506,8 @@ static int resampler_run_sinc_sse(resampler *r, float **out_, float *out_end) {
         used = (int)(in - in_);
 
         r->write_filled -= used;
+
+        resampler_sinc_bank_put(bank);
     }
 
     return used;
@@ -1227,49 +1528,43 @@ static int resampler_run_sinc(resampler *r, float **out_, float *out_end) {
         float phase = r->phase;
         float phase_inc = r->phase_inc;
 
-        int step = phase_inc > 1.0f
-                       ? (int)(RESAMPLER_RESOLUTION / phase_inc *
-                               RESAMPLER_SINC_CUTOFF)
-                       : (int)(RESAMPLER_RESOLUTION * RESAMPLER_SINC_CUTOFF);
-        int window_step = RESAMPLER_RESOLUTION;
+        int step = resampler_sinc_step(phase_inc);
+        const float *bank = resampler_sinc_bank_get(step);
 
         do {
-            // accumulate in extended precision
-            float kernel_sum = 0.0;
-            float32x4_t kernel[SINC_WIDTH / 2];
-            float32x4_t temp1, temp2;
-            float32x4_t samplex = {0};
+            float32x4_t kernel_temp[SINC_BANK_TAPS / 4];
+            const float *kernel;
+            float32x4_t sample1 = vdupq_n_f32(0.0f);
+            float32x4_t sample2 = vdupq_n_f32(0.0f);
             float32x2_t half;
-            float *kernelf = (float *)(&kernel);
-            int i = SINC_WIDTH;
+            int i;
             int phase_reduced = (int)(phase * RESAMPLER_RESOLUTION);
-            int phase_adj = phase_reduced * step / RESAMPLER_RESOLUTION;
 
             if (out >= out_end)
                 break;
 
-            for (; i >= -SINC_WIDTH + 1; --i) {
-                int pos = i * step;
-                int window_pos = i * window_step;
-                kernel_sum += kernelf[i + SINC_WIDTH - 1] =
-                    sinc_lut[abs(phase_adj - pos)] *
-                    window_lut[abs(phase_reduced - window_pos)];
+            if (bank)
+                kernel = bank + phase_reduced * SINC_BANK_TAPS;
+            else {
+                resampler_sinc_kernel((float *)kernel_temp, phase_reduced,
+                                      step);
+                kernel = (const float *)kernel_temp;
             }
-            for (i = 0; i < SINC_WIDTH / 2; ++i) {
-                temp1 = vld1q_f32((const float32_t *)(in + i * 4));
-                temp2 = vld1q_f32((const float32_t *)(kernel + i));
-                samplex = vmlaq_f32(samplex, temp1, temp2);
+            for (i = 0; i < SINC_BANK_TAPS; i += 8) {
+                sample1 = vmlaq_f32(sample1, vld1q_f32(in + i),
+                                    vld1q_f32(kernel + i));
+                sample2 = vmlaq_f32(sample2, vld1q_f32(in + i + 4),
+                                    vld1q_f32(kernel + i + 4));
             }
-            kernel_sum = 1.0 / kernel_sum;
-            samplex = vmulq_f32(samplex, vmovq_n_f32(kernel_sum));
-            half = vadd_f32(vget_high_f32(samplex), vget_low_f32(samplex));
+            sample1 = vaddq_f32(sample1, sample2);
+            half = vadd_f32(vget_high_f32(sample1), vget_low_f32(sample1));
             *out++ = vget_lane_f32(vpadd_f32(half, half), 0);
 
             phase += phase_inc;
 
             in += (int)phase;
 
-            phase = fmod(phase, 1.0f);
+            phase -= (int)phase;
         } while (in < in_end);
 
         r->phase = phase;
@@ -1278,158 +1573,1479 @@ static int resampler_run_sinc(resampler *r, float **out_, float *out_end) {
         used = (int)(in - in_);
 
         r->write_filled -= used;
+
+        resampler_sinc_bank_put(bank);
     }
 
     return used;
 }
 #endif
 
-static void resampler_fill(resampler *r) {
-    int min_filled = resampler_min_filled(r);
-    int quality = r->quality;
-    while (r->write_filled > min_filled &&
-           r->read_filled < resampler_buffer_size) {
-        int write_pos = (r->read_pos + r->read_filled) % resampler_buffer_size;
-        int write_size = resampler_buffer_size - write_pos;
-        float *out = r->buffer_out + write_pos;
-        if (write_size > (resampler_buffer_size - r->read_filled))
-            write_size = resampler_buffer_size - r->read_filled;
-        switch (quality) {
-        case RESAMPLER_QUALITY_ZOH:
-            resampler_run_zoh(r, &out, out + write_size);
-            break;
+/* Two-channel kernels. Input and output frames are interleaved, and the
+ * phase and kernel for each output frame are worked out once and applied to
+ * both channels. NEON builds use the portable versions.
+ */
+static int resampler_run_zoh_stereo(resampler *r, float **out_,
+                                    float *out_end) {
+    int in_size = r->write_filled;
+    float const *in_ =
+        r->buffer_in +
+        (resampler_buffer_size + r->write_pos - r->write_filled) * 2;
+    int used = 0;
+    in_size -= 1;
+    if (in_size > 0) {
+        float *out = *out_;
+        float const *in = in_;
+        float const *const in_end = in + in_size * 2;
+        float phase = r->phase;
+        float phase_inc = r->phase_inc;
 
-        case RESAMPLER_QUALITY_BLEP: {
-            int used;
-            int write_extra = 0;
-            if (write_pos >= r->read_pos)
-                write_extra = r->read_pos;
-            if (write_extra > SINC_WIDTH * 2 - 1)
-                write_extra = SINC_WIDTH * 2 - 1;
-            memcpy(r->buffer_out + resampler_buffer_size, r->buffer_out,
-                   write_extra * sizeof(r->buffer_out[0]));
-#ifdef RESAMPLER_SSE
-            if (resampler_has_sse)
-                used = resampler_run_blep_sse(r, &out,
-                                              out + write_size + write_extra);
-            else
-#endif
-                used =
-                    resampler_run_blep(r, &out, out + write_size + write_extra);
-            memcpy(r->buffer_out, r->buffer_out + resampler_buffer_size,
-                   write_extra * sizeof(r->buffer_out[0]));
-            if (!used)
-                return;
-            break;
-        }
+        do {
+            if (out >= out_end)
+                break;
 
-        case RESAMPLER_QUALITY_LINEAR:
-            resampler_run_linear(r, &out, out + write_size);
-            break;
+            out[0] = in[0];
+            out[1] = in[1];
+            out += 2;
 
-        case RESAMPLER_QUALITY_BLAM: {
-            float *out_ = out;
-            int write_extra = 0;
-            if (write_pos >= r->read_pos)
-                write_extra = r->read_pos;
-            if (write_extra > SINC_WIDTH * 2 - 1)
-                write_extra = SINC_WIDTH * 2 - 1;
-            memcpy(r->buffer_out + resampler_buffer_size, r->buffer_out,
-                   write_extra * sizeof(r->buffer_out[0]));
-#ifdef RESAMPLER_SSE
-            if (resampler_has_sse)
-                resampler_run_blam_sse(r, &out, out + write_size + write_extra);
-            else
-#endif
-                resampler_run_blam(r, &out, out + write_size + write_extra);
-            memcpy(r->buffer_out, r->buffer_out + resampler_buffer_size,
-                   write_extra * sizeof(r->buffer_out[0]));
-            if (out == out_)
-                return;
-            break;
-        }
+            phase += phase_inc;
 
-        case RESAMPLER_QUALITY_CUBIC:
-#ifdef RESAMPLER_SSE
-            if (resampler_has_sse)
-                resampler_run_cubic_sse(r, &out, out + write_size);
-            else
-#endif
-                resampler_run_cubic(r, &out, out + write_size);
-            break;
+            in += (int)phase * 2;
 
-        case RESAMPLER_QUALITY_SINC:
-#ifdef RESAMPLER_SSE
-            if (resampler_has_sse)
-                resampler_run_sinc_sse(r, &out, out + write_size);
-            else
-#endif
-                resampler_run_sinc(r, &out, out + write_size);
-            break;
-        }
-        r->read_filled += out - r->buffer_out - write_pos;
-    }
-}
+            phase -= (int)phase;
+        } while (in < in_end);
 
-static void resampler_fill_and_remove_delay(resampler *r) {
-    resampler_fill(r);
-    if (r->delay_removed < 0) {
-        int delay = resampler_output_delay(r);
-        r->delay_removed = 0;
-        while (delay--)
-            resampler_remove_sample(r, 1);
+        r->phase = phase;
+        *out_ = out;
+
+        used = (int)(in - in_) / 2;
+
+        r->write_filled -= used;
     }
-}
 
-int resampler_get_sample_count(void *_r) {
-    resampler *r = (resampler *)_r;
-    if (r->read_filled < 1 && ((r->quality != RESAMPLER_QUALITY_BLEP &&
-                                r->quality != RESAMPLER_QUALITY_BLAM) ||
-                               r->inv_phase_inc))
-        resampler_fill_and_remove_delay(r);
-    return r->read_filled;
+    return used;
 }
 
-int resampler_get_sample(void *_r) {
-    resampler *r = (resampler *)_r;
-    if (r->read_filled < 1 && r->phase_inc)
-        resampler_fill_and_remove_delay(r);
-    if (r->read_filled < 1)
-        return 0;
-    if (r->quality == RESAMPLER_QUALITY_BLEP ||
-        r->quality == RESAMPLER_QUALITY_BLAM)
-        return (int)(r->buffer_out[r->read_pos] + r->accumulator);
-    else
-        return (int)r->buffer_out[r->read_pos];
-}
+static int resampler_run_blep_stereo(resampler *r, float **out_,
+                                     float *out_end) {
+    int in_size = r->write_filled;
+    float const *in_ =
+        r->buffer_in +
+        (resampler_buffer_size + r->write_pos - r->write_filled) * 2;
+    int used = 0;
+    in_size -= 1;
+    if (in_size > 0) {
+        float *out = *out_;
+        float const *in = in_;
+        float const *const in_end = in + in_size * 2;
+        float last_amp_l = r->last_amp[0];
+        float last_amp_r = r->last_amp[1];
+        float inv_phase = r->inv_phase;
+        float inv_phase_inc = r->inv_phase_inc;
 
-float resampler_get_sample_float(void *_r) {
-    resampler *r = (resampler *)_r;
-    if (r->read_filled < 1 && r->phase_inc)
-        resampler_fill_and_remove_delay(r);
-    if (r->read_filled < 1)
-        return 0;
-    if (r->quality == RESAMPLER_QUALITY_BLEP ||
-        r->quality == RESAMPLER_QUALITY_BLAM)
-        return r->buffer_out[r->read_pos] + r->accumulator;
-    else
-        return r->buffer_out[r->read_pos];
-}
+        const int step = RESAMPLER_BLEP_CUTOFF * RESAMPLER_RESOLUTION;
 
-void resampler_remove_sample(void *_r, int decay) {
-    resampler *r = (resampler *)_r;
-    if (r->read_filled > 0) {
-        if (r->quality == RESAMPLER_QUALITY_BLEP ||
-            r->quality == RESAMPLER_QUALITY_BLAM) {
-            r->accumulator += r->buffer_out[r->read_pos];
-            r->buffer_out[r->read_pos] = 0;
-            if (decay) {
-                r->accumulator -= r->accumulator * (1.0f / 8192.0f);
-                if (fabs(r->accumulator) < 1e-20f)
-                    r->accumulator = 0;
+        do {
+            float sample_l, sample_r;
+
+            if (out + SINC_WIDTH * 2 * 2 > out_end)
+                break;
+
+            sample_l = in[0] - last_amp_l;
+            sample_r = in[1] - last_amp_r;
+            in += 2;
+
+            if (sample_l || sample_r) {
+                float kernel[SINC_WIDTH * 2], kernel_sum;
+                int phase_reduced = (int)(inv_phase * RESAMPLER_RESOLUTION);
+                int i;
+
+                kernel_sum =
+                    resampler_build_kernel(kernel, phase_reduced, step);
+                last_amp_l += sample_l;
+                last_amp_r += sample_r;
+                sample_l /= kernel_sum;
+                sample_r /= kernel_sum;
+                for (i = 0; i < SINC_WIDTH * 2; ++i) {
+                    out[i * 2] += sample_l * kernel[i];
+                    out[i * 2 + 1] += sample_r * kernel[i];
+                }
             }
-        }
-        --r->read_filled;
-        r->read_pos = (r->read_pos + 1) % resampler_buffer_size;
+
+            inv_phase += inv_phase_inc;
+
+            out += (int)inv_phase * 2;
+
+            inv_phase -= (int)inv_phase;
+        } while (in < in_end);
+
+        r->inv_phase = inv_phase;
+        r->last_amp[0] = last_amp_l;
+        r->last_amp[1] = last_amp_r;
+        *out_ = out;
+
+        used = (int)(in - in_) / 2;
+
+        r->write_filled -= used;
     }
+
+    return used;
+}
+
+static int resampler_run_linear_stereo(resampler *r, float **out_,
+                                       float *out_end) {
+    int in_size = r->write_filled;
+    float const *in_ =
+        r->buffer_in +
+        (resampler_buffer_size + r->write_pos - r->write_filled) * 2;
+    int used = 0;
+    in_size -= 2;
+    if (in_size > 0) {
+        float *out = *out_;
+        float const *in = in_;
+        float const *const in_end = in + in_size * 2;
+        float phase = r->phase;
+        float phase_inc = r->phase_inc;
+
+        do {
+            if (out >= out_end)
+                break;
+
+            out[0] = in[0] + (in[2] - in[0]) * phase;
+            out[1] = in[1] + (in[3] - in[1]) * phase;
+            out += 2;
+
+            phase += phase_inc;
+
+            in += (int)phase * 2;
+
+            phase -= (int)phase;
+        } while (in < in_end);
+
+        r->phase = phase;
+        *out_ = out;
+
+        used = (int)(in - in_) / 2;
+
+        r->write_filled -= used;
+    }
+
+    return used;
+}
+
+static int resampler_run_blam_stereo(resampler *r, float **out_,
+                                     float *out_end) {
+    int in_size = r->write_filled;
+    float const *in_ =
+        r->buffer_in +
+        (resampler_buffer_size + r->write_pos - r->write_filled) * 2;
+    int used = 0;
+    in_size -= 2;
+    if (in_size > 0) {
+        float *out = *out_;
+        float const *in = in_;
+        float const *const in_end = in + in_size * 2;
+        float last_amp_l = r->last_amp[0];
+        float last_amp_r = r->last_amp[1];
+        float phase = r->phase;
+        float phase_inc = r->phase_inc;
+        float inv_phase = r->inv_phase;
+        float inv_phase_inc = r->inv_phase_inc;
+
+        const int step = RESAMPLER_BLAM_CUTOFF * RESAMPLER_RESOLUTION;
+
+        do {
+            float sample_l, sample_r;
+
+            if (out + SINC_WIDTH * 2 * 2 > out_end)
+                break;
+
+            sample_l = in[0];
+            sample_r = in[1];
+            if (phase_inc < 1.0f) {
+                sample_l += (in[2] - in[0]) * phase;
+                sample_r += (in[3] - in[1]) * phase;
+            }
+            sample_l -= last_amp_l;
+            sample_r -= last_amp_r;
+
+            if (sample_l || sample_r) {
+                float kernel[SINC_WIDTH * 2], kernel_sum;
+                int phase_reduced = (int)(inv_phase * RESAMPLER_RESOLUTION);
+                int i;
+
+                kernel_sum =
+                    resampler_build_kernel(kernel, phase_reduced, step);
+                last_amp_l += sample_l;
+                last_amp_r += sample_r;
+                sample_l /= kernel_sum;
+                sample_r /= kernel_sum;
+                for (i = 0; i < SINC_WIDTH * 2; ++i) {
+                    out[i * 2] += sample_l * kernel[i];
+                    out[i * 2 + 1] += sample_r * kernel[i];
+                }
+            }
+
+            if (inv_phase_inc < 1.0f) {
+                in += 2;
+                inv_phase += inv_phase_inc;
+                out += (int)inv_phase * 2;
+                inv_phase -= (int)inv_phase;
+            } else {
+                phase += phase_inc;
+                out += 2;
+
+                if (phase >= 1.0f) {
+                    in += 2;
+                    phase -= (int)phase;
+                }
+            }
+        } while (in < in_end);
+
+        r->phase = phase;
+        r->inv_phase = inv_phase;
+        r->last_amp[0] = last_amp_l;
+        r->last_amp[1] = last_amp_r;
+        *out_ = out;
+
+        used = (int)(in - in_) / 2;
+
+        r->write_filled -= used;
+    }
+
+    return used;
+}
+
+static int resampler_run_cubic_stereo(resampler *r, float **out_,
+                                      float *out_end) {
+    int in_size = r->write_filled;
+    float const *in_ =
+        r->buffer_in +
+        (resampler_buffer_size + r->write_pos - r->write_filled) * 2;
+    int used = 0;
+    in_size -= 4;
+    if (in_size > 0) {
+        float *out = *out_;
+        float const *in = in_;
+        float const *const in_end = in + in_size * 2;
+        float phase = r->phase;
+        float phase_inc = r->phase_inc;
+
+        do {
+            float *kernel;
+            int i;
+            float sample_l, sample_r;
+
+            if (out >= out_end)
+                break;
+
+            kernel = cubic_lut + (int)(phase * RESAMPLER_RESOLUTION) * 4;
+
+            for (sample_l = 0, sample_r = 0, i = 0; i < 4; ++i) {
+                sample_l += in[i * 2] * kernel[i];
+                sample_r += in[i * 2 + 1] * kernel[i];
+            }
+            out[0] = sample_l;
+            out[1] = sample_r;
+            out += 2;
+
+            phase += phase_inc;
+
+            in += (int)phase * 2;
+
+            phase -= (int)phase;
+        } while (in < in_end);
+
+        r->phase = phase;
+        *out_ = out;
+
+        used = (int)(in - in_) / 2;
+
+        r->write_filled -= used;
+    }
+
+    return used;
+}
+
+static int resampler_run_sinc_stereo(resampler *r, float **out_,
+                                     float *out_end) {
+    int in_size = r->write_filled;
+    float const *in_ =
+        r->buffer_in +
+        (resampler_buffer_size + r->write_pos - r->write_filled) * 2;
+    int used = 0;
+    in_size -= SINC_WIDTH * 2;
+    if (in_size > 0) {
+        float *out = *out_;
+        float const *in = in_;
+        float const *const in_end = in + in_size * 2;
+        float phase = r->phase;
+        float phase_inc = r->phase_inc;
+
+        int step = resampler_sinc_step(phase_inc);
+        const float *bank = resampler_sinc_bank_get(step);
+
+        do {
+            float kernel_temp[SINC_BANK_TAPS];
+            const float *kernel;
+            int i;
+            int phase_reduced = (int)(phase * RESAMPLER_RESOLUTION);
+            float sample_l, sample_r;
+
+            if (out >= out_end)
+                break;
+
+            if (bank)
+                kernel = bank + phase_reduced * SINC_BANK_TAPS;
+            else {
+                resampler_sinc_kernel(kernel_temp, phase_reduced, step);
+                kernel = kernel_temp;
+            }
+            for (sample_l = 0, sample_r = 0, i = 0; i < SINC_BANK_TAPS; ++i) {
+                sample_l += in[i * 2] * kernel[i];
+                sample_r += in[i * 2 + 1] * kernel[i];
+            }
+            out[0] = sample_l;
+            out[1] = sample_r;
+            out += 2;
+
+            phase += phase_inc;
+
+            in += (int)phase * 2;
+
+            phase -= (int)phase;
+        } while (in < in_end);
+
+        r->phase = phase;
+        *out_ = out;
+
+        used = (int)(in - in_) / 2;
+
+        r->write_filled -= used;
+
+        resampler_sinc_bank_put(bank);
+    }
+
+    return used;
+}
+
+#ifdef RESAMPLER_SSE
+static int resampler_run_blep_stereo_sse(resampler *r, float **out_,
+                                         float *out_end) {
+    int in_size = r->write_filled;
+    float const *in_ =
+        r->buffer_in +
+        (resampler_buffer_size + r->write_pos - r->write_filled) * 2;
+    int used = 0;
+    in_size -= 1;
+    if (in_size > 0) {
+        float *out = *out_;
+        float const *in = in_;
+        float const *const in_end = in + in_size * 2;
+        float last_amp_l = r->last_amp[0];
+        float last_amp_r = r->last_amp[1];
+        float inv_phase = r->inv_phase;
+        float inv_phase_inc = r->inv_phase_inc;
+
+        const int step = RESAMPLER_BLEP_CUTOFF * RESAMPLER_RESOLUTION;
+
+        do {
+            float sample_l, sample_r;
+
+            if (out + SINC_WIDTH * 2 * 2 > out_end)
+                break;
+
+            sample_l = in[0] - last_amp_l;
+            sample_r = in[1] - last_amp_r;
+            in += 2;
+
+            if (sample_l || sample_r) {
+                __m128 kernel[SINC_WIDTH / 2];
+                __m128 samplex, temp1;
+                float kernel_sum;
+                int phase_reduced = (int)(inv_phase * RESAMPLER_RESOLUTION);
+                int i;
+
+                kernel_sum = resampler_build_kernel((float *)kernel,
+                                                   phase_reduced, step);
+                last_amp_l += sample_l;
+                last_amp_r += sample_r;
+                sample_l /= kernel_sum;
+                sample_r /= kernel_sum;
+                samplex = _mm_setr_ps(sample_l, sample_r, sample_l, sample_r);
+                for (i = 0; i < SINC_WIDTH / 2; ++i) {
+                    temp1 = _mm_unpacklo_ps(kernel[i], kernel[i]);
+                    _mm_storeu_ps(out + i * 8,
+                                  _mm_add_ps(_mm_loadu_ps(out + i * 8),
+                                             _mm_mul_ps(temp1, samplex)));
+                    temp1 = _mm_unpackhi_ps(kernel[i], kernel[i]);
+                    _mm_storeu_ps(out + i * 8 + 4,
+                                  _mm_add_ps(_mm_loadu_ps(out + i * 8 + 4),
+                                             _mm_mul_ps(temp1, samplex)));
+                }
+            }
+
+            inv_phase += inv_phase_inc;
+
+            out += (int)inv_phase * 2;
+
+            inv_phase -= (int)inv_phase;
+        } while (in < in_end);
+
+        r->inv_phase = inv_phase;
+        r->last_amp[0] = last_amp_l;
+        r->last_amp[1] = last_amp_r;
+        *out_ = out;
+
+        used = (int)(in - in_) / 2;
+
+        r->write_filled -= used;
+    }
+
+    return used;
+}
+
+static int resampler_run_blam_stereo_sse(resampler *r, float **out_,
+                                         float *out_end) {
+    int in_size = r->write_filled;
+    float const *in_ =
+        r->buffer_in +
+        (resampler_buffer_size + r->write_pos - r->write_filled) * 2;
+    int used = 0;
+    in_size -= 2;
+    if (in_size > 0) {
+        float *out = *out_;
+        float const *in = in_;
+        float const *const in_end = in + in_size * 2;
+        float last_amp_l = r->last_amp[0];
+        float last_amp_r = r->last_amp[1];
+        float phase = r->phase;
+        float phase_inc = r->phase_inc;
+        float inv_phase = r->inv_phase;
+        float inv_phase_inc = r->inv_phase_inc;
+
+        const int step = RESAMPLER_BLAM_CUTOFF * RESAMPLER_RESOLUTION;
+
+        do {
+            float sample_l, sample_r;
+
+            if (out + SINC_WIDTH * 2 * 2 > out_end)
+                break;
+
+            sample_l = in[0];
+            sample_r = in[1];
+            if (phase_inc < 1.0f) {
+                sample_l += (in[2] - in[0]) * phase;
+                sample_r += (in[3] - in[1]) * phase;
+            }
+            sample_l -= last_amp_l;
+            sample_r -= last_amp_r;
+
+            if (sample_l || sample_r) {
+                __m128 kernel[SINC_WIDTH / 2];
+                __m128 samplex, temp1;
+                float kernel_sum;
+                int phase_reduced = (int)(inv_phase * RESAMPLER_RESOLUTION);
+                int i;
+
+                kernel_sum = resampler_build_kernel((float *)kernel,
+                                                   phase_reduced, step);
+                last_amp_l += sample_l;
+                last_amp_r += sample_r;
+                sample_l /= kernel_sum;
+                sample_r /= kernel_sum;
+                samplex = _mm_setr_ps(sample_l, sample_r, sample_l, sample_r);
+                for (i = 0; i < SINC_WIDTH / 2; ++i) {
+                    temp1 = _mm_unpacklo_ps(kernel[i], kernel[i]);
+                    _mm_storeu_ps(out + i * 8,
+                                  _mm_add_ps(_mm_loadu_ps(out + i * 8),
+                                             _mm_mul_ps(temp1, samplex)));
+                    temp1 = _mm_unpackhi_ps(kernel[i], kernel[i]);
+                    _mm_storeu_ps(out + i * 8 + 4,
+                                  _mm_add_ps(_mm_loadu_ps(out + i * 8 + 4),
+                                             _mm_mul_ps(temp1, samplex)));
+                }
+            }
+
+            if (inv_phase_inc < 1.0f) {
+                in += 2;
+                inv_phase += inv_phase_inc;
+                out += (int)inv_phase * 2;
+                inv_phase -= (int)inv_phase;
+            } else {
+                phase += phase_inc;
+                out += 2;
+
+                if (phase >= 1.0f) {
+                    in += 2;
+                    phase -= (int)phase;
+                }
+            }
+        } while (in < in_end);
+
+        r->phase = phase;
+        r->inv_phase = inv_phase;
+        r->last_amp[0] = last_amp_l;
+        r->last_amp[1] = last_amp_r;
+        *out_ = out;
+
+        used = (int)(in - in_) / 2;
+
+        r->write_filled -= used;
+    }
+
+    return used;
+}
+
+static int resampler_run_cubic_stereo_sse(resampler *r, float **out_,
+                                          float *out_end) {
+    int in_size = r->write_filled;
+    float const *in_ =
+        r->buffer_in +
+        (resampler_buffer_size + r->write_pos - r->write_filled) * 2;
+    int used = 0;
+    in_size -= 4;
+    if (in_size > 0) {
+        float *out = *out_;
+        float const *in = in_;
+        float const *const in_end = in + in_size * 2;
+        float phase = r->phase;
+        float phase_inc = r->phase_inc;
+
+        do {
+            __m128 kernel, samplex;
+
+            if (out >= out_end)
+                break;
+
+            kernel = _mm_load_ps(cubic_lut +
+                                 (int)(phase * RESAMPLER_RESOLUTION) * 4);
+            samplex = _mm_add_ps(
+                _mm_mul_ps(_mm_loadu_ps(in), _mm_unpacklo_ps(kernel, kernel)),
+                _mm_mul_ps(_mm_loadu_ps(in + 4),
+                           _mm_unpackhi_ps(kernel, kernel)));
+            samplex = _mm_add_ps(samplex, _mm_movehl_ps(samplex, samplex));
+            _mm_storel_pi((__m64 *)out, samplex);
+            out += 2;
+
+            phase += phase_inc;
+
+            in += (int)phase * 2;
+
+            phase -= (int)phase;
+        } while (in < in_end);
+
+        r->phase = phase;
+        *out_ = out;
+
+        used = (int)(in - in_) / 2;
+
+        r->write_filled -= used;
+    }
+
+    return used;
+}
+
+static int resampler_run_sinc_stereo_sse(resampler *r, float **out_,
+                                         float *out_end) {
+    int in_size = r->write_filled;
+    float const *in_ =
+        r->buffer_in +
+        (resampler_buffer_size + r->write_pos - r->write_filled) * 2;
+    int used = 0;
+    in_size -= SINC_WIDTH * 2;
+    if (in_size > 0) {
+        float *out = *out_;
+        float const *in = in_;
+        float const *const in_end = in + in_size * 2;
+        float phase = r->phase;
+        float phase_inc = r->phase_inc;
+
+        int step = resampler_sinc_step(phase_inc);
+        const float *bank = resampler_sinc_bank_get(step);
+
+        do {
+            __m128 kernel_temp[SINC_BANK_TAPS / 4];
+            const __m128 *kernel;
+            __m128 sample1 = _mm_setzero_ps();
+            __m128 sample2 = _mm_setzero_ps();
+            int i;
+            int phase_reduced = (int)(phase * RESAMPLER_RESOLUTION);
+
+            if (out >= out_end)
+                break;
+
+            if (bank)
+                kernel =
+                    (const __m128 *)(bank + phase_reduced * SINC_BANK_TAPS);
+            else {
+                resampler_sinc_kernel((float *)kernel_temp, phase_reduced,
+                                      step);
+                kernel = kernel_temp;
+            }
+            /* Each tap is spread across both channels of a frame */
+            for (i = 0; i < SINC_BANK_TAPS / 4; ++i) {
+                sample1 = _mm_add_ps(
+                    sample1, _mm_mul_ps(_mm_loadu_ps(in + i * 8),
+                                        _mm_unpacklo_ps(kernel[i], kernel[i])));
+                sample2 = _mm_add_ps(
+                    sample2, _mm_mul_ps(_mm_loadu_ps(in + i * 8 + 4),
+                                        _mm_unpackhi_ps(kernel[i], kernel[i])));
+            }
+            sample1 = _mm_add_ps(sample1, sample2);
+            sample1 = _mm_add_ps(sample1, _mm_movehl_ps(sample1, sample1));
+            _mm_storel_pi((__m64 *)out, sample1);
+            out += 2;
+
+            phase += phase_inc;
+
+            in += (int)phase * 2;
+
+            phase -= (int)phase;
+        } while (in < in_end);
+
+        r->phase = phase;
+        *out_ = out;
+
+        used = (int)(in - in_) / 2;
+
+        r->write_filled -= used;
+
+        resampler_sinc_bank_put(bank);
+    }
+
+    return used;
+}
+#endif
+
+#ifdef RESAMPLER_AVX
+RESAMPLER_TARGET_AVX2
+static float resampler_hsum_avx(__m256 v) {
+    __m128 x =
+        _mm_add_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+    x = _mm_add_ps(x, _mm_movehl_ps(x, x));
+    x = _mm_add_ss(x, _mm_shuffle_ps(x, x, _MM_SHUFFLE(0, 0, 0, 1)));
+    return _mm_cvtss_f32(x);
+}
+
+/* Same kernel as resampler_sinc_kernel(), eight taps per gather, but left
+ * unnormalised; returns the sum of the taps.
+ */
+RESAMPLER_TARGET_AVX2
+static float resampler_kernel_avx2(__m256 *kernel, int phase_reduced,
+                                   int step) {
+    const __m256i first =
+        _mm256_setr_epi32(-15, -14, -13, -12, -11, -10, -9, -8);
+    const __m256i step8 = _mm256_set1_epi32(step);
+    const __m256i phase_adj =
+        _mm256_set1_epi32(phase_reduced * step / RESAMPLER_RESOLUTION);
+    const __m256i phase = _mm256_set1_epi32(phase_reduced);
+    __m256 kernel_sum = _mm256_setzero_ps();
+    int i;
+
+    for (i = 0; i < SINC_BANK_TAPS / 8; ++i) {
+        __m256i tap = _mm256_add_epi32(first, _mm256_set1_epi32(i * 8));
+        __m256i pos = _mm256_abs_epi32(
+            _mm256_sub_epi32(phase_adj, _mm256_mullo_epi32(tap, step8)));
+        __m256i window_pos = _mm256_abs_epi32(
+            _mm256_sub_epi32(phase, _mm256_slli_epi32(tap, RESAMPLER_SHIFT)));
+        kernel[i] =
+            _mm256_mul_ps(_mm256_i32gather_ps(sinc_lut, pos, 4),
+                          _mm256_i32gather_ps(window_lut, window_pos, 4));
+        kernel_sum = _mm256_add_ps(kernel_sum, kernel[i]);
+    }
+
+    return resampler_hsum_avx(kernel_sum);
+}
+
+RESAMPLER_TARGET_AVX2
+static int resampler_run_blep_avx2(resampler *r, float **out_,
+                                   float *out_end) {
+    int in_size = r->write_filled;
+    float const *in_ =
+        r->buffer_in + resampler_buffer_size + r->write_pos - r->write_filled;
+    int used = 0;
+    in_size -= 1;
+    if (in_size > 0) {
+        float *out = *out_;
+        float const *in = in_;
+        float const *const in_end = in + in_size;
+        float last_amp = r->last_amp[0];
+        float inv_phase = r->inv_phase;
+        float inv_phase_inc = r->inv_phase_inc;
+
+        const int step = RESAMPLER_BLEP_CUTOFF * RESAMPLER_RESOLUTION;
+
+        do {
+            float sample;
+
+            if (out + SINC_WIDTH * 2 > out_end)
+                break;
+
+            sample = *in++ - last_amp;
+
+            if (sample) {
+                __m256 kernel[SINC_BANK_TAPS / 8];
+                __m256 samplex;
+                int phase_reduced = (int)(inv_phase * RESAMPLER_RESOLUTION);
+                float kernel_sum =
+                    resampler_kernel_avx2(kernel, phase_reduced, step);
+                int i;
+
+                last_amp += sample;
+                sample /= kernel_sum;
+                samplex = _mm256_set1_ps(sample);
+                for (i = 0; i < SINC_BANK_TAPS / 8; ++i)
+                    _mm256_storeu_ps(
+                        out + i * 8,
+                        _mm256_fmadd_ps(kernel[i], samplex,
+                                        _mm256_loadu_ps(out + i * 8)));
+            }
+
+            inv_phase += inv_phase_inc;
+
+            out += (int)inv_phase;
+
+            inv_phase -= (int)inv_phase;
+        } while (in < in_end);
+
+        r->inv_phase = inv_phase;
+        r->last_amp[0] = last_amp;
+        *out_ = out;
+
+        used = (int)(in - in_);
+
+        r->write_filled -= used;
+    }
+
+    return used;
+}
+
+RESAMPLER_TARGET_AVX2
+static int resampler_run_blam_avx2(resampler *r, float **out_,
+                                   float *out_end) {
+    int in_size = r->write_filled;
+    float const *in_ =
+        r->buffer_in + resampler_buffer_size + r->write_pos - r->write_filled;
+    int used = 0;
+    in_size -= 2;
+    if (in_size > 0) {
+        float *out = *out_;
+        float const *in = in_;
+        float const *const in_end = in + in_size;
+        float last_amp = r->last_amp[0];
+        float phase = r->phase;
+        float phase_inc = r->phase_inc;
+        float inv_phase = r->inv_phase;
+        float inv_phase_inc = r->inv_phase_inc;
+
+        const int step = RESAMPLER_BLAM_CUTOFF * RESAMPLER_RESOLUTION;
+
+        do {
+            float sample;
+
+            if (out + SINC_WIDTH * 2 > out_end)
+                break;
+
+            sample = in[0];
+            if (phase_inc < 1.0f) {
+                sample += (in[1] - in[0]) * phase;
+            }
+            sample -= last_amp;
+
+            if (sample) {
+                __m256 kernel[SINC_BANK_TAPS / 8];
+                __m256 samplex;
+                int phase_reduced = (int)(inv_phase * RESAMPLER_RESOLUTION);
+                float kernel_sum =
+                    resampler_kernel_avx2(kernel, phase_reduced, step);
+                int i;
+
+                last_amp += sample;
+                sample /= kernel_sum;
+                samplex = _mm256_set1_ps(sample);
+                for (i = 0; i < SINC_BANK_TAPS / 8; ++i)
+                    _mm256_storeu_ps(
+                        out + i * 8,
+                        _mm256_fmadd_ps(kernel[i], samplex,
+                                        _mm256_loadu_ps(out + i * 8)));
+            }
+
+            if (inv_phase_inc < 1.0f) {
+                ++in;
+                inv_phase += inv_phase_inc;
+                out += (int)inv_phase;
+                inv_phase -= (int)inv_phase;
+            } else {
+                phase += phase_inc;
+                ++out;
+
+                if (phase >= 1.0f) {
+                    ++in;
+                    phase -= (int)phase;
+                }
+            }
+        } while (in < in_end);
+
+        r->phase = phase;
+        r->inv_phase = inv_phase;
+        r->last_amp[0] = last_amp;
+        *out_ = out;
+
+        used = (int)(in - in_);
+
+        r->write_filled -= used;
+    }
+
+    return used;
+}
+
+RESAMPLER_TARGET_AVX2
+static int resampler_run_sinc_avx2(resampler *r, float **out_,
+                                   float *out_end) {
+    int in_size = r->write_filled;
+    float const *in_ =
+        r->buffer_in + resampler_buffer_size + r->write_pos - r->write_filled;
+    int used = 0;
+    in_size -= SINC_WIDTH * 2;
+    if (in_size > 0) {
+        float *out = *out_;
+        float const *in = in_;
+        float const *const in_end = in + in_size;
+        float phase = r->phase;
+        float phase_inc = r->phase_inc;
+
+        int step = resampler_sinc_step(phase_inc);
+        const float *bank = resampler_sinc_bank_get(step);
+
+        do {
+            __m256 kernel_temp[SINC_BANK_TAPS / 8];
+            const __m256 *kernel;
+            __m256 sample1, sample2;
+            int phase_reduced = (int)(phase * RESAMPLER_RESOLUTION);
+
+            if (out >= out_end)
+                break;
+
+            if (bank)
+                kernel =
+                    (const __m256 *)(bank + phase_reduced * SINC_BANK_TAPS);
+            else {
+                resampler_sinc_kernel((float *)kernel_temp, phase_reduced,
+                                      step);
+                kernel = kernel_temp;
+            }
+            sample1 = _mm256_mul_ps(_mm256_loadu_ps(in), kernel[0]);
+            sample2 = _mm256_mul_ps(_mm256_loadu_ps(in + 8), kernel[1]);
+            sample1 = _mm256_fmadd_ps(_mm256_loadu_ps(in + 16), kernel[2],
+                                      sample1);
+            sample2 = _mm256_fmadd_ps(_mm256_loadu_ps(in + 24), kernel[3],
+                                      sample2);
+            *out++ = resampler_hsum_avx(_mm256_add_ps(sample1, sample2));
+
+            phase += phase_inc;
+
+            in += (int)phase;
+
+            phase -= (int)phase;
+        } while (in < in_end);
+
+        r->phase = phase;
+        *out_ = out;
+
+        used = (int)(in - in_);
+
+        r->write_filled -= used;
+
+        resampler_sinc_bank_put(bank);
+    }
+
+    return used;
+}
+
+RESAMPLER_TARGET_AVX512
+static int resampler_run_sinc_avx512(resampler *r, float **out_,
+                                     float *out_end) {
+    int in_size = r->write_filled;
+    float const *in_ =
+        r->buffer_in + resampler_buffer_size + r->write_pos - r->write_filled;
+    int used = 0;
+    in_size -= SINC_WIDTH * 2;
+    if (in_size > 0) {
+        float *out = *out_;
+        float const *in = in_;
+        float const *const in_end = in + in_size;
+        float phase = r->phase;
+        float phase_inc = r->phase_inc;
+
+        int step = resampler_sinc_step(phase_inc);
+        const float *bank = resampler_sinc_bank_get(step);
+
+        do {
+            __m256 kernel_temp[SINC_BANK_TAPS / 8];
+            const float *kernel;
+            __m512 samplex;
+            int phase_reduced = (int)(phase * RESAMPLER_RESOLUTION);
+
+            if (out >= out_end)
+                break;
+
+            if (bank)
+                kernel = bank + phase_reduced * SINC_BANK_TAPS;
+            else {
+                resampler_sinc_kernel((float *)kernel_temp, phase_reduced,
+                                      step);
+                kernel = (const float *)kernel_temp;
+            }
+            samplex = _mm512_mul_ps(_mm512_loadu_ps(in),
+                                    _mm512_loadu_ps(kernel));
+            samplex = _mm512_fmadd_ps(_mm512_loadu_ps(in + 16),
+                                      _mm512_loadu_ps(kernel + 16), samplex);
+            *out++ = resampler_hsum_avx(_mm256_add_ps(
+                _mm512_castps512_ps256(samplex),
+                _mm256_castpd_ps(
+                    _mm512_extractf64x4_pd(_mm512_castps_pd(samplex), 1))));
+
+            phase += phase_inc;
+
+            in += (int)phase;
+
+            phase -= (int)phase;
+        } while (in < in_end);
+
+        r->phase = phase;
+        *out_ = out;
+
+        used = (int)(in - in_);
+
+        r->write_filled -= used;
+
+        resampler_sinc_bank_put(bank);
+    }
+
+    return used;
+}
+/* Spreads taps 0-3 or 4-7 of an eight-tap vector across stereo frames */
+RESAMPLER_TARGET_AVX2
+static __m256 resampler_spread_lo_avx2(__m256 kernel) {
+    return _mm256_permutevar8x32_ps(kernel,
+                                    _mm256_setr_epi32(0, 0, 1, 1, 2, 2, 3, 3));
+}
+
+RESAMPLER_TARGET_AVX2
+static __m256 resampler_spread_hi_avx2(__m256 kernel) {
+    return _mm256_permutevar8x32_ps(kernel,
+                                    _mm256_setr_epi32(4, 4, 5, 5, 6, 6, 7, 7));
+}
+
+RESAMPLER_TARGET_AVX2
+static void resampler_add_kernel_stereo_avx2(float *out, const __m256 *kernel,
+                                             float sample_l, float sample_r) {
+    __m256 samplex = _mm256_setr_ps(sample_l, sample_r, sample_l, sample_r,
+                                    sample_l, sample_r, sample_l, sample_r);
+    int i;
+    for (i = 0; i < SINC_BANK_TAPS / 8; ++i) {
+        _mm256_storeu_ps(out + i * 16,
+                         _mm256_fmadd_ps(resampler_spread_lo_avx2(kernel[i]),
+                                         samplex,
+                                         _mm256_loadu_ps(out + i * 16)));
+        _mm256_storeu_ps(out + i * 16 + 8,
+                         _mm256_fmadd_ps(resampler_spread_hi_avx2(kernel[i]),
+                                         samplex,
+                                         _mm256_loadu_ps(out + i * 16 + 8)));
+    }
+}
+
+RESAMPLER_TARGET_AVX2
+static int resampler_run_blep_stereo_avx2(resampler *r, float **out_,
+                                          float *out_end) {
+    int in_size = r->write_filled;
+    float const *in_ =
+        r->buffer_in +
+        (resampler_buffer_size + r->write_pos - r->write_filled) * 2;
+    int used = 0;
+    in_size -= 1;
+    if (in_size > 0) {
+        float *out = *out_;
+        float const *in = in_;
+        float const *const in_end = in + in_size * 2;
+        float last_amp_l = r->last_amp[0];
+        float last_amp_r = r->last_amp[1];
+        float inv_phase = r->inv_phase;
+        float inv_phase_inc = r->inv_phase_inc;
+
+        const int step = RESAMPLER_BLEP_CUTOFF * RESAMPLER_RESOLUTION;
+
+        do {
+            float sample_l, sample_r;
+
+            if (out + SINC_WIDTH * 2 * 2 > out_end)
+                break;
+
+            sample_l = in[0] - last_amp_l;
+            sample_r = in[1] - last_amp_r;
+            in += 2;
+
+            if (sample_l || sample_r) {
+                __m256 kernel[SINC_BANK_TAPS / 8];
+                int phase_reduced = (int)(inv_phase * RESAMPLER_RESOLUTION);
+                float kernel_sum =
+                    resampler_kernel_avx2(kernel, phase_reduced, step);
+
+                last_amp_l += sample_l;
+                last_amp_r += sample_r;
+                resampler_add_kernel_stereo_avx2(out, kernel,
+                                                 sample_l / kernel_sum,
+                                                 sample_r / kernel_sum);
+            }
+
+            inv_phase += inv_phase_inc;
+
+            out += (int)inv_phase * 2;
+
+            inv_phase -= (int)inv_phase;
+        } while (in < in_end);
+
+        r->inv_phase = inv_phase;
+        r->last_amp[0] = last_amp_l;
+        r->last_amp[1] = last_amp_r;
+        *out_ = out;
+
+        used = (int)(in - in_) / 2;
+
+        r->write_filled -= used;
+    }
+
+    return used;
+}
+
+RESAMPLER_TARGET_AVX2
+static int resampler_run_blam_stereo_avx2(resampler *r, float **out_,
+                                          float *out_end) {
+    int in_size = r->write_filled;
+    float const *in_ =
+        r->buffer_in +
+        (resampler_buffer_size + r->write_pos - r->write_filled) * 2;
+    int used = 0;
+    in_size -= 2;
+    if (in_size > 0) {
+        float *out = *out_;
+        float const *in = in_;
+        float const *const in_end = in + in_size * 2;
+        float last_amp_l = r->last_amp[0];
+        float last_amp_r = r->last_amp[1];
+        float phase = r->phase;
+        float phase_inc = r->phase_inc;
+        float inv_phase = r->inv_phase;
+        float inv_phase_inc = r->inv_phase_inc;
+
+        const int step = RESAMPLER_BLAM_CUTOFF * RESAMPLER_RESOLUTION;
+
+        do {
+            float sample_l, sample_r;
+
+            if (out + SINC_WIDTH * 2 * 2 > out_end)
+                break;
+
+            sample_l = in[0];
+            sample_r = in[1];
+            if (phase_inc < 1.0f) {
+                sample_l += (in[2] - in[0]) * phase;
+                sample_r += (in[3] - in[1]) * phase;
+            }
+            sample_l -= last_amp_l;
+            sample_r -= last_amp_r;
+
+            if (sample_l || sample_r) {
+                __m256 kernel[SINC_BANK_TAPS / 8];
+                int phase_reduced = (int)(inv_phase * RESAMPLER_RESOLUTION);
+                float kernel_sum =
+                    resampler_kernel_avx2(kernel, phase_reduced, step);
+
+                last_amp_l += sample_l;
+                last_amp_r += sample_r;
+                resampler_add_kernel_stereo_avx2(out, kernel,
+                                                 sample_l / kernel_sum,
+                                                 sample_r / kernel_sum);
+            }
+
+            if (inv_phase_inc < 1.0f) {
+                in += 2;
+                inv_phase += inv_phase_inc;
+                out += (int)inv_phase * 2;
+                inv_phase -= (int)inv_phase;
+            } else {
+                phase += phase_inc;
+                out += 2;
+
+                if (phase >= 1.0f) {
+                    in += 2;
+                    phase -= (int)phase;
+                }
+            }
+        } while (in < in_end);
+
+        r->phase = phase;
+        r->inv_phase = inv_phase;
+        r->last_amp[0] = last_amp_l;
+        r->last_amp[1] = last_amp_r;
+        *out_ = out;
+
+        used = (int)(in - in_) / 2;
+
+        r->write_filled -= used;
+    }
+
+    return used;
+}
+
+RESAMPLER_TARGET_AVX2
+static int resampler_run_sinc_stereo_avx2(resampler *r, float **out_,
+                                          float *out_end) {
+    int in_size = r->write_filled;
+    float const *in_ =
+        r->buffer_in +
+        (resampler_buffer_size + r->write_pos - r->write_filled) * 2;
+    int used = 0;
+    in_size -= SINC_WIDTH * 2;
+    if (in_size > 0) {
+        float *out = *out_;
+        float const *in = in_;
+        float const *const in_end = in + in_size * 2;
+        float phase = r->phase;
+        float phase_inc = r->phase_inc;
+
+        int step = resampler_sinc_step(phase_inc);
+        const float *bank = resampler_sinc_bank_get(step);
+
+        do {
+            __m256 kernel_temp[SINC_BANK_TAPS / 8];
+            const __m256 *kernel;
+            __m256 sample1 = _mm256_setzero_ps();
+            __m256 sample2 = _mm256_setzero_ps();
+            __m128 samplex;
+            int i;
+            int phase_reduced = (int)(phase * RESAMPLER_RESOLUTION);
+
+            if (out >= out_end)
+                break;
+
+            if (bank)
+                kernel =
+                    (const __m256 *)(bank + phase_reduced * SINC_BANK_TAPS);
+            else {
+                resampler_sinc_kernel((float *)kernel_temp, phase_reduced,
+                                      step);
+                kernel = kernel_temp;
+            }
+            for (i = 0; i < SINC_BANK_TAPS / 8; ++i) {
+                sample1 = _mm256_fmadd_ps(_mm256_loadu_ps(in + i * 16),
+                                          resampler_spread_lo_avx2(kernel[i]),
+                                          sample1);
+                sample2 = _mm256_fmadd_ps(_mm256_loadu_ps(in + i * 16 + 8),
+                                          resampler_spread_hi_avx2(kernel[i]),
+                                          sample2);
+            }
+            sample1 = _mm256_add_ps(sample1, sample2);
+            samplex = _mm_add_ps(_mm256_castps256_ps128(sample1),
+                                 _mm256_extractf128_ps(sample1, 1));
+            samplex = _mm_add_ps(samplex, _mm_movehl_ps(samplex, samplex));
+            _mm_storel_pi((__m64 *)out, samplex);
+            out += 2;
+
+            phase += phase_inc;
+
+            in += (int)phase * 2;
+
+            phase -= (int)phase;
+        } while (in < in_end);
+
+        r->phase = phase;
+        *out_ = out;
+
+        used = (int)(in - in_) / 2;
+
+        r->write_filled -= used;
+
+        resampler_sinc_bank_put(bank);
+    }
+
+    return used;
+}
+#endif
+
+/* Kernels for each SIMD level, channel count and quality. resampler_set_simd()
+ * publishes one table with a single atomic store, so resamplers running in
+ * other threads see either the old kernels or the new ones. Cubic has only
+ * four taps, so it stays on SSE above that level.
+ */
+typedef int (*resampler_run_fn)(resampler *r, float **out_, float *out_end);
+typedef resampler_run_fn resampler_run_table[2][RESAMPLER_QUALITY_MAX + 1];
+
+static const resampler_run_table resampler_run_none = {
+    {resampler_run_zoh, resampler_run_blep, resampler_run_linear,
+     resampler_run_blam, resampler_run_cubic, resampler_run_sinc},
+    {resampler_run_zoh_stereo, resampler_run_blep_stereo,
+     resampler_run_linear_stereo, resampler_run_blam_stereo,
+     resampler_run_cubic_stereo, resampler_run_sinc_stereo}};
+#ifdef RESAMPLER_SSE
+static const resampler_run_table resampler_run_sse = {
+    {resampler_run_zoh, resampler_run_blep_sse, resampler_run_linear,
+     resampler_run_blam_sse, resampler_run_cubic_sse, resampler_run_sinc_sse},
+    {resampler_run_zoh_stereo, resampler_run_blep_stereo_sse,
+     resampler_run_linear_stereo, resampler_run_blam_stereo_sse,
+     resampler_run_cubic_stereo_sse, resampler_run_sinc_stereo_sse}};
+#endif
+#ifdef RESAMPLER_AVX
+static const resampler_run_table resampler_run_avx2 = {
+    {resampler_run_zoh, resampler_run_blep_avx2, resampler_run_linear,
+     resampler_run_blam_avx2, resampler_run_cubic_sse,
+     resampler_run_sinc_avx2},
+    {resampler_run_zoh_stereo, resampler_run_blep_stereo_avx2,
+     resampler_run_linear_stereo, resampler_run_blam_stereo_avx2,
+     resampler_run_cubic_stereo_sse, resampler_run_sinc_stereo_avx2}};
+static const resampler_run_table resampler_run_avx512 = {
+    {resampler_run_zoh, resampler_run_blep_avx2, resampler_run_linear,
+     resampler_run_blam_avx2, resampler_run_cubic_sse,
+     resampler_run_sinc_avx512},
+    {resampler_run_zoh_stereo, resampler_run_blep_stereo_avx2,
+     resampler_run_linear_stereo, resampler_run_blam_stereo_avx2,
+     resampler_run_cubic_stereo_sse, resampler_run_sinc_stereo_avx2}};
+#endif
+
+static const resampler_run_table *resampler_run = &resampler_run_none;
+static volatile int resampler_simd_available = -1;
+static volatile int resampler_simd_level = RESAMPLER_SIMD_NONE;
+
+int resampler_set_simd(int level) {
+    const resampler_run_table *run = &resampler_run_none;
+
+    if (resampler_simd_available < 0) {
+#ifdef RESAMPLER_SSE
+        resampler_simd_available = query_cpu_simd();
+#else
+        resampler_simd_available = RESAMPLER_SIMD_NONE;
+#endif
+    }
+
+    resampler_simd_request = level;
+    if (level < 0 || level > resampler_simd_available)
+        level = resampler_simd_available;
+
+#ifdef RESAMPLER_SSE
+    if (level >= RESAMPLER_SIMD_SSE)
+        run = &resampler_run_sse;
+#endif
+#ifdef RESAMPLER_AVX
+    if (level >= RESAMPLER_SIMD_AVX2)
+        run = &resampler_run_avx2;
+    if (level >= RESAMPLER_SIMD_AVX512)
+        run = &resampler_run_avx512;
+#endif
+    resampler_store_ptr(&resampler_run, run);
+    resampler_simd_level = level;
+
+    return level;
+}
+
+int resampler_get_simd(void) { return resampler_simd_level; }
+
+static void resampler_fill(resampler *r) {
+    int min_filled = resampler_min_filled(r);
+    int quality = r->quality;
+    int channels = r->channels;
+    resampler_run_fn run =
+        (*resampler_load_ptr(&resampler_run))[channels - 1][quality];
+    while (r->write_filled > min_filled &&
+           r->read_filled < resampler_buffer_size) {
+        int write_pos = (r->read_pos + r->read_filled) % resampler_buffer_size;
+        int write_size = resampler_buffer_size - write_pos;
+        float *out = r->buffer_out + write_pos * channels;
+        if (write_size > (resampler_buffer_size - r->read_filled))
+            write_size = resampler_buffer_size - r->read_filled;
+        switch (quality) {
+        case RESAMPLER_QUALITY_BLEP: {
+            int used;
+            int write_extra = 0;
+            if (write_pos >= r->read_pos)
+                write_extra = r->read_pos;
+            if (write_extra > SINC_WIDTH * 2 - 1)
+                write_extra = SINC_WIDTH * 2 - 1;
+            memcpy(r->buffer_out + resampler_buffer_size * channels,
+                   r->buffer_out,
+                   write_extra * channels * sizeof(r->buffer_out[0]));
+            used = run(r, &out, out + (write_size + write_extra) * channels);
+            memcpy(r->buffer_out,
+                   r->buffer_out + resampler_buffer_size * channels,
+                   write_extra * channels * sizeof(r->buffer_out[0]));
+            if (!used)
+                return;
+            break;
+        }
+
+        case RESAMPLER_QUALITY_BLAM: {
+            float *out_ = out;
+            int write_extra = 0;
+            if (write_pos >= r->read_pos)
+                write_extra = r->read_pos;
+            if (write_extra > SINC_WIDTH * 2 - 1)
+                write_extra = SINC_WIDTH * 2 - 1;
+            memcpy(r->buffer_out + resampler_buffer_size * channels,
+                   r->buffer_out,
+                   write_extra * channels * sizeof(r->buffer_out[0]));
+            run(r, &out, out + (write_size + write_extra) * channels);
+            memcpy(r->buffer_out,
+                   r->buffer_out + resampler_buffer_size * channels,
+                   write_extra * channels * sizeof(r->buffer_out[0]));
+            if (out == out_)
+                return;
+            break;
+        }
+
+        default:
+            run(r, &out, out + write_size * channels);
+            break;
+        }
+        r->read_filled += (int)(out - r->buffer_out) / channels - write_pos;
+    }
+}
+
+static void resampler_fill_and_remove_delay(resampler *r) {
+    resampler_fill(r);
+    if (r->delay_removed < 0) {
+        int delay = resampler_output_delay(r);
+        r->delay_removed = 0;
+        while (delay--)
+            resampler_remove_sample(r, 1);
+    }
+}
+
+int resampler_get_sample_count(void *_r) {
+    resampler *r = (resampler *)_r;
+    if (r->read_filled < 1 && ((r->quality != RESAMPLER_QUALITY_BLEP &&
+                                r->quality != RESAMPLER_QUALITY_BLAM) ||
+                               r->inv_phase_inc))
+        resampler_fill_and_remove_delay(r);
+    return r->read_filled;
+}
+
+int resampler_get_sample(void *_r) {
+    resampler *r = (resampler *)_r;
+    if (r->read_filled < 1 && r->phase_inc)
+        resampler_fill_and_remove_delay(r);
+    if (r->read_filled < 1)
+        return 0;
+    if (r->quality == RESAMPLER_QUALITY_BLEP ||
+        r->quality == RESAMPLER_QUALITY_BLAM)
+        return (int)(r->buffer_out[r->read_pos * r->channels] +
+                     r->accumulator[0]);
+    else
+        return (int)r->buffer_out[r->read_pos * r->channels];
+}
+
+float resampler_get_sample_float(void *_r) {
+    resampler *r = (resampler *)_r;
+    if (r->read_filled < 1 && r->phase_inc)
+        resampler_fill_and_remove_delay(r);
+    if (r->read_filled < 1)
+        return 0;
+    if (r->quality == RESAMPLER_QUALITY_BLEP ||
+        r->quality == RESAMPLER_QUALITY_BLAM)
+        return r->buffer_out[r->read_pos * r->channels] + r->accumulator[0];
+    else
+        return r->buffer_out[r->read_pos * r->channels];
+}
+
+void resampler_get_frame_float(void *_r, float *out) {
+    resampler *r = (resampler *)_r;
+    int channels = r->channels;
+    int i;
+    if (r->read_filled < 1 && r->phase_inc)
+        resampler_fill_and_remove_delay(r);
+    for (i = 0; i < channels; ++i) {
+        if (r->read_filled < 1)
+            out[i] = 0;
+        else if (r->quality == RESAMPLER_QUALITY_BLEP ||
+                 r->quality == RESAMPLER_QUALITY_BLAM)
+            out[i] = r->buffer_out[r->read_pos * channels + i] +
+                     r->accumulator[i];
+        else
+            out[i] = r->buffer_out[r->read_pos * channels + i];
+    }
+}
+
+void resampler_remove_sample(void *_r, int decay) {
+    resampler *r = (resampler *)_r;
+    if (r->read_filled > 0) {
+        if (r->quality == RESAMPLER_QUALITY_BLEP ||
+            r->quality == RESAMPLER_QUALITY_BLAM) {
+            int i;
+            for (i = 0; i < r->channels; ++i) {
+                float *in = r->buffer_out + r->read_pos * r->channels + i;
+                float accumulator = r->accumulator[i] + *in;
+                *in = 0;
+                if (decay) {
+                    accumulator -= accumulator * (1.0f / 8192.0f);
+                    if (fabs(accumulator) < 1e-20f)
+                        accumulator = 0;
+                }
+                r->accumulator[i] = accumulator;
+            }
+        }
+        --r->read_filled;
+        r->read_pos = (r->read_pos + 1) % resampler_buffer_size;
+    }
+}
+
+int resampler_read_block(void *_r, float *out, int count) {
+    resampler *r = (resampler *)_r;
+    int channels = r->channels;
+    int is_blep = r->quality == RESAMPLER_QUALITY_BLEP ||
+                  r->quality == RESAMPLER_QUALITY_BLAM;
+    int done = 0;
+
+    while (done < count) {
+        int todo;
+
+        if (r->read_filled < 1 && (!is_blep || r->inv_phase_inc))
+            resampler_fill_and_remove_delay(r);
+        if (r->read_filled < 1)
+            break;
+
+        todo = r->read_filled;
+        if (todo > count - done)
+            todo = count - done;
+        if (todo > resampler_buffer_size - r->read_pos)
+            todo = resampler_buffer_size - r->read_pos;
+
+        if (is_blep) {
+            int c;
+            for (c = 0; c < channels; ++c) {
+                float *in = r->buffer_out + r->read_pos * channels + c;
+                float *dst = out + done * channels + c;
+                float accumulator = r->accumulator[c];
+                int i;
+                for (i = 0; i < todo * channels; i += channels) {
+                    float sample = in[i];
+                    dst[i] = sample + accumulator;
+                    accumulator += sample;
+                    in[i] = 0;
+                    accumulator -= accumulator * (1.0f / 8192.0f);
+                    if (fabs(accumulator) < 1e-20f)
+                        accumulator = 0;
+                }
+                r->accumulator[c] = accumulator;
+            }
+        } else {
+            memcpy(out + done * channels,
+                   r->buffer_out + r->read_pos * channels,
+                   todo * channels * sizeof(r->buffer_out[0]));
+        }
+
+        done += todo;
+        r->read_filled -= todo;
+        r->read_pos = (r->read_pos + todo) % resampler_buffer_size;
+    }
+
+    return done;
 }
@@ -1,7 +1,21 @@
 #include "internal/tarray.h"
 
+#include <stddef.h>
 #include <string.h>
 
+#if defined(_MSC_VER)
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#define timekeeping_atomic_add(p, v)                                           \
+    (InterlockedExchangeAdd((volatile LONG *)(p), (v)) + (v))
+#elif defined(__GNUC__) || defined(__clang__)
+#define timekeeping_atomic_add(p, v) __sync_add_and_fetch((p), (v))
+#else
+#define timekeeping_atomic_add(p, v) (*(p) += (v))
+#endif
+
 /*
    Structures which contain the play times of each pattern and row combination
    in the song, not guaranteed to be valid for the whole song until the loop
@@ -13,6 +27,13 @@
 
    Timestamp lists are guaranteed to be allocated in blocks of 16 timestamps at
    a time.
+
+   The rows are kept in pages of one order each, which are shared between
+   duplicates and only copied when one of the owners writes to them, since
+   every checkpoint carries its own array and only a few orders change from
+   one to the next. Pages of rows which have never been played are not
+   allocated at all. Reference counts are atomic, as several threads may start
+   sigrenderers from the same checkpoint at once.
 */
 
 /*
@@ -33,75 +54,156 @@ typedef struct DUMB_IT_ROW_TIME {
 #endif
 } DUMB_IT_ROW_TIME;
 
-void *timekeeping_array_create(size_t size) {
-    size_t *_size =
-        (size_t *)calloc(1, sizeof(size_t) + sizeof(DUMB_IT_ROW_TIME) * size);
-    if (_size) {
-        *_size = size;
-    }
-    return _size;
-}
+enum { TIMEKEEPING_PAGE_SIZE = 256 };
 
-void timekeeping_array_destroy(void *array) {
+typedef struct timekeeping_page {
+    long refs;
+    DUMB_IT_ROW_TIME s[TIMEKEEPING_PAGE_SIZE];
+} timekeeping_page;
+
+typedef struct timekeeping_array {
+    size_t size;
+    size_t n_pages;
+    timekeeping_page *page[1];
+} timekeeping_array;
+
+static void timekeeping_page_release(timekeeping_page *page) {
 #ifdef FULL_TIMEKEEPING
     size_t i;
-    size_t *size = (size_t *)array;
-    DUMB_IT_ROW_TIME *s = (DUMB_IT_ROW_TIME *)(size + 1);
+#endif
+
+    if (!page || timekeeping_atomic_add(&page->refs, -1) != 0)
+        return;
 
-    for (i = 0; i < *size; i++) {
-        if (s[i].times)
-            free(s[i].times);
+#ifdef FULL_TIMEKEEPING
+    for (i = 0; i < TIMEKEEPING_PAGE_SIZE; i++) {
+        if (page->s[i].times)
+            free(page->s[i].times);
     }
 #endif
 
-    free(array);
+    free(page);
 }
 
-void *timekeeping_array_dup(void *array) {
-    size_t i;
-    size_t *size = (size_t *)array;
-    DUMB_IT_ROW_TIME *s = (DUMB_IT_ROW_TIME *)(size + 1);
-    size_t *new_size =
-        (size_t *)calloc(1, sizeof(size_t) + sizeof(DUMB_IT_ROW_TIME) * *size);
-    if (new_size) {
-        DUMB_IT_ROW_TIME *new_s = (DUMB_IT_ROW_TIME *)(new_size + 1);
-
-        *new_size = *size;
-
-        for (i = 0; i < *size; i++) {
-            new_s[i].count = s[i].count;
-            new_s[i].restart_count = s[i].restart_count;
-
-#ifndef FULL_TIMEKEEPING
-            new_s[i].first_time = s[i].first_time;
-#else
-            if (s[i].times) {
-                size_t time_count = (s[i].count + 15) & ~15;
-                new_s[i].times =
+/* Returns the row at index, ready to be written to, or NULL if memory runs
+ * out.
+ */
+static DUMB_IT_ROW_TIME *timekeeping_array_write(timekeeping_array *ta,
+                                                 size_t index) {
+    timekeeping_page **slot = &ta->page[index / TIMEKEEPING_PAGE_SIZE];
+    timekeeping_page *page = *slot;
+
+    if (!page) {
+        page = (timekeeping_page *)calloc(1, sizeof(*page));
+        if (!page)
+            return (DUMB_IT_ROW_TIME *)0;
+        page->refs = 1;
+        *slot = page;
+    } else if (timekeeping_atomic_add(&page->refs, 0) > 1) {
+#ifdef FULL_TIMEKEEPING
+        size_t i;
+#endif
+        page = (timekeeping_page *)malloc(sizeof(*page));
+        if (!page)
+            return (DUMB_IT_ROW_TIME *)0;
+        page->refs = 1;
+        memcpy(page->s, (*slot)->s, sizeof(page->s));
+#ifdef FULL_TIMEKEEPING
+        for (i = 0; i < TIMEKEEPING_PAGE_SIZE; i++) {
+            if (page->s[i].times) {
+                size_t time_count = (page->s[i].count + 15) & ~15;
+                LONG_LONG *times =
                     (LONG_LONG *)malloc(sizeof(LONG_LONG) * time_count);
-                if (new_s[i].times == (void *)0) {
-                    timekeeping_array_destroy(new_size);
-                    return (void *)0;
+                if (times == (void *)0) {
+                    while (i--)
+                        free(page->s[i].times);
+                    free(page);
+                    return (DUMB_IT_ROW_TIME *)0;
                 }
-                memcpy(new_s[i].times, s[i].times,
-                       sizeof(LONG_LONG) * s[i].count);
+                memcpy(times, page->s[i].times,
+                       sizeof(LONG_LONG) * page->s[i].count);
+                page->s[i].times = times;
             }
+        }
 #endif
+        timekeeping_page_release(*slot);
+        *slot = page;
+    }
+
+    return &page->s[index % TIMEKEEPING_PAGE_SIZE];
+}
+
+/* Returns the row at index for reading, or NULL if it has never been played.
+ */
+static DUMB_IT_ROW_TIME *timekeeping_array_read(timekeeping_array *ta,
+                                                size_t index) {
+    timekeeping_page *page = ta->page[index / TIMEKEEPING_PAGE_SIZE];
+    if (!page)
+        return (DUMB_IT_ROW_TIME *)0;
+    return &page->s[index % TIMEKEEPING_PAGE_SIZE];
+}
+
+void *timekeeping_array_create(size_t size) {
+    size_t n_pages =
+        (size + TIMEKEEPING_PAGE_SIZE - 1) / TIMEKEEPING_PAGE_SIZE;
+    timekeeping_array *ta = (timekeeping_array *)calloc(
+        1, sizeof(*ta) + sizeof(ta->page[0]) * n_pages);
+    if (ta) {
+        ta->size = size;
+        ta->n_pages = n_pages;
+    }
+    return ta;
+}
+
+void timekeeping_array_destroy(void *array) {
+    timekeeping_array *ta = (timekeeping_array *)array;
+    size_t i;
+
+    if (!ta)
+        return;
+
+    for (i = 0; i < ta->n_pages; i++)
+        timekeeping_page_release(ta->page[i]);
+
+    free(array);
+}
+
+void *timekeeping_array_dup(void *array) {
+    size_t i;
+    timekeeping_array *ta = (timekeeping_array *)array;
+    timekeeping_array *new_ta;
+
+    if (!ta)
+        return (void *)0;
+
+    new_ta = (timekeeping_array *)malloc(sizeof(*ta) +
+                                         sizeof(ta->page[0]) * ta->n_pages);
+    if (new_ta) {
+        new_ta->size = ta->size;
+        new_ta->n_pages = ta->n_pages;
+
+        for (i = 0; i < ta->n_pages; i++) {
+            new_ta->page[i] = ta->page[i];
+            if (new_ta->page[i])
+                timekeeping_atomic_add(&new_ta->page[i]->refs, 1);
         }
     }
 
-    return new_size;
+    return new_ta;
 }
 
 void timekeeping_array_reset(void *array, size_t loop_start) {
-    size_t i;
-    size_t *size = (size_t *)array;
-    DUMB_IT_ROW_TIME *s = (DUMB_IT_ROW_TIME *)(size + 1);
+    size_t i, j;
+    timekeeping_array *ta = (timekeeping_array *)array;
 
-    DUMB_IT_ROW_TIME *s_loop_start = s + loop_start;
+    DUMB_IT_ROW_TIME *s_loop_start;
     LONG_LONG loop_start_time;
 
-    if (loop_start >= *size || s_loop_start->count < 1)
+    if (loop_start >= ta->size)
+        return;
+
+    s_loop_start = timekeeping_array_read(ta, loop_start);
+    if (!s_loop_start || s_loop_start->count < 1)
         return;
 
 #ifndef FULL_TIMEKEEPING
@@ -110,71 +212,155 @@ void timekeeping_array_reset(void *array, size_t loop_start) {
     loop_start_time = s_loop_start->times[0];
 #endif
 
-    for (i = 0; i < *size; i++) {
+    for (i = 0; i < ta->n_pages; i++) {
+        if (!ta->page[i])
+            continue;
+        for (j = 0; j < TIMEKEEPING_PAGE_SIZE; j++) {
+            DUMB_IT_ROW_TIME *s = &ta->page[i]->s[j];
+            /* Only write where it changes anything, so as not to copy pages
+             * needlessly.
+             */
 #ifndef FULL_TIMEKEEPING
-        if (s[i].count && s[i].first_time >= loop_start_time) {
+            if (s->count && s->first_time >= loop_start_time &&
+                s->restart_count) {
 #else
-        if (s[i].count && s[i].times[0] >= loop_start_time) {
+            if (s->count && s->times[0] >= loop_start_time &&
+                s->restart_count) {
 #endif
-            s[i].restart_count = 0;
+                s = timekeeping_array_write(ta, i * TIMEKEEPING_PAGE_SIZE + j);
+                if (s)
+                    s->restart_count = 0;
+            }
         }
     }
 }
 
 void timekeeping_array_push(void *array, size_t index, LONG_LONG time) {
 #ifdef FULL_TIMEKEEPING
-    size_t i;
     size_t time_count;
 #endif
-    size_t *size = (size_t *)array;
-    DUMB_IT_ROW_TIME *s = (DUMB_IT_ROW_TIME *)(size + 1);
+    timekeeping_array *ta = (timekeeping_array *)array;
+    DUMB_IT_ROW_TIME *s;
 
-    if (index >= *size)
+    if (index >= ta->size)
+        return;
+
+    s = timekeeping_array_write(ta, index);
+    if (!s)
         return;
 
 #ifndef FULL_TIMEKEEPING
-    if (!s[index].count++)
-        s[index].first_time = time;
+    if (!s->count++)
+        s->first_time = time;
 #else
-    time_count = (s[index].count + 16) & ~15;
+    time_count = (s->count + 16) & ~15;
 
-    s[index].times =
-        (LONG_LONG *)realloc(s[index].times, sizeof(LONG_LONG) * time_count);
+    s->times = (LONG_LONG *)realloc(s->times, sizeof(LONG_LONG) * time_count);
 
-    s[index].times[s[index].count++] = time;
+    s->times[s->count++] = time;
 #endif
 }
 
 void timekeeping_array_bump(void *array, size_t index) {
-    size_t *size = (size_t *)array;
-    DUMB_IT_ROW_TIME *s = (DUMB_IT_ROW_TIME *)(size + 1);
+    timekeeping_array *ta = (timekeeping_array *)array;
+    DUMB_IT_ROW_TIME *s;
 
-    if (index >= *size)
+    if (index >= ta->size)
         return;
 
-    s[index].restart_count++;
+    s = timekeeping_array_write(ta, index);
+    if (s)
+        s->restart_count++;
 }
 
 unsigned int timekeeping_array_get_count(void *array, size_t index) {
-    size_t *size = (size_t *)array;
-    DUMB_IT_ROW_TIME *s = (DUMB_IT_ROW_TIME *)(size + 1);
+    timekeeping_array *ta = (timekeeping_array *)array;
+    DUMB_IT_ROW_TIME *s;
+
+    if (index >= ta->size)
+        return 0;
 
-    if (index >= *size)
+    s = timekeeping_array_read(ta, index);
+    if (!s)
         return 0;
 
-    return s[index].count;
+    return s->count;
 }
 
 LONG_LONG timekeeping_array_get_item(void *array, size_t index) {
-    size_t *size = (size_t *)array;
-    DUMB_IT_ROW_TIME *s = (DUMB_IT_ROW_TIME *)(size + 1);
+    timekeeping_array *ta = (timekeeping_array *)array;
+    DUMB_IT_ROW_TIME *s;
+
+    if (index >= ta->size)
+        return 0;
 
-    if (index >= *size || s[index].restart_count >= s[index].count)
+    s = timekeeping_array_read(ta, index);
+    if (!s || s->restart_count >= s->count)
         return 0;
 
 #ifndef FULL_TIMEKEEPING
-    return s[index].first_time;
+    return s->first_time;
+#else
+    return s->times[s->restart_count];
+#endif
+}
+
+size_t timekeeping_array_get_row(void *array, size_t index,
+                                 unsigned int *count,
+                                 unsigned int *restart_count,
+                                 LONG_LONG *first_time) {
+    timekeeping_array *ta = (timekeeping_array *)array;
+
+    while (index < ta->size) {
+        timekeeping_page *page = ta->page[index / TIMEKEEPING_PAGE_SIZE];
+        DUMB_IT_ROW_TIME *s;
+
+        if (!page) {
+            index += TIMEKEEPING_PAGE_SIZE - index % TIMEKEEPING_PAGE_SIZE;
+            continue;
+        }
+
+        s = &page->s[index % TIMEKEEPING_PAGE_SIZE];
+        if (s->count) {
+            *count = s->count;
+            *restart_count = s->restart_count;
+#ifndef FULL_TIMEKEEPING
+            *first_time = s->first_time;
+#else
+            *first_time = s->times[0];
+#endif
+            return index;
+        }
+        index++;
+    }
+
+    return ta->size;
+}
+
+/* Under FULL_TIMEKEEPING, only the first play time is restored, and every
+ * later one is taken to be the same.
+ */
+void timekeeping_array_set_row(void *array, size_t index, unsigned int count,
+                               unsigned int restart_count,
+                               LONG_LONG first_time) {
+    timekeeping_array *ta = (timekeeping_array *)array;
+    DUMB_IT_ROW_TIME *s;
+
+    if (index >= ta->size || (!count && !timekeeping_array_read(ta, index)))
+        return;
+
+    s = timekeeping_array_write(ta, index);
+    if (!s)
+        return;
+
+#ifndef FULL_TIMEKEEPING
+    s->count = count;
+    s->first_time = first_time;
 #else
-    return s[index].times[s[index].restart_count];
+    if (s->count > count)
+        s->count = count;
+    while (s->count < count)
+        timekeeping_array_push(array, index, first_time);
 #endif
+    s->restart_count = restart_count;
 }
@@ -0,0 +1,1391 @@
+/*  _______         ____    __         ___    ___
+ * \    _  \       \    /  \  /       \   \  /   /       '   '  '
+ *  |  | \  \       |  |    ||         |   \/   |         .      .
+ *  |  |  |  |      |  |    ||         ||\  /|  |
+ *  |  |  |  |      |  |    ||         || \/ |  |         '  '  '
+ *  |  |  |  |      |  |    ||         ||    |  |         .      .
+ *  |  |_/  /        \  \__//          ||    |  |
+ * /_______/ynamic    \____/niversal  /__\  /____\usic   /|  .  . ibliotheque
+ *                                                      /  \
+ *                                                     / .  \
+ * itcache.c - Saving and restoring the results       / / \  \
+ *             of the initial runthrough.            | <  /   \_
+ *                                                   |  \/ /\   /
+ *                                                    \_  /  > /
+ *                                                      | \ / /
+ *                                                      |  ' /
+ *                                                       \__/
+ */
+
+#include <limits.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "dumb.h"
+#include "internal/dumb.h"
+#include "internal/it.h"
+
+/*
+   The saved data is only meant for a build of DUMB keeping the same state
+   on the same kind of machine. Checkpoints are stored field by field, in
+   the machine's own byte order, with their pointers replaced by indices.
+   The header records the byte order and a hash of the fields' names and
+   sizes, which turns anything else away. Bump IT_CACHE_VERSION whenever a
+   field changes meaning without changing name or size.
+
+   The checksum only catches damage, so everything restored which the
+   renderer uses to index the module or its sample data is checked against
+   the module as it is read.
+
+   The module hash, on the other hand, is worked out the same way everywhere.
+*/
+
+#define IT_CACHE_VERSION 2
+
+static const char it_cache_magic[8] = "DUMBRUN";
+
+/* 64-bit FNV-1a */
+#define FNV_OFFSET_BASIS                                                       \
+    ((unsigned LONG_LONG)0xCBF29CE4 << 32 | (unsigned LONG_LONG)0x84222325)
+#define FNV_PRIME ((unsigned LONG_LONG)1 << 40 | 0x1B3)
+
+static unsigned LONG_LONG hash_bytes(unsigned LONG_LONG hash, const void *data,
+                                     size_t size) {
+    const unsigned char *p = (const unsigned char *)data;
+    while (size--) {
+        hash ^= *p++;
+        hash *= FNV_PRIME;
+    }
+    return hash;
+}
+
+/* Integers are hashed as eight bytes, least significant first. */
+static unsigned LONG_LONG hash_int(unsigned LONG_LONG hash, LONG_LONG value) {
+    unsigned char b[8];
+    int i;
+    for (i = 0; i < 8; i++)
+        b[i] = (unsigned char)((unsigned LONG_LONG)value >> (i * 8));
+    return hash_bytes(hash, b, 8);
+}
+
+/* Loaders only fill names in as far as the terminator. */
+static unsigned LONG_LONG hash_string(unsigned LONG_LONG hash,
+                                      const unsigned char *s, size_t size) {
+    size_t n = 0;
+    while (n < size && s[n])
+        n++;
+    return hash_bytes(hash_int(hash, n), s, n);
+}
+
+static unsigned LONG_LONG hash_envelope(unsigned LONG_LONG hash,
+                                        const IT_ENVELOPE *envelope) {
+    int n_nodes = envelope->n_nodes < 25 ? envelope->n_nodes : 25;
+    int i;
+
+    hash = hash_int(hash, envelope->flags);
+    hash = hash_int(hash, envelope->n_nodes);
+    hash = hash_int(hash, envelope->loop_start);
+    hash = hash_int(hash, envelope->loop_end);
+    hash = hash_int(hash, envelope->sus_loop_start);
+    hash = hash_int(hash, envelope->sus_loop_end);
+    for (i = 0; i < n_nodes; i++) {
+        hash = hash_int(hash, envelope->node_y[i]);
+        hash = hash_int(hash, envelope->node_t[i]);
+    }
+    return hash;
+}
+
+static unsigned LONG_LONG hash_instrument(unsigned LONG_LONG hash,
+                                          const IT_INSTRUMENT *instrument) {
+    int i;
+
+    hash = hash_string(hash, instrument->name, sizeof(instrument->name));
+    hash = hash_string(hash, instrument->filename,
+                       sizeof(instrument->filename));
+    hash = hash_int(hash, instrument->fadeout);
+    hash = hash_envelope(hash, &instrument->volume_envelope);
+    hash = hash_envelope(hash, &instrument->pan_envelope);
+    hash = hash_envelope(hash, &instrument->pitch_envelope);
+    hash = hash_int(hash, instrument->new_note_action);
+    hash = hash_int(hash, instrument->dup_check_type);
+    hash = hash_int(hash, instrument->dup_check_action);
+    hash = hash_int(hash, instrument->pp_separation);
+    hash = hash_int(hash, instrument->pp_centre);
+    hash = hash_int(hash, instrument->global_volume);
+    hash = hash_int(hash, instrument->default_pan);
+    hash = hash_int(hash, instrument->random_volume);
+    hash = hash_int(hash, instrument->random_pan);
+    hash = hash_int(hash, instrument->filter_cutoff);
+    hash = hash_int(hash, instrument->filter_resonance);
+    for (i = 0; i < 120; i++) {
+        hash = hash_int(hash, instrument->map_note[i]);
+        hash = hash_int(hash, instrument->map_sample[i]);
+    }
+    return hash;
+}
+
+/* The sample data is left out. It has no bearing on the runthrough, and
+ * invert loop effects change it as the module plays. Some loaders leave
+ * whatever a sample's flags say it does not use unset.
+ */
+static unsigned LONG_LONG hash_sample(unsigned LONG_LONG hash,
+                                      const IT_SAMPLE *sample) {
+    hash = hash_int(hash, sample->flags);
+    if (!(sample->flags & IT_SAMPLE_EXISTS))
+        return hash;
+    hash = hash_string(hash, sample->name, sizeof(sample->name));
+    hash = hash_string(hash, sample->filename, sizeof(sample->filename));
+    hash = hash_int(hash, sample->global_volume);
+    hash = hash_int(hash, sample->default_volume);
+    hash = hash_int(hash, sample->default_pan);
+    hash = hash_int(hash, sample->length);
+    if (sample->flags & IT_SAMPLE_LOOP) {
+        hash = hash_int(hash, sample->loop_start);
+        hash = hash_int(hash, sample->loop_end);
+    }
+    hash = hash_int(hash, sample->C5_speed);
+    if (sample->flags & IT_SAMPLE_SUS_LOOP) {
+        hash = hash_int(hash, sample->sus_loop_start);
+        hash = hash_int(hash, sample->sus_loop_end);
+    }
+    hash = hash_int(hash, sample->vibrato_speed);
+    hash = hash_int(hash, sample->vibrato_depth);
+    hash = hash_int(hash, sample->vibrato_rate);
+    hash = hash_int(hash, sample->vibrato_waveform);
+    hash = hash_int(hash, sample->finetune);
+    hash = hash_int(hash, sample->data != NULL);
+    hash = hash_int(hash, sample->fir_data != NULL);
+    hash = hash_int(hash, sample->fir_loop_end);
+    hash = hash_int(hash, sample->max_resampling_quality);
+    return hash;
+}
+
+/* Only the fields the mask says are there have been filled in. */
+static unsigned LONG_LONG hash_pattern(unsigned LONG_LONG hash,
+                                       const IT_PATTERN *pattern) {
+    int n;
+
+    hash = hash_int(hash, pattern->n_rows);
+    hash = hash_int(hash, pattern->n_entries);
+    if (!pattern->entry)
+        return hash_int(hash, -1);
+
+    for (n = 0; n < pattern->n_entries; n++) {
+        const IT_ENTRY *entry = &pattern->entry[n];
+        hash = hash_int(hash, entry->channel);
+        if (IT_IS_END_ROW(entry))
+            continue;
+        hash = hash_int(hash, entry->mask);
+        if (entry->mask & IT_ENTRY_NOTE)
+            hash = hash_int(hash, entry->note);
+        if (entry->mask & IT_ENTRY_INSTRUMENT)
+            hash = hash_int(hash, entry->instrument);
+        if (entry->mask & IT_ENTRY_VOLPAN)
+            hash = hash_int(hash, entry->volpan);
+        if (entry->mask & IT_ENTRY_EFFECT) {
+            hash = hash_int(hash, entry->effect);
+            hash = hash_int(hash, entry->effectvalue);
+        }
+    }
+    return hash;
+}
+
+static unsigned LONG_LONG hash_midi(unsigned LONG_LONG hash,
+                                    const IT_MIDI *midi) {
+    int i;
+
+    for (i = 0; i < 16; i++) {
+        int len = midi->SFmacrolen[i] < 16 ? midi->SFmacrolen[i] : 16;
+        hash = hash_int(hash, midi->SFmacrolen[i]);
+        hash = hash_bytes(hash, midi->SFmacro[i], len);
+        hash = hash_int(hash, midi->SFmacroz[i]);
+    }
+    for (i = 0; i < 128; i++) {
+        int len = midi->Zmacrolen[i] < 16 ? midi->Zmacrolen[i] : 16;
+        hash = hash_int(hash, midi->Zmacrolen[i]);
+        hash = hash_bytes(hash, midi->Zmacro[i], len);
+    }
+    return hash;
+}
+
+int dumb_it_sd_get_hash(DUMB_IT_SIGDATA *sd, unsigned char *hash) {
+    unsigned LONG_LONG h = FNV_OFFSET_BASIS;
+    int i;
+
+    /* Hash the module as it will be played, so that the hash is the same
+     * before and after the runthrough.
+     */
+    if (!sd || !hash || _dumb_it_process_sigdata(sd) < 0)
+        return -1;
+
+    h = hash_string(h, sd->name, sizeof(sd->name));
+    h = hash_int(h, sd->n_orders);
+    h = hash_int(h, sd->n_instruments);
+    h = hash_int(h, sd->n_samples);
+    h = hash_int(h, sd->n_patterns);
+    h = hash_int(h, sd->flags & ~(IT_WAS_PROCESSED | IT_WAS_FROZEN));
+    h = hash_int(h, sd->global_volume);
+    h = hash_int(h, sd->mixing_volume);
+    h = hash_int(h, sd->speed);
+    h = hash_int(h, sd->tempo);
+    h = hash_int(h, sd->pan_separation);
+    h = hash_bytes(h, sd->channel_pan, sizeof(sd->channel_pan));
+    h = hash_bytes(h, sd->channel_volume, sizeof(sd->channel_volume));
+    if (sd->order)
+        h = hash_bytes(h, sd->order, sd->n_orders);
+    h = hash_int(h, sd->restart_position);
+
+    if (sd->instrument)
+        for (i = 0; i < sd->n_instruments; i++)
+            h = hash_instrument(h, &sd->instrument[i]);
+    if (sd->sample)
+        for (i = 0; i < sd->n_samples; i++)
+            h = hash_sample(h, &sd->sample[i]);
+    if (sd->pattern)
+        for (i = 0; i < sd->n_patterns; i++)
+            h = hash_pattern(h, &sd->pattern[i]);
+
+    h = hash_int(h, sd->midi != NULL);
+    if (sd->midi)
+        h = hash_midi(h, sd->midi);
+
+    for (i = 0; i < 8; i++)
+        hash[i] = (unsigned char)(h >> (i * 8));
+
+    return 0;
+}
+
+typedef struct IT_CACHE_WRITER {
+    unsigned char *data;
+    long size;
+    long allocated;
+    int error;
+} IT_CACHE_WRITER;
+
+typedef struct IT_CACHE_READER {
+    const unsigned char *data;
+    long size;
+    long pos;
+    int error;
+} IT_CACHE_READER;
+
+static void write_bytes(IT_CACHE_WRITER *w, const void *data, long size) {
+    if (w->error)
+        return;
+
+    if (size > w->allocated - w->size) {
+        long allocated = w->allocated ? w->allocated : 65536;
+        unsigned char *p;
+        while (size > allocated - w->size)
+            allocated *= 2;
+        p = (unsigned char *)realloc(w->data, allocated);
+        if (!p) {
+            w->error = 1;
+            return;
+        }
+        w->data = p;
+        w->allocated = allocated;
+    }
+
+    memcpy(w->data + w->size, data, size);
+    w->size += size;
+}
+
+static void write_long(IT_CACHE_WRITER *w, long value) {
+    write_bytes(w, &value, sizeof(value));
+}
+
+/* For counts which are only known once the things counted are written. */
+static void patch_long(IT_CACHE_WRITER *w, long pos, long value) {
+    if (!w->error)
+        memcpy(w->data + pos, &value, sizeof(value));
+}
+
+static int read_bytes(IT_CACHE_READER *r, void *data, long size) {
+    if (r->error || size > r->size - r->pos) {
+        r->error = 1;
+        memset(data, 0, size);
+        return -1;
+    }
+    memcpy(data, r->data + r->pos, size);
+    r->pos += size;
+    return 0;
+}
+
+static long read_long(IT_CACHE_READER *r) {
+    long value;
+    read_bytes(r, &value, sizeof(value));
+    return value;
+}
+
+/* The state a checkpoint keeps, field by field, as save_snapshot(),
+ * dup_channel() and dup_playing() copy it. Pointers are left out and stored
+ * as indices instead. The names and sizes go into the header, so a build
+ * which keeps different state, or keeps it in different types, turns the
+ * data away.
+ */
+typedef struct IT_CACHE_FIELD {
+    const char *name;
+    size_t offset;
+    size_t size;
+} IT_CACHE_FIELD;
+
+#define CACHE_FIELD(type, field)                                               \
+    { #field, offsetof(type, field), sizeof(((type *)0)->field) }
+#define SNAPSHOT_FIELD(field) CACHE_FIELD(IT_SNAPSHOT, field)
+#define CHANNEL_FIELD(field) CACHE_FIELD(IT_CHANNEL, field)
+#define VOICE_FIELD(field) CACHE_FIELD(IT_PLAYING, field)
+
+static const IT_CACHE_FIELD snapshot_fields[] = {
+    SNAPSHOT_FIELD(ramp_style),
+    SNAPSHOT_FIELD(globalvolume),
+    SNAPSHOT_FIELD(globalvolslide),
+    SNAPSHOT_FIELD(tempo),
+    SNAPSHOT_FIELD(temposlide),
+    SNAPSHOT_FIELD(tick),
+    SNAPSHOT_FIELD(speed),
+    SNAPSHOT_FIELD(rowcount),
+    SNAPSHOT_FIELD(order),
+    SNAPSHOT_FIELD(row),
+    SNAPSHOT_FIELD(processorder),
+    SNAPSHOT_FIELD(processrow),
+    SNAPSHOT_FIELD(breakrow),
+    SNAPSHOT_FIELD(restart_position),
+    SNAPSHOT_FIELD(n_rows),
+    SNAPSHOT_FIELD(time_left),
+    SNAPSHOT_FIELD(sub_time_left),
+#ifdef BIT_ARRAY_BULLSHIT
+    SNAPSHOT_FIELD(looped),
+    SNAPSHOT_FIELD(time_played),
+#endif
+    SNAPSHOT_FIELD(gvz_time),
+    SNAPSHOT_FIELD(gvz_sub_time),
+};
+
+static const IT_CACHE_FIELD channel_fields[] = {
+    CHANNEL_FIELD(flags),
+    CHANNEL_FIELD(volume),
+    CHANNEL_FIELD(volslide),
+    CHANNEL_FIELD(xm_volslide),
+    CHANNEL_FIELD(panslide),
+    CHANNEL_FIELD(pan),
+    CHANNEL_FIELD(truepan),
+    CHANNEL_FIELD(channelvolume),
+    CHANNEL_FIELD(channelvolslide),
+    CHANNEL_FIELD(instrument),
+    CHANNEL_FIELD(note),
+    CHANNEL_FIELD(SFmacro),
+    CHANNEL_FIELD(filter_cutoff),
+    CHANNEL_FIELD(filter_resonance),
+    CHANNEL_FIELD(key_off_count),
+    CHANNEL_FIELD(note_cut_count),
+    CHANNEL_FIELD(note_delay_count),
+    CHANNEL_FIELD(new_note_action),
+    CHANNEL_FIELD(arpeggio_offsets),
+    CHANNEL_FIELD(retrig),
+    CHANNEL_FIELD(xm_retrig),
+    CHANNEL_FIELD(retrig_tick),
+    CHANNEL_FIELD(tremor_time),
+    CHANNEL_FIELD(vibrato_waveform),
+    CHANNEL_FIELD(tremolo_waveform),
+    CHANNEL_FIELD(panbrello_waveform),
+    CHANNEL_FIELD(portamento),
+    CHANNEL_FIELD(toneporta),
+    CHANNEL_FIELD(toneslide),
+    CHANNEL_FIELD(toneslide_tick),
+    CHANNEL_FIELD(last_toneslide_tick),
+    CHANNEL_FIELD(ptm_toneslide),
+    CHANNEL_FIELD(ptm_last_toneslide),
+    CHANNEL_FIELD(okt_toneslide),
+    CHANNEL_FIELD(destnote),
+    CHANNEL_FIELD(glissando),
+    CHANNEL_FIELD(sample),
+    CHANNEL_FIELD(truenote),
+    CHANNEL_FIELD(midi_state),
+    CHANNEL_FIELD(lastvolslide),
+    CHANNEL_FIELD(lastDKL),
+    CHANNEL_FIELD(lastEF),
+    CHANNEL_FIELD(lastG),
+    CHANNEL_FIELD(lastHspeed),
+    CHANNEL_FIELD(lastHdepth),
+    CHANNEL_FIELD(lastRspeed),
+    CHANNEL_FIELD(lastRdepth),
+    CHANNEL_FIELD(lastYspeed),
+    CHANNEL_FIELD(lastYdepth),
+    CHANNEL_FIELD(lastI),
+    CHANNEL_FIELD(lastJ),
+    CHANNEL_FIELD(lastN),
+    CHANNEL_FIELD(lastO),
+    CHANNEL_FIELD(high_offset),
+    CHANNEL_FIELD(lastP),
+    CHANNEL_FIELD(lastQ),
+    CHANNEL_FIELD(lastS),
+    CHANNEL_FIELD(pat_loop_row),
+    CHANNEL_FIELD(pat_loop_count),
+    CHANNEL_FIELD(pat_loop_end_row),
+    CHANNEL_FIELD(lastW),
+    CHANNEL_FIELD(xm_lastE1),
+    CHANNEL_FIELD(xm_lastE2),
+    CHANNEL_FIELD(xm_lastEA),
+    CHANNEL_FIELD(xm_lastEB),
+    CHANNEL_FIELD(xm_lastX1),
+    CHANNEL_FIELD(xm_lastX2),
+    CHANNEL_FIELD(inv_loop_delay),
+    CHANNEL_FIELD(inv_loop_speed),
+    CHANNEL_FIELD(inv_loop_offset),
+#ifdef BIT_ARRAY_BULLSHIT
+    CHANNEL_FIELD(played_patjump_order),
+#endif
+};
+
+static const IT_CACHE_FIELD voice_fields[] = {
+    VOICE_FIELD(flags),
+    VOICE_FIELD(resampling_quality),
+    VOICE_FIELD(sampnum),
+    VOICE_FIELD(instnum),
+    VOICE_FIELD(declick_stage),
+    VOICE_FIELD(float_volume),
+    VOICE_FIELD(ramp_volume),
+    VOICE_FIELD(ramp_delta),
+    VOICE_FIELD(mix_volume),
+    VOICE_FIELD(channel_volume),
+    VOICE_FIELD(volume),
+    VOICE_FIELD(pan),
+    VOICE_FIELD(volume_offset),
+    VOICE_FIELD(panning_offset),
+    VOICE_FIELD(note),
+    VOICE_FIELD(enabled_envelopes),
+    VOICE_FIELD(filter_cutoff),
+    VOICE_FIELD(filter_resonance),
+    VOICE_FIELD(true_filter_cutoff),
+    VOICE_FIELD(true_filter_resonance),
+    VOICE_FIELD(vibrato_speed),
+    VOICE_FIELD(vibrato_depth),
+    VOICE_FIELD(vibrato_n),
+    VOICE_FIELD(vibrato_time),
+    VOICE_FIELD(vibrato_waveform),
+    VOICE_FIELD(tremolo_speed),
+    VOICE_FIELD(tremolo_depth),
+    VOICE_FIELD(tremolo_time),
+    VOICE_FIELD(tremolo_waveform),
+    VOICE_FIELD(panbrello_speed),
+    VOICE_FIELD(panbrello_depth),
+    VOICE_FIELD(panbrello_time),
+    VOICE_FIELD(panbrello_waveform),
+    VOICE_FIELD(panbrello_random),
+    VOICE_FIELD(sample_vibrato_time),
+    VOICE_FIELD(sample_vibrato_waveform),
+    VOICE_FIELD(sample_vibrato_depth),
+    VOICE_FIELD(slide),
+    VOICE_FIELD(delta),
+    VOICE_FIELD(finetune),
+    VOICE_FIELD(pitch_factor),
+    VOICE_FIELD(filter_envelope),
+    VOICE_FIELD(volume_envelope.next_node),
+    VOICE_FIELD(volume_envelope.tick),
+    VOICE_FIELD(volume_envelope.value),
+    VOICE_FIELD(pan_envelope.next_node),
+    VOICE_FIELD(pan_envelope.tick),
+    VOICE_FIELD(pan_envelope.value),
+    VOICE_FIELD(pitch_envelope.next_node),
+    VOICE_FIELD(pitch_envelope.tick),
+    VOICE_FIELD(pitch_envelope.value),
+    VOICE_FIELD(fadeoutcount),
+    VOICE_FIELD(filter_state[0].currsample),
+    VOICE_FIELD(filter_state[0].prevsample),
+    VOICE_FIELD(filter_state[1].currsample),
+    VOICE_FIELD(filter_state[1].prevsample),
+    VOICE_FIELD(resampler.pos),
+    VOICE_FIELD(resampler.subpos),
+    VOICE_FIELD(resampler.start),
+    VOICE_FIELD(resampler.end),
+    VOICE_FIELD(resampler.dir),
+    VOICE_FIELD(resampler.quality),
+    VOICE_FIELD(resampler.x),
+    VOICE_FIELD(resampler.overshot),
+    VOICE_FIELD(resampler.fir_resampler_ratio),
+    VOICE_FIELD(time_lost),
+};
+
+#define N_FIELDS(fields) ((int)(sizeof(fields) / sizeof(*(fields))))
+
+static long fields_size(const IT_CACHE_FIELD *field, int n_fields) {
+    long size = 0;
+    while (n_fields--)
+        size += (long)(field++)->size;
+    return size;
+}
+
+/* Copies the fields out of src, returning where they end in dst. */
+static unsigned char *pack_fields(unsigned char *dst, const void *src,
+                                  const IT_CACHE_FIELD *field, int n_fields) {
+    for (; n_fields--; field++) {
+        memcpy(dst, (const unsigned char *)src + field->offset, field->size);
+        dst += field->size;
+    }
+    return dst;
+}
+
+static const unsigned char *unpack_fields(void *dst, const unsigned char *src,
+                                          const IT_CACHE_FIELD *field,
+                                          int n_fields) {
+    for (; n_fields--; field++) {
+        memcpy((unsigned char *)dst + field->offset, src, field->size);
+        src += field->size;
+    }
+    return src;
+}
+
+static unsigned LONG_LONG hash_fields(unsigned LONG_LONG hash,
+                                      const IT_CACHE_FIELD *field,
+                                      int n_fields) {
+    hash = hash_int(hash, n_fields);
+    for (; n_fields--; field++) {
+        hash = hash_string(hash, (const unsigned char *)field->name,
+                           strlen(field->name));
+        hash = hash_int(hash, (LONG_LONG)field->size);
+    }
+    return hash;
+}
+
+static void write_header(IT_CACHE_WRITER *w) {
+    unsigned LONG_LONG layout = FNV_OFFSET_BASIS;
+
+    layout = hash_fields(layout, snapshot_fields, N_FIELDS(snapshot_fields));
+    layout = hash_fields(layout, channel_fields, N_FIELDS(channel_fields));
+    layout = hash_fields(layout, voice_fields, N_FIELDS(voice_fields));
+    layout = hash_int(layout, DUMB_IT_N_CHANNELS);
+    layout = hash_int(layout, DUMB_IT_N_NNA_CHANNELS);
+    layout = hash_int(layout, IT_N_PICKUPS);
+    layout = hash_int(layout, IT_N_ARPEGGIO_TABLES);
+
+    write_bytes(w, it_cache_magic, sizeof(it_cache_magic));
+    write_long(w, IT_CACHE_VERSION);
+    write_long(w, 0x01020304); /* Byte order */
+    write_long(w, sizeof(long));
+    write_bytes(w, &layout, sizeof(layout));
+}
+
+/* Pattern entries are stored as a pattern number and an offset into it,
+ * which may be one past the last entry.
+ */
+static void write_entry(IT_CACHE_WRITER *w, DUMB_IT_SIGDATA *sigdata,
+                        IT_ENTRY *entry) {
+    int n;
+
+    if (entry) {
+        for (n = 0; n < sigdata->n_patterns; n++) {
+            IT_PATTERN *pattern = &sigdata->pattern[n];
+            if (pattern->entry && entry >= pattern->entry &&
+                entry <= pattern->entry + pattern->n_entries) {
+                write_long(w, n);
+                write_long(w, (long)(entry - pattern->entry));
+                return;
+            }
+        }
+        w->error = 1;
+        return;
+    }
+
+    write_long(w, -1);
+    write_long(w, 0);
+}
+
+static IT_ENTRY *read_entry(IT_CACHE_READER *r, DUMB_IT_SIGDATA *sigdata) {
+    long n = read_long(r);
+    long offset = read_long(r);
+    IT_PATTERN *pattern;
+
+    if (n < 0)
+        return NULL;
+
+    if (n >= sigdata->n_patterns) {
+        r->error = 1;
+        return NULL;
+    }
+
+    pattern = &sigdata->pattern[n];
+    if (!pattern->entry || offset < 0 || offset > pattern->n_entries) {
+        r->error = 1;
+        return NULL;
+    }
+
+    return pattern->entry + offset;
+}
+
+static void *voice_src(IT_SAMPLE *sample) {
+    return sample->fir_data ? (void *)sample->fir_data : sample->data;
+}
+
+static void write_voice(IT_CACHE_WRITER *w, DUMB_IT_SIGDATA *sigdata,
+                        IT_SNAPSHOT *snapshot, IT_PLAYING *playing) {
+    unsigned char fields[sizeof(IT_PLAYING)];
+    long channel, sample, instrument = -1, env_instrument = -1;
+    int pickup;
+
+    write_long(w, playing != NULL);
+    if (!playing)
+        return;
+
+    channel = (long)(playing->channel - snapshot->channel);
+    sample = playing->sample ? (long)(playing->sample - sigdata->sample) : -1;
+    if (playing->instrument)
+        instrument = (long)(playing->instrument - sigdata->instrument);
+    if (playing->env_instrument)
+        env_instrument = (long)(playing->env_instrument - sigdata->instrument);
+    for (pickup = 0; pickup < IT_N_PICKUPS; pickup++)
+        if (_dumb_it_pickups[pickup] == playing->resampler.pickup)
+            break;
+
+    if (channel < 0 || channel >= DUMB_IT_N_CHANNELS || sample < 0 ||
+        sample >= sigdata->n_samples || instrument < -1 ||
+        instrument >= sigdata->n_instruments || env_instrument < -1 ||
+        env_instrument >= sigdata->n_instruments || pickup == IT_N_PICKUPS ||
+        playing->resampler.pickup_data != playing ||
+        playing->resampler.src != voice_src(playing->sample)) {
+        w->error = 1;
+        return;
+    }
+
+    pack_fields(fields, playing, voice_fields, N_FIELDS(voice_fields));
+    write_bytes(w, fields, fields_size(voice_fields, N_FIELDS(voice_fields)));
+    write_long(w, channel);
+    write_long(w, sample);
+    write_long(w, instrument);
+    write_long(w, env_instrument);
+    write_long(w, pickup);
+}
+
+/* next_node may be one past the last of an IT_ENVELOPE's 25 nodes. Voices
+ * only follow the envelopes their instrument has switched on.
+ */
+static int envelope_is_valid(IT_ENVELOPE *envelope, IT_PLAYING_ENVELOPE *pe) {
+    return !(envelope->flags & IT_ENVELOPE_ON) ||
+           (pe->next_node >= 0 && pe->next_node <= 25);
+}
+
+/* Checks the fields of a restored voice which say where to read sample data
+ * from, or which index into the module.
+ */
+static int voice_is_valid(IT_PLAYING *playing, long sampnum) {
+    DUMB_RESAMPLER *resampler = &playing->resampler;
+    IT_SAMPLE *sample = playing->sample;
+    IT_INSTRUMENT *instrument = playing->env_instrument;
+    long length = MAX(sample->length, sample->fir_loop_end);
+
+    if (!sample->data || playing->sampnum != sampnum + 1)
+        return 0;
+
+    /* Envelopes are only started, and so only used, with an instrument. */
+    if (instrument &&
+        (!envelope_is_valid(&instrument->volume_envelope,
+                            &playing->volume_envelope) ||
+         !envelope_is_valid(&instrument->pan_envelope,
+                            &playing->pan_envelope) ||
+         !envelope_is_valid(&instrument->pitch_envelope,
+                            &playing->pitch_envelope)))
+        return 0;
+
+    if (resampler->quality < 0 || resampler->quality >= DUMB_RQ_N_LEVELS ||
+        resampler->dir < -1 || resampler->dir > 1 || resampler->subpos < 0 ||
+        resampler->subpos > 0xFFFF || resampler->start < 0 ||
+        resampler->start > resampler->end || resampler->end > length)
+        return 0;
+
+    if (resampler->dir && (resampler->pos < 0 || resampler->pos > length))
+        return 0;
+
+    return 1;
+}
+
+/* The resampling quality is a setting of the process loading the voice, not
+ * of the one which saved it. This is what it_playing_reset_resamplers() would
+ * have done with it.
+ */
+static void set_voice_quality(IT_PLAYING *playing, int quality) {
+    playing->resampling_quality = quality;
+    if (playing->sample->max_resampling_quality >= 0 &&
+        quality > playing->sample->max_resampling_quality)
+        quality = playing->sample->max_resampling_quality;
+    playing->resampler.quality = MID(0, quality, DUMB_RQ_N_LEVELS - 1);
+}
+
+/* Voices come back as they are in checkpoints, without FIR resamplers. */
+static IT_PLAYING *read_voice(IT_CACHE_READER *r, DUMB_IT_SIGDATA *sigdata,
+                              IT_SNAPSHOT *snapshot) {
+    unsigned char fields[sizeof(IT_PLAYING)];
+    IT_PLAYING *playing;
+    long channel, sample, instrument, env_instrument, pickup;
+
+    if (!read_long(r) || r->error)
+        return NULL;
+
+    playing = (IT_PLAYING *)calloc(1, sizeof(*playing));
+    if (!playing) {
+        r->error = 1;
+        return NULL;
+    }
+
+    read_bytes(r, fields, fields_size(voice_fields, N_FIELDS(voice_fields)));
+    unpack_fields(playing, fields, voice_fields, N_FIELDS(voice_fields));
+    channel = read_long(r);
+    sample = read_long(r);
+    instrument = read_long(r);
+    env_instrument = read_long(r);
+    pickup = read_long(r);
+
+    if (r->error || channel < 0 || channel >= DUMB_IT_N_CHANNELS ||
+        sample < 0 || sample >= sigdata->n_samples || instrument < -1 ||
+        instrument >= sigdata->n_instruments || env_instrument < -1 ||
+        env_instrument >= sigdata->n_instruments || pickup < 0 ||
+        pickup >= IT_N_PICKUPS) {
+        r->error = 1;
+        free(playing);
+        return NULL;
+    }
+
+    playing->channel = &snapshot->channel[channel];
+    playing->sample = &sigdata->sample[sample];
+    playing->instrument =
+        instrument >= 0 ? &sigdata->instrument[instrument] : NULL;
+    playing->env_instrument =
+        env_instrument >= 0 ? &sigdata->instrument[env_instrument] : NULL;
+    playing->resampler.src = voice_src(playing->sample);
+    playing->resampler.pickup = _dumb_it_pickups[pickup];
+    playing->resampler.pickup_data = playing;
+    playing->resampler.fir_resampler = NULL;
+
+    if (!voice_is_valid(playing, sample)) {
+        r->error = 1;
+        free(playing);
+        return NULL;
+    }
+
+    set_voice_quality(playing, dumb_resampling_quality);
+    return playing;
+}
+
+#ifdef BIT_ARRAY_BULLSHIT
+/* Bit arrays are stored as runs of set bits. */
+static void write_bit_array(IT_CACHE_WRITER *w, void *array, size_t size) {
+    size_t bit = 0;
+    long n_runs = 0;
+    long n_runs_pos;
+
+    write_long(w, array != NULL);
+    if (!array)
+        return;
+
+    n_runs_pos = w->size;
+    write_long(w, 0);
+
+    while ((bit = bit_array_find_set(array, bit)) < size) {
+        size_t start = bit;
+        bit = bit_array_find_clear(array, bit);
+        if (bit > size)
+            bit = size;
+        write_long(w, (long)start);
+        write_long(w, (long)(bit - start));
+        n_runs++;
+    }
+
+    patch_long(w, n_runs_pos, n_runs);
+}
+
+static void *read_bit_array(IT_CACHE_READER *r, size_t size) {
+    void *array;
+    long n_runs;
+
+    if (!read_long(r) || r->error)
+        return NULL;
+
+    array = bit_array_create(size);
+    if (!array) {
+        r->error = 1;
+        return NULL;
+    }
+
+    n_runs = read_long(r);
+    while (n_runs-- > 0 && !r->error) {
+        long start = read_long(r);
+        long count = read_long(r);
+        if (start < 0 || count < 0 || (size_t)start > size ||
+            (size_t)count > size - start) {
+            r->error = 1;
+            break;
+        }
+        bit_array_set_range(array, start, count);
+    }
+
+    return array;
+}
+
+/* Each checkpoint's row times are stored as the rows which differ from the
+ * previous checkpoint's, since only the last few rows played ever do.
+ */
+static void write_row(IT_CACHE_WRITER *w, size_t index, unsigned int count,
+                      unsigned int restart_count, LONG_LONG first_time) {
+    write_long(w, (long)index);
+    write_bytes(w, &count, sizeof(count));
+    write_bytes(w, &restart_count, sizeof(restart_count));
+    write_bytes(w, &first_time, sizeof(first_time));
+}
+
+static void write_timekeeper(IT_CACHE_WRITER *w, void *array, void *prev,
+                             size_t size) {
+    size_t index, next_index, prev_index = size;
+    unsigned int count, restart_count, prev_count, prev_restart_count;
+    LONG_LONG first_time, prev_first_time;
+    long n_rows = 0;
+    long n_rows_pos;
+
+    write_long(w, array != NULL);
+    if (!array)
+        return;
+
+    n_rows_pos = w->size;
+    write_long(w, 0);
+
+    index = timekeeping_array_get_row(array, 0, &count, &restart_count,
+                                      &first_time);
+    if (prev)
+        prev_index = timekeeping_array_get_row(
+            prev, 0, &prev_count, &prev_restart_count, &prev_first_time);
+
+    while (index < size || prev_index < size) {
+        if (index < prev_index) {
+            write_row(w, index, count, restart_count, first_time);
+            n_rows++;
+        } else if (prev_index < index) {
+            write_row(w, prev_index, 0, 0, 0);
+            n_rows++;
+        } else if (count != prev_count ||
+                   restart_count != prev_restart_count ||
+                   first_time != prev_first_time) {
+            write_row(w, index, count, restart_count, first_time);
+            n_rows++;
+        }
+
+        /* Step whichever side was just consumed, or both if they matched. */
+        next_index = index;
+        if (index <= prev_index)
+            next_index = timekeeping_array_get_row(
+                array, index + 1, &count, &restart_count, &first_time);
+        if (prev_index <= index)
+            prev_index = timekeeping_array_get_row(prev, prev_index + 1,
+                                                   &prev_count,
+                                                   &prev_restart_count,
+                                                   &prev_first_time);
+        index = next_index;
+    }
+
+    patch_long(w, n_rows_pos, n_rows);
+}
+
+static void *read_timekeeper(IT_CACHE_READER *r, void *prev, size_t size) {
+    void *array;
+    long n_rows;
+
+    if (!read_long(r) || r->error)
+        return NULL;
+
+    array = prev ? timekeeping_array_dup(prev) : timekeeping_array_create(size);
+    if (!array) {
+        r->error = 1;
+        return NULL;
+    }
+
+    n_rows = read_long(r);
+    while (n_rows-- > 0 && !r->error) {
+        long index = read_long(r);
+        unsigned int count, restart_count;
+        LONG_LONG first_time;
+        read_bytes(r, &count, sizeof(count));
+        read_bytes(r, &restart_count, sizeof(restart_count));
+        read_bytes(r, &first_time, sizeof(first_time));
+        if (index < 0 || (size_t)index >= size) {
+            r->error = 1;
+            break;
+        }
+        timekeeping_array_set_row(array, index, count, restart_count,
+                                  first_time);
+    }
+
+    return array;
+}
+#endif
+
+/* Checks the restored song position and the channels' sample, instrument
+ * and effect numbers, since the renderer indexes arrays with them.
+ */
+static int snapshot_is_valid(DUMB_IT_SIGDATA *sigdata, IT_SNAPSHOT *snapshot) {
+    int i, max_rows = 0;
+
+    for (i = 0; i < sigdata->n_patterns; i++)
+        max_rows = MAX(max_rows, sigdata->pattern[i].n_rows);
+
+    /* order and row are both -1 once the song has been terminated. */
+    if (snapshot->order < -1 || snapshot->order >= sigdata->n_orders ||
+        snapshot->row < -1 || snapshot->row > 0xFFFF ||
+        snapshot->processorder < -1 || snapshot->processorder > 0xFFFF ||
+        snapshot->processrow < 0 || snapshot->processrow > 0xFFFE ||
+        snapshot->breakrow < 0 || snapshot->breakrow > 0xFFFE ||
+        snapshot->restart_position < 0 ||
+        snapshot->restart_position > 0xFFFF || snapshot->n_rows < 0 ||
+        snapshot->n_rows > max_rows)
+        return 0;
+
+    for (i = 0; i < DUMB_IT_N_CHANNELS; i++) {
+        IT_CHANNEL *channel = &snapshot->channel[i];
+        if (channel->sample > sigdata->n_samples || channel->SFmacro >= 16 ||
+            channel->inv_loop_speed >= 16 || channel->inv_loop_offset < 0)
+            return 0;
+        if (channel->sample && (sigdata->flags & IT_USE_INSTRUMENTS) &&
+            (channel->instrument < 1 ||
+             channel->instrument > sigdata->n_instruments))
+            return 0;
+    }
+
+    return 1;
+}
+
+/* The renderer walks from entry to entry_end, which must both be in the
+ * pattern starting at entry_start.
+ */
+static int entries_are_valid(DUMB_IT_SIGDATA *sigdata, IT_SNAPSHOT *snapshot) {
+    int n;
+
+    if (!snapshot->entry_start)
+        return !snapshot->entry && !snapshot->entry_end;
+
+    for (n = 0; n < sigdata->n_patterns; n++) {
+        IT_PATTERN *pattern = &sigdata->pattern[n];
+        if (pattern->entry == snapshot->entry_start)
+            return snapshot->entry_end ==
+                       pattern->entry + pattern->n_entries &&
+                   snapshot->entry >= snapshot->entry_start &&
+                   snapshot->entry <= snapshot->entry_end;
+    }
+
+    return 0;
+}
+
+/* Blocks are stored as the runs of bytes which differ from base, so that
+ * the state which carries over from one checkpoint to the next costs
+ * nothing. Short matching gaps are kept in the runs they split.
+ */
+static void write_delta(IT_CACHE_WRITER *w, const unsigned char *data,
+                        const unsigned char *base, long size) {
+    long pos = 0, start, end, gap;
+    long n_runs = 0;
+    long n_runs_pos = w->size;
+
+    write_long(w, 0);
+
+    for (;;) {
+        while (pos < size && data[pos] == base[pos])
+            pos++;
+        if (pos == size)
+            break;
+
+        start = pos;
+        end = pos;
+        while (pos < size) {
+            if (data[pos] != base[pos]) {
+                end = ++pos;
+                continue;
+            }
+            for (gap = 0; pos + gap < size && gap < 2 * (long)sizeof(long);
+                 gap++)
+                if (data[pos + gap] != base[pos + gap])
+                    break;
+            if (pos + gap == size || gap == 2 * (long)sizeof(long))
+                break;
+            pos += gap;
+        }
+
+        write_long(w, start);
+        write_long(w, end - start);
+        write_bytes(w, data + start, end - start);
+        n_runs++;
+        pos = end;
+    }
+
+    patch_long(w, n_runs_pos, n_runs);
+}
+
+static void read_delta(IT_CACHE_READER *r, unsigned char *data, long size) {
+    long n_runs = read_long(r);
+    long pos = 0;
+
+    while (n_runs-- > 0 && !r->error) {
+        long start = read_long(r);
+        long length = read_long(r);
+        if (start < pos || length <= 0 || length > size - start) {
+            r->error = 1;
+            return;
+        }
+        read_bytes(r, data + start, length);
+        pos = start + length;
+    }
+}
+
+#define SNAPSHOT_FIELDS_SIZE                                                   \
+    (fields_size(snapshot_fields, N_FIELDS(snapshot_fields)) +                 \
+     DUMB_IT_N_CHANNELS *                                                      \
+         fields_size(channel_fields, N_FIELDS(channel_fields)))
+
+/* Packs the snapshot's fields and its channels', or zeros if it is NULL. */
+static void pack_snapshot(unsigned char *dst, IT_SNAPSHOT *snapshot) {
+    int i;
+
+    if (!snapshot) {
+        memset(dst, 0, SNAPSHOT_FIELDS_SIZE);
+        return;
+    }
+
+    dst = pack_fields(dst, snapshot, snapshot_fields,
+                      N_FIELDS(snapshot_fields));
+    for (i = 0; i < DUMB_IT_N_CHANNELS; i++)
+        dst = pack_fields(dst, &snapshot->channel[i], channel_fields,
+                          N_FIELDS(channel_fields));
+}
+
+static void unpack_snapshot(IT_SNAPSHOT *snapshot, const unsigned char *src) {
+    int i;
+
+    src = unpack_fields(snapshot, src, snapshot_fields,
+                        N_FIELDS(snapshot_fields));
+    for (i = 0; i < DUMB_IT_N_CHANNELS; i++)
+        src = unpack_fields(&snapshot->channel[i], src, channel_fields,
+                            N_FIELDS(channel_fields));
+}
+
+/* prev is the previous checkpoint's snapshot, or NULL for the first. */
+static void write_snapshot(IT_CACHE_WRITER *w, DUMB_IT_SIGDATA *sigdata,
+                           IT_SNAPSHOT *snapshot, IT_SNAPSHOT *prev) {
+    long size = SNAPSHOT_FIELDS_SIZE;
+    unsigned char *fields;
+    int i, table;
+
+    fields = (unsigned char *)malloc(2 * size);
+    if (!fields) {
+        w->error = 1;
+        return;
+    }
+    pack_snapshot(fields, snapshot);
+    pack_snapshot(fields + size, prev);
+    write_delta(w, fields, fields + size, size);
+    free(fields);
+
+    write_entry(w, sigdata, snapshot->entry_start);
+    write_entry(w, sigdata, snapshot->entry);
+    write_entry(w, sigdata, snapshot->entry_end);
+
+    for (i = 0; i < DUMB_IT_N_CHANNELS; i++) {
+        IT_CHANNEL *channel = &snapshot->channel[i];
+        for (table = 0; table < IT_N_ARPEGGIO_TABLES; table++)
+            if (_dumb_it_arpeggio_tables[table] == channel->arpeggio_table)
+                break;
+        if (table == IT_N_ARPEGGIO_TABLES)
+            w->error = 1;
+        write_long(w, table);
+        write_entry(w, sigdata, channel->note_delay_entry);
+        write_voice(w, sigdata, snapshot, channel->playing);
+#ifdef BIT_ARRAY_BULLSHIT
+        write_bit_array(w, channel->played_patjump, 256);
+#endif
+    }
+
+    write_long(w, snapshot->n_playing);
+    for (i = 0; i < snapshot->n_playing; i++)
+        write_voice(w, sigdata, snapshot, snapshot->playing[i]);
+
+#ifdef BIT_ARRAY_BULLSHIT
+    write_bit_array(w, snapshot->played, sigdata->n_orders * 256);
+    write_timekeeper(w, snapshot->row_timekeeper,
+                     prev ? prev->row_timekeeper : NULL,
+                     sigdata->n_orders * 256);
+#endif
+}
+
+static IT_SNAPSHOT *read_snapshot(IT_CACHE_READER *r, DUMB_IT_SIGDATA *sigdata,
+                                  IT_SNAPSHOT *prev) {
+    long size = SNAPSHOT_FIELDS_SIZE;
+    IT_SNAPSHOT *snapshot;
+    unsigned char *fields;
+    long n_playing;
+    int i;
+
+    /* Everything left unread is a null pointer or a zero count, so the
+     * snapshot can be destroyed at any point.
+     */
+    snapshot = (IT_SNAPSHOT *)calloc(1, sizeof(*snapshot));
+    fields = (unsigned char *)malloc(size);
+    if (!snapshot || !fields) {
+        free(snapshot);
+        free(fields);
+        r->error = 1;
+        return NULL;
+    }
+
+    pack_snapshot(fields, prev);
+    read_delta(r, fields, size);
+    unpack_snapshot(snapshot, fields);
+    free(fields);
+    if (!r->error && !snapshot_is_valid(sigdata, snapshot))
+        r->error = 1;
+    snapshot->resampling_quality = dumb_resampling_quality;
+
+    snapshot->entry_start = read_entry(r, sigdata);
+    snapshot->entry = read_entry(r, sigdata);
+    snapshot->entry_end = read_entry(r, sigdata);
+    if (!r->error && !entries_are_valid(sigdata, snapshot))
+        r->error = 1;
+
+    for (i = 0; i < DUMB_IT_N_CHANNELS; i++) {
+        IT_CHANNEL *channel = &snapshot->channel[i];
+        long table = read_long(r);
+        if (table < 0 || table >= IT_N_ARPEGGIO_TABLES)
+            r->error = 1;
+        else
+            channel->arpeggio_table = _dumb_it_arpeggio_tables[table];
+        channel->note_delay_entry = read_entry(r, sigdata);
+        channel->playing = read_voice(r, sigdata, snapshot);
+#ifdef BIT_ARRAY_BULLSHIT
+        channel->played_patjump = read_bit_array(r, 256);
+#endif
+    }
+
+    n_playing = read_long(r);
+    if (n_playing < 0 || n_playing > DUMB_IT_N_NNA_CHANNELS)
+        r->error = 1;
+    else if (n_playing && !r->error) {
+        snapshot->playing =
+            (IT_PLAYING **)malloc(n_playing * sizeof(*snapshot->playing));
+        if (!snapshot->playing)
+            r->error = 1;
+    }
+    for (i = 0; i < n_playing && !r->error; i++) {
+        snapshot->playing[i] = read_voice(r, sigdata, snapshot);
+        snapshot->n_playing = i + 1;
+    }
+
+#ifdef BIT_ARRAY_BULLSHIT
+    snapshot->played = read_bit_array(r, sigdata->n_orders * 256);
+    snapshot->row_timekeeper =
+        read_timekeeper(r, prev ? prev->row_timekeeper : NULL,
+                        sigdata->n_orders * 256);
+#endif
+
+    if (r->error) {
+        _dumb_it_destroy_snapshot(snapshot);
+        return NULL;
+    }
+
+    return snapshot;
+}
+
+typedef struct IT_CACHE_SUBSONGS {
+    long *entry; /* Pairs of order and length */
+    long n;
+    long size;
+} IT_CACHE_SUBSONGS;
+
+static int collect_subsong(void *data, int order, long length) {
+    IT_CACHE_SUBSONGS *subsongs = (IT_CACHE_SUBSONGS *)data;
+
+    if (subsongs->n >= subsongs->size) {
+        long new_size = subsongs->size ? subsongs->size * 2 : 16;
+        long *entry = (long *)realloc(subsongs->entry,
+                                      new_size * 2 * sizeof(*entry));
+        if (!entry)
+            return -1;
+        subsongs->entry = entry;
+        subsongs->size = new_size;
+    }
+
+    subsongs->entry[subsongs->n * 2] = order;
+    subsongs->entry[subsongs->n * 2 + 1] = length;
+    subsongs->n++;
+    return 0;
+}
+
+void *dumb_it_save_runthrough(DUH *duh, long *size) {
+    DUMB_IT_SIGDATA *sigdata = duh_get_it_sigdata(duh);
+    IT_CACHE_WRITER w = {NULL, 0, 0, 0};
+    IT_CACHE_SUBSONGS subsongs = {NULL, 0, 0};
+    unsigned char hash[8];
+    LONG_LONG length;
+    unsigned LONG_LONG checksum;
+    long i, n_checkpoints;
+
+    if (!sigdata || !size || dumb_it_sd_get_hash(sigdata, hash) < 0)
+        return NULL;
+
+    /* Finish a runthrough being done a step at a time. */
+    if (sigdata->runthrough &&
+        dumb_it_do_initial_runthrough_step(duh, LONG_MAX) < 0)
+        return NULL;
+
+    if (sigdata->n_orders && sigdata->order &&
+        dumb_it_scan_for_playable_orders(sigdata, &collect_subsong,
+                                         &subsongs) < 0) {
+        free(subsongs.entry);
+        return NULL;
+    }
+
+    write_header(&w);
+    write_bytes(&w, hash, sizeof(hash));
+    length = duh_get_length(duh);
+    write_bytes(&w, &length, sizeof(length));
+
+    write_long(&w, subsongs.n);
+    for (i = 0; i < subsongs.n * 2; i++)
+        write_long(&w, subsongs.entry[i]);
+    free(subsongs.entry);
+
+    n_checkpoints = sigdata->checkpoint ? sigdata->n_checkpoints : 0;
+    write_long(&w, n_checkpoints);
+    for (i = 0; i < n_checkpoints; i++) {
+        write_long(&w, sigdata->checkpoint[i].time);
+        write_snapshot(&w, sigdata, sigdata->checkpoint[i].snapshot,
+                       i ? sigdata->checkpoint[i - 1].snapshot : NULL);
+    }
+
+    write_long(&w, sigdata->row_index != NULL);
+    if (sigdata->row_index) {
+        write_long(&w, sigdata->row_index->n_rows);
+        for (i = 0; i < sigdata->row_index->n_rows; i++)
+            write_long(&w, sigdata->row_index->time[i]);
+    }
+
+    checksum = hash_bytes(FNV_OFFSET_BASIS, w.data, w.size);
+    write_bytes(&w, &checksum, sizeof(checksum));
+
+    if (w.error) {
+        free(w.data);
+        return NULL;
+    }
+
+    *size = w.size;
+    return w.data;
+}
+
+int dumb_it_load_runthrough(DUH *duh, const void *data, long size,
+                            dumb_scan_callback callback, void *callback_data) {
+    DUMB_IT_SIGDATA *sigdata = duh_get_it_sigdata(duh);
+    IT_CACHE_WRITER header = {NULL, 0, 0, 0};
+    IT_CACHE_READER r;
+    IT_CHECKPOINT *checkpoint = NULL;
+    IT_ROW_INDEX *row_index = NULL;
+    unsigned char hash[8], saved_hash[8];
+    LONG_LONG length;
+    unsigned LONG_LONG checksum;
+    long i, n_subsongs, subsongs_pos, n_checkpoints;
+    int mismatch;
+
+    if (!sigdata || (sigdata->flags & IT_WAS_FROZEN) || !data ||
+        size < (long)sizeof(checksum))
+        return -1;
+
+    r.data = (const unsigned char *)data;
+    r.size = size - (long)sizeof(checksum);
+    r.pos = 0;
+    r.error = 0;
+
+    memcpy(&checksum, r.data + r.size, sizeof(checksum));
+    if (hash_bytes(FNV_OFFSET_BASIS, r.data, r.size) != checksum)
+        return -1;
+
+    write_header(&header);
+    mismatch = header.error || header.size > r.size ||
+               memcmp(r.data, header.data, header.size);
+    r.pos = header.size;
+    free(header.data);
+    if (mismatch)
+        return -1;
+
+    if (dumb_it_sd_get_hash(sigdata, hash) < 0)
+        return -1;
+    read_bytes(&r, saved_hash, sizeof(saved_hash));
+    read_bytes(&r, &length, sizeof(length));
+    if (r.error || memcmp(hash, saved_hash, sizeof(hash)))
+        return -1;
+
+    /* The subsongs are only passed on once everything else has been read. */
+    n_subsongs = read_long(&r);
+    subsongs_pos = r.pos;
+    if (r.error || n_subsongs < 0 ||
+        n_subsongs > (r.size - r.pos) / (long)(2 * sizeof(long)))
+        return -1;
+    r.pos += n_subsongs * (long)(2 * sizeof(long));
+
+    /* Every checkpoint takes at least its time and its count of runs. */
+    n_checkpoints = read_long(&r);
+    if (r.error || n_checkpoints < 0 ||
+        n_checkpoints > (r.size - r.pos) / (long)(2 * sizeof(long)))
+        return -1;
+
+    if (n_checkpoints) {
+        checkpoint = (IT_CHECKPOINT *)malloc(n_checkpoints *
+                                             sizeof(*checkpoint));
+        if (!checkpoint)
+            return -1;
+    }
+
+    for (i = 0; i < n_checkpoints; i++) {
+        checkpoint[i].time = read_long(&r);
+        checkpoint[i].snapshot = read_snapshot(
+            &r, sigdata, i ? checkpoint[i - 1].snapshot : NULL);
+        if (!checkpoint[i].snapshot || checkpoint[i].time < 0 ||
+            (i && checkpoint[i].time < checkpoint[i - 1].time)) {
+            _dumb_it_destroy_snapshot(checkpoint[i].snapshot);
+            r.error = 1;
+            break;
+        }
+    }
+
+    if (!r.error && read_long(&r)) {
+        row_index = _dumb_it_create_row_index(sigdata);
+        if (!row_index || read_long(&r) != row_index->n_rows)
+            r.error = 1;
+        else {
+            long j;
+            for (j = 0; j < row_index->n_rows && !r.error; j++) {
+                row_index->time[j] = read_long(&r);
+                if (row_index->time[j] < -1)
+                    r.error = 1;
+            }
+            if (!r.error && _dumb_it_sort_row_index(row_index) < 0)
+                r.error = 1;
+        }
+    }
+
+    if (r.error || r.pos != r.size) {
+        _dumb_it_destroy_row_index(row_index);
+        while (i--)
+            _dumb_it_destroy_snapshot(checkpoint[i].snapshot);
+        free(checkpoint);
+        return -1;
+    }
+
+    _dumb_it_free_checkpoints(sigdata);
+    sigdata->checkpoint = checkpoint;
+    sigdata->n_checkpoints = (int)n_checkpoints;
+    sigdata->row_index = row_index;
+    duh_set_length(duh, length);
+
+    if (callback) {
+        r.pos = subsongs_pos;
+        for (i = 0; i < n_subsongs; i++) {
+            long order = read_long(&r);
+            long subsong_length = read_long(&r);
+            if ((*callback)(callback_data, (int)order, subsong_length) < 0)
+                return -1;
+        }
+    }
+
+    return 0;
+}
@@ -70,7 +70,7 @@ int dumb_it_sd_get_initial_global_volume(DUMB_IT_SIGDATA *sd) {
 }
 
 void dumb_it_sd_set_initial_global_volume(DUMB_IT_SIGDATA *sd, int gv) {
-    if (sd)
+    if (sd && !(sd->flags & IT_WAS_FROZEN))
         sd->global_volume = gv;
 }
 
@@ -79,7 +79,7 @@ int dumb_it_sd_get_mixing_volume(DUMB_IT_SIGDATA *sd) {
 }
 
 void dumb_it_sd_set_mixing_volume(DUMB_IT_SIGDATA *sd, int mv) {
-    if (sd)
+    if (sd && !(sd->flags & IT_WAS_FROZEN))
         sd->mixing_volume = mv;
 }
 
@@ -88,7 +88,7 @@ int dumb_it_sd_get_initial_speed(DUMB_IT_SIGDATA *sd) {
 }
 
 void dumb_it_sd_set_initial_speed(DUMB_IT_SIGDATA *sd, int speed) {
-    if (sd)
+    if (sd && !(sd->flags & IT_WAS_FROZEN))
         sd->speed = speed;
 }
 
@@ -97,7 +97,7 @@ int dumb_it_sd_get_initial_tempo(DUMB_IT_SIGDATA *sd) {
 }
 
 void dumb_it_sd_set_initial_tempo(DUMB_IT_SIGDATA *sd, int tempo) {
-    if (sd)
+    if (sd && !(sd->flags & IT_WAS_FROZEN))
         sd->tempo = tempo;
 }
 
@@ -109,7 +109,7 @@ int dumb_it_sd_get_initial_channel_volume(DUMB_IT_SIGDATA *sd, int channel) {
 void dumb_it_sd_set_initial_channel_volume(DUMB_IT_SIGDATA *sd, int channel,
                                            int volume) {
     ASSERT(channel >= 0 && channel < DUMB_IT_N_CHANNELS);
-    if (sd)
+    if (sd && !(sd->flags & IT_WAS_FROZEN))
         sd->channel_volume[channel] = volume;
 }
 
@@ -21,6 +21,7 @@
 #include <string.h> //might not be necessary later; required for memset
 
 #include "dumb.h"
+#include "internal/dumbfile.h"
 #include "internal/it.h"
 
 #ifndef min
@@ -35,11 +36,17 @@ typedef unsigned long dword;
 
 typedef struct readblock_crap readblock_crap;
 
+/* Compressed samples are read a block at a time into sourcebuf, which is
+ * kept from one block to the next, and the block's bits are taken from the
+ * bottom of a 64-bit buffer that is topped up a word at a time.
+ */
 struct readblock_crap {
     unsigned char *sourcebuf;
-    unsigned char *sourcepos;
-    unsigned char *sourceend;
-    int rembits;
+    size_t sourcesize;
+    const unsigned char *sourcepos;
+    const unsigned char *sourceend;
+    unsigned LONG_LONG bitbuf;
+    int bitcount;
 };
 
 static int readblock(DUMBFILE *f, readblock_crap *crap) {
@@ -50,47 +57,77 @@ static int readblock(DUMBFILE *f, readblock_crap *crap) {
     if (size < 0)
         return (int)size;
 
-    crap->sourcebuf = malloc(size);
-    if (!crap->sourcebuf)
-        return -1;
+    if (!crap->sourcebuf || (size_t)size > crap->sourcesize) {
+        /* Empty blocks still need somewhere to point. */
+        size_t sourcesize = size ? size : 1;
+        unsigned char *sourcebuf = realloc(crap->sourcebuf, sourcesize);
+        if (!sourcebuf)
+            return -1;
+        crap->sourcebuf = sourcebuf;
+        crap->sourcesize = sourcesize;
+    }
 
     c = (int)dumbfile_getnc((char *)crap->sourcebuf, size, f);
-    if (c < size) {
-        free(crap->sourcebuf);
-        crap->sourcebuf = NULL;
+    if (c < size)
         return -1;
-    }
 
     crap->sourcepos = crap->sourcebuf;
     crap->sourceend = crap->sourcebuf + size;
-    crap->rembits = 8;
+    crap->bitbuf = 0;
+    crap->bitcount = 0;
     return 0;
 }
 
 static void freeblock(readblock_crap *crap) {
     free(crap->sourcebuf);
     crap->sourcebuf = NULL;
+    crap->sourcesize = 0;
 }
 
-static int readbits(int bitwidth, readblock_crap *crap) {
-    int val = 0;
-    int b = 0;
+/* Fills the bit buffer up to at least 57 bits, or with what is left of the
+ * block. A whole word is ORed in at once while there are eight bytes to
+ * spare; any bits of it past the new bitcount are the same ones the next
+ * refill ORs in again, so they do no harm.
+ */
+static void refillbits(readblock_crap *crap) {
+    const unsigned char *p = crap->sourcepos;
+
+    if (crap->sourceend - p >= 8) {
+        unsigned LONG_LONG word =
+            (unsigned LONG_LONG)p[0] | (unsigned LONG_LONG)p[1] << 8 |
+            (unsigned LONG_LONG)p[2] << 16 | (unsigned LONG_LONG)p[3] << 24 |
+            (unsigned LONG_LONG)p[4] << 32 | (unsigned LONG_LONG)p[5] << 40 |
+            (unsigned LONG_LONG)p[6] << 48 | (unsigned LONG_LONG)p[7] << 56;
+        crap->bitbuf |= word << crap->bitcount;
+        crap->sourcepos += (63 - crap->bitcount) >> 3;
+        crap->bitcount |= 56;
+    } else {
+        while (crap->bitcount <= 56 && p < crap->sourceend) {
+            crap->bitbuf |= (unsigned LONG_LONG)*p++ << crap->bitcount;
+            crap->bitcount += 8;
+        }
+        crap->sourcepos = p;
+    }
+}
 
-    if (crap->sourcepos >= crap->sourceend)
-        return val;
+/* Reads the next bitwidth bits, up to 32, lowest first. Bits past the end
+ * of the block read as zero.
+ */
+static inline int readbits(int bitwidth, readblock_crap *crap) {
+    int val;
 
-    while (bitwidth > crap->rembits) {
-        val |= *crap->sourcepos++ << b;
-        if (crap->sourcepos >= crap->sourceend)
-            return val;
-        b += crap->rembits;
-        bitwidth -= crap->rembits;
-        crap->rembits = 8;
-    }
+    if (crap->bitcount < bitwidth)
+        refillbits(crap);
 
-    val |= (*crap->sourcepos & ((1 << bitwidth) - 1)) << b;
-    *crap->sourcepos >>= bitwidth;
-    crap->rembits -= bitwidth;
+    val = (int)(crap->bitbuf & (((unsigned LONG_LONG)1 << bitwidth) - 1));
+
+    if (crap->bitcount < bitwidth) {
+        crap->bitbuf = 0;
+        crap->bitcount = 0;
+    } else {
+        crap->bitbuf >>= bitwidth;
+        crap->bitcount -= bitwidth;
+    }
 
     return val;
 }
@@ -114,8 +151,10 @@ static int decompress8(DUMBFILE *f, signed char *data, int len, int it215,
 
     while (len > 0) {
         // Read a block of compressed data:
-        if (readblock(f, &crap))
+        if (readblock(f, &crap)) {
+            freeblock(&crap);
             return -1;
+        }
         // Set up a few variables
         blocklen =
             (len < 0x8000) ? len : 0x8000; // Max block length is 0x8000 bytes
@@ -124,12 +163,16 @@ static int decompress8(DUMBFILE *f, signed char *data, int len, int it215,
         d1 = d2 = 0;
         // Start the decompression:
         while (blockpos < blocklen) {
+            if (bitwidth > 9) { // Illegal width, abort ?
+                freeblock(&crap);
+                return -1;
+            }
             // Read a value:
             val = (word)readbits(bitwidth, &crap);
             // Check for bit width change:
 
             if (bitwidth < 7) { // Method 1:
-                if (val == (1 << (bitwidth - 1))) {
+                if (bitwidth && val == (1 << (bitwidth - 1))) {
                     val = (word)readbits(3, &crap) + 1;
                     bitwidth = (val < bitwidth) ? val : val + 1;
                     continue;
@@ -137,19 +180,19 @@ static int decompress8(DUMBFILE *f, signed char *data, int len, int it215,
             } else if (bitwidth < 9) { // Method 2
                 byte border = (0xFF >> (9 - bitwidth)) - 4;
 
-                if (val > border && val <= (border + 8)) {
+                /* border < val <= border + 8, as one test that stays
+                 * predictable however the sample values fall.
+                 */
+                if ((unsigned int)(val - border - 1) < 8) {
                     val -= border;
                     bitwidth = (val < bitwidth) ? val : val + 1;
                     continue;
                 }
-            } else if (bitwidth == 9) { // Method 3
+            } else { // Method 3
                 if (val & 0x100) {
                     bitwidth = (val + 1) & 0xFF;
                     continue;
                 }
-            } else { // Illegal width, abort ?
-                freeblock(&crap);
-                return -1;
             }
 
             // Expand the value to signed byte:
@@ -177,8 +220,8 @@ static int decompress8(DUMBFILE *f, signed char *data, int len, int it215,
             len--;
             blockpos++;
         }
-        freeblock(&crap);
     }
+    freeblock(&crap);
     return 0;
 }
 
@@ -198,8 +241,10 @@ static int decompress16(DUMBFILE *f, short *data, int len, int it215,
 
     while (len > 0) {
         // Read a block of compressed data:
-        if (readblock(f, &crap))
+        if (readblock(f, &crap)) {
+            freeblock(&crap);
             return -1;
+        }
         // Set up a few variables
         blocklen =
             (len < 0x4000) ? len : 0x4000; // Max block length is 0x4000 bytes
@@ -208,11 +253,15 @@ static int decompress16(DUMBFILE *f, short *data, int len, int it215,
         d1 = d2 = 0;
         // Start the decompression:
         while (blockpos < blocklen) {
+            if (bitwidth > 17) { // Illegal width, abort ?
+                freeblock(&crap);
+                return -1;
+            }
             val = readbits(bitwidth, &crap);
             // Check for bit width change:
 
             if (bitwidth < 7) { // Method 1:
-                if (val == (1 << (bitwidth - 1))) {
+                if (bitwidth && val == (1 << (bitwidth - 1))) {
                     val = readbits(4, &crap) + 1;
                     bitwidth = (val < bitwidth) ? val : val + 1;
                     continue;
@@ -220,19 +269,17 @@ static int decompress16(DUMBFILE *f, short *data, int len, int it215,
             } else if (bitwidth < 17) { // Method 2
                 word border = (0xFFFF >> (17 - bitwidth)) - 8;
 
-                if (val > border && val <= (border + 16)) {
+                /* border < val <= border + 16, tested as in decompress8(). */
+                if ((unsigned long)(val - border - 1) < 16) {
                     val -= border;
                     bitwidth = val < bitwidth ? val : val + 1;
                     continue;
                 }
-            } else if (bitwidth == 17) { // Method 3
+            } else { // Method 3
                 if (val & 0x10000) {
                     bitwidth = (val + 1) & 0xFF;
                     continue;
                 }
-            } else { // Illegal width, abort ?
-                freeblock(&crap);
-                return -1;
             }
 
             // Expand the value to signed byte:
@@ -260,8 +307,8 @@ static int decompress16(DUMBFILE *f, short *data, int len, int it215,
             len--;
             blockpos++;
         }
-        freeblock(&crap);
     }
+    freeblock(&crap);
     return 0;
 }
 
@@ -636,82 +683,299 @@ long _dumb_it_read_sample_data_adpcm4(IT_SAMPLE *sample, DUMBFILE *f) {
     return 0;
 }
 
-static long it_read_sample_data(IT_SAMPLE *sample, unsigned char convert,
-                                DUMBFILE *f) {
-    long n;
+static int it_host_is_big_endian(void) {
+    const unsigned short one = 1;
+    return *(const unsigned char *)&one == 0;
+}
 
-    long datasize = sample->length;
-    if (sample->flags & IT_SAMPLE_STEREO)
-        datasize <<= 1;
+/* Returns nonzero if data stored in the given IT_PCM_* format need no
+ * conversion.
+ */
+static int it_pcm_is_native(int format) {
+    return !(format & (IT_PCM_UNSIGNED | IT_PCM_DELTA)) &&
+           (!(format & IT_PCM_16BIT) ||
+            !(format & IT_PCM_BIG_ENDIAN) == !it_host_is_big_endian());
+}
 
-    sample->data = malloc(datasize * (sample->flags & IT_SAMPLE_16BIT ? 2 : 1));
-    if (!sample->data)
+/* Converts n stored sample values at data, in the given IT_PCM_* format, to
+ * native signed values in place. Each step is a separate flat loop so that
+ * the compiler can vectorise all but the delta decoding.
+ */
+void _dumb_it_convert_sample_data(void *data, long n, int format) {
+    long i;
+
+    if (format & IT_PCM_16BIT) {
+        unsigned short *ptr = (unsigned short *)data;
+        unsigned short delta = 0;
+
+        if (!(format & IT_PCM_BIG_ENDIAN) != !it_host_is_big_endian())
+            for (i = 0; i < n; i++)
+                ptr[i] = (unsigned short)((ptr[i] >> 8) | (ptr[i] << 8));
+
+        if (format & IT_PCM_DELTA)
+            for (i = 0; i < n; i++)
+                ptr[i] = delta += ptr[i];
+
+        if (format & IT_PCM_UNSIGNED)
+            for (i = 0; i < n; i++)
+                ptr[i] ^= 0x8000;
+    } else {
+        unsigned char *ptr = (unsigned char *)data;
+        unsigned char delta = 0;
+
+        if (format & IT_PCM_DELTA)
+            for (i = 0; i < n; i++)
+                ptr[i] = delta += ptr[i];
+
+        if (format & IT_PCM_UNSIGNED)
+            for (i = 0; i < n; i++)
+                ptr[i] ^= 0x80;
+    }
+}
+
+/* Points the sample at the next size bytes of f instead of copying them, if
+ * f is a mapped file and the data can be used where they are. The sigdata
+ * then holds on to the mapping until it is unloaded. Returns -1, having done
+ * nothing, if the data must be copied after all.
+ */
+int _dumb_it_map_sample_data(DUMB_IT_SIGDATA *sigdata, IT_SAMPLE *sample,
+                             long size, DUMBFILE *f) {
+    const char *data;
+
+    if (size <= 0)
         return -1;
 
-    if (!(sample->flags & IT_SAMPLE_16BIT) && (convert == 0xFF)) {
-        if (_dumb_it_read_sample_data_adpcm4(sample, f) < 0)
-            return -1;
-    } else if (sample->flags & 8) {
-        /* If the sample is packed, then we must unpack it. */
+    data = _dumbfile_peek_mapped(f, size);
+    if (!data || ((sample->flags & IT_SAMPLE_16BIT) && ((size_t)data & 1)))
+        return -1;
 
-        /* Behavior as defined by greasemonkey's munch.py and observed by XMPlay
-         * and OpenMPT */
+    if (!sigdata->mapping)
+        sigdata->mapping = _dumbfile_ref_mapping(f);
 
-        if (sample->flags & IT_SAMPLE_STEREO) {
-            if (sample->flags & IT_SAMPLE_16BIT) {
-                decompress16(f, (short *)sample->data, (int)(datasize >> 1),
-                             convert & 4, 1);
-                decompress16(f, (short *)sample->data + 1, (int)(datasize >> 1),
-                             convert & 4, 1);
-            } else {
-                decompress8(f, (signed char *)sample->data,
-                            (int)(datasize >> 1), convert & 4, 1);
-                decompress8(f, (signed char *)sample->data + 1,
-                            (int)(datasize >> 1), convert & 4, 1);
-            }
-        } else {
-            if (sample->flags & IT_SAMPLE_16BIT)
-                decompress16(f, (short *)sample->data, (int)datasize,
-                             convert & 4, 0);
-            else
-                decompress8(f, (signed char *)sample->data, (int)datasize,
-                            convert & 4, 0);
-        }
-    } else if (sample->flags & IT_SAMPLE_16BIT) {
-        if (sample->flags & IT_SAMPLE_STEREO) {
-            if (convert & 2) {
-                for (n = 0; n < datasize; n += 2)
-                    ((short *)sample->data)[n] = dumbfile_mgetw(f);
-                for (n = 1; n < datasize; n += 2)
-                    ((short *)sample->data)[n] = dumbfile_mgetw(f);
-            } else {
-                for (n = 0; n < datasize; n += 2)
-                    ((short *)sample->data)[n] = dumbfile_igetw(f);
-                for (n = 1; n < datasize; n += 2)
-                    ((short *)sample->data)[n] = dumbfile_igetw(f);
-            }
-        } else {
-            if (convert & 2)
-                for (n = 0; n < datasize; n++)
-                    ((short *)sample->data)[n] = dumbfile_mgetw(f);
-            else
-                for (n = 0; n < datasize; n++)
-                    ((short *)sample->data)[n] = dumbfile_igetw(f);
+    sample->data = (void *)data;
+    return dumbfile_skip(f, size);
+}
+
+dumb_parallel_for dumb_it_load_parallel_for = NULL;
+void *dumb_it_load_pool_data = NULL;
+
+typedef struct IT_SAMPLE_JOB IT_SAMPLE_JOB;
+typedef struct IT_SAMPLE_JOBS IT_SAMPLE_JOBS;
+
+/* A sample whose data have been read but not decoded. Compressed data are
+ * kept at source, in the same form as in the file. Uncompressed stereo data
+ * are kept in buffer, with the channels one after the other, and are
+ * converted from format as they are interleaved into the sample. Otherwise
+ * the sample's own data are converted from format where they are.
+ */
+struct IT_SAMPLE_JOB {
+    int n; /* Index into sigdata->sample, which may move while loading. */
+    int format;
+    unsigned char convert;
+    const char *source;
+    size_t size;
+    char *buffer; /* Freed with the job. */
+    int ret;
+};
+
+struct IT_SAMPLE_JOBS {
+    DUMB_IT_SIGDATA *sigdata;
+    dumb_parallel_for parallel_for;
+    void *pool_data;
+    IT_SAMPLE_JOB *job;
+    int n_jobs;
+    int capacity;
+};
+
+/* Adds a job to decode the sample later. Returns NULL if memory runs out. */
+static IT_SAMPLE_JOB *it_add_sample_job(DUMB_IT_SIGDATA *sigdata,
+                                        IT_SAMPLE *sample) {
+    IT_SAMPLE_JOBS *jobs = sigdata->sample_jobs;
+    IT_SAMPLE_JOB *job;
+
+    if (!jobs) {
+        jobs = malloc(sizeof(*jobs));
+        if (!jobs)
+            return NULL;
+        jobs->sigdata = sigdata;
+        jobs->parallel_for = dumb_it_load_parallel_for;
+        jobs->pool_data = dumb_it_load_pool_data;
+        jobs->job = NULL;
+        jobs->n_jobs = 0;
+        jobs->capacity = 0;
+        sigdata->sample_jobs = jobs;
+    }
+
+    if (jobs->n_jobs == jobs->capacity) {
+        int capacity = jobs->capacity ? jobs->capacity * 2 : 16;
+        job = realloc(jobs->job, capacity * sizeof(*job));
+        if (!job)
+            return NULL;
+        jobs->job = job;
+        jobs->capacity = capacity;
+    }
+
+    job = &jobs->job[jobs->n_jobs++];
+    job->n = (int)(sample - sigdata->sample);
+    job->format = 0;
+    job->convert = 0;
+    job->source = NULL;
+    job->size = 0;
+    job->buffer = NULL;
+    job->ret = 0;
+    return job;
+}
+
+/* Converts both channels of a stereo sample, stored one after the other in
+ * buffer, and interleaves them into the sample's data.
+ */
+static void it_interleave_sample_data(IT_SAMPLE *sample, char *buffer,
+                                      int format) {
+    long i;
+    size_t plane = sample->length * (format & IT_PCM_16BIT ? 2 : 1);
+
+    _dumb_it_convert_sample_data(buffer, sample->length, format);
+    _dumb_it_convert_sample_data(buffer + plane, sample->length, format);
+
+    if (format & IT_PCM_16BIT) {
+        const short *left = (const short *)buffer;
+        const short *right = (const short *)(buffer + plane);
+        short *out = (short *)sample->data;
+        for (i = 0; i < sample->length; i++) {
+            out[i * 2] = left[i];
+            out[i * 2 + 1] = right[i];
         }
     } else {
-        if (sample->flags & IT_SAMPLE_STEREO) {
-            for (n = 0; n < datasize; n += 2)
-                ((signed char *)sample->data)[n] = dumbfile_getc(f);
-            for (n = 1; n < datasize; n += 2)
-                ((signed char *)sample->data)[n] = dumbfile_getc(f);
+        const signed char *left = (const signed char *)buffer;
+        const signed char *right = (const signed char *)(buffer + plane);
+        signed char *out = (signed char *)sample->data;
+        for (i = 0; i < sample->length; i++) {
+            out[i * 2] = left[i];
+            out[i * 2 + 1] = right[i];
+        }
+    }
+}
+
+/* Reads uncompressed data into a newly allocated buffer for the sample, or
+ * maps them if they need no conversion. Each channel is stored whole, one
+ * after the other, and holds stored_length values of which only the first
+ * sample->length are kept. Stereo samples are read into a scratch buffer and
+ * interleaved from there. If dumb_it_load_parallel_for is set, the data are
+ * converted later, by _dumb_it_decode_sample_data().
+ */
+long _dumb_it_read_sample_data_pcm(DUMB_IT_SIGDATA *sigdata,
+                                   IT_SAMPLE *sample, long stored_length,
+                                   int format, DUMBFILE *f) {
+    size_t width, plane;
+    char *buffer;
+    IT_SAMPLE_JOB *job;
+
+    if (sample->flags & IT_SAMPLE_16BIT)
+        format |= IT_PCM_16BIT;
+    width = format & IT_PCM_16BIT ? 2 : 1;
+    plane = sample->length * width;
+
+    if (!(sample->flags & IT_SAMPLE_STEREO)) {
+        if (it_pcm_is_native(format) &&
+            _dumb_it_map_sample_data(sigdata, sample, plane, f) == 0) {
+            if (stored_length > sample->length)
+                dumbfile_skip(f, (stored_length - sample->length) * width);
+            return dumbfile_error(f) ? -1 : 0;
+        }
+
+        sample->data = malloc(plane);
+        if (!sample->data)
+            return -1;
+        if (dumbfile_getnc((char *)sample->data, plane, f) <
+            (dumb_ssize_t)plane)
+            return -1;
+        if (stored_length > sample->length)
+            dumbfile_skip(f, (stored_length - sample->length) * width);
+        if (dumbfile_error(f))
+            return -1;
+
+        if (it_pcm_is_native(format))
+            return 0;
+
+        if (dumb_it_load_parallel_for) {
+            job = it_add_sample_job(sigdata, sample);
+            if (!job)
+                return -1;
+            job->format = format;
         } else
-            for (n = 0; n < datasize; n++)
-                ((signed char *)sample->data)[n] = dumbfile_getc(f);
+            _dumb_it_convert_sample_data(sample->data, sample->length, format);
+        return 0;
     }
 
-    if (dumbfile_error(f))
+    sample->data = malloc(plane * 2);
+    if (!sample->data)
+        return -1;
+
+    buffer = malloc(plane * 2);
+    if (!buffer)
         return -1;
 
+    if (dumbfile_getnc(buffer, plane, f) < (dumb_ssize_t)plane)
+        goto error;
+    if (stored_length > sample->length)
+        dumbfile_skip(f, (stored_length - sample->length) * width);
+    if (dumbfile_getnc(buffer + plane, plane, f) < (dumb_ssize_t)plane)
+        goto error;
+    if (stored_length > sample->length)
+        dumbfile_skip(f, (stored_length - sample->length) * width);
+    if (dumbfile_error(f))
+        goto error;
+
+    if (dumb_it_load_parallel_for) {
+        job = it_add_sample_job(sigdata, sample);
+        if (!job)
+            goto error;
+        job->format = format;
+        job->buffer = buffer;
+        return 0;
+    }
+
+    it_interleave_sample_data(sample, buffer, format);
+    free(buffer);
+    return 0;
+
+error:
+    free(buffer);
+    return -1;
+}
+
+static void it_decompress_sample_data(IT_SAMPLE *sample,
+                                      unsigned char convert, DUMBFILE *f) {
+    long n;
+
+    long datasize = sample->length;
+    if (sample->flags & IT_SAMPLE_STEREO)
+        datasize <<= 1;
+
+    /* Behavior as defined by greasemonkey's munch.py and observed by XMPlay
+     * and OpenMPT */
+
+    if (sample->flags & IT_SAMPLE_STEREO) {
+        if (sample->flags & IT_SAMPLE_16BIT) {
+            decompress16(f, (short *)sample->data, (int)(datasize >> 1),
+                         convert & 4, 1);
+            decompress16(f, (short *)sample->data + 1, (int)(datasize >> 1),
+                         convert & 4, 1);
+        } else {
+            decompress8(f, (signed char *)sample->data, (int)(datasize >> 1),
+                        convert & 4, 1);
+            decompress8(f, (signed char *)sample->data + 1,
+                        (int)(datasize >> 1), convert & 4, 1);
+        }
+    } else {
+        if (sample->flags & IT_SAMPLE_16BIT)
+            decompress16(f, (short *)sample->data, (int)datasize, convert & 4,
+                         0);
+        else
+            decompress8(f, (signed char *)sample->data, (int)datasize,
+                        convert & 4, 0);
+    }
+
     if (!(convert & 1)) {
         /* Convert to signed. */
         if (sample->flags & IT_SAMPLE_16BIT)
@@ -721,6 +985,105 @@ static long it_read_sample_data(IT_SAMPLE *sample, unsigned char convert,
             for (n = 0; n < datasize; n++)
                 ((signed char *)sample->data)[n] ^= 0x80;
     }
+}
+
+/* Reads a compressed sample's blocks as they are, and leaves them to be
+ * decompressed by _dumb_it_decode_sample_data(). Each channel takes one block
+ * per 0x8000 values, or 0x4000 for 16-bit samples, so the blocks can be found
+ * without decompressing them. They are not copied if f is a mapped file.
+ */
+static long it_defer_compressed_sample_data(DUMB_IT_SIGDATA *sigdata,
+                                            IT_SAMPLE *sample,
+                                            unsigned char convert,
+                                            DUMBFILE *f) {
+    IT_SAMPLE_JOB *job;
+    const char *mapped;
+    dumb_off_t start;
+    long n_blocks, block_length, i;
+
+    block_length = sample->flags & IT_SAMPLE_16BIT ? 0x4000 : 0x8000;
+    n_blocks = (sample->length + block_length - 1) / block_length;
+    if (sample->flags & IT_SAMPLE_STEREO)
+        n_blocks *= 2;
+
+    if (!n_blocks)
+        return 0;
+
+    job = it_add_sample_job(sigdata, sample);
+    if (!job)
+        return -1;
+    job->convert = convert;
+
+    mapped = _dumbfile_peek_mapped(f, 0);
+    start = dumbfile_pos(f);
+
+    for (i = 0; i < n_blocks; i++) {
+        long size = dumbfile_igetw(f);
+        char *buffer;
+
+        if (size < 0)
+            return -1;
+
+        if (mapped) {
+            if (dumbfile_skip(f, size))
+                return -1;
+            continue;
+        }
+
+        buffer = realloc(job->buffer, job->size + 2 + size);
+        if (!buffer)
+            return -1;
+        job->buffer = buffer;
+
+        buffer[job->size++] = (char)size;
+        buffer[job->size++] = (char)(size >> 8);
+        if (dumbfile_getnc(buffer + job->size, size, f) < size)
+            return -1;
+        job->size += size;
+    }
+
+    if (mapped) {
+        job->source = mapped;
+        job->size = (size_t)(dumbfile_pos(f) - start);
+    } else
+        job->source = job->buffer;
+
+    return dumbfile_error(f) ? -1 : 0;
+}
+
+static long it_read_sample_data(DUMB_IT_SIGDATA *sigdata, IT_SAMPLE *sample,
+                                unsigned char convert, DUMBFILE *f) {
+    int adpcm = !(sample->flags & IT_SAMPLE_16BIT) && (convert == 0xFF);
+
+    long datasize = sample->length;
+    if (sample->flags & IT_SAMPLE_STEREO)
+        datasize <<= 1;
+
+    if (!adpcm && !(sample->flags & 8)) {
+        /* Uncompressed samples are converted to signed as they are read. */
+        return _dumb_it_read_sample_data_pcm(
+            sigdata, sample, sample->length,
+            (convert & 2 ? IT_PCM_BIG_ENDIAN : 0) |
+                (convert & 1 ? 0 : IT_PCM_UNSIGNED),
+            f);
+    }
+
+    sample->data = malloc(datasize * (sample->flags & IT_SAMPLE_16BIT ? 2 : 1));
+    if (!sample->data)
+        return -1;
+
+    if (adpcm) {
+        if (_dumb_it_read_sample_data_adpcm4(sample, f) < 0)
+            return -1;
+    } else if (dumb_it_load_parallel_for) {
+        return it_defer_compressed_sample_data(sigdata, sample, convert, f);
+    } else {
+        /* If the sample is packed, then we must unpack it. */
+        it_decompress_sample_data(sample, convert, f);
+    }
+
+    if (dumbfile_error(f))
+        return -1;
 
     /* NOT SUPPORTED:
      *
@@ -732,6 +1095,63 @@ static long it_read_sample_data(IT_SAMPLE *sample, unsigned char convert,
     return 0;
 }
 
+static void it_run_sample_job(void *data, int i) {
+    IT_SAMPLE_JOBS *jobs = data;
+    IT_SAMPLE_JOB *job = &jobs->job[i];
+    IT_SAMPLE *sample = &jobs->sigdata->sample[job->n];
+
+    if (job->source) {
+        DUMBFILE *f = dumbfile_open_memory(job->source, job->size);
+        if (!f) {
+            job->ret = -1;
+            return;
+        }
+        it_decompress_sample_data(sample, job->convert, f);
+        if (dumbfile_error(f))
+            job->ret = -1;
+        dumbfile_close(f);
+    } else if (job->buffer)
+        it_interleave_sample_data(sample, job->buffer, job->format);
+    else
+        _dumb_it_convert_sample_data(sample->data, sample->length,
+                                     job->format);
+}
+
+/* Decodes every sample the loader has read and left for later, handing them
+ * to dumb_it_load_parallel_for all at once. Loaders call this once all the
+ * samples have been read. Returns -1 if any of them could not be decoded.
+ */
+int _dumb_it_decode_sample_data(DUMB_IT_SIGDATA *sigdata) {
+    IT_SAMPLE_JOBS *jobs = sigdata->sample_jobs;
+    int i, ret = 0;
+
+    if (!jobs)
+        return 0;
+
+    (*jobs->parallel_for)(jobs->pool_data, jobs->n_jobs, &it_run_sample_job,
+                          jobs);
+
+    for (i = 0; i < jobs->n_jobs; i++)
+        if (jobs->job[i].ret < 0)
+            ret = -1;
+
+    _dumb_it_free_sample_jobs(sigdata);
+    return ret;
+}
+
+void _dumb_it_free_sample_jobs(DUMB_IT_SIGDATA *sigdata) {
+    IT_SAMPLE_JOBS *jobs = sigdata->sample_jobs;
+    int i;
+
+    if (jobs) {
+        for (i = 0; i < jobs->n_jobs; i++)
+            free(jobs->job[i].buffer);
+        free(jobs->job);
+        free(jobs);
+        sigdata->sample_jobs = NULL;
+    }
+}
+
 //#define DETECT_DUPLICATE_CHANNELS
 #ifdef DETECT_DUPLICATE_CHANNELS
 #include <stdio.h>
@@ -1002,6 +1422,11 @@ static sigdata_t *it_load_sigdata(DUMBFILE *f) {
     sigdata->pattern = NULL;
     sigdata->midi = NULL;
     sigdata->checkpoint = NULL;
+    sigdata->row_index = NULL;
+    sigdata->runthrough = NULL;
+    sigdata->mapping = NULL;
+    sigdata->sample_jobs = NULL;
+    sigdata->flags = 0;
 
     dumbfile_getnc((char *)sigdata->name, 26, f);
     sigdata->name[26] = 0;
@@ -1070,8 +1495,10 @@ static sigdata_t *it_load_sigdata(DUMBFILE *f) {
             _dumb_it_unload_sigdata(sigdata);
             return NULL;
         }
-        for (n = 0; n < sigdata->n_samples; n++)
+        for (n = 0; n < sigdata->n_samples; n++) {
             sigdata->sample[n].data = NULL;
+            sigdata->sample[n].fir_data = NULL;
+        }
     }
 
     if (sigdata->n_patterns) {
@@ -1375,7 +1802,7 @@ static sigdata_t *it_load_sigdata(DUMBFILE *f) {
                 return NULL;
             }
 
-            if (it_read_sample_data(&sigdata->sample[component[m].n],
+            if (it_read_sample_data(sigdata, &sigdata->sample[component[m].n],
                                     sample_convert[component[m].n], f)) {
                 free(buffer);
                 free(component);
@@ -1387,6 +1814,13 @@ static sigdata_t *it_load_sigdata(DUMBFILE *f) {
         }
     }
 
+    if (_dumb_it_decode_sample_data(sigdata) < 0) {
+        free(buffer);
+        free(component);
+        _dumb_it_unload_sigdata(sigdata);
+        return NULL;
+    }
+
     for (n = 0; n < 10; n++) {
         if (dumbfile_getc(f) == 'X') {
             if (dumbfile_getc(f) == 'T') {
@@ -23,6 +23,7 @@
 
 #include "dumb.h"
 #include "internal/dumb.h"
+#include "internal/dumbfile.h"
 #include "internal/it.h"
 #include "internal/lpc.h"
 
@@ -41,39 +42,84 @@
 
 // #define BIT_ARRAY_BULLSHIT
 
-static IT_PLAYING *new_playing() {
-    IT_PLAYING *r = (IT_PLAYING *)malloc(sizeof(*r));
-    if (r) {
-        r->resampler.fir_resampler_ratio = 0.0;
-        r->resampler.fir_resampler[0] = resampler_create();
-        if (!r->resampler.fir_resampler[0]) {
-            free(r);
+/* Voices allocated without a pool are for checkpoint snapshots, which are
+ * never rendered, so they go without a FIR resampler.
+ */
+static IT_PLAYING *new_playing(IT_PLAYING_POOL *pool) {
+    IT_PLAYING *r;
+    if (!pool) {
+        r = (IT_PLAYING *)malloc(sizeof(*r));
+        if (!r)
             return NULL;
-        }
-        r->resampler.fir_resampler[1] = resampler_create();
-        if (!r->resampler.fir_resampler[1]) {
-            resampler_delete(r->resampler.fir_resampler[0]);
+        r->resampler.fir_resampler = NULL;
+    } else if (pool->n_free) {
+        r = pool->free[--pool->n_free];
+        resampler_reset(r->resampler.fir_resampler);
+    } else {
+        r = (IT_PLAYING *)malloc(sizeof(*r));
+        if (!r)
+            return NULL;
+        r->resampler.fir_resampler = resampler_create();
+        if (!r->resampler.fir_resampler) {
             free(r);
             return NULL;
         }
-    }
+        pool->n_allocated++;
+    }
+    r->resampler.fir_resampler_ratio = 0.0;
+    r->mix_volume = 0;
+    r->pitch_factor = 1.0f;
+    r->filter_envelope = -1;
+    if (pool && ++pool->n_active > pool->peak_active)
+        pool->peak_active = pool->n_active;
     return r;
 }
 
-static void free_playing(IT_PLAYING *r) {
-    resampler_delete(r->resampler.fir_resampler[1]);
-    resampler_delete(r->resampler.fir_resampler[0]);
+static void destroy_playing(IT_PLAYING *r) {
+    resampler_delete(r->resampler.fir_resampler);
     free(r);
 }
 
-static IT_PLAYING *dup_playing(IT_PLAYING *src, IT_CHANNEL *dstchannel,
+static void free_playing(IT_PLAYING_POOL *pool, IT_PLAYING *r) {
+    pool->n_active--;
+    if (pool->n_free < DUMB_IT_TOTAL_CHANNELS) {
+        pool->free[pool->n_free++] = r;
+        if (pool->n_free > pool->peak_free)
+            pool->peak_free = pool->n_free;
+    } else
+        destroy_playing(r);
+}
+
+static IT_PLAYING_POOL *create_playing_pool(void) {
+    IT_PLAYING_POOL *pool = malloc(sizeof(*pool));
+    if (!pool)
+        return NULL;
+    pool->n_free = 0;
+    pool->n_active = 0;
+    pool->peak_free = 0;
+    pool->peak_active = 0;
+    pool->n_allocated = 0;
+    return pool;
+}
+
+static void destroy_playing_pool(IT_PLAYING_POOL *pool) {
+    if (pool) {
+        while (pool->n_free)
+            destroy_playing(pool->free[--pool->n_free]);
+        free(pool);
+    }
+}
+
+static IT_PLAYING *dup_playing(IT_PLAYING_POOL *pool, IT_PLAYING *src,
+                               IT_CHANNEL *dstchannel,
                                IT_CHANNEL *srcchannel) {
     IT_PLAYING *dst;
+    void *fir_resampler;
 
     if (!src)
         return NULL;
 
-    dst = malloc(sizeof(*dst));
+    dst = new_playing(pool);
     if (!dst)
         return NULL;
 
@@ -100,6 +146,8 @@ static IT_PLAYING *dup_playing(IT_PLAYING *src, IT_CHANNEL *dstchannel,
     dst->ramp_delta[0] = src->ramp_delta[0];
     dst->ramp_delta[1] = src->ramp_delta[1];
 
+    dst->mix_volume = src->mix_volume;
+
     dst->channel_volume = src->channel_volume;
 
     dst->volume = src->volume;
@@ -143,6 +191,9 @@ static IT_PLAYING *dup_playing(IT_PLAYING *src, IT_CHANNEL *dstchannel,
     dst->delta = src->delta;
     dst->finetune = src->finetune;
 
+    dst->pitch_factor = src->pitch_factor;
+    dst->filter_envelope = src->filter_envelope;
+
     dst->volume_envelope = src->volume_envelope;
     dst->pan_envelope = src->pan_envelope;
     dst->pitch_envelope = src->pitch_envelope;
@@ -152,21 +203,22 @@ static IT_PLAYING *dup_playing(IT_PLAYING *src, IT_CHANNEL *dstchannel,
     dst->filter_state[0] = src->filter_state[0];
     dst->filter_state[1] = src->filter_state[1];
 
+    fir_resampler = dst->resampler.fir_resampler;
     dst->resampler = src->resampler;
     dst->resampler.pickup_data = dst;
-    dst->resampler.fir_resampler_ratio = src->resampler.fir_resampler_ratio;
-    dst->resampler.fir_resampler[0] =
-        resampler_dup(src->resampler.fir_resampler[0]);
-    if (!dst->resampler.fir_resampler[0]) {
-        free(dst);
-        return NULL;
-    }
-    dst->resampler.fir_resampler[1] =
-        resampler_dup(src->resampler.fir_resampler[1]);
-    if (!dst->resampler.fir_resampler[1]) {
-        resampler_delete(dst->resampler.fir_resampler[0]);
-        free(dst);
-        return NULL;
+    dst->resampler.fir_resampler = fir_resampler;
+    if (src->resampler.fir_resampler) {
+        if (fir_resampler)
+            resampler_dup_inplace(fir_resampler,
+                                  src->resampler.fir_resampler);
+    } else if (fir_resampler) {
+        /* Restoring a snapshot. Silent rendering never feeds the FIR
+         * resampler, so it only needs setting up as the last reset left it.
+         */
+        resampler_set_channels(fir_resampler,
+                               dst->sample->flags & IT_SAMPLE_STEREO ? 2 : 1);
+        resampler_set_quality(fir_resampler, dst->resampler.quality);
+        dst->resampler.fir_resampler_ratio = 0.0;
     }
     dst->time_lost = src->time_lost;
 
@@ -175,7 +227,8 @@ static IT_PLAYING *dup_playing(IT_PLAYING *src, IT_CHANNEL *dstchannel,
     return dst;
 }
 
-static void dup_channel(IT_CHANNEL *dst, IT_CHANNEL *src) {
+static void dup_channel(IT_PLAYING_POOL *pool, IT_CHANNEL *dst,
+                        IT_CHANNEL *src) {
     dst->flags = src->flags;
 
     dst->volume = src->volume;
@@ -268,7 +321,7 @@ static void dup_channel(IT_CHANNEL *dst, IT_CHANNEL *src) {
     dst->inv_loop_speed = src->inv_loop_speed;
     dst->inv_loop_offset = src->inv_loop_offset;
 
-    dst->playing = dup_playing(src->playing, dst, src);
+    dst->playing = dup_playing(pool, src->playing, dst, src);
 
 #ifdef BIT_ARRAY_BULLSHIT
     dst->played_patjump = bit_array_dup(src->played_patjump);
@@ -278,33 +331,48 @@ static void dup_channel(IT_CHANNEL *dst, IT_CHANNEL *src) {
     // dst->output = src->output;
 }
 
-/* Allocate the new callbacks first, then pass them to this function!
- * It will free them on failure.
- */
-static DUMB_IT_SIGRENDERER *dup_sigrenderer(DUMB_IT_SIGRENDERER *src,
-                                            int n_channels,
-                                            IT_CALLBACKS *callbacks) {
-    DUMB_IT_SIGRENDERER *dst;
+static void destroy_snapshot_voices(IT_SNAPSHOT *snapshot) {
     int i;
 
-    if (!src) {
-        if (callbacks)
-            free(callbacks);
-        return NULL;
+    for (i = 0; i < DUMB_IT_N_CHANNELS; i++) {
+        if (snapshot->channel[i].playing)
+            destroy_playing(snapshot->channel[i].playing);
+#ifdef BIT_ARRAY_BULLSHIT
+        bit_array_destroy(snapshot->channel[i].played_patjump);
+#endif
     }
 
-    dst = malloc(sizeof(*dst));
-    if (!dst) {
-        if (callbacks)
-            free(callbacks);
-        return NULL;
+    for (i = 0; i < snapshot->n_playing; i++)
+        if (snapshot->playing[i])
+            destroy_playing(snapshot->playing[i]);
+}
+
+void _dumb_it_destroy_snapshot(IT_SNAPSHOT *snapshot) {
+    if (snapshot) {
+        destroy_snapshot_voices(snapshot);
+        free(snapshot->playing);
+#ifdef BIT_ARRAY_BULLSHIT
+        bit_array_destroy(snapshot->played);
+        timekeeping_array_destroy(snapshot->row_timekeeper);
+#endif
+        free(snapshot);
     }
+}
 
-    dst->sigdata = src->sigdata;
+/* Saves what a checkpoint needs of the sigrenderer's state. The voices are
+ * copied without their FIR resamplers; see new_playing(). Returns NULL if
+ * memory runs out.
+ */
+static IT_SNAPSHOT *save_snapshot(DUMB_IT_SIGRENDERER *src) {
+    IT_SNAPSHOT *dst;
+    int i, failed = 0;
 
-    dst->n_channels = n_channels;
+    dst = malloc(sizeof(*dst));
+    if (!dst)
+        return NULL;
 
     dst->resampling_quality = src->resampling_quality;
+    dst->ramp_style = src->ramp_style;
 
     dst->globalvolume = src->globalvolume;
     dst->globalvolslide = src->globalvolslide;
@@ -312,12 +380,35 @@ static DUMB_IT_SIGRENDERER *dup_sigrenderer(DUMB_IT_SIGRENDERER *src,
     dst->tempo = src->tempo;
     dst->temposlide = src->temposlide;
 
-    for (i = 0; i < DUMB_IT_N_CHANNELS; i++)
-        dup_channel(&dst->channel[i], &src->channel[i]);
+    for (i = 0; i < DUMB_IT_N_CHANNELS; i++) {
+        dup_channel(NULL, &dst->channel[i], &src->channel[i]);
+        if (src->channel[i].playing && !dst->channel[i].playing)
+            failed = 1;
+#ifdef BIT_ARRAY_BULLSHIT
+        if (src->channel[i].played_patjump && !dst->channel[i].played_patjump)
+            failed = 1;
+#endif
+    }
 
-    for (i = 0; i < DUMB_IT_N_NNA_CHANNELS; i++)
+    dst->n_playing = DUMB_IT_N_NNA_CHANNELS;
+    while (dst->n_playing && !src->playing[dst->n_playing - 1])
+        dst->n_playing--;
+
+    dst->playing = NULL;
+    if (dst->n_playing) {
+        dst->playing = malloc(dst->n_playing * sizeof(*dst->playing));
+        if (!dst->playing) {
+            dst->n_playing = 0;
+            failed = 1;
+        }
+    }
+
+    for (i = 0; i < dst->n_playing; i++) {
         dst->playing[i] =
-            dup_playing(src->playing[i], dst->channel, src->channel);
+            dup_playing(NULL, src->playing[i], dst->channel, src->channel);
+        if (src->playing[i] && !dst->playing[i])
+            failed = 1;
+    }
 
     dst->tick = src->tick;
     dst->speed = src->speed;
@@ -340,11 +431,75 @@ static DUMB_IT_SIGRENDERER *dup_sigrenderer(DUMB_IT_SIGRENDERER *src,
     dst->time_left = src->time_left;
     dst->sub_time_left = src->sub_time_left;
 
+#ifdef BIT_ARRAY_BULLSHIT
+    dst->played = bit_array_dup(src->played);
+
+    dst->looped = src->looped;
+    dst->time_played = src->time_played;
+    dst->row_timekeeper = timekeeping_array_dup(src->row_timekeeper);
+
+    if ((src->played && !dst->played) ||
+        (src->row_timekeeper && !dst->row_timekeeper))
+        failed = 1;
+#endif
+
+    dst->gvz_time = src->gvz_time;
+    dst->gvz_sub_time = src->gvz_sub_time;
+
+    if (failed) {
+        _dumb_it_destroy_snapshot(dst);
+        return NULL;
+    }
+
+    return dst;
+}
+
+/* Puts the playback state saved by save_snapshot() into dst, taking voices
+ * from its pool. dst's state must already have been released by
+ * release_playback_state(). Its channel count, callbacks, click remover and
+ * voice statistics are left alone.
+ */
+static void restore_snapshot(DUMB_IT_SIGRENDERER *dst, IT_SNAPSHOT *src) {
+    int i;
+
+    dst->resampling_quality = src->resampling_quality;
     dst->ramp_style = src->ramp_style;
 
-    dst->click_remover = NULL;
+    dst->globalvolume = src->globalvolume;
+    dst->globalvolslide = src->globalvolslide;
+
+    dst->tempo = src->tempo;
+    dst->temposlide = src->temposlide;
+
+    for (i = 0; i < DUMB_IT_N_CHANNELS; i++)
+        dup_channel(dst->voice_pool, &dst->channel[i], &src->channel[i]);
+
+    for (i = 0; i < DUMB_IT_N_NNA_CHANNELS; i++)
+        dst->playing[i] = i < src->n_playing
+                              ? dup_playing(dst->voice_pool, src->playing[i],
+                                            dst->channel, src->channel)
+                              : NULL;
+
+    dst->tick = src->tick;
+    dst->speed = src->speed;
+    dst->rowcount = src->rowcount;
+
+    dst->order = src->order;
+    dst->row = src->row;
+    dst->processorder = src->processorder;
+    dst->processrow = src->processrow;
+    dst->breakrow = src->breakrow;
+
+    dst->restart_position = src->restart_position;
+
+    dst->n_rows = src->n_rows;
+
+    dst->entry_start = src->entry_start;
+    dst->entry = src->entry;
+    dst->entry_end = src->entry_end;
 
-    dst->callbacks = callbacks;
+    dst->time_left = src->time_left;
+    dst->sub_time_left = src->sub_time_left;
 
 #ifdef BIT_ARRAY_BULLSHIT
     dst->played = bit_array_dup(src->played);
@@ -356,10 +511,6 @@ static DUMB_IT_SIGRENDERER *dup_sigrenderer(DUMB_IT_SIGRENDERER *src,
 
     dst->gvz_time = src->gvz_time;
     dst->gvz_sub_time = src->gvz_sub_time;
-
-    // dst->max_output = src->max_output;
-
-    return dst;
 }
 
 static const IT_MIDI default_midi = {
@@ -687,6 +838,73 @@ static void it_reset_filter_state(IT_FILTER_STATE *state) {
  * click removal right.
  */
 
+#ifdef DUMB_FLOAT_SAMPLES
+
+static void it_filter_float(DUMB_CLICK_REMOVER *cr, IT_FILTER_STATE *state,
+                            sample_t *dst, long pos, sample_t *src, long size,
+                            int step, int sampfreq, int cutoff,
+                            int resonance) {
+    sample_t currsample = state->currsample;
+    sample_t prevsample = state->prevsample;
+
+    float a, b, c;
+
+    long datasize;
+
+    {
+        float inv_angle =
+            (float)(sampfreq *
+                    pow(0.5,
+                        0.25 + cutoff * (1.0 / (24 << IT_ENVELOPE_SHIFT))) *
+                    (1.0 / (2 * 3.14159265358979323846 * 110.0)));
+        float loss = (float)exp(resonance * (-LOG10 * 1.2 / 128.0));
+        float d, e;
+
+        d = (1.0f - loss) / inv_angle;
+        if (d > 2.0f)
+            d = 2.0f;
+        d = (loss - d) * inv_angle;
+        e = inv_angle * inv_angle;
+        a = 1.0f / (1.0f + d + e);
+        c = -e * a;
+        b = 1.0f - a - c;
+    }
+
+    dst += pos * step;
+    datasize = size * step;
+
+    {
+        long i;
+
+        if (cr)
+            dumb_record_click(cr, pos,
+                              src[0] * a + currsample * b + prevsample * c);
+
+        for (i = 0; i < datasize; i += step) {
+            sample_t newsample = src[i] * a + currsample * b + prevsample * c;
+            prevsample = currsample;
+            currsample = newsample;
+            dst[i] += currsample;
+        }
+
+        if (cr)
+            dumb_record_click(cr, pos + size,
+                              -(src[datasize] * a + currsample * b +
+                                prevsample * c));
+    }
+
+    /* Left alone, the state decays into denormals during silence. Anything
+     * this small is far below one 24-bit step anyway.
+     */
+    if (fabs(currsample) < 1e-6f && fabs(prevsample) < 1e-6f)
+        currsample = prevsample = 0;
+
+    state->currsample = currsample;
+    state->prevsample = prevsample;
+}
+
+#else
+
 static void it_filter_int(DUMB_CLICK_REMOVER *cr, IT_FILTER_STATE *state,
                           sample_t *dst, long pos, sample_t *src, long size,
                           int step, int sampfreq, int cutoff, int resonance) {
@@ -999,6 +1217,8 @@ static void it_filter_neon(DUMB_CLICK_REMOVER *cr, IT_FILTER_STATE *state,
 }
 #endif
 
+#endif
+
 #undef LOG10
 
 #ifdef _USE_SSE
@@ -1062,6 +1282,10 @@ void _dumb_init_sse() {}
 static void it_filter(DUMB_CLICK_REMOVER *cr, IT_FILTER_STATE *state,
                       sample_t *dst, long pos, sample_t *src, long size,
                       int step, int sampfreq, int cutoff, int resonance) {
+#ifdef DUMB_FLOAT_SAMPLES
+    it_filter_float(cr, state, dst, pos, src, size, step, sampfreq, cutoff,
+                    resonance);
+#else
 #if defined(_USE_SSE) && (defined(_M_IX86) || defined(__i386__) ||             \
                           defined(_M_X64) || defined(__amd64__))
     _dumb_init_sse();
@@ -1077,6 +1301,7 @@ static void it_filter(DUMB_CLICK_REMOVER *cr, IT_FILTER_STATE *state,
     it_filter_int(cr, state, dst, pos, src, size, step, sampfreq, cutoff,
                   resonance);
 #endif
+#endif
 }
 
 static const signed char it_sine[256] = {
@@ -1214,6 +1439,10 @@ static const unsigned char arpeggio_okt_5[32] = {
     2, 2, 0, 2, 2, 0, 2, 2, 0, 2, 2, 0, 2, 2, 0, 2,
     2, 0, 2, 2, 0, 2, 2, 0, 2, 2, 0, 2, 2, 0, 2, 2};
 
+const unsigned char *const _dumb_it_arpeggio_tables[IT_N_ARPEGGIO_TABLES] = {
+    NULL,           arpeggio_mod,   arpeggio_xm,
+    arpeggio_okt_3, arpeggio_okt_4, arpeggio_okt_5};
+
 static void reset_channel_effects(IT_CHANNEL *channel) {
     channel->volslide = 0;
     channel->xm_volslide = 0;
@@ -1256,6 +1485,37 @@ static void reset_effects(DUMB_IT_SIGRENDERER *sigrenderer) {
     }
 }
 
+/* it_pitch_table[n] is pow(DUMB_PITCH_BASE, n), covering one octave of the
+ * 256-units-per-semitone pitch scale.
+ */
+static float it_pitch_table[12 * 256];
+
+static void it_init_pitch_table(void) {
+    static int done = 0;
+    int i;
+
+    if (done)
+        return;
+
+    for (i = 0; i < 12 * 256; i++)
+        it_pitch_table[i] = (float)pow(DUMB_PITCH_BASE, i);
+
+    done = 1;
+}
+
+/* Returns pow(DUMB_PITCH_BASE, pitch) without calling pow(). */
+static float it_pitch_factor(int pitch) {
+    int octave = pitch / (12 * 256);
+
+    pitch %= 12 * 256;
+    if (pitch < 0) {
+        pitch += 12 * 256;
+        octave--;
+    }
+
+    return (float)ldexp(it_pitch_table[pitch], octave);
+}
+
 static void update_tremor(IT_CHANNEL *channel) {
     if ((channel->tremor_time & 128) && channel->playing) {
         if (channel->tremor_time == 128)
@@ -1310,6 +1570,32 @@ static void it_pickup_stop_after_reverse(DUMB_RESAMPLER *resampler,
     resampler->dir = 0;
 }
 
+/* An unrolled loop is played one copy of the original loop at a time, so
+ * that the voice stops feeding the FIR resampler at the same points as it
+ * would wrapping around the original. The resampler works ahead of the voice,
+ * and where its input stops decides when it picks up a pitch change. Moving
+ * on to the next copy, ping-pong or not, is all that is left to do here, and
+ * the voice only jumps back at fir_loop_end. time_lost is not kept, since
+ * only sustain loops use it and they are never unrolled.
+ */
+static void it_pickup_unrolled_loop(DUMB_RESAMPLER *resampler, void *data) {
+    IT_SAMPLE *sample = ((IT_PLAYING *)data)->sample;
+    long length = resampler->end - resampler->start;
+
+    if (resampler->end < sample->fir_loop_end) {
+        resampler->start = resampler->end;
+        resampler->end += length;
+    } else {
+        resampler->pos -= sample->fir_loop_end - sample->loop_start;
+        resampler->start = sample->loop_start;
+        resampler->end = sample->loop_start + length;
+    }
+}
+
+const DUMB_RESAMPLE_PICKUP _dumb_it_pickups[IT_N_PICKUPS] = {
+    NULL, &it_pickup_loop, &it_pickup_pingpong_loop, &it_pickup_stop_at_end,
+    &it_pickup_stop_after_reverse, &it_pickup_unrolled_loop};
+
 static void it_playing_update_resamplers(IT_PLAYING *playing) {
     if ((playing->sample->flags & IT_SAMPLE_SUS_LOOP) &&
         !(playing->flags & IT_PLAYING_SUSTAINOFF)) {
@@ -1321,6 +1607,11 @@ static void it_playing_update_resamplers(IT_PLAYING *playing) {
             playing->resampler.pickup = &it_pickup_pingpong_loop;
         else
             playing->resampler.pickup = &it_pickup_loop;
+    } else if (playing->sample->fir_loop_end) {
+        /* The loop was unrolled, ping-pong or not, into forward copies. */
+        playing->resampler.start = playing->sample->loop_start;
+        playing->resampler.end = playing->sample->loop_end;
+        playing->resampler.pickup = &it_pickup_unrolled_loop;
     } else if (playing->sample->flags & IT_SAMPLE_LOOP) {
         playing->resampler.start = playing->sample->loop_start;
         playing->resampler.end = playing->sample->loop_end;
@@ -1346,16 +1637,25 @@ static void it_playing_update_resamplers(IT_PLAYING *playing) {
     ASSERT(playing->resampler.pickup_data == playing);
 }
 
+/* Returns the 'n' to pass to the dumb_resample_n functions for a sample. */
+static int it_sample_bits(IT_SAMPLE *sample) {
+    if (sample->fir_data)
+        return 32;
+    return sample->flags & IT_SAMPLE_16BIT ? 16 : 8;
+}
+
 /* This should be called whenever the sample or sample position changes. */
 static void it_playing_reset_resamplers(IT_PLAYING *playing, long pos) {
-    int bits = playing->sample->flags & IT_SAMPLE_16BIT ? 16 : 8;
+    int bits = it_sample_bits(playing->sample);
+    void *src = playing->sample->fir_data ? (void *)playing->sample->fir_data
+                                          : playing->sample->data;
     int quality = playing->resampling_quality;
     int channels = playing->sample->flags & IT_SAMPLE_STEREO ? 2 : 1;
     if (playing->sample->max_resampling_quality >= 0 &&
         quality > playing->sample->max_resampling_quality)
         quality = playing->sample->max_resampling_quality;
-    dumb_reset_resampler_n(bits, &playing->resampler, playing->sample->data,
-                           channels, pos, 0, 0, quality);
+    dumb_reset_resampler_n(bits, &playing->resampler, src, channels, pos, 0, 0,
+                           quality);
     playing->resampler.pickup_data = playing;
     playing->time_lost = 0;
     playing->flags &= ~IT_PLAYING_DEAD;
@@ -1482,7 +1782,120 @@ static const unsigned char pt_tab_invloop[16] = {
     0x00, 0x05, 0x06, 0x07, 0x08, 0x0A, 0x0B, 0x0D,
     0x0F, 0x13, 0x16, 0x1A, 0x20, 0x2B, 0x40, 0x80};
 
-static void update_invert_loop(IT_CHANNEL *channel, IT_SAMPLE *sample) {
+/* Refreshes every copy of frame i of an 8-bit mono sample in fir_data. */
+static void it_update_fir_frame(IT_SAMPLE *sample, long i) {
+    float x = ((signed char *)sample->data)[i] * (1.0f / 256.0f);
+    long period, j;
+
+    sample->fir_data[i] = x;
+    if (!sample->fir_loop_end || i < sample->loop_start ||
+        i >= sample->loop_end)
+        return;
+
+    period = sample->loop_end - sample->loop_start;
+    if (sample->flags & IT_SAMPLE_PINGPONG_LOOP) {
+        period <<= 1;
+        for (j = (sample->loop_end << 1) - 1 - i; j < sample->fir_loop_end;
+             j += period)
+            sample->fir_data[j] = x;
+    }
+    for (j = i + period; j < sample->fir_loop_end; j += period)
+        sample->fir_data[j] = x;
+}
+
+/* Returns the sample a sigrenderer plays for sample n (counting from 0). */
+static IT_SAMPLE *it_get_sample(DUMB_IT_SIGRENDERER *sigrenderer, int n) {
+    if (sigrenderer->own_sample && sigrenderer->own_sample[n])
+        return sigrenderer->own_sample[n];
+    return &sigrenderer->sigdata->sample[n];
+}
+
+static void it_free_own_sample(IT_SAMPLE *sample) {
+    if (sample) {
+        free(sample->data);
+        free(sample->fir_data);
+        free(sample);
+    }
+}
+
+/* Frees the sigrenderer's own sample copies. None of its voices may still
+ * be playing them.
+ */
+static void it_free_own_samples(DUMB_IT_SIGRENDERER *sigrenderer) {
+    int n;
+
+    if (sigrenderer->own_sample) {
+        for (n = 0; n < sigrenderer->sigdata->n_samples; n++)
+            it_free_own_sample(sigrenderer->own_sample[n]);
+        free(sigrenderer->own_sample);
+        sigrenderer->own_sample = NULL;
+    }
+}
+
+static void it_move_voice(IT_PLAYING *playing, IT_SAMPLE *from,
+                          IT_SAMPLE *to) {
+    if (playing && playing->sample == from) {
+        playing->sample = to;
+        playing->resampler.src = to->fir_data ? (void *)to->fir_data : to->data;
+    }
+}
+
+/* Gives the sigrenderer its own copy of 8-bit mono sample n, for EFx to
+ * invert, and moves its voices playing the sample over to the copy. Other
+ * threads may be playing a frozen sigdata's samples, so they must not be
+ * changed. Returns NULL if memory runs out.
+ */
+static IT_SAMPLE *it_own_sample(DUMB_IT_SIGRENDERER *sigrenderer, int n) {
+    DUMB_IT_SIGDATA *sigdata = sigrenderer->sigdata;
+    IT_SAMPLE *sample = &sigdata->sample[n];
+    IT_SAMPLE *copy;
+    long fir_size;
+    int i;
+
+    if (!sigrenderer->own_sample) {
+        sigrenderer->own_sample =
+            calloc(sigdata->n_samples, sizeof(*sigrenderer->own_sample));
+        if (!sigrenderer->own_sample)
+            return NULL;
+    }
+
+    if (sigrenderer->own_sample[n])
+        return sigrenderer->own_sample[n];
+
+    copy = malloc(sizeof(*copy));
+    if (!copy)
+        return NULL;
+
+    *copy = *sample;
+    copy->data = malloc(sample->length);
+    copy->fir_data = NULL;
+    if (sample->fir_data) {
+        fir_size = MAX(sample->length, sample->fir_loop_end);
+        copy->fir_data = malloc(fir_size * sizeof(*copy->fir_data));
+        if (copy->fir_data)
+            memcpy(copy->fir_data, sample->fir_data,
+                   fir_size * sizeof(*copy->fir_data));
+    }
+    if (!copy->data || (sample->fir_data && !copy->fir_data)) {
+        it_free_own_sample(copy);
+        return NULL;
+    }
+    memcpy(copy->data, sample->data, sample->length);
+
+    sigrenderer->own_sample[n] = copy;
+
+    for (i = 0; i < DUMB_IT_N_CHANNELS; i++)
+        it_move_voice(sigrenderer->channel[i].playing, sample, copy);
+    for (i = 0; i < DUMB_IT_N_NNA_CHANNELS; i++)
+        it_move_voice(sigrenderer->playing[i], sample, copy);
+
+    return copy;
+}
+
+static void update_invert_loop(DUMB_IT_SIGRENDERER *sigrenderer,
+                               IT_CHANNEL *channel, IT_PLAYING *playing) {
+    IT_SAMPLE *sample = playing ? playing->sample : NULL;
+
     channel->inv_loop_delay += pt_tab_invloop[channel->inv_loop_speed];
     if (channel->inv_loop_delay >= 0x80) {
         channel->inv_loop_delay = 0;
@@ -1497,9 +1910,18 @@ static void update_invert_loop(IT_CHANNEL *channel, IT_SAMPLE *sample) {
                     (sample->loop_end - sample->loop_start))
                     channel->inv_loop_offset = 0;
 
+                if (sigrenderer->sigdata->flags & IT_WAS_FROZEN) {
+                    sample = it_own_sample(sigrenderer, playing->sampnum - 1);
+                    if (!sample)
+                        return;
+                }
+
                 ((char *)sample
                      ->data)[sample->loop_start + channel->inv_loop_offset] ^=
                     0xFF;
+                if (sample->fir_data)
+                    it_update_fir_frame(sample, sample->loop_start +
+                                                    channel->inv_loop_offset);
             }
         }
     }
@@ -1635,7 +2057,7 @@ static void update_effects(DUMB_IT_SIGRENDERER *sigrenderer) {
         update_retrig(sigrenderer, channel);
 
         if (channel->inv_loop_speed)
-            update_invert_loop(channel, playing ? playing->sample : NULL);
+            update_invert_loop(sigrenderer, channel, playing);
 
         if (playing) {
             playing->slide += channel->portamento;
@@ -1666,14 +2088,14 @@ static void update_effects(DUMB_IT_SIGRENDERER *sigrenderer) {
                         playing->sample->C5_speed * (1.0f / AMIGA_DIVISOR);
 
                     float deltanote =
-                        (float)pow(DUMB_SEMITONE_BASE, 60 - playing->note);
+                        it_pitch_factor((60 - playing->note) * 256);
                     /* deltanote is 1.0 for C-5, 0.5 for C-6, etc. */
 
                     float deltaslid =
                         deltanote - playing->slide * amiga_multiplier;
 
                     float destdelta =
-                        (float)pow(DUMB_SEMITONE_BASE, 60 - channel->destnote);
+                        it_pitch_factor((60 - channel->destnote) * 256);
                     if (deltaslid < destdelta) {
                         playing->slide -= channel->toneporta;
                         deltaslid =
@@ -2178,9 +2600,9 @@ static void it_retrigger_note(DUMB_IT_SIGRENDERER *sigrenderer,
     }
 
     if (channel->playing)
-        free_playing(channel->playing);
+        free_playing(sigrenderer->voice_pool, channel->playing);
 
-    channel->playing = new_playing();
+    channel->playing = new_playing(sigrenderer->voice_pool);
 
     if (!channel->playing)
         return;
@@ -2204,7 +2626,7 @@ static void it_retrigger_note(DUMB_IT_SIGRENDERER *sigrenderer,
     channel->playing->flags = 0;
     channel->playing->resampling_quality = sigrenderer->resampling_quality;
     channel->playing->channel = channel;
-    channel->playing->sample = &sigdata->sample[channel->sample - 1];
+    channel->playing->sample = it_get_sample(sigrenderer, channel->sample - 1);
     if (sigdata->flags & IT_USE_INSTRUMENTS)
         channel->playing->instrument =
             &sigdata->instrument[channel->instrument - 1];
@@ -3223,9 +3645,8 @@ static int process_effects(DUMB_IT_SIGRENDERER *sigrenderer, IT_ENTRY *entry,
                 if ((sigdata->flags & (IT_WAS_AN_XM | IT_WAS_A_MOD)) ==
                     (IT_WAS_AN_XM | IT_WAS_A_MOD)) {
                     channel->inv_loop_speed = effectvalue & 15;
-                    update_invert_loop(channel, channel->playing
-                                                    ? channel->playing->sample
-                                                    : NULL);
+                    update_invert_loop(sigrenderer, channel,
+                                       channel->playing);
                 } else
                     channel->SFmacro = effectvalue & 15;
                 break;
@@ -3708,7 +4129,8 @@ static void process_xm_note_data(DUMB_IT_SIGRENDERER *sigrenderer,
             !((entry->mask & IT_ENTRY_NOTE) && entry->note >= 120) &&
             !((entry->mask & IT_ENTRY_EFFECT) &&
               entry->effect == IT_XM_KEY_OFF && entry->effectvalue == 0)) {
-            playing = dup_playing(channel->playing, channel, channel);
+            playing = dup_playing(sigrenderer->voice_pool, channel->playing,
+                                  channel, channel);
             if (!playing)
                 return;
             if (!(sigdata->flags & IT_WAS_A_MOD)) {
@@ -3739,19 +4161,21 @@ static void process_xm_note_data(DUMB_IT_SIGRENDERER *sigrenderer,
 
                     if (!channel->sample) {
                         if (channel->playing) {
-                            free_playing(channel->playing);
+                            free_playing(sigrenderer->voice_pool,
+                                         channel->playing);
                             channel->playing = NULL;
                         }
                     } else {
                         if (channel->playing) {
-                            free_playing(channel->playing);
+                            free_playing(sigrenderer->voice_pool,
+                                         channel->playing);
                         }
                         channel->playing = playing;
                         playing = NULL;
                         channel->playing->declick_stage = 0;
                         channel->playing->sampnum = channel->sample;
                         channel->playing->sample =
-                            &sigdata->sample[channel->sample - 1];
+                            it_get_sample(sigrenderer, channel->sample - 1);
                         it_playing_reset_resamplers(channel->playing, 0);
                     }
                 }
@@ -3781,7 +4205,7 @@ static void process_xm_note_data(DUMB_IT_SIGRENDERER *sigrenderer,
             if (channel->playing) {
                 int i;
                 if (playing) {
-                    free_playing(channel->playing);
+                    free_playing(sigrenderer->voice_pool, channel->playing);
                     channel->playing = playing;
                     playing = NULL;
                 }
@@ -3794,12 +4218,12 @@ static void process_xm_note_data(DUMB_IT_SIGRENDERER *sigrenderer,
                     }
                 }
                 if (channel->playing) {
-                    free_playing(channel->playing);
+                    free_playing(sigrenderer->voice_pool, channel->playing);
                     channel->playing = NULL;
                 }
             }
             if (playing)
-                free_playing(playing);
+                free_playing(sigrenderer->voice_pool, playing);
             return;
         } else if (channel->playing && (entry->mask & IT_ENTRY_VOLPAN) &&
                    ((entry->volpan >> 4) == 0xF)) {
@@ -3812,10 +4236,10 @@ static void process_xm_note_data(DUMB_IT_SIGRENDERER *sigrenderer,
             channel->destnote = IT_NOTE_OFF;
 
             if (!channel->playing) {
-                channel->playing = new_playing();
+                channel->playing = new_playing(sigrenderer->voice_pool);
                 if (!channel->playing) {
                     if (playing)
-                        free_playing(playing);
+                        free_playing(sigrenderer->voice_pool, playing);
                     return;
                 }
                 // Adding the following seems to do the trick for the case where
@@ -3832,7 +4256,7 @@ static void process_xm_note_data(DUMB_IT_SIGRENDERER *sigrenderer,
                     ptemp = channel->playing;
                 if (!ptemp) {
                     if (playing)
-                        free_playing(playing);
+                        free_playing(sigrenderer->voice_pool, playing);
                     return;
                 }
                 playing = NULL;
@@ -3847,14 +4271,15 @@ static void process_xm_note_data(DUMB_IT_SIGRENDERER *sigrenderer,
                     }
                 }
                 if (ptemp)
-                    free_playing(ptemp);
+                    free_playing(sigrenderer->voice_pool, ptemp);
             }
 
             channel->playing->flags = 0;
             channel->playing->resampling_quality =
                 sigrenderer->resampling_quality;
             channel->playing->channel = channel;
-            channel->playing->sample = &sigdata->sample[channel->sample - 1];
+            channel->playing->sample =
+                it_get_sample(sigrenderer, channel->sample - 1);
             if (sigdata->flags & IT_USE_INSTRUMENTS)
                 channel->playing->instrument =
                     &sigdata->instrument[channel->instrument - 1];
@@ -4006,7 +4431,7 @@ static void process_xm_note_data(DUMB_IT_SIGRENDERER *sigrenderer,
     }
 
     if (playing)
-        free_playing(playing);
+        free_playing(sigrenderer->voice_pool, playing);
 }
 
 /* This function assumes !IT_IS_END_ROW(entry). */
@@ -4078,7 +4503,8 @@ static void update_tick_counts(DUMB_IT_SIGRENDERER *sigrenderer) {
                         }
                     }
                     if (channel->playing) {
-                        free_playing(channel->playing);
+                        free_playing(sigrenderer->voice_pool,
+                                     channel->playing);
                         channel->playing = NULL;
                     }
                 }
@@ -4304,6 +4730,7 @@ static void playing_volume_setup(DUMB_IT_SIGRENDERER *sigrenderer,
     }
 
     vol = calculate_volume(sigrenderer, playing, 1.0f);
+    playing->mix_volume = vol;
     playing->float_volume[0] *= vol;
     playing->float_volume[1] *= vol;
 
@@ -4353,40 +4780,125 @@ static void playing_volume_setup(DUMB_IT_SIGRENDERER *sigrenderer,
     }
 }
 
-static void process_playing(DUMB_IT_SIGRENDERER *sigrenderer,
-                            IT_PLAYING *playing, float invt2g) {
-    DUMB_IT_SIGDATA *sigdata = sigrenderer->sigdata;
-
-    if (playing->instrument) {
-        if (sigdata->flags & IT_WAS_AN_XM)
-            update_xm_envelopes(playing);
-        else
-            update_it_envelopes(playing);
-        update_fadeout(sigdata, playing);
-    }
-
-    playing_volume_setup(sigrenderer, playing, invt2g);
-
-    if (sigdata->flags & IT_WAS_AN_XM) {
-        /* 'depth' is used to store the tick number for XM files. */
-        if (playing->sample_vibrato_depth < playing->sample->vibrato_rate)
-            playing->sample_vibrato_depth++;
-    } else {
-        playing->sample_vibrato_depth += playing->sample->vibrato_rate;
-        if (playing->sample_vibrato_depth > playing->sample->vibrato_depth << 8)
-            playing->sample_vibrato_depth = playing->sample->vibrato_depth << 8;
-    }
+/* Works out playing->pitch_factor and playing->filter_envelope for this tick,
+ * from the sample vibrato and pitch envelope state process_playing() has just
+ * updated.
+ */
+static void update_pitch_modifications(DUMB_IT_SIGDATA *sigdata,
+                                       IT_PLAYING *playing) {
+    float factor = 1.0f;
 
-    playing->sample_vibrato_time += playing->sample->vibrato_speed;
-}
+    playing->filter_envelope = -1;
 
-static int delta_to_note(float delta, int base) {
-#define DUMB_LOG2(x) ((float)log((x))/(float)log(2.0f))
-    float note;
-    note = DUMB_LOG2(delta * 65536.f / (float)base) * 12.0f + 60.5f;
-    if (note > 119)
-        note = 119;
-    else if (note < 0)
+    {
+        int sample_vibrato_shift;
+        switch (playing->sample_vibrato_waveform) {
+        default:
+            sample_vibrato_shift = it_sine[playing->sample_vibrato_time];
+            break;
+        case 1:
+            sample_vibrato_shift = it_sawtooth[playing->sample_vibrato_time];
+            break;
+        case 2:
+            sample_vibrato_shift = it_squarewave[playing->sample_vibrato_time];
+            break;
+        case 3:
+            sample_vibrato_shift = (rand() % 129) - 64;
+            break;
+        case 4:
+            sample_vibrato_shift =
+                it_xm_squarewave[playing->sample_vibrato_time];
+            break;
+        case 5:
+            sample_vibrato_shift = it_xm_ramp[playing->sample_vibrato_time];
+            break;
+        case 6:
+            sample_vibrato_shift =
+                it_xm_ramp[255 - playing->sample_vibrato_time];
+            break;
+        }
+
+        if (sigdata->flags & IT_WAS_AN_XM) {
+            int depth = playing->sample->vibrato_depth; /* True depth */
+            if (playing->sample->vibrato_rate) {
+                depth *= playing->sample_vibrato_depth; /* Tick number */
+                depth /= playing->sample->vibrato_rate; /* XM sweep */
+            }
+            sample_vibrato_shift *= depth;
+        } else
+            sample_vibrato_shift *= playing->sample_vibrato_depth >> 8;
+
+        sample_vibrato_shift >>= 4;
+
+        if (sample_vibrato_shift) {
+            if ((sigdata->flags & IT_LINEAR_SLIDES) ||
+                !(sigdata->flags & IT_WAS_AN_XM))
+                factor = it_pitch_factor(sample_vibrato_shift);
+            else {
+                /* complicated! */
+                float delta = (1.0f / 65536.0f) / playing->delta;
+
+                delta -= sample_vibrato_shift / AMIGA_DIVISOR;
+
+                if (delta < (1.0f / 65536.0f) / 32767.0f) {
+                    delta = (1.0f / 65536.0f) / 32767.0f;
+                }
+
+                factor = (1.0f / 65536.0f) / delta / playing->delta;
+            }
+        }
+    }
+
+    if (playing->env_instrument &&
+        (playing->enabled_envelopes & IT_ENV_PITCH)) {
+        int p = envelope_get_y(&playing->env_instrument->pitch_envelope,
+                               &playing->pitch_envelope);
+        if (playing->env_instrument->pitch_envelope.flags &
+            IT_ENVELOPE_PITCH_IS_FILTER)
+            playing->filter_envelope = p + (32 << IT_ENVELOPE_SHIFT);
+        else
+            factor *= it_pitch_factor(p >> (IT_ENVELOPE_SHIFT - 7));
+    }
+
+    playing->pitch_factor = factor;
+}
+
+static void process_playing(DUMB_IT_SIGRENDERER *sigrenderer,
+                            IT_PLAYING *playing, float invt2g) {
+    DUMB_IT_SIGDATA *sigdata = sigrenderer->sigdata;
+
+    if (playing->instrument) {
+        if (sigdata->flags & IT_WAS_AN_XM)
+            update_xm_envelopes(playing);
+        else
+            update_it_envelopes(playing);
+        update_fadeout(sigdata, playing);
+    }
+
+    playing_volume_setup(sigrenderer, playing, invt2g);
+
+    if (sigdata->flags & IT_WAS_AN_XM) {
+        /* 'depth' is used to store the tick number for XM files. */
+        if (playing->sample_vibrato_depth < playing->sample->vibrato_rate)
+            playing->sample_vibrato_depth++;
+    } else {
+        playing->sample_vibrato_depth += playing->sample->vibrato_rate;
+        if (playing->sample_vibrato_depth > playing->sample->vibrato_depth << 8)
+            playing->sample_vibrato_depth = playing->sample->vibrato_depth << 8;
+    }
+
+    playing->sample_vibrato_time += playing->sample->vibrato_speed;
+
+    update_pitch_modifications(sigdata, playing);
+}
+
+static int delta_to_note(float delta, int base) {
+#define DUMB_LOG2(x) ((float)log((x))/(float)log(2.0f))
+    float note;
+    note = DUMB_LOG2(delta * 65536.f / (float)base) * 12.0f + 60.5f;
+    if (note > 119)
+        note = 119;
+    else if (note < 0)
         note = 0;
     return (int)note;
 #undef DUMB_LOG2
@@ -4507,14 +5019,13 @@ static void process_all_playing(DUMB_IT_SIGRENDERER *sigrenderer) {
                 else if (currpitch > 32767)
                     currpitch = 32767;
 
-                playing->delta = (float)pow(DUMB_PITCH_BASE, currpitch);
+                playing->delta = it_pitch_factor(currpitch);
                 playing->delta *= playing->sample->C5_speed * (1.f / 65536.0f);
             } else {
                 int slide = playing->slide + vibrato_shift;
 
-                playing->delta =
-                    (float)pow(DUMB_PITCH_BASE,
-                               ((60 - playing->note) << 8) - playing->finetune);
+                playing->delta = it_pitch_factor(((60 - playing->note) << 8) -
+                                                 playing->finetune);
                 /* playing->delta is 1.0 for C-5, 0.5 for C-6, etc. */
 
                 playing->delta *= 1.0f / playing->sample->C5_speed;
@@ -4534,10 +5045,11 @@ static void process_all_playing(DUMB_IT_SIGRENDERER *sigrenderer) {
             if (playing->channel->glissando && playing->channel->toneporta &&
                 playing->channel->destnote < 120) {
                 playing->delta =
-                    (float)pow(DUMB_SEMITONE_BASE,
-                               delta_to_note(playing->delta,
-                                             (int)playing->sample->C5_speed) -
-                                   60) *
+                    it_pitch_factor(
+                        (delta_to_note(playing->delta,
+                                       (int)playing->sample->C5_speed) -
+                         60) *
+                        256) *
                     playing->sample->C5_speed * (1.f / 65536.f);
             }
 
@@ -4555,6 +5067,7 @@ static void process_all_playing(DUMB_IT_SIGRENDERER *sigrenderer) {
                     else*/
             {
                 int tick = sigrenderer->tick - 1;
+                int arpeggio;
                 if ((sigrenderer->sigdata->flags &
                      (IT_WAS_AN_XM | IT_WAS_A_MOD)) != IT_WAS_AN_XM)
                     tick = sigrenderer->speed - tick - 1;
@@ -4564,10 +5077,9 @@ static void process_all_playing(DUMB_IT_SIGRENDERER *sigrenderer) {
                     ++tick;
                 if (sigrenderer->sigdata->flags & IT_WAS_AN_STM)
                     tick /= 16;
-                playing->delta *= (float)pow(
-                    DUMB_SEMITONE_BASE,
-                    channel
-                        ->arpeggio_offsets[channel->arpeggio_table[tick & 31]]);
+                arpeggio = channel->arpeggio_table[tick & 31];
+                arpeggio = channel->arpeggio_offsets[arpeggio];
+                playing->delta *= it_pitch_factor(arpeggio * 256);
             }
             /*
             }*/
@@ -4589,7 +5101,8 @@ static void process_all_playing(DUMB_IT_SIGRENDERER *sigrenderer) {
                 // faded out or whatever. Let's hope nothing else was broken by
                 // it.
                 if (sigrenderer->channel[i].playing->flags & IT_PLAYING_DEAD) {
-                    free_playing(sigrenderer->channel[i].playing);
+                    free_playing(sigrenderer->voice_pool,
+                                 sigrenderer->channel[i].playing);
                     sigrenderer->channel[i].playing = NULL;
                 }
             }
@@ -4600,7 +5113,7 @@ static void process_all_playing(DUMB_IT_SIGRENDERER *sigrenderer) {
         if (sigrenderer->playing[i]) {
             process_playing(sigrenderer, sigrenderer->playing[i], invt2g);
             if (sigrenderer->playing[i]->flags & IT_PLAYING_DEAD) {
-                free_playing(sigrenderer->playing[i]);
+                free_playing(sigrenderer->voice_pool, sigrenderer->playing[i]);
                 sigrenderer->playing[i] = NULL;
             }
         }
@@ -4924,7 +5437,8 @@ static int process_tick(DUMB_IT_SIGRENDERER *sigrenderer) {
         }
     }
 
-    process_all_playing(sigrenderer);
+    if (!sigrenderer->timing_only)
+        process_all_playing(sigrenderer);
 
     {
         LONG_LONG t = (TICK_TIME_DIVIDEND / (sigrenderer->tempo << 8)) << 16;
@@ -4941,6 +5455,10 @@ static int process_tick(DUMB_IT_SIGRENDERER *sigrenderer) {
 
 int dumb_it_max_to_mix = 64;
 
+long dumb_it_max_float_sample_memory = 0;
+int dumb_it_min_unrolled_loop = 1024;
+long dumb_it_max_unroll_memory = 1024 * 1024;
+
 #if 0
 static const int aiMODVol[] =
 {
@@ -5113,11 +5631,10 @@ static long render_playing(DUMB_IT_SIGRENDERER *sigrenderer,
             quality > playing->sample->max_resampling_quality)
             quality = playing->sample->max_resampling_quality;
         playing->resampler.quality = quality;
-        resampler_set_quality(playing->resampler.fir_resampler[0], quality);
-        resampler_set_quality(playing->resampler.fir_resampler[1], quality);
+        resampler_set_quality(playing->resampler.fir_resampler, quality);
     }
 
-    bits = playing->sample->flags & IT_SAMPLE_16BIT ? 16 : 8;
+    bits = it_sample_bits(playing->sample);
 
     if (volume == 0) {
         if (playing->sample->flags & IT_SAMPLE_STEREO)
@@ -5263,91 +5780,92 @@ typedef struct IT_TO_MIX {
     float volume;
 } IT_TO_MIX;
 
-static int it_to_mix_compare(const void *e1, const void *e2) {
-    if (((const IT_TO_MIX *)e1)->volume > ((const IT_TO_MIX *)e2)->volume)
-        return -1;
-
-    if (((const IT_TO_MIX *)e1)->volume < ((const IT_TO_MIX *)e2)->volume)
-        return 1;
-
-    return 0;
-}
-
-static void apply_pitch_modifications(DUMB_IT_SIGDATA *sigdata,
-                                      IT_PLAYING *playing, float *delta,
-                                      int *cutoff) {
-    {
-        int sample_vibrato_shift;
-        switch (playing->sample_vibrato_waveform) {
-        default:
-            sample_vibrato_shift = it_sine[playing->sample_vibrato_time];
-            break;
-        case 1:
-            sample_vibrato_shift = it_sawtooth[playing->sample_vibrato_time];
-            break;
-        case 2:
-            sample_vibrato_shift = it_squarewave[playing->sample_vibrato_time];
-            break;
-        case 3:
-            sample_vibrato_shift = (rand() % 129) - 64;
-            break;
-        case 4:
-            sample_vibrato_shift =
-                it_xm_squarewave[playing->sample_vibrato_time];
-            break;
-        case 5:
-            sample_vibrato_shift = it_xm_ramp[playing->sample_vibrato_time];
-            break;
-        case 6:
-            sample_vibrato_shift =
-                it_xm_ramp[255 - playing->sample_vibrato_time];
-            break;
-        }
-
-        if (sigdata->flags & IT_WAS_AN_XM) {
-            int depth = playing->sample->vibrato_depth; /* True depth */
-            if (playing->sample->vibrato_rate) {
-                depth *= playing->sample_vibrato_depth; /* Tick number */
-                depth /= playing->sample->vibrato_rate; /* XM sweep */
+/* Moves the k loudest voices to the front of to_mix, so that those are the
+ * ones render_playing() lets through. Ties go to the voice that comes first,
+ * as they did when the whole lot was sorted, and each part stays in order.
+ * Only the k-th loudest volume has to be found for that, not a full sort.
+ */
+static void it_to_mix_select(IT_TO_MIX *to_mix, int n, int k) {
+    float vol[DUMB_IT_TOTAL_CHANNELS];
+    IT_TO_MIX rest[DUMB_IT_TOTAL_CHANNELS];
+    float threshold;
+    int lo = 0, hi = n - 1, i, n_front, n_rest, n_ties;
+
+    for (i = 0; i < n; i++)
+        vol[i] = to_mix[i].volume;
+
+    /* Partial quickselect, leaving the k-th loudest at vol[k - 1]. */
+    k--;
+    while (lo < hi) {
+        float pivot = vol[(lo + hi) >> 1];
+        int j = hi;
+        i = lo;
+        while (i <= j) {
+            while (vol[i] > pivot)
+                i++;
+            while (vol[j] < pivot)
+                j--;
+            if (i <= j) {
+                float t = vol[i];
+                vol[i++] = vol[j];
+                vol[j--] = t;
             }
-            sample_vibrato_shift *= depth;
-        } else
-            sample_vibrato_shift *= playing->sample_vibrato_depth >> 8;
-
-        sample_vibrato_shift >>= 4;
-
-        if (sample_vibrato_shift) {
-            if ((sigdata->flags & IT_LINEAR_SLIDES) ||
-                !(sigdata->flags & IT_WAS_AN_XM))
-                *delta *= (float)pow(DUMB_PITCH_BASE, sample_vibrato_shift);
-            else {
-                /* complicated! */
-                float scale = *delta / playing->delta;
+        }
+        if (k <= j)
+            hi = j;
+        else if (k >= i)
+            lo = i;
+        else
+            break;
+    }
+    threshold = vol[k];
 
-                *delta = (1.0f / 65536.0f) / playing->delta;
+    n_ties = k + 1;
+    for (i = 0; i < n; i++)
+        if (to_mix[i].volume > threshold)
+            n_ties--;
 
-                *delta -= sample_vibrato_shift / AMIGA_DIVISOR;
+    n_front = n_rest = 0;
+    for (i = 0; i < n; i++) {
+        if (to_mix[i].volume > threshold ||
+            (to_mix[i].volume == threshold && n_ties-- > 0))
+            to_mix[n_front++] = to_mix[i];
+        else
+            rest[n_rest++] = to_mix[i];
+    }
+    memcpy(to_mix + n_front, rest, n_rest * sizeof(*rest));
+}
 
-                if (*delta < (1.0f / 65536.0f) / 32767.0f) {
-                    *delta = (1.0f / 65536.0f) / 32767.0f;
-                }
+/* Makes sure the voices in to_mix that will be audible, given how many more
+ * may be mixed, come first. Returns how many will be silenced.
+ */
+static int it_to_mix_cull(IT_TO_MIX *to_mix, int n_to_mix, int left_to_mix) {
+    if (left_to_mix < 0)
+        left_to_mix = 0;
+    if (n_to_mix <= left_to_mix)
+        return 0;
+    if (left_to_mix > 0)
+        it_to_mix_select(to_mix, n_to_mix, left_to_mix);
+    return n_to_mix - left_to_mix;
+}
 
-                *delta = (1.0f / 65536.0f) / *delta * scale;
-            }
+static void it_count_culled(DUMB_IT_SIGRENDERER *sigrenderer, int n_to_mix,
+                            int n_culled) {
+    if (n_to_mix) {
+        sigrenderer->n_mix_slices++;
+        if (n_culled) {
+            sigrenderer->n_culled_slices++;
+            sigrenderer->n_culled_voices += n_culled;
         }
     }
+}
 
-    if (playing->env_instrument &&
-        (playing->enabled_envelopes & IT_ENV_PITCH)) {
-        int p = envelope_get_y(&playing->env_instrument->pitch_envelope,
-                               &playing->pitch_envelope);
-        if (playing->env_instrument->pitch_envelope.flags &
-            IT_ENVELOPE_PITCH_IS_FILTER)
-            *cutoff = (*cutoff * (p + (32 << IT_ENVELOPE_SHIFT))) >>
-                      (6 + IT_ENVELOPE_SHIFT);
-        else
-            *delta *= (float)pow(DUMB_PITCH_BASE, p >> (IT_ENVELOPE_SHIFT - 7));
-    }
+static void apply_pitch_modifications(IT_PLAYING *playing, float *delta,
+                                      int *cutoff) {
+    *delta *= playing->pitch_factor;
+    if (playing->filter_envelope >= 0)
+        *cutoff =
+            (*cutoff * playing->filter_envelope) >> (6 + IT_ENVELOPE_SHIFT);
 }
 
 static void render_normal(DUMB_IT_SIGRENDERER *sigrenderer, float volume,
@@ -5368,10 +5886,7 @@ static void render_normal(DUMB_IT_SIGRENDERER *sigrenderer, float volume,
             !(sigrenderer->channel[i].playing->flags & IT_PLAYING_DEAD)) {
             to_mix[n_to_mix].playing = sigrenderer->channel[i].playing;
             to_mix[n_to_mix].volume =
-                volume == 0
-                    ? 0
-                    : calculate_volume(sigrenderer,
-                                       sigrenderer->channel[i].playing, volume);
+                sigrenderer->channel[i].playing->mix_volume;
             n_to_mix++;
         }
     }
@@ -5380,16 +5895,14 @@ static void render_normal(DUMB_IT_SIGRENDERER *sigrenderer, float volume,
         if (sigrenderer
                 ->playing[i]) { /* Won't be dead; it would have been freed. */
             to_mix[n_to_mix].playing = sigrenderer->playing[i];
-            to_mix[n_to_mix].volume =
-                volume == 0 ? 0
-                            : calculate_volume(sigrenderer,
-                                               sigrenderer->playing[i], volume);
+            to_mix[n_to_mix].volume = sigrenderer->playing[i]->mix_volume;
             n_to_mix++;
         }
     }
 
     if (volume != 0)
-        qsort(to_mix, n_to_mix, sizeof(IT_TO_MIX), &it_to_mix_compare);
+        it_count_culled(sigrenderer, n_to_mix,
+                        it_to_mix_cull(to_mix, n_to_mix, left_to_mix));
 
     for (i = 0; i < n_to_mix; i++) {
         IT_PLAYING *playing = to_mix[i].playing;
@@ -5397,8 +5910,7 @@ static void render_normal(DUMB_IT_SIGRENDERER *sigrenderer, float volume,
         int cutoff = playing->filter_cutoff << IT_ENVELOPE_SHIFT;
         // int output = min( playing->output, max_output );
 
-        apply_pitch_modifications(sigrenderer->sigdata, playing, &note_delta,
-                                  &cutoff);
+        apply_pitch_modifications(playing, &note_delta, &cutoff);
 
         if (cutoff != 127 << IT_ENVELOPE_SHIFT ||
             playing->filter_resonance != 0) {
@@ -5468,7 +5980,8 @@ static void render_normal(DUMB_IT_SIGRENDERER *sigrenderer, float volume,
             // This change was made so Gxx would work correctly when a note
             // faded out or whatever. Let's hope nothing else was broken by it.
             if (sigrenderer->channel[i].playing->flags & IT_PLAYING_DEAD) {
-                free_playing(sigrenderer->channel[i].playing);
+                free_playing(sigrenderer->voice_pool,
+                             sigrenderer->channel[i].playing);
                 sigrenderer->channel[i].playing = NULL;
             }
         }
@@ -5477,7 +5990,7 @@ static void render_normal(DUMB_IT_SIGRENDERER *sigrenderer, float volume,
     for (i = 0; i < DUMB_IT_N_NNA_CHANNELS; i++) {
         if (sigrenderer->playing[i]) {
             if (sigrenderer->playing[i]->flags & IT_PLAYING_DEAD) {
-                free_playing(sigrenderer->playing[i]);
+                free_playing(sigrenderer->voice_pool, sigrenderer->playing[i]);
                 sigrenderer->playing[i] = NULL;
             }
         }
@@ -5489,7 +6002,7 @@ static void render_surround(DUMB_IT_SIGRENDERER *sigrenderer, float volume,
                             sample_t **samples) {
     int i;
 
-    int n_to_mix = 0, n_to_mix_surround = 0;
+    int n_to_mix = 0, n_to_mix_surround = 0, n_culled;
     IT_TO_MIX to_mix[DUMB_IT_TOTAL_CHANNELS];
     IT_TO_MIX to_mix_surround[DUMB_IT_TOTAL_CHANNELS];
     int left_to_mix = dumb_it_max_to_mix;
@@ -5510,9 +6023,7 @@ static void render_surround(DUMB_IT_SIGRENDERER *sigrenderer, float volume,
                                      ? to_mix_surround + n_to_mix_surround++
                                      : to_mix + n_to_mix++;
             _to_mix->playing = playing;
-            _to_mix->volume =
-                volume == 0 ? 0
-                            : calculate_volume(sigrenderer, playing, volume);
+            _to_mix->volume = playing->mix_volume;
         }
     }
 
@@ -5524,16 +6035,16 @@ static void render_surround(DUMB_IT_SIGRENDERER *sigrenderer, float volume,
                                      ? to_mix_surround + n_to_mix_surround++
                                      : to_mix + n_to_mix++;
             _to_mix->playing = playing;
-            _to_mix->volume =
-                volume == 0 ? 0
-                            : calculate_volume(sigrenderer, playing, volume);
+            _to_mix->volume = playing->mix_volume;
         }
     }
 
+    /* The surround voices get whatever mixing budget the others leave. */
     if (volume != 0) {
-        qsort(to_mix, n_to_mix, sizeof(IT_TO_MIX), &it_to_mix_compare);
-        qsort(to_mix_surround, n_to_mix_surround, sizeof(IT_TO_MIX),
-              &it_to_mix_compare);
+        n_culled = it_to_mix_cull(to_mix, n_to_mix, left_to_mix);
+        n_culled += it_to_mix_cull(to_mix_surround, n_to_mix_surround,
+                                   left_to_mix - (n_to_mix - n_culled));
+        it_count_culled(sigrenderer, n_to_mix + n_to_mix_surround, n_culled);
     }
 
     sigrenderer->n_channels = 2;
@@ -5544,8 +6055,7 @@ static void render_surround(DUMB_IT_SIGRENDERER *sigrenderer, float volume,
         int cutoff = playing->filter_cutoff << IT_ENVELOPE_SHIFT;
         // int output = min( playing->output, max_output );
 
-        apply_pitch_modifications(sigrenderer->sigdata, playing, &note_delta,
-                                  &cutoff);
+        apply_pitch_modifications(playing, &note_delta, &cutoff);
 
         if (cutoff != 127 << IT_ENVELOPE_SHIFT ||
             playing->filter_resonance != 0) {
@@ -5603,8 +6113,7 @@ static void render_surround(DUMB_IT_SIGRENDERER *sigrenderer, float volume,
         int cutoff = playing->filter_cutoff << IT_ENVELOPE_SHIFT;
         // int output = min( playing->output, max_output );
 
-        apply_pitch_modifications(sigrenderer->sigdata, playing, &note_delta,
-                                  &cutoff);
+        apply_pitch_modifications(playing, &note_delta, &cutoff);
 
         if (cutoff != 127 << IT_ENVELOPE_SHIFT ||
             playing->filter_resonance != 0) {
@@ -5662,7 +6171,8 @@ static void render_surround(DUMB_IT_SIGRENDERER *sigrenderer, float volume,
             // This change was made so Gxx would work correctly when a note
             // faded out or whatever. Let's hope nothing else was broken by it.
             if (sigrenderer->channel[i].playing->flags & IT_PLAYING_DEAD) {
-                free_playing(sigrenderer->channel[i].playing);
+                free_playing(sigrenderer->voice_pool,
+                             sigrenderer->channel[i].playing);
                 sigrenderer->channel[i].playing = NULL;
             }
         }
@@ -5671,7 +6181,76 @@ static void render_surround(DUMB_IT_SIGRENDERER *sigrenderer, float volume,
     for (i = 0; i < DUMB_IT_N_NNA_CHANNELS; i++) {
         if (sigrenderer->playing[i]) {
             if (sigrenderer->playing[i]->flags & IT_PLAYING_DEAD) {
-                free_playing(sigrenderer->playing[i]);
+                free_playing(sigrenderer->voice_pool, sigrenderer->playing[i]);
+                sigrenderer->playing[i] = NULL;
+            }
+        }
+    }
+}
+
+/* Moves a voice on as rendering it silently would, leaving out everything
+ * that only matters to the output. The FIR resampler is left alone too.
+ */
+static void simulate_playing(DUMB_IT_SIGRENDERER *sigrenderer,
+                             IT_PLAYING *playing, float delta, long size) {
+    int quality = sigrenderer->resampling_quality;
+    int bits = it_sample_bits(playing->sample);
+    float note_delta = delta * playing->delta;
+    int cutoff = playing->filter_cutoff << IT_ENVELOPE_SHIFT;
+
+    apply_pitch_modifications(playing, &note_delta, &cutoff);
+
+    if (cutoff != 127 << IT_ENVELOPE_SHIFT || playing->filter_resonance != 0) {
+        playing->true_filter_cutoff = cutoff;
+        playing->true_filter_resonance = playing->filter_resonance;
+    }
+    it_reset_filter_state(&playing->filter_state[0]);
+    it_reset_filter_state(&playing->filter_state[1]);
+
+    if (playing->sample->max_resampling_quality >= 0 &&
+        quality > playing->sample->max_resampling_quality)
+        quality = playing->sample->max_resampling_quality;
+    playing->resampler.quality = quality;
+
+    if (playing->sample->flags & IT_SAMPLE_STEREO)
+        dumb_resample_n_2_1(bits, &playing->resampler, NULL, size, 0, 0,
+                            note_delta);
+    else
+        dumb_resample_n_1_1(bits, &playing->resampler, NULL, size, 0,
+                            note_delta);
+
+    /* Silent rendering never gets to the end of a ramp, so let go of voices
+     * which would have finished ramping out by now.
+     */
+    if (playing->resampler.dir == 0 || playing->declick_stage >= 4)
+        playing->flags |= IT_PLAYING_DEAD;
+}
+
+/* Used in place of render() when there is nowhere for the output to go, as
+ * when seeking or building checkpoints.
+ */
+static void simulate(DUMB_IT_SIGRENDERER *sigrenderer, float delta,
+                     long size) {
+    int i;
+
+    for (i = 0; i < DUMB_IT_N_CHANNELS; i++) {
+        IT_PLAYING *playing = sigrenderer->channel[i].playing;
+        if (playing) {
+            if (!(playing->flags & IT_PLAYING_DEAD))
+                simulate_playing(sigrenderer, playing, delta, size);
+            if (playing->flags & IT_PLAYING_DEAD) {
+                free_playing(sigrenderer->voice_pool, playing);
+                sigrenderer->channel[i].playing = NULL;
+            }
+        }
+    }
+
+    for (i = 0; i < DUMB_IT_N_NNA_CHANNELS; i++) {
+        IT_PLAYING *playing = sigrenderer->playing[i];
+        if (playing) {
+            simulate_playing(sigrenderer, playing, delta, size);
+            if (playing->flags & IT_PLAYING_DEAD) {
+                free_playing(sigrenderer->voice_pool, playing);
                 sigrenderer->playing[i] = NULL;
             }
         }
@@ -5682,12 +6261,136 @@ static void render(DUMB_IT_SIGRENDERER *sigrenderer, float volume, float delta,
                    long pos, long size, sample_t **samples) {
     if (size == 0)
         return;
-    if (sigrenderer->n_channels == 1 || sigrenderer->n_channels == 2)
+    if (!samples) {
+        if (!sigrenderer->timing_only)
+            simulate(sigrenderer, delta, size);
+    } else if (sigrenderer->n_channels == 1 || sigrenderer->n_channels == 2)
         render_normal(sigrenderer, volume, delta, pos, size, samples);
     else if (sigrenderer->n_channels == 3)
         render_surround(sigrenderer, volume, delta, pos, size, samples);
 }
 
+/* Returns where a loop shorter than dumb_it_min_unrolled_loop will end once
+ * it has been copied out to at least that length, or 0 if it will be left
+ * alone. Ping-pong loops are copied forwards and then backwards, so that they
+ * too can be played as forward loops. Sustain loops are left alone, since
+ * releasing them has to find the position within the original loop.
+ */
+static long it_unrolled_loop_end(IT_SAMPLE *sample) {
+    long length = sample->loop_end - sample->loop_start;
+    long period = length;
+
+    if ((sample->flags & (IT_SAMPLE_LOOP | IT_SAMPLE_SUS_LOOP)) !=
+            IT_SAMPLE_LOOP ||
+        length <= 0 || length >= dumb_it_min_unrolled_loop)
+        return 0;
+
+    if (sample->flags & IT_SAMPLE_PINGPONG_LOOP)
+        period <<= 1;
+    return sample->loop_start +
+           (dumb_it_min_unrolled_loop + period - 1) / period * period;
+}
+
+/* Fills fir_data from loop_end up to fir_loop_end with copies of the loop. */
+static void it_unroll_loop(IT_SAMPLE *sample, int channels) {
+    long length = sample->loop_end - sample->loop_start;
+    long period = length;
+    long j;
+    int c;
+
+    if (sample->flags & IT_SAMPLE_PINGPONG_LOOP)
+        period <<= 1;
+
+    for (j = length; j < sample->fir_loop_end - sample->loop_start; j++) {
+        long i = j % period;
+        if (i >= length)
+            i = (length << 1) - 1 - i;
+        for (c = 0; c < channels; c++)
+            sample->fir_data[(sample->loop_start + j) * channels + c] =
+                sample->fir_data[(sample->loop_start + i) * channels + c];
+    }
+}
+
+/* Converts the samples to floats once, as far as
+ * dumb_it_max_float_sample_memory allows, so the FIR resampler can be fed from
+ * them without converting every sample each time it is played. Short loops
+ * are unrolled at the same time, as far as dumb_it_max_unroll_memory allows.
+ * A sample there is no memory for is played from its original data instead.
+ */
+static void it_make_fir_data(DUMB_IT_SIGDATA *sigdata) {
+    long float_memory = dumb_it_max_float_sample_memory;
+    long unroll_memory = dumb_it_max_unroll_memory;
+    int n;
+
+    for (n = 0; n < sigdata->n_samples; n++) {
+        IT_SAMPLE *sample = &sigdata->sample[n];
+        int channels = sample->flags & IT_SAMPLE_STEREO ? 2 : 1;
+        long i, size = sample->length;
+        long loop_end;
+
+        sample->fir_data = NULL;
+        sample->fir_loop_end = 0;
+        if (!(sample->flags & IT_SAMPLE_EXISTS) || !sample->data || size <= 0)
+            continue;
+
+        /* A private float copy would cost more memory than sharing the
+         * mapped file's pages saves.
+         */
+        if (_dumbfile_mapping_contains(sigdata->mapping, sample->data))
+            continue;
+
+        if (size > float_memory / (channels * (long)sizeof(float)))
+            continue;
+
+        loop_end = it_unrolled_loop_end(sample);
+        if (loop_end > size) {
+            long extra = (loop_end - size) * channels * (long)sizeof(float);
+            if (extra > unroll_memory)
+                loop_end = 0;
+            else {
+                unroll_memory -= extra;
+                size = loop_end;
+            }
+        }
+
+        sample->fir_data = malloc(size * channels * sizeof(*sample->fir_data));
+        if (!sample->fir_data)
+            continue;
+
+        size = sample->length * channels;
+        float_memory -= size * (long)sizeof(float);
+        if (sample->flags & IT_SAMPLE_16BIT) {
+            short *src = sample->data;
+            for (i = 0; i < size; i++)
+                sample->fir_data[i] = src[i] * (1.0f / 32768.0f);
+        } else {
+            signed char *src = sample->data;
+            for (i = 0; i < size; i++)
+                sample->fir_data[i] = src[i] * (1.0f / 256.0f);
+        }
+
+        if (loop_end) {
+            sample->fir_loop_end = loop_end;
+            it_unroll_loop(sample, channels);
+        }
+    }
+}
+
+/* Prepares the samples for playback, the first time the sigdata is played.
+ * Returns -1 if memory runs out.
+ */
+int _dumb_it_process_sigdata(DUMB_IT_SIGDATA *sigdata) {
+    if (!(sigdata->flags & IT_WAS_PROCESSED)) {
+        if (dumb_it_add_lpc(sigdata) < 0)
+            return -1;
+
+        it_make_fir_data(sigdata);
+
+        sigdata->flags |= IT_WAS_PROCESSED;
+    }
+    return 0;
+}
+
 static DUMB_IT_SIGRENDERER *init_sigrenderer(DUMB_IT_SIGDATA *sigdata,
                                              int n_channels, int startorder,
                                              IT_CALLBACKS *callbacks,
@@ -5695,6 +6398,8 @@ static DUMB_IT_SIGRENDERER *init_sigrenderer(DUMB_IT_SIGDATA *sigdata,
     DUMB_IT_SIGRENDERER *sigrenderer;
     int i;
 
+    it_init_pitch_table();
+
     if (startorder > sigdata->n_orders) {
         free(callbacks);
         dumb_destroy_click_remover_array(n_channels, cr);
@@ -5702,6 +6407,13 @@ static DUMB_IT_SIGRENDERER *init_sigrenderer(DUMB_IT_SIGDATA *sigdata,
     }
 
     sigrenderer = malloc(sizeof(*sigrenderer));
+    if (sigrenderer) {
+        sigrenderer->voice_pool = create_playing_pool();
+        if (!sigrenderer->voice_pool) {
+            free(sigrenderer);
+            sigrenderer = NULL;
+        }
+    }
     if (!sigrenderer) {
         free(callbacks);
         dumb_destroy_click_remover_array(n_channels, cr);
@@ -5711,8 +6423,15 @@ static DUMB_IT_SIGRENDERER *init_sigrenderer(DUMB_IT_SIGDATA *sigdata,
     sigrenderer->callbacks = callbacks;
     sigrenderer->click_remover = cr;
 
+    sigrenderer->own_sample = NULL;
+    sigrenderer->n_mix_slices = 0;
+    sigrenderer->n_culled_slices = 0;
+    sigrenderer->n_culled_voices = 0;
+
     sigrenderer->sigdata = sigdata;
     sigrenderer->n_channels = n_channels;
+
+    sigrenderer->timing_only = 0;
     sigrenderer->resampling_quality = dumb_resampling_quality;
     sigrenderer->ramp_style = DUMB_IT_RAMP_FULL;
     sigrenderer->globalvolume = sigdata->global_volume;
@@ -5735,6 +6454,7 @@ static DUMB_IT_SIGRENDERER *init_sigrenderer(DUMB_IT_SIGDATA *sigdata,
         channel->filter_cutoff = 127;
         channel->filter_resonance = 0;
         channel->new_note_action = 0xFF;
+        channel->arpeggio_table = (const unsigned char *)&arpeggio_mod;
         channel->xm_retrig = 0;
         channel->retrig_tick = 0;
         channel->tremor_time = 0;
@@ -5802,6 +6522,9 @@ static DUMB_IT_SIGRENDERER *init_sigrenderer(DUMB_IT_SIGDATA *sigdata,
     sigrenderer->n_rows = 0;
     sigrenderer->breakrow = 0;
     sigrenderer->rowcount = 1;
+    sigrenderer->entry_start = NULL;
+    sigrenderer->entry = NULL;
+    sigrenderer->entry_end = NULL;
     sigrenderer->order = startorder;
     /* meh!
     if (startorder > 0) {
@@ -5872,13 +6595,9 @@ found_valid_order:
 
     // sigrenderer->max_output = 0;
 
-    if (!(sigdata->flags & IT_WAS_PROCESSED)) {
-        if (dumb_it_add_lpc(sigdata) < 0) {
-            _dumb_it_end_sigrenderer(sigrenderer);
-            return NULL;
-        }
-
-        sigdata->flags |= IT_WAS_PROCESSED;
+    if (_dumb_it_process_sigdata(sigdata) < 0) {
+        _dumb_it_end_sigrenderer(sigrenderer);
+        return NULL;
     }
 
     return sigrenderer;
@@ -5894,9 +6613,7 @@ void dumb_it_set_resampling_quality(DUMB_IT_SIGRENDERER *sigrenderer,
                 IT_PLAYING *playing = sigrenderer->channel[i].playing;
                 playing->resampling_quality = quality;
                 playing->resampler.quality = quality;
-                resampler_set_quality(playing->resampler.fir_resampler[0],
-                                      quality);
-                resampler_set_quality(playing->resampler.fir_resampler[1],
+                resampler_set_quality(playing->resampler.fir_resampler,
                                       quality);
             }
         }
@@ -5905,9 +6622,7 @@ void dumb_it_set_resampling_quality(DUMB_IT_SIGRENDERER *sigrenderer,
                 IT_PLAYING *playing = sigrenderer->playing[i];
                 playing->resampling_quality = quality;
                 playing->resampler.quality = quality;
-                resampler_set_quality(playing->resampler.fir_resampler[0],
-                                      quality);
-                resampler_set_quality(playing->resampler.fir_resampler[1],
+                resampler_set_quality(playing->resampler.fir_resampler,
                                       quality);
             }
         }
@@ -5992,38 +6707,26 @@ DUH_SIGRENDERER *dumb_it_start_at_order(DUH *duh, int n_channels,
     return duh_encapsulate_it_sigrenderer(itsr, n_channels, 0);
 }
 
-static sigrenderer_t *it_start_sigrenderer(DUH *duh, sigdata_t *vsigdata,
-                                           int n_channels, long pos) {
-    DUMB_IT_SIGDATA *sigdata = vsigdata;
-    DUMB_IT_SIGRENDERER *sigrenderer;
-
-    (void)duh;
-
-    {
-        IT_CALLBACKS *callbacks = create_callbacks();
-        if (!callbacks)
-            return NULL;
+static void extend_runthrough(DUMB_IT_SIGDATA *sigdata, long pos);
 
-        if (sigdata->checkpoint) {
-            IT_CHECKPOINT *checkpoint = sigdata->checkpoint;
-            while (checkpoint->next && checkpoint->next->time < pos)
-                checkpoint = checkpoint->next;
-            sigrenderer =
-                dup_sigrenderer(checkpoint->sigrenderer, n_channels, callbacks);
-            if (!sigrenderer)
-                return NULL;
-            sigrenderer->click_remover =
-                dumb_create_click_remover_array(n_channels);
-            pos -= checkpoint->time;
-        } else {
-            sigrenderer =
-                init_sigrenderer(sigdata, n_channels, 0, callbacks,
-                                 dumb_create_click_remover_array(n_channels));
-            if (!sigrenderer)
-                return NULL;
-        }
+/* Returns the last checkpoint at or before pos. */
+static IT_CHECKPOINT *find_checkpoint(DUMB_IT_SIGDATA *sigdata, long pos) {
+    IT_CHECKPOINT *checkpoint = sigdata->checkpoint;
+    int lo = 0, hi = sigdata->n_checkpoints - 1;
+    while (lo < hi) {
+        int mid = (lo + hi + 1) >> 1;
+        if (checkpoint[mid].time <= pos)
+            lo = mid;
+        else
+            hi = mid - 1;
     }
+    return checkpoint + lo;
+}
 
+/* Advances the sigrenderer by pos samples without mixing anything. Returns
+ * nonzero if a callback terminated the music on the way.
+ */
+static int skip_sigrenderer(DUMB_IT_SIGRENDERER *sigrenderer, long pos) {
     while (pos > 0 && pos >= sigrenderer->time_left) {
         render(sigrenderer, 0, 1.0f, 0, sigrenderer->time_left, NULL);
 
@@ -6034,10 +6737,8 @@ static sigrenderer_t *it_start_sigrenderer(DUH *duh, sigdata_t *vsigdata,
         pos -= sigrenderer->time_left;
         sigrenderer->time_left = 0;
 
-        if (process_tick(sigrenderer)) {
-            _dumb_it_end_sigrenderer(sigrenderer);
-            return NULL;
-        }
+        if (process_tick(sigrenderer))
+            return 1;
     }
 
     render(sigrenderer, 0, 1.0f, 0, pos, NULL);
@@ -6047,9 +6748,146 @@ static sigrenderer_t *it_start_sigrenderer(DUH *duh, sigdata_t *vsigdata,
     sigrenderer->time_played += (LONG_LONG)pos << 16;
 #endif
 
+    return 0;
+}
+
+/* Releases the sigrenderer's voices, returning them to its pool, along with
+ * its own samples, bit arrays and timekeeper, ready for restore_snapshot().
+ */
+static void release_playback_state(DUMB_IT_SIGRENDERER *sigrenderer) {
+    int i;
+
+    for (i = 0; i < DUMB_IT_N_CHANNELS; i++) {
+        IT_CHANNEL *channel = &sigrenderer->channel[i];
+        if (channel->playing)
+            free_playing(sigrenderer->voice_pool, channel->playing);
+#ifdef BIT_ARRAY_BULLSHIT
+        bit_array_destroy(channel->played_patjump);
+#endif
+    }
+
+    for (i = 0; i < DUMB_IT_N_NNA_CHANNELS; i++)
+        if (sigrenderer->playing[i])
+            free_playing(sigrenderer->voice_pool, sigrenderer->playing[i]);
+
+    it_free_own_samples(sigrenderer);
+
+#ifdef BIT_ARRAY_BULLSHIT
+    bit_array_destroy(sigrenderer->played);
+    timekeeping_array_destroy(sigrenderer->row_timekeeper);
+#endif
+}
+
+static sigrenderer_t *it_start_sigrenderer(DUH *duh, sigdata_t *vsigdata,
+                                           int n_channels, long pos) {
+    DUMB_IT_SIGDATA *sigdata = vsigdata;
+    DUMB_IT_SIGRENDERER *sigrenderer;
+
+    (void)duh;
+
+    {
+        IT_CALLBACKS *callbacks;
+
+        extend_runthrough(sigdata, pos);
+
+        callbacks = create_callbacks();
+        if (!callbacks)
+            return NULL;
+
+        sigrenderer =
+            init_sigrenderer(sigdata, n_channels, 0, callbacks,
+                             dumb_create_click_remover_array(n_channels));
+        if (!sigrenderer)
+            return NULL;
+
+        if (sigdata->checkpoint) {
+            IT_CHECKPOINT *checkpoint = find_checkpoint(sigdata, pos);
+            /* Checkpoints restored by dumb_it_load_runthrough() may be the
+             * first thing this process plays.
+             */
+            it_init_pitch_table();
+            release_playback_state(sigrenderer);
+            restore_snapshot(sigrenderer, checkpoint->snapshot);
+            pos -= checkpoint->time;
+        }
+    }
+
+    if (skip_sigrenderer(sigrenderer, pos)) {
+        _dumb_it_end_sigrenderer(sigrenderer);
+        return NULL;
+    }
+
     return sigrenderer;
 }
 
+/* Puts the sigrenderer back at pos samples from the start of the song, as
+ * it_start_sigrenderer() would have left it, but keeps its voice pool,
+ * callbacks, resampling quality and ramp style. The click removers start
+ * afresh. The callbacks are not called while skipping ahead from the
+ * checkpoint.
+ */
+static int it_sigrenderer_seek(sigrenderer_t *vsigrenderer, long pos) {
+    DUMB_IT_SIGRENDERER *sigrenderer = vsigrenderer;
+    DUMB_IT_SIGDATA *sigdata = sigrenderer->sigdata;
+    IT_SNAPSHOT *snapshot, *initial = NULL;
+    IT_CALLBACKS *callbacks = sigrenderer->callbacks;
+    IT_CALLBACKS no_callbacks;
+    int resampling_quality = sigrenderer->resampling_quality;
+    int ramp_style = sigrenderer->ramp_style;
+    int ret;
+
+    if (pos < 0)
+        return -1;
+
+    extend_runthrough(sigdata, pos);
+
+    if (sigdata->checkpoint) {
+        IT_CHECKPOINT *checkpoint = find_checkpoint(sigdata, pos);
+        it_init_pitch_table();
+        snapshot = checkpoint->snapshot;
+        pos -= checkpoint->time;
+    } else {
+        DUMB_IT_SIGRENDERER *start;
+        IT_CALLBACKS *start_callbacks = create_callbacks();
+        if (!start_callbacks)
+            return -1;
+        start = init_sigrenderer(sigdata, 0, 0, start_callbacks, NULL);
+        if (!start)
+            return -1;
+        initial = save_snapshot(start);
+        _dumb_it_end_sigrenderer(start);
+        if (!initial)
+            return -1;
+        snapshot = initial;
+    }
+
+    release_playback_state(sigrenderer);
+    restore_snapshot(sigrenderer, snapshot);
+    _dumb_it_destroy_snapshot(initial);
+
+    /* Clicks recorded before the seek belong to the old position. */
+    dumb_destroy_click_remover_array(sigrenderer->n_channels,
+                                     sigrenderer->click_remover);
+    sigrenderer->click_remover =
+        dumb_create_click_remover_array(sigrenderer->n_channels);
+
+    memset(&no_callbacks, 0, sizeof(no_callbacks));
+    sigrenderer->callbacks = &no_callbacks;
+    ret = skip_sigrenderer(sigrenderer, pos);
+    sigrenderer->callbacks = callbacks;
+
+    dumb_it_set_resampling_quality(sigrenderer, resampling_quality);
+    sigrenderer->ramp_style = ramp_style;
+
+    if (ret) {
+        sigrenderer->order = -1;
+        sigrenderer->row = -1;
+        return -1;
+    }
+
+    return 0;
+}
+
 static long it_sigrenderer_get_samples(sigrenderer_t *vsigrenderer,
                                        float volume, float delta, long size,
                                        sample_t **samples) {
@@ -6159,7 +6997,7 @@ void _dumb_it_end_sigrenderer(sigrenderer_t *vsigrenderer) {
     if (sigrenderer) {
         for (i = 0; i < DUMB_IT_N_CHANNELS; i++) {
             if (sigrenderer->channel[i].playing)
-                free_playing(sigrenderer->channel[i].playing);
+                destroy_playing(sigrenderer->channel[i].playing);
 #ifdef BIT_ARRAY_BULLSHIT
             bit_array_destroy(sigrenderer->channel[i].played_patjump);
 #endif
@@ -6167,7 +7005,11 @@ void _dumb_it_end_sigrenderer(sigrenderer_t *vsigrenderer) {
 
         for (i = 0; i < DUMB_IT_N_NNA_CHANNELS; i++)
             if (sigrenderer->playing[i])
-                free_playing(sigrenderer->playing[i]);
+                destroy_playing(sigrenderer->playing[i]);
+
+        destroy_playing_pool(sigrenderer->voice_pool);
+
+        it_free_own_samples(sigrenderer);
 
         dumb_destroy_click_remover_array(sigrenderer->n_channels,
                                          sigrenderer->click_remover);
@@ -6205,7 +7047,8 @@ DUH_SIGTYPE_DESC _dumb_sigtype_it = {SIGTYPE_IT,
                                      NULL,
 #endif
                                      &_dumb_it_end_sigrenderer,
-                                     &_dumb_it_unload_sigdata};
+                                     &_dumb_it_unload_sigdata,
+                                     &it_sigrenderer_seek};
 
 DUH_SIGRENDERER *
 duh_encapsulate_it_sigrenderer(DUMB_IT_SIGRENDERER *it_sigrenderer,
@@ -6258,7 +7101,7 @@ void dumb_it_sr_get_channel_state(DUMB_IT_SIGRENDERER *sr, int channel,
 
     delta = playing->delta * 65536.0f;
     t = playing->filter_cutoff << IT_ENVELOPE_SHIFT;
-    apply_pitch_modifications(sr->sigdata, playing, &delta, &t);
+    apply_pitch_modifications(playing, &delta, &t);
     state->freq = (int)delta;
     if (t == 127 << IT_ENVELOPE_SHIFT && playing->filter_resonance == 0) {
         state->filter_resonance = playing->true_filter_resonance;
@@ -6269,6 +7112,25 @@ void dumb_it_sr_get_channel_state(DUMB_IT_SIGRENDERER *sr, int channel,
     state->filter_subcutoff = (unsigned char)t;
 }
 
+void dumb_it_sr_get_voice_stats(DUMB_IT_SIGRENDERER *sr,
+                                DUMB_IT_VOICE_STATS *stats) {
+    if (!sr) {
+        stats->active = stats->active_peak = 0;
+        stats->pooled = stats->pooled_peak = 0;
+        stats->allocated = 0;
+        stats->mix_slices = stats->culled_slices = stats->culled = 0;
+        return;
+    }
+    stats->active = sr->voice_pool->n_active;
+    stats->active_peak = sr->voice_pool->peak_active;
+    stats->pooled = sr->voice_pool->n_free;
+    stats->pooled_peak = sr->voice_pool->peak_free;
+    stats->allocated = sr->voice_pool->n_allocated;
+    stats->mix_slices = sr->n_mix_slices;
+    stats->culled_slices = sr->n_culled_slices;
+    stats->culled = sr->n_culled_voices;
+}
+
 int dumb_it_callback_terminate(void *data) {
     (void)data;
     return 1;
@@ -6287,90 +7149,452 @@ int dumb_it_callback_midi_block(void *data, int channel,
 #define FUCKIT_THRESHOLD                                                       \
     (120 * 60 * 65536) /* two hours? probably a pattern loop mess... */
 
-/* Returns the length of the module, up until it first loops. */
-long dumb_it_build_checkpoints(DUMB_IT_SIGDATA *sigdata, int startorder) {
-    IT_CHECKPOINT *checkpoint;
-    if (!sigdata)
-        return 0;
-    checkpoint = sigdata->checkpoint;
-    while (checkpoint) {
-        IT_CHECKPOINT *next = checkpoint->next;
-        _dumb_it_end_sigrenderer(checkpoint->sigrenderer);
-        free(checkpoint);
-        checkpoint = next;
-    }
+long dumb_it_checkpoint_interval = 2 * 65536;
+int dumb_it_max_checkpoints = 512;
+
+void _dumb_it_free_checkpoints(DUMB_IT_SIGDATA *sigdata) {
+    int i;
+    if (sigdata->runthrough) {
+        _dumb_it_end_sigrenderer(sigdata->runthrough->sigrenderer);
+        free(sigdata->runthrough);
+        sigdata->runthrough = NULL;
+    }
+    _dumb_it_destroy_row_index(sigdata->row_index);
+    sigdata->row_index = NULL;
+    if (!sigdata->checkpoint)
+        return;
+    for (i = 0; i < sigdata->n_checkpoints; i++)
+        _dumb_it_destroy_snapshot(sigdata->checkpoint[i].snapshot);
+    free(sigdata->checkpoint);
     sigdata->checkpoint = NULL;
-    checkpoint = malloc(sizeof(*checkpoint));
-    if (!checkpoint)
-        return 0;
-    checkpoint->time = 0;
-    checkpoint->sigrenderer = dumb_it_init_sigrenderer(sigdata, 0, startorder);
-    if (!checkpoint->sigrenderer) {
-        free(checkpoint);
-        return 0;
+}
+
+/* Appends a snapshot of sigrenderer, first thinning the checkpoints out if
+ * there are too many. Returns -1 if memory runs out.
+ */
+static int add_checkpoint(DUMB_IT_SIGDATA *sigdata, int *size,
+                          long *interval, DUMB_IT_SIGRENDERER *sigrenderer,
+                          long time) {
+    IT_CHECKPOINT *checkpoint = sigdata->checkpoint;
+    int n = sigdata->n_checkpoints;
+    int i;
+
+    if (n >= dumb_it_max_checkpoints && n >= 2) {
+        for (i = 1; i < n; i += 2)
+            _dumb_it_destroy_snapshot(checkpoint[i].snapshot);
+        for (i = 2; i < n; i += 2)
+            checkpoint[i >> 1] = checkpoint[i];
+        n = (n + 1) >> 1;
+        sigdata->n_checkpoints = n;
+        *interval <<= 1;
     }
-    checkpoint->sigrenderer->callbacks->loop = &dumb_it_callback_terminate;
-    checkpoint->sigrenderer->callbacks->xm_speed_zero =
-        &dumb_it_callback_terminate;
-    checkpoint->sigrenderer->callbacks->global_volume_zero =
-        &dumb_it_callback_terminate;
 
-    if (sigdata->checkpoint) {
-        IT_CHECKPOINT *checkpoint = sigdata->checkpoint;
-        while (checkpoint) {
-            IT_CHECKPOINT *next = checkpoint->next;
-            _dumb_it_end_sigrenderer(checkpoint->sigrenderer);
-            free(checkpoint);
-            checkpoint = next;
+    if (n >= *size) {
+        int new_size = *size ? *size * 2 : 64;
+        checkpoint = realloc(checkpoint, new_size * sizeof(*checkpoint));
+        if (!checkpoint)
+            return -1;
+        sigdata->checkpoint = checkpoint;
+        *size = new_size;
+    }
+
+    checkpoint[n].snapshot = save_snapshot(sigrenderer);
+    if (!checkpoint[n].snapshot)
+        return -1;
+    checkpoint[n].time = time;
+    sigdata->n_checkpoints = n + 1;
+    return 0;
+}
+
+IT_ROW_INDEX *_dumb_it_create_row_index(DUMB_IT_SIGDATA *sigdata) {
+    IT_ROW_INDEX *index;
+    int n_rows = 0;
+    int i;
+
+    for (i = 0; i < sigdata->n_orders; i++) {
+        int n = sigdata->order[i];
+        if (n < sigdata->n_patterns)
+            n_rows += MIN(sigdata->pattern[n].n_rows, 256);
+    }
+
+    index = malloc(sizeof(*index) + n_rows * sizeof(*index->time) +
+                   (sigdata->n_orders + 1) * sizeof(*index->order_start));
+    if (!index)
+        return NULL;
+
+    index->n_orders = sigdata->n_orders;
+    index->n_rows = n_rows;
+    index->n_reached = 0;
+    index->time = (long *)(index + 1);
+    index->order_start = (int *)(index->time + n_rows);
+    index->by_time = NULL;
+
+    n_rows = 0;
+    for (i = 0; i < sigdata->n_orders; i++) {
+        int n = sigdata->order[i];
+        index->order_start[i] = n_rows;
+        if (n < sigdata->n_patterns)
+            n_rows += MIN(sigdata->pattern[n].n_rows, 256);
+    }
+    index->order_start[i] = n_rows;
+
+    for (i = 0; i < n_rows; i++)
+        index->time[i] = -1;
+
+    return index;
+}
+
+static int row_time_compare(const void *a, const void *b) {
+    const IT_ROW_TIME *ra = (const IT_ROW_TIME *)a;
+    const IT_ROW_TIME *rb = (const IT_ROW_TIME *)b;
+    if (ra->time != rb->time)
+        return ra->time < rb->time ? -1 : 1;
+    if (ra->order != rb->order)
+        return ra->order - rb->order;
+    return ra->row - rb->row;
+}
+
+int _dumb_it_sort_row_index(IT_ROW_INDEX *index) {
+    int order, i, n = 0;
+
+    for (i = 0; i < index->n_rows; i++)
+        if (index->time[i] >= 0)
+            n++;
+
+    free(index->by_time);
+    index->n_reached = 0;
+    index->by_time = malloc((n ? n : 1) * sizeof(*index->by_time));
+    if (!index->by_time)
+        return -1;
+
+    for (order = 0; order < index->n_orders; order++) {
+        for (i = index->order_start[order];
+             i < index->order_start[order + 1]; i++) {
+            if (index->time[i] >= 0) {
+                IT_ROW_TIME *r = &index->by_time[index->n_reached++];
+                r->time = index->time[i];
+                r->order = order;
+                r->row = i - index->order_start[order];
+            }
         }
     }
 
-    sigdata->checkpoint = checkpoint;
+    qsort(index->by_time, index->n_reached, sizeof(*index->by_time),
+          &row_time_compare);
+    return 0;
+}
+
+void _dumb_it_destroy_row_index(IT_ROW_INDEX *index) {
+    if (index) {
+        free(index->by_time);
+        free(index);
+    }
+}
+
+#ifdef BIT_ARRAY_BULLSHIT
+/* Records when the runthrough first reached each row. */
+static IT_ROW_INDEX *build_row_index(DUMB_IT_SIGDATA *sigdata,
+                                     DUMB_IT_SIGRENDERER *sigrenderer) {
+    IT_ROW_INDEX *index = _dumb_it_create_row_index(sigdata);
+    size_t size = (size_t)sigdata->n_orders * 256;
+    size_t row;
+    unsigned int count, restart_count;
+    LONG_LONG first_time;
+
+    if (!index)
+        return NULL;
+
+    for (row = timekeeping_array_get_row(sigrenderer->row_timekeeper, 0,
+                                         &count, &restart_count, &first_time);
+         row < size;
+         row = timekeeping_array_get_row(sigrenderer->row_timekeeper,
+                                         row + 1, &count, &restart_count,
+                                         &first_time)) {
+        int order = (int)(row >> 8);
+        int i = index->order_start[order] + (int)(row & 255);
+        if (i < index->order_start[order + 1])
+            index->time[i] = (long)(first_time >> 16);
+    }
+
+    if (_dumb_it_sort_row_index(index) < 0) {
+        _dumb_it_destroy_row_index(index);
+        return NULL;
+    }
+
+    return index;
+}
+#endif
+
+/* Starts a runthrough from startorder, throwing away any checkpoints there
+ * were. Returns -1 if memory runs out.
+ */
+static int start_runthrough(DUMB_IT_SIGDATA *sigdata, int startorder) {
+    IT_RUNTHROUGH *runthrough;
+    DUMB_IT_SIGRENDERER *sigrenderer;
+    IT_CALLBACKS *callbacks;
+
+    _dumb_it_free_checkpoints(sigdata);
+
+    runthrough = malloc(sizeof(*runthrough));
+    if (!runthrough)
+        return -1;
+
+    callbacks = create_callbacks();
+    if (!callbacks) {
+        free(runthrough);
+        return -1;
+    }
+    /* Voice volumes and panning are worked out for the number of channels
+     * they are heading for, so run in stereo, the usual case, though with
+     * nothing to remove clicks from.
+     */
+    sigrenderer = init_sigrenderer(sigdata, 2, startorder, callbacks, NULL);
+    if (!sigrenderer) {
+        free(runthrough);
+        return -1;
+    }
+    sigrenderer->callbacks->loop = &dumb_it_callback_terminate;
+    sigrenderer->callbacks->xm_speed_zero = &dumb_it_callback_terminate;
+    sigrenderer->callbacks->global_volume_zero = &dumb_it_callback_terminate;
+
+    runthrough->sigrenderer = sigrenderer;
+    runthrough->interval = dumb_it_checkpoint_interval;
+    runthrough->time = 0;
+    runthrough->size = 0;
+
+    /* Without checkpoints, only the length is wanted. */
+    if (runthrough->interval <= 0) {
+        sigrenderer->timing_only = 1;
+        runthrough->interval = IT_CHECKPOINT_INTERVAL;
+    }
+
+    sigdata->n_checkpoints = 0;
+    sigdata->runthrough = runthrough;
+
+    return 0;
+}
+
+/* Ends the runthrough where it is, building the row index from it. */
+static void finish_runthrough(DUMB_IT_SIGDATA *sigdata) {
+    IT_RUNTHROUGH *runthrough = sigdata->runthrough;
+
+    if (!sigdata->n_checkpoints) {
+        free(sigdata->checkpoint);
+        sigdata->checkpoint = NULL;
+    }
+
+#ifdef BIT_ARRAY_BULLSHIT
+    sigdata->row_index = build_row_index(sigdata, runthrough->sigrenderer);
+#endif
+
+    _dumb_it_end_sigrenderer(runthrough->sigrenderer);
+    runthrough->sigrenderer = NULL;
+}
+
+/* Plays the runthrough on until at least budget more has been played, or
+ * the end is found. The sigrenderer plays on from one checkpoint to the
+ * next, leaving a snapshot behind at each. Returns -1 if memory runs out,
+ * leaving the runthrough where it was.
+ */
+static int continue_runthrough(DUMB_IT_SIGDATA *sigdata, long budget) {
+    IT_RUNTHROUGH *runthrough = sigdata->runthrough;
+    DUMB_IT_SIGRENDERER *sigrenderer = runthrough->sigrenderer;
+    long start = runthrough->time;
 
     for (;;) {
         long l;
-        DUMB_IT_SIGRENDERER *sigrenderer = dup_sigrenderer(
-            checkpoint->sigrenderer, 0, checkpoint->sigrenderer->callbacks);
-        checkpoint->sigrenderer->callbacks = NULL;
-        if (!sigrenderer) {
-            checkpoint->next = NULL;
-            return checkpoint->time;
-        }
+
+        if (!sigrenderer->timing_only &&
+            add_checkpoint(sigdata, &runthrough->size, &runthrough->interval,
+                           sigrenderer, runthrough->time) < 0)
+            return -1;
 
         l = it_sigrenderer_get_samples(sigrenderer, 0, 1.0f,
-                                       IT_CHECKPOINT_INTERVAL, NULL);
-        if (l < IT_CHECKPOINT_INTERVAL) {
-            _dumb_it_end_sigrenderer(sigrenderer);
-            checkpoint->next = NULL;
-            return checkpoint->time + l;
-        }
+                                       runthrough->interval, NULL);
+        runthrough->time += l;
+        if (l < runthrough->interval)
+            break;
 
-        checkpoint->next = malloc(sizeof(*checkpoint->next));
-        if (!checkpoint->next) {
-            _dumb_it_end_sigrenderer(sigrenderer);
-            return checkpoint->time + IT_CHECKPOINT_INTERVAL;
+        if (runthrough->time >= FUCKIT_THRESHOLD) {
+            runthrough->time = 0;
+            break;
         }
 
-        checkpoint->next->time = checkpoint->time + IT_CHECKPOINT_INTERVAL;
-        checkpoint = checkpoint->next;
-        checkpoint->sigrenderer = sigrenderer;
-
-        if (checkpoint->time >= FUCKIT_THRESHOLD) {
-            checkpoint->next = NULL;
+        if (runthrough->time - start >= budget)
             return 0;
-        }
     }
+
+    /* The end has been found. */
+    finish_runthrough(sigdata);
+    return 0;
+}
+
+int dumb_it_build_checkpoints_step(DUMB_IT_SIGDATA *sigdata, long budget,
+                                   long *length) {
+    IT_RUNTHROUGH *runthrough;
+
+    if (!sigdata || (sigdata->flags & IT_WAS_FROZEN))
+        return -1;
+
+    if (!sigdata->runthrough && start_runthrough(sigdata, 0) < 0)
+        return -1;
+
+    runthrough = sigdata->runthrough;
+    if (runthrough->sigrenderer && continue_runthrough(sigdata, budget) < 0)
+        return -1;
+
+    if (length)
+        *length = runthrough->time;
+
+    if (runthrough->sigrenderer)
+        return 1;
+
+    free(runthrough);
+    sigdata->runthrough = NULL;
+    return 0;
+}
+
+/* Plays a runthrough in progress on past pos, so that the checkpoint for pos
+ * is there to start from. If memory runs out, playback starts from an
+ * earlier checkpoint instead.
+ */
+static void extend_runthrough(DUMB_IT_SIGDATA *sigdata, long pos) {
+    IT_RUNTHROUGH *runthrough = sigdata->runthrough;
+
+    if (runthrough && runthrough->sigrenderer &&
+        !runthrough->sigrenderer->timing_only && pos >= runthrough->time)
+        continue_runthrough(sigdata, pos - runthrough->time + 1);
+}
+
+/* Returns the length of the module, up until it first loops, or -1 if the
+ * sigdata is frozen.
+ */
+long dumb_it_build_checkpoints(DUMB_IT_SIGDATA *sigdata, int startorder) {
+    long length = 0;
+
+    if (!sigdata)
+        return 0;
+
+    if (sigdata->flags & IT_WAS_FROZEN)
+        return -1;
+
+    if (start_runthrough(sigdata, startorder) < 0)
+        return 0;
+
+    /* If memory runs out, settle for the checkpoints and length so far. */
+    if (dumb_it_build_checkpoints_step(sigdata, FUCKIT_THRESHOLD, &length) <
+        0) {
+        length = sigdata->runthrough->time;
+        finish_runthrough(sigdata);
+        free(sigdata->runthrough);
+        sigdata->runthrough = NULL;
+    }
+
+    return length;
 }
 
 void dumb_it_do_initial_runthrough(DUH *duh) {
     if (duh) {
         DUMB_IT_SIGDATA *sigdata = duh_get_it_sigdata(duh);
 
-        if (sigdata)
+        if (sigdata && !(sigdata->flags & IT_WAS_FROZEN))
             duh_set_length(duh, dumb_it_build_checkpoints(sigdata, 0));
     }
 }
 
+int dumb_it_do_initial_runthrough_step(DUH *duh, long budget) {
+    DUMB_IT_SIGDATA *sigdata = duh_get_it_sigdata(duh);
+    long length;
+    int ret;
+
+    if (!sigdata)
+        return -1;
+
+    /* A length means the runthrough has been done, or was not wanted. */
+    if (!sigdata->runthrough && duh_get_length(duh) >= 0)
+        return 0;
+
+    ret = dumb_it_build_checkpoints_step(sigdata, budget, &length);
+    if (ret == 0)
+        duh_set_length(duh, length);
+
+    return ret;
+}
+
+int dumb_it_freeze(DUH *duh) {
+    DUMB_IT_SIGDATA *sigdata = duh_get_it_sigdata(duh);
+
+    if (!sigdata)
+        return -1;
+
+    if (sigdata->flags & IT_WAS_FROZEN)
+        return 0;
+
+    if (sigdata->runthrough &&
+        dumb_it_do_initial_runthrough_step(duh, FUCKIT_THRESHOLD) < 0)
+        return -1;
+
+    /* Everything which would otherwise be set up the first time the module
+     * is played.
+     */
+    if (_dumb_it_process_sigdata(sigdata) < 0)
+        return -1;
+    it_init_pitch_table();
+    _dumb_init_cubic();
+
+    sigdata->flags |= IT_WAS_FROZEN;
+    duh->frozen = 1;
+    return 0;
+}
+
+long dumb_it_sd_get_row_time(DUMB_IT_SIGDATA *sd, int order, int row) {
+    IT_ROW_INDEX *index;
+    int i;
+
+    if (!sd || !sd->row_index)
+        return -1;
+
+    index = sd->row_index;
+    if (order < 0 || order >= index->n_orders || row < 0)
+        return -1;
+
+    i = index->order_start[order] + row;
+    if (i >= index->order_start[order + 1])
+        return -1;
+
+    return index->time[i];
+}
+
+int dumb_it_sd_get_row_at_time(DUMB_IT_SIGDATA *sd, long time, int *order,
+                               int *row) {
+    IT_ROW_INDEX *index;
+    int lo, hi;
+
+    if (!sd || !sd->row_index || !sd->row_index->n_reached)
+        return -1;
+
+    index = sd->row_index;
+    if (time < index->by_time[0].time)
+        return -1;
+
+    /* Find the last row reached at or before time. */
+    lo = 0;
+    hi = index->n_reached - 1;
+    while (lo < hi) {
+        int mid = (lo + hi + 1) >> 1;
+        if (index->by_time[mid].time <= time)
+            lo = mid;
+        else
+            hi = mid - 1;
+    }
+
+    if (order)
+        *order = index->by_time[lo].order;
+    if (row)
+        *row = index->by_time[lo].row;
+    return 0;
+}
+
 static int is_pattern_silent(IT_PATTERN *pattern, int order) {
     int ret = 1;
     IT_ENTRY *entry, *end;
@@ -6478,7 +7702,8 @@ int dumb_it_trim_silent_patterns(DUH *duh) {
 
     sigdata = duh_get_it_sigdata(duh);
 
-    if (!sigdata || !sigdata->order || !sigdata->pattern)
+    if (!sigdata || (sigdata->flags & IT_WAS_FROZEN) || !sigdata->order ||
+        !sigdata->pattern)
         return -1;
 
     for (n = 0; n < sigdata->n_orders; n++) {
@@ -6524,21 +7749,90 @@ int dumb_it_trim_silent_patterns(DUH *duh) {
     return 0;
 }
 
+typedef struct IT_SCAN_JOB {
+    int order;
+    DUMB_IT_SIGRENDERER *sigrenderer;
+    long length;
+} IT_SCAN_JOB;
+
+/* Plays the subsong for job i through to its end, to find its length. Jobs
+ * only read the sigdata, so several may run at once.
+ */
+static void scan_subsong(void *data, int i) {
+    IT_SCAN_JOB *job = (IT_SCAN_JOB *)data + i;
+    long length = 0;
+
+    for (;;) {
+        long l;
+
+        l = it_sigrenderer_get_samples(job->sigrenderer, 0, 1.0f,
+                                       IT_CHECKPOINT_INTERVAL, NULL);
+        length += l;
+        if (l < IT_CHECKPOINT_INTERVAL || length >= FUCKIT_THRESHOLD) {
+            /* SONG OVA! */
+            break;
+        }
+    }
+
+    job->length = length;
+}
+
+/* Returns the first order from n on with no rows played, or n_orders if
+ * there is none.
+ */
+static int next_unplayed_order(DUMB_IT_SIGDATA *sigdata, void *ba_played,
+                               int n) {
+    while (n < sigdata->n_orders) {
+        size_t played = bit_array_find_set(ba_played, (size_t)n * 256);
+        if (played >= (size_t)(n + 1) * 256)
+            return n;
+        n++;
+    }
+    return sigdata->n_orders;
+}
+
+static void scan_serially(void *pool_data, int n, void (*job)(void *, int),
+                          void *job_data) {
+    int i;
+    (void)pool_data;
+    for (i = 0; i < n; i++)
+        (*job)(job_data, i);
+}
+
 int dumb_it_scan_for_playable_orders(DUMB_IT_SIGDATA *sigdata,
                                      dumb_scan_callback callback,
                                      void *callback_data) {
-    int n;
-    long length;
+    return dumb_it_scan_for_playable_orders_parallel(
+        sigdata, callback, callback_data, &scan_serially, NULL, 1);
+}
+
+int dumb_it_scan_for_playable_orders_parallel(DUMB_IT_SIGDATA *sigdata,
+                                              dumb_scan_callback callback,
+                                              void *callback_data,
+                                              dumb_parallel_for parallel_for,
+                                              void *pool_data, int batch) {
+    int n, i, n_jobs;
+    int ret = 0;
+    int batch_size = 1;
     void *ba_played;
-    DUMB_IT_SIGRENDERER *sigrenderer;
+    IT_SCAN_JOB *job;
 
     if (!sigdata->n_orders || !sigdata->order)
         return -1;
 
+    if (batch < 1)
+        batch = 1;
+
     ba_played = bit_array_create(sigdata->n_orders * 256);
     if (!ba_played)
         return -1;
 
+    job = malloc(batch * sizeof(*job));
+    if (!job) {
+        bit_array_destroy(ba_played);
+        return -1;
+    }
+
     /* Skip the first order, it should always be played */
     for (n = 1; n < sigdata->n_orders; n++) {
         if ((sigdata->order[n] >= sigdata->n_patterns) ||
@@ -6547,47 +7841,57 @@ int dumb_it_scan_for_playable_orders(DUMB_IT_SIGDATA *sigdata,
     }
 
     for (;;) {
-        for (n = 0; n < sigdata->n_orders; n++) {
-            if (!bit_array_test_range(ba_played, n * 256, 256))
+        /* Each subsong starts at the first order nothing has played yet.
+         * Until the one before has been played, it is not known which order
+         * that will be, so guess that it will be any of the next few. The
+         * first subsong is often the whole module, so it goes on its own.
+         */
+        n_jobs = 0;
+        for (n = next_unplayed_order(sigdata, ba_played, 0);
+             n < sigdata->n_orders && n_jobs < batch_size;
+             n = next_unplayed_order(sigdata, ba_played, n + 1)) {
+            DUMB_IT_SIGRENDERER *sigrenderer;
+
+            sigrenderer = dumb_it_init_sigrenderer(sigdata, 0, n);
+            if (!sigrenderer) {
+                ret = -1;
                 break;
+            }
+            sigrenderer->callbacks->loop = &dumb_it_callback_terminate;
+            sigrenderer->callbacks->xm_speed_zero = &dumb_it_callback_terminate;
+            sigrenderer->callbacks->global_volume_zero =
+                &dumb_it_callback_terminate;
+            sigrenderer->timing_only = 1;
+
+            job[n_jobs].order = n;
+            job[n_jobs].sigrenderer = sigrenderer;
+            n_jobs++;
         }
 
-        if (n == sigdata->n_orders)
-            break;
-
-        sigrenderer = dumb_it_init_sigrenderer(sigdata, 0, n);
-        if (!sigrenderer) {
-            bit_array_destroy(ba_played);
-            return -1;
-        }
-        sigrenderer->callbacks->loop = &dumb_it_callback_terminate;
-        sigrenderer->callbacks->xm_speed_zero = &dumb_it_callback_terminate;
-        sigrenderer->callbacks->global_volume_zero =
-            &dumb_it_callback_terminate;
-
-        length = 0;
-
-        for (;;) {
-            long l;
+        if (ret == 0 && n_jobs)
+            (*parallel_for)(pool_data, n_jobs, &scan_subsong, job);
 
-            l = it_sigrenderer_get_samples(sigrenderer, 0, 1.0f,
-                                           IT_CHECKPOINT_INTERVAL, NULL);
-            length += l;
-            if (l < IT_CHECKPOINT_INTERVAL || length >= FUCKIT_THRESHOLD) {
-                /* SONG OVA! */
-                break;
+        /* Guesses which an earlier subsong went on to play are wasted. */
+        for (i = 0; i < n_jobs; i++) {
+            if (ret == 0 &&
+                !bit_array_test_range(ba_played, job[i].order * 256, 256)) {
+                if ((*callback)(callback_data, job[i].order,
+                                job[i].length) < 0)
+                    ret = -1;
+                else
+                    bit_array_merge(ba_played, job[i].sigrenderer->played, 0);
             }
+            _dumb_it_end_sigrenderer(job[i].sigrenderer);
         }
 
-        if ((*callback)(callback_data, n, length) < 0)
-            return -1;
-
-        bit_array_merge(ba_played, sigrenderer->played, 0);
+        if (ret < 0 || !n_jobs)
+            break;
 
-        _dumb_it_end_sigrenderer(sigrenderer);
+        batch_size = batch;
     }
 
+    free(job);
     bit_array_destroy(ba_played);
 
-    return 0;
+    return ret;
 }
@@ -20,6 +20,7 @@
 #include <stdlib.h>
 
 #include "dumb.h"
+#include "internal/dumbfile.h"
 #include "internal/it.h"
 
 void _dumb_it_unload_sigdata(sigdata_t *vsigdata) {
@@ -37,9 +38,14 @@ void _dumb_it_unload_sigdata(sigdata_t *vsigdata) {
             free(sigdata->instrument);
 
         if (sigdata->sample) {
-            for (n = 0; n < sigdata->n_samples; n++)
-                if (sigdata->sample[n].data)
+            for (n = 0; n < sigdata->n_samples; n++) {
+                if (sigdata->sample[n].data &&
+                    !_dumbfile_mapping_contains(sigdata->mapping,
+                                                sigdata->sample[n].data))
                     free(sigdata->sample[n].data);
+                if (sigdata->sample[n].fir_data)
+                    free(sigdata->sample[n].fir_data);
+            }
 
             free(sigdata->sample);
         }
@@ -54,15 +60,11 @@ void _dumb_it_unload_sigdata(sigdata_t *vsigdata) {
         if (sigdata->midi)
             free(sigdata->midi);
 
-        {
-            IT_CHECKPOINT *checkpoint = sigdata->checkpoint;
-            while (checkpoint) {
-                IT_CHECKPOINT *next = checkpoint->next;
-                _dumb_it_end_sigrenderer(checkpoint->sigrenderer);
-                free(checkpoint);
-                checkpoint = next;
-            }
-        }
+        _dumb_it_free_checkpoints(sigdata);
+
+        _dumb_it_free_sample_jobs(sigdata);
+
+        _dumbfile_unref_mapping(sigdata->mapping);
 
         free(vsigdata);
     }
@@ -279,6 +279,11 @@ static DUMB_IT_SIGDATA *it_669_load_sigdata(DUMBFILE *f, int *ext) {
     sigdata->pattern = NULL;
     sigdata->midi = NULL;
     sigdata->checkpoint = NULL;
+    sigdata->row_index = NULL;
+    sigdata->runthrough = NULL;
+    sigdata->mapping = NULL;
+    sigdata->sample_jobs = NULL;
+    sigdata->flags = 0;
     sigdata->sample = NULL;
 
     sigdata->n_instruments = 0;
@@ -349,8 +354,10 @@ static DUMB_IT_SIGDATA *it_669_load_sigdata(DUMBFILE *f, int *ext) {
         return NULL;
     }
 
-    for (i = 0; i < sigdata->n_samples; i++)
+    for (i = 0; i < sigdata->n_samples; i++) {
         sigdata->sample[i].data = NULL;
+        sigdata->sample[i].fir_data = NULL;
+    }
 
     for (i = 0; i < sigdata->n_samples; i++) {
         if (it_669_read_sample_header(&sigdata->sample[i], f)) {
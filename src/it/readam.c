@@ -346,6 +346,11 @@ static DUMB_IT_SIGDATA *it_riff_amff_load_sigdata(DUMBFILE *f,
     sigdata->pattern = NULL;
     sigdata->midi = NULL;
     sigdata->checkpoint = NULL;
+    sigdata->row_index = NULL;
+    sigdata->runthrough = NULL;
+    sigdata->mapping = NULL;
+    sigdata->sample_jobs = NULL;
+    sigdata->flags = 0;
 
     sigdata->mixing_volume = 48;
     sigdata->pan_separation = 128;
@@ -413,6 +418,7 @@ static DUMB_IT_SIGDATA *it_riff_amff_load_sigdata(DUMBFILE *f,
     for (n = 0; n < sigdata->n_samples; ++n) {
         IT_SAMPLE *sample = sigdata->sample + n;
         sample->data = NULL;
+        sample->fir_data = NULL;
         sample->flags = 0;
         sample->name[0] = 0;
     }
@@ -589,6 +595,11 @@ static DUMB_IT_SIGDATA *it_riff_am_load_sigdata(DUMBFILE *f,
     sigdata->pattern = NULL;
     sigdata->midi = NULL;
     sigdata->checkpoint = NULL;
+    sigdata->row_index = NULL;
+    sigdata->runthrough = NULL;
+    sigdata->mapping = NULL;
+    sigdata->sample_jobs = NULL;
+    sigdata->flags = 0;
 
     sigdata->mixing_volume = 48;
     sigdata->pan_separation = 128;
@@ -657,6 +668,7 @@ static DUMB_IT_SIGDATA *it_riff_am_load_sigdata(DUMBFILE *f,
     for (n = 0; n < sigdata->n_samples; ++n) {
         IT_SAMPLE *sample = sigdata->sample + n;
         sample->data = NULL;
+        sample->fir_data = NULL;
         sample->flags = 0;
         sample->name[0] = 0;
     }
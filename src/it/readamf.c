@@ -360,12 +360,15 @@ static DUMB_IT_SIGDATA *it_amf_load_sigdata(DUMBFILE *f, int *version) {
                 pan = IT_SURROUND;
             sigdata->channel_pan[i] = pan;
         }
+        memset(sigdata->channel_pan + nchannels, 32,
+               DUMB_IT_N_CHANNELS - nchannels);
     } else {
         int sep = 32 * dumb_it_default_panning_separation / 100;
         for (i = 0; i < 16; i++) {
             sigdata->channel_pan[i] =
                 (dumbfile_getc(f) & 1) ? 32 - sep : 32 + sep;
         }
+        memset(sigdata->channel_pan + 16, 32, DUMB_IT_N_CHANNELS - 16);
     }
 
     sigdata->tempo = 125;
@@ -426,11 +429,18 @@ static DUMB_IT_SIGDATA *it_amf_load_sigdata(DUMBFILE *f, int *version) {
     sigdata->pattern = NULL;
     sigdata->midi = NULL;
     sigdata->checkpoint = NULL;
+    sigdata->row_index = NULL;
+    sigdata->runthrough = NULL;
+    sigdata->mapping = NULL;
+    sigdata->sample_jobs = NULL;
+    sigdata->flags = 0;
 
     sigdata->n_instruments = 0;
 
-    for (i = 0; i < sigdata->n_samples; ++i)
+    for (i = 0; i < sigdata->n_samples; ++i) {
         sigdata->sample[i].data = NULL;
+        sigdata->sample[i].fir_data = NULL;
+    }
 
     for (i = 0; i < sigdata->n_samples; ++i) {
         int offset;
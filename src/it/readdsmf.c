@@ -264,6 +264,11 @@ static DUMB_IT_SIGDATA *it_riff_dsmf_load_sigdata(DUMBFILE *f,
     sigdata->pattern = NULL;
     sigdata->midi = NULL;
     sigdata->checkpoint = NULL;
+    sigdata->row_index = NULL;
+    sigdata->runthrough = NULL;
+    sigdata->mapping = NULL;
+    sigdata->sample_jobs = NULL;
+    sigdata->flags = 0;
 
     sigdata->mixing_volume = 48;
     sigdata->pan_separation = 128;
@@ -329,6 +334,7 @@ static DUMB_IT_SIGDATA *it_riff_dsmf_load_sigdata(DUMBFILE *f,
     for (n = 0; n < sigdata->n_samples; ++n) {
         IT_SAMPLE *sample = sigdata->sample + n;
         sample->data = NULL;
+        sample->fir_data = NULL;
     }
 
     sigdata->n_samples = 0;
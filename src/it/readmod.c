@@ -23,6 +23,7 @@
 
 #include "dumb.h"
 #include "internal/dumb.h"
+#include "internal/dumbfile.h"
 #include "internal/it.h"
 
 static int it_mod_read_pattern(IT_PATTERN *pattern, DUMBFILE *f, int n_channels,
@@ -197,10 +198,33 @@ static int it_mod_read_sample_header(IT_SAMPLE *sample, DUMBFILE *f,
     return dumbfile_error(f);
 }
 
-static int it_mod_read_sample_data(IT_SAMPLE *sample, DUMBFILE *f,
+/* EFx inverts sample loops as the module plays, by writing into the sample
+ * data, so a module that uses it cannot play from mapped sample data.
+ */
+static int it_mod_inverts_loops(DUMB_IT_SIGDATA *sigdata) {
+    int i, j;
+
+    for (i = 0; i < sigdata->n_patterns; i++) {
+        IT_PATTERN *pattern = &sigdata->pattern[i];
+        for (j = 0; j < pattern->n_entries; j++) {
+            IT_ENTRY *entry = &pattern->entry[j];
+            if (IT_IS_END_ROW(entry) || !(entry->mask & IT_ENTRY_EFFECT))
+                continue;
+            if (entry->effect == IT_S &&
+                (entry->effectvalue >> 4) == IT_S_SET_MIDI_MACRO)
+                return 1;
+        }
+    }
+
+    return 0;
+}
+
+static int it_mod_read_sample_data(DUMB_IT_SIGDATA *sigdata,
+                                   IT_SAMPLE *sample, DUMBFILE *f,
                                    unsigned long fft) {
     long i;
     long truncated_size;
+    const char *mapped;
 
     /* let's get rid of the sample data coming after the end of the loop */
     if ((sample->flags & IT_SAMPLE_LOOP) && sample->loop_end < sample->length) {
@@ -210,6 +234,22 @@ static int it_mod_read_sample_data(IT_SAMPLE *sample, DUMBFILE *f,
         truncated_size = 0;
     }
 
+    /* Plain signed samples can be used straight out of a mapped file, as
+     * long as they are all there. sigdata is NULL if the module inverts
+     * loops.
+     */
+    mapped = sigdata && fft != DUMB_ID('M', 0, 0, 0) &&
+                     fft != DUMB_ID('8', 0, 0, 0)
+                 ? _dumbfile_peek_mapped(f, sample->length)
+                 : NULL;
+    if (mapped && (sample->length < 5 || memcmp(mapped, "ADPCM", 5)) &&
+        _dumb_it_map_sample_data(sigdata, sample, sample->length, f) == 0) {
+        /* skip truncated data */
+        if (truncated_size)
+            dumbfile_skip(f, truncated_size);
+        return 0;
+    }
+
     if (sample->length) {
         sample->data = malloc(sample->length);
 
@@ -261,13 +301,9 @@ static int it_mod_read_sample_data(IT_SAMPLE *sample, DUMBFILE *f,
                 return -1;
         }
 
-        if (fft == DUMB_ID('M', 0, 0, 0) || fft == DUMB_ID('8', 0, 0, 0)) {
-            int delta = 0;
-            for (i = 0; i < sample->length; i++) {
-                delta += ((signed char *)sample->data)[i];
-                ((signed char *)sample->data)[i] = delta;
-            }
-        }
+        if (fft == DUMB_ID('M', 0, 0, 0) || fft == DUMB_ID('8', 0, 0, 0))
+            _dumb_it_convert_sample_data(sample->data, sample->length,
+                                         IT_PCM_DELTA);
     }
 
     return 0;
@@ -279,6 +315,7 @@ static DUMB_IT_SIGDATA *it_mod_load_sigdata(DUMBFILE *f, int restrict_) {
     DUMB_IT_SIGDATA *sigdata;
     int n_channels;
     int i;
+    int inverts_loops;
     unsigned long fft;
 
     if (dumbfile_seek(f, MOD_FFT_OFFSET, DFS_SEEK_SET))
@@ -410,11 +447,18 @@ static DUMB_IT_SIGDATA *it_mod_load_sigdata(DUMBFILE *f, int restrict_) {
     sigdata->pattern = NULL;
     sigdata->midi = NULL;
     sigdata->checkpoint = NULL;
+    sigdata->row_index = NULL;
+    sigdata->runthrough = NULL;
+    sigdata->mapping = NULL;
+    sigdata->sample_jobs = NULL;
+    sigdata->flags = 0;
 
     sigdata->n_instruments = 0;
 
-    for (i = 0; i < sigdata->n_samples; i++)
+    for (i = 0; i < sigdata->n_samples; i++) {
         sigdata->sample[i].data = NULL;
+        sigdata->sample[i].fir_data = NULL;
+    }
 
     for (i = 0; i < sigdata->n_samples; i++) {
         if (it_mod_read_sample_header(&sigdata->sample[i], f, fft,
@@ -573,8 +617,10 @@ static DUMB_IT_SIGDATA *it_mod_load_sigdata(DUMBFILE *f, int restrict_) {
     }
 
     /* And finally, the sample data */
+    inverts_loops = it_mod_inverts_loops(sigdata);
     for (i = 0; i < sigdata->n_samples; i++) {
-        if (it_mod_read_sample_data(&sigdata->sample[i], f, fft)) {
+        if (it_mod_read_sample_data(inverts_loops ? NULL : sigdata,
+                                    &sigdata->sample[i], f, fft)) {
             _dumb_it_unload_sigdata(sigdata);
             return NULL;
         }
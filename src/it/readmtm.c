@@ -270,14 +270,20 @@ static DUMB_IT_SIGDATA *it_mtm_load_sigdata(DUMBFILE *f, int *version) {
     sigdata->pattern = NULL;
     sigdata->midi = NULL;
     sigdata->checkpoint = NULL;
+    sigdata->row_index = NULL;
+    sigdata->runthrough = NULL;
+    sigdata->mapping = NULL;
+    sigdata->sample_jobs = NULL;
 
     sigdata->n_instruments = 0;
 
     sigdata->restart_position = 0;
     sigdata->n_pchannels = n_channels;
 
-    for (n = 0; n < sigdata->n_samples; n++)
+    for (n = 0; n < sigdata->n_samples; n++) {
         sigdata->sample[n].data = NULL;
+        sigdata->sample[n].fir_data = NULL;
+    }
 
     skip_bytes = calloc(sizeof(int), sigdata->n_samples);
     if (!skip_bytes)
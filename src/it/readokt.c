@@ -440,11 +440,18 @@ static DUMB_IT_SIGDATA *it_okt_load_sigdata(DUMBFILE *f) {
     sigdata->pattern = NULL;
     sigdata->midi = NULL;
     sigdata->checkpoint = NULL;
+    sigdata->row_index = NULL;
+    sigdata->runthrough = NULL;
+    sigdata->mapping = NULL;
+    sigdata->sample_jobs = NULL;
+    sigdata->flags = 0;
 
     sigdata->n_instruments = 0;
 
-    for (i = 0; i < sigdata->n_samples; i++)
+    for (i = 0; i < sigdata->n_samples; i++) {
         sigdata->sample[i].data = NULL;
+        sigdata->sample[i].fir_data = NULL;
+    }
 
     chunk = get_chunk_by_type(mod, DUMB_ID('S', 'A', 'M', 'P'), 0);
 
@@ -62,6 +62,7 @@ static int it_old_psm_read_samples(IT_SAMPLE **sample, DUMBFILE *f, int *num) {
             goto error_fb;
         for (n = count; n < true_num; n++) {
             meh[n].data = NULL;
+            meh[n].fir_data = NULL;
         }
         *sample = meh;
         *num = true_num;
@@ -590,6 +591,10 @@ static DUMB_IT_SIGDATA *it_old_psm_load_sigdata(DUMBFILE *f) {
     sigdata->pattern = NULL;
     sigdata->midi = NULL;
     sigdata->checkpoint = NULL;
+    sigdata->row_index = NULL;
+    sigdata->runthrough = NULL;
+    sigdata->mapping = NULL;
+    sigdata->sample_jobs = NULL;
 
     sigdata->n_instruments = 0;
 
@@ -603,8 +608,10 @@ static DUMB_IT_SIGDATA *it_old_psm_load_sigdata(DUMBFILE *f) {
         sigdata->sample = malloc(sigdata->n_samples * sizeof(*sigdata->sample));
         if (!sigdata->sample)
             goto error_usd;
-        for (n = 0; n < sigdata->n_samples; n++)
+        for (n = 0; n < sigdata->n_samples; n++) {
             sigdata->sample[n].data = NULL;
+            sigdata->sample[n].fir_data = NULL;
+        }
     }
 
     if (sigdata->n_patterns) {
@@ -620,6 +620,11 @@ static DUMB_IT_SIGDATA *it_psm_load_sigdata(DUMBFILE *f, int *ver,
     sigdata->pattern = NULL;
     sigdata->midi = NULL;
     sigdata->checkpoint = NULL;
+    sigdata->row_index = NULL;
+    sigdata->runthrough = NULL;
+    sigdata->mapping = NULL;
+    sigdata->sample_jobs = NULL;
+    sigdata->flags = 0;
 
     sigdata->n_instruments = 0;
     sigdata->n_orders = 0;
@@ -1035,6 +1040,7 @@ static DUMB_IT_SIGDATA *it_psm_load_sigdata(DUMBFILE *f, int *ver,
         goto error_ev;
     for (n = 0; n < sigdata->n_samples; n++) {
         sigdata->sample[n].data = NULL;
+        sigdata->sample[n].fir_data = NULL;
         sigdata->sample[n].flags = 0;
     }
 
@@ -109,37 +109,24 @@ static int it_ptm_read_sample_header(IT_SAMPLE *sample, long *offset,
     return dumbfile_error(f);
 }
 
-static int it_ptm_read_byte(DUMBFILE *f) {
-    int meh = dumbfile_getc(f);
-    if (meh < 0)
-        return 0;
-    return meh;
-}
-
 static int it_ptm_read_sample_data(IT_SAMPLE *sample, int last, DUMBFILE *f) {
-    long n;
-    int s;
+    long size = sample->length * (sample->flags & IT_SAMPLE_16BIT ? 2 : 1);
+    dumb_ssize_t n;
 
-    sample->data =
-        malloc(sample->length * (sample->flags & IT_SAMPLE_16BIT ? 2 : 1));
+    sample->data = malloc(size);
     if (!sample->data)
         return -1;
 
-    s = 0;
+    /* Missing data at the end of the file read as zero deltas. */
+    n = dumbfile_getnc((char *)sample->data, size, f);
+    if (n < size)
+        memset((char *)sample->data + MAX(n, 0), 0, size - MAX(n, 0));
 
-    if (sample->flags & IT_SAMPLE_16BIT) {
-        unsigned char a, b;
-        for (n = 0; n < sample->length; n++) {
-            a = s += (signed char)it_ptm_read_byte(f);
-            b = s += (signed char)it_ptm_read_byte(f);
-            ((short *)sample->data)[n] = a | (b << 8);
-        }
-    } else {
-        for (n = 0; n < sample->length; n++) {
-            s += (signed char)it_ptm_read_byte(f);
-            ((signed char *)sample->data)[n] = s;
-        }
-    }
+    /* Both bytes of 16-bit values are delta coded as one run of bytes. */
+    _dumb_it_convert_sample_data(sample->data, size, IT_PCM_DELTA);
+    if (sample->flags & IT_SAMPLE_16BIT)
+        _dumb_it_convert_sample_data(sample->data, sample->length,
+                                     IT_PCM_16BIT);
 
     if (dumbfile_error(f) && !last)
         return -1;
@@ -345,6 +332,11 @@ static DUMB_IT_SIGDATA *it_ptm_load_sigdata(DUMBFILE *f) {
     sigdata->pattern = NULL;
     sigdata->midi = NULL;
     sigdata->checkpoint = NULL;
+    sigdata->row_index = NULL;
+    sigdata->runthrough = NULL;
+    sigdata->mapping = NULL;
+    sigdata->sample_jobs = NULL;
+    sigdata->flags = 0;
 
     sigdata->n_orders = dumbfile_igetw(f);
     sigdata->n_instruments = 0;
@@ -386,8 +378,10 @@ static DUMB_IT_SIGDATA *it_ptm_load_sigdata(DUMBFILE *f) {
             _dumb_it_unload_sigdata(sigdata);
             return NULL;
         }
-        for (n = 0; n < sigdata->n_samples; n++)
+        for (n = 0; n < sigdata->n_samples; n++) {
             sigdata->sample[n].data = NULL;
+            sigdata->sample[n].fir_data = NULL;
+        }
     }
 
     if (sigdata->n_patterns) {
@@ -483,6 +477,9 @@ static DUMB_IT_SIGDATA *it_ptm_load_sigdata(DUMBFILE *f) {
         }
     }
 
+    memset(sigdata->channel_volume + 32, 64, DUMB_IT_N_CHANNELS - 32);
+    memset(sigdata->channel_pan + 32, 32, DUMB_IT_N_CHANNELS - 32);
+
     sigdata->pan_separation = 128;
 
     if (dumbfile_error(f)) {
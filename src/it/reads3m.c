@@ -143,53 +143,28 @@ static int it_s3m_read_sample_header(IT_SAMPLE *sample, long *offset,
     return dumbfile_error(f);
 }
 
-static int it_s3m_read_sample_data(IT_SAMPLE *sample, int ffi,
+static int it_s3m_read_sample_data(DUMB_IT_SIGDATA *sigdata,
+                                   IT_SAMPLE *sample, int ffi,
                                    unsigned char pack, DUMBFILE *f) {
-    long n;
+    int format = ffi != 1 ? IT_PCM_UNSIGNED : 0;
 
     long datasize = sample->length;
     if (sample->flags & IT_SAMPLE_STEREO)
         datasize <<= 1;
 
+    if (pack != 4)
+        return _dumb_it_read_sample_data_pcm(sigdata, sample, sample->length,
+                                             format, f);
+
     sample->data = malloc(datasize * (sample->flags & IT_SAMPLE_16BIT ? 2 : 1));
     if (!sample->data)
         return -1;
 
-    if (pack == 4) {
-        if (_dumb_it_read_sample_data_adpcm4(sample, f) < 0)
-            return -1;
-    } else if (sample->flags & IT_SAMPLE_STEREO) {
-        if (sample->flags & IT_SAMPLE_16BIT) {
-            for (n = 0; n < datasize; n += 2)
-                ((short *)sample->data)[n] = dumbfile_igetw(f);
-            for (n = 1; n < datasize; n += 2)
-                ((short *)sample->data)[n] = dumbfile_igetw(f);
-        } else {
-            for (n = 0; n < datasize; n += 2)
-                ((signed char *)sample->data)[n] = dumbfile_getc(f);
-            for (n = 1; n < datasize; n += 2)
-                ((signed char *)sample->data)[n] = dumbfile_getc(f);
-        }
-    } else if (sample->flags & IT_SAMPLE_16BIT)
-        for (n = 0; n < sample->length; n++)
-            ((short *)sample->data)[n] = dumbfile_igetw(f);
-    else
-        for (n = 0; n < sample->length; n++)
-            ((signed char *)sample->data)[n] = dumbfile_getc(f);
-
-    if (dumbfile_error(f))
+    if (_dumb_it_read_sample_data_adpcm4(sample, f) < 0)
         return -1;
-
-    if (ffi != 1) {
-        /* Convert to signed. */
-        if (sample->flags & IT_SAMPLE_16BIT)
-            for (n = 0; n < datasize; n++)
-                ((short *)sample->data)[n] ^= 0x8000;
-        else
-            for (n = 0; n < datasize; n++)
-                ((signed char *)sample->data)[n] ^= 0x80;
-    }
-
+    if (sample->flags & IT_SAMPLE_16BIT)
+        format |= IT_PCM_16BIT;
+    _dumb_it_convert_sample_data(sample->data, datasize, format);
     return 0;
 }
 
@@ -473,6 +448,11 @@ static DUMB_IT_SIGDATA *it_s3m_load_sigdata(DUMBFILE *f, int *cwtv) {
     sigdata->pattern = NULL;
     sigdata->midi = NULL;
     sigdata->checkpoint = NULL;
+    sigdata->row_index = NULL;
+    sigdata->runthrough = NULL;
+    sigdata->mapping = NULL;
+    sigdata->sample_jobs = NULL;
+    sigdata->flags = 0;
 
     sigdata->n_orders = dumbfile_igetw(f);
     sigdata->n_instruments = 0;
@@ -498,8 +478,10 @@ static DUMB_IT_SIGDATA *it_s3m_load_sigdata(DUMBFILE *f, int *cwtv) {
             _dumb_it_unload_sigdata(sigdata);
             return NULL;
         }
-        for (n = 0; n < sigdata->n_samples; n++)
+        for (n = 0; n < sigdata->n_samples; n++) {
             sigdata->sample[n].data = NULL;
+            sigdata->sample[n].fir_data = NULL;
+        }
     }
 
     if (sigdata->n_patterns) {
@@ -639,6 +621,9 @@ static DUMB_IT_SIGDATA *it_s3m_load_sigdata(DUMBFILE *f, int *cwtv) {
         }
     }
 
+    memset(sigdata->channel_volume + 32, 64, DUMB_IT_N_CHANNELS - 32);
+    memset(sigdata->channel_pan + 32, 32, DUMB_IT_N_CHANNELS - 32);
+
     sigdata->pan_separation = 128;
 
     if (dumbfile_error(f)) {
@@ -719,7 +704,8 @@ static DUMB_IT_SIGDATA *it_s3m_load_sigdata(DUMBFILE *f, int *cwtv) {
                 return NULL;
             }
 
-            if (it_s3m_read_sample_data(&sigdata->sample[component[m].n], ffi,
+            if (it_s3m_read_sample_data(sigdata,
+                                        &sigdata->sample[component[m].n], ffi,
                                         sample_pack[component[m].n], f)) {
                 free(buffer);
                 free(component);
@@ -734,6 +720,11 @@ static DUMB_IT_SIGDATA *it_s3m_load_sigdata(DUMBFILE *f, int *cwtv) {
     free(buffer);
     free(component);
 
+    if (_dumb_it_decode_sample_data(sigdata) < 0) {
+        _dumb_it_unload_sigdata(sigdata);
+        return NULL;
+    }
+
     if (_dumb_it_fix_invalid_orders(sigdata) < 0) {
         _dumb_it_unload_sigdata(sigdata);
         return NULL;
@@ -235,6 +235,11 @@ static DUMB_IT_SIGDATA *it_stm_load_sigdata(DUMBFILE *f, int *version) {
     sigdata->pattern = NULL;
     sigdata->midi = NULL;
     sigdata->checkpoint = NULL;
+    sigdata->row_index = NULL;
+    sigdata->runthrough = NULL;
+    sigdata->mapping = NULL;
+    sigdata->sample_jobs = NULL;
+    sigdata->flags = 0;
 
     sigdata->n_instruments = 0;
     sigdata->n_samples = 31;
@@ -270,8 +275,10 @@ static DUMB_IT_SIGDATA *it_stm_load_sigdata(DUMBFILE *f, int *version) {
         _dumb_it_unload_sigdata(sigdata);
         return NULL;
     }
-    for (n = 0; n < sigdata->n_samples; n++)
+    for (n = 0; n < sigdata->n_samples; n++) {
         sigdata->sample[n].data = NULL;
+        sigdata->sample[n].fir_data = NULL;
+    }
 
     if (sigdata->n_patterns) {
         sigdata->pattern =
@@ -284,7 +291,8 @@ static DUMB_IT_SIGDATA *it_stm_load_sigdata(DUMBFILE *f, int *version) {
             sigdata->pattern[n].entry = NULL;
     }
 
-    memset(sigdata->channel_volume, 64, 4);
+    memset(sigdata->channel_volume, 64, DUMB_IT_N_CHANNELS);
+    memset(sigdata->channel_pan + 4, 32, DUMB_IT_N_CHANNELS - 4);
     n = 32 * dumb_it_default_panning_separation / 100;
     sigdata->channel_pan[0] = 32 + n;
     sigdata->channel_pan[1] = 32 - n;
@@ -368,6 +368,7 @@ static int limit_xm_resize(void *f, long n) {
     }
     lx->limit = n;
     lx->ptr = 0;
+    _dumbfile_drop_buffer(df);
     return 0;
 }
 
@@ -707,10 +708,8 @@ static int it_xm_read_sample_header(IT_SAMPLE *sample, DUMBFILE *f) {
     return roguebytes;
 }
 
-static int it_xm_read_sample_data(IT_SAMPLE *sample, unsigned char roguebytes,
-                                  DUMBFILE *f) {
-    int old;
-    long i;
+static int it_xm_read_sample_data(DUMB_IT_SIGDATA *sigdata, IT_SAMPLE *sample,
+                                  unsigned char roguebytes, DUMBFILE *f) {
     long truncated_size;
     int n_channels;
     long datasize;
@@ -730,44 +729,21 @@ static int it_xm_read_sample_data(IT_SAMPLE *sample, unsigned char roguebytes,
     n_channels = sample->flags & IT_SAMPLE_STEREO ? 2 : 1;
     datasize = sample->length * n_channels;
 
-    sample->data = malloc(datasize * (sample->flags & IT_SAMPLE_16BIT ? 2 : 1));
-    if (!sample->data)
-        return -1;
-
     if (roguebytes == 4) {
+        sample->data =
+            malloc(datasize * (sample->flags & IT_SAMPLE_16BIT ? 2 : 1));
+        if (!sample->data)
+            return -1;
         if (_dumb_it_read_sample_data_adpcm4(sample, f) < 0)
             return -1;
         roguebytes = 0;
     } else {
-        /* sample data is stored as signed delta values */
-        old = 0;
-        if (sample->flags & IT_SAMPLE_16BIT)
-            for (i = 0; i < sample->length; i++)
-                ((short *)sample->data)[i * n_channels] = old +=
-                    dumbfile_igetw(f);
-        else
-            for (i = 0; i < sample->length; i++)
-                ((signed char *)sample->data)[i * n_channels] = old +=
-                    dumbfile_getc(f);
-    }
-
-    /* skip truncated data */
-    dumbfile_skip(f, (sample->flags & IT_SAMPLE_16BIT) ? (2 * truncated_size)
-                                                       : (truncated_size));
-
-    if (sample->flags & IT_SAMPLE_STEREO) {
-        old = 0;
-        if (sample->flags & IT_SAMPLE_16BIT)
-            for (i = 1; i < datasize; i += 2)
-                ((short *)sample->data)[i] = old += dumbfile_igetw(f);
-        else
-            for (i = 1; i < datasize; i += 2)
-                ((signed char *)sample->data)[i] = old += dumbfile_getc(f);
-
-        /* skip truncated data */
-        dumbfile_skip(f, (sample->flags & IT_SAMPLE_16BIT)
-                             ? (2 * truncated_size)
-                             : (truncated_size));
+        /* sample data is stored as signed delta values, so they are never
+         * mapped */
+        if (_dumb_it_read_sample_data_pcm(sigdata, sample,
+                                          sample->length + truncated_size,
+                                          IT_PCM_DELTA, f) < 0)
+            return -1;
     }
 
     dumbfile_skip(f, roguebytes);
@@ -856,6 +832,11 @@ static DUMB_IT_SIGDATA *it_xm_load_sigdata(DUMBFILE *f, int *version) {
     sigdata->pattern = NULL;
     sigdata->midi = NULL;
     sigdata->checkpoint = NULL;
+    sigdata->row_index = NULL;
+    sigdata->runthrough = NULL;
+    sigdata->mapping = NULL;
+    sigdata->sample_jobs = NULL;
+    sigdata->flags = 0;
 
     sigdata->n_samples = 0;
     sigdata->n_orders = dumbfile_igetw(f);
@@ -950,7 +931,7 @@ static DUMB_IT_SIGDATA *it_xm_load_sigdata(DUMBFILE *f, int *version) {
         */
 
         sigdata->instrument =
-            malloc(sigdata->n_instruments * sizeof(*sigdata->instrument));
+            calloc(sigdata->n_instruments, sizeof(*sigdata->instrument));
         if (!sigdata->instrument) {
             _dumb_it_unload_sigdata(sigdata);
             return NULL;
@@ -1010,8 +991,10 @@ static DUMB_IT_SIGDATA *it_xm_load_sigdata(DUMBFILE *f, int *version) {
                     return NULL;
                 }
                 for (j = total_samples; j < total_samples + extra.n_samples;
-                     j++)
+                     j++) {
                     sigdata->sample[j].data = NULL;
+                    sigdata->sample[j].fir_data = NULL;
+                }
 
                 if (limit_xm_resize(lf, 0) < 0) {
                     dumbfile_close(lf);
@@ -1049,8 +1032,8 @@ static DUMB_IT_SIGDATA *it_xm_load_sigdata(DUMBFILE *f, int *version) {
                 }
                 for (j = 0; j < extra.n_samples; j++) {
                     if (it_xm_read_sample_data(
-                            &sigdata->sample[total_samples + j], roguebytes[j],
-                            f) != 0) {
+                            sigdata, &sigdata->sample[total_samples + j],
+                            roguebytes[j], f) != 0) {
                         dumbfile_close(lf);
                         _dumb_it_unload_sigdata(sigdata);
                         return NULL;
@@ -1082,7 +1065,7 @@ static DUMB_IT_SIGDATA *it_xm_load_sigdata(DUMBFILE *f, int *version) {
         }
 
         sigdata->instrument =
-            malloc(sigdata->n_instruments * sizeof(*sigdata->instrument));
+            calloc(sigdata->n_instruments, sizeof(*sigdata->instrument));
         if (!sigdata->instrument) {
             free(roguebytes);
             _dumb_it_unload_sigdata(sigdata);
@@ -1126,8 +1109,10 @@ static DUMB_IT_SIGDATA *it_xm_load_sigdata(DUMBFILE *f, int *version) {
                     return NULL;
                 }
                 for (j = total_samples; j < total_samples + extra.n_samples;
-                     j++)
+                     j++) {
                     sigdata->sample[j].data = NULL;
+                    sigdata->sample[j].fir_data = NULL;
+                }
 
                 if (limit_xm_resize(lf, 0) < 0) {
                     dumbfile_close(lf);
@@ -1211,8 +1196,8 @@ static DUMB_IT_SIGDATA *it_xm_load_sigdata(DUMBFILE *f, int *version) {
 
         // and now we load the sample data
         for (j = 0; j < total_samples; j++) {
-            if (it_xm_read_sample_data(&sigdata->sample[j], roguebytes[j], f) !=
-                0) {
+            if (it_xm_read_sample_data(sigdata, &sigdata->sample[j],
+                                       roguebytes[j], f) != 0) {
                 free(roguebytes);
                 _dumb_it_unload_sigdata(sigdata);
                 return NULL;
@@ -1222,6 +1207,11 @@ static DUMB_IT_SIGDATA *it_xm_load_sigdata(DUMBFILE *f, int *version) {
         free(roguebytes);
     }
 
+    if (_dumb_it_decode_sample_data(sigdata) < 0) {
+        _dumb_it_unload_sigdata(sigdata);
+        return NULL;
+    }
+
     sigdata->flags = IT_WAS_AN_XM | IT_OLD_EFFECTS | IT_COMPATIBLE_GXX |
                      IT_STEREO | IT_USE_INSTRUMENTS;
     // Are we OK with IT_COMPATIBLE_GXX off?
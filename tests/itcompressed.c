@@ -0,0 +1,309 @@
+/*  _______         ____    __         ___    ___
+ * \    _  \       \    /  \  /       \   \  /   /       '   '  '
+ *  |  | \  \       |  |    ||         |   \/   |         .      .
+ *  |  |  |  |      |  |    ||         ||\  /|  |
+ *  |  |  |  |      |  |    ||         || \/ |  |         '  '  '
+ *  |  |  |  |      |  |    ||         ||    |  |         .      .
+ *  |  |_/  /        \  \__//          ||    |  |
+ * /_______/ynamic    \____/niversal  /__\  /____\usic   /|  .  . ibliotheque
+ *                                                      /  \
+ *                                                     / .  \
+ * itcompressed.c - Checks that IT214 and IT215       / / \  \
+ *                  compressed samples still decode  | <  /   \_
+ *                  to the same PCM as they did      |  \/ /\   /
+ *                  before the 64-bit bit reader.     \_  /  > /
+ *                                                      | \ / /
+ *                                                      |  ' /
+ *                                                       \__/
+ */
+
+/* An IT module is built in memory with one compressed sample per test case.
+ * The compressed streams are pseudo-random bits, which exercise every width
+ * change, illegal width and sign extension the decoder has. The expected
+ * hashes were made by loading the same module with the decoder DUMB had
+ * before the 64-bit bit reader. The module is loaded twice, the second time
+ * through dumb_it_load_parallel_for, which decodes the samples separately.
+ *
+ * Run with -p to print the hashes this build produces instead of checking.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "dumb.h"
+#include "internal/dumb.h"
+#include "internal/it.h"
+
+typedef struct TEST_CASE {
+    int bits;
+    int it215;
+    int stereo;
+    long length; /* in frames */
+    int bias;    /* 0: uniform bits, 1: mostly 0s, 2: mostly 1s */
+    unsigned LONG_LONG expected;
+} TEST_CASE;
+
+static const TEST_CASE test_case[] = {
+    {8, 0, 0, 70000, 0, 0x6D980E9ADE68EDEFULL},
+    {8, 1, 0, 40000, 0, 0x600F98AB98233825ULL},
+    {16, 0, 0, 50000, 0, 0x61B94018DF3E37A5ULL},
+    {16, 1, 0, 30000, 0, 0x686F553A5C47C125ULL},
+    {8, 1, 1, 20000, 0, 0x93C294598614BFAAULL},
+    {16, 0, 1, 20000, 0, 0x31CD1F40428FFAFCULL},
+    {8, 0, 0, 33000, 1, 0xF64CF7124DF748FFULL},
+    {8, 1, 0, 33000, 2, 0x5117FB1844936B45ULL},
+    {16, 1, 0, 17000, 1, 0xFD313D2A12272365ULL},
+    {16, 0, 0, 17000, 2, 0xB2A088C926C9F82AULL},
+};
+
+#define N_TEST_CASES ((int)(sizeof(test_case) / sizeof(*test_case)))
+
+#define N_ORDERS 2
+#define N_ROWS 64
+
+static unsigned LONG_LONG random_state;
+
+static unsigned int random_bits(void) {
+    random_state ^= random_state << 13;
+    random_state ^= random_state >> 7;
+    random_state ^= random_state << 17;
+    return (unsigned int)random_state;
+}
+
+typedef struct BUFFER {
+    unsigned char *data;
+    long size, allocated;
+} BUFFER;
+
+static void put_byte(BUFFER *b, int x) {
+    if (b->size == b->allocated) {
+        b->allocated = b->allocated ? b->allocated * 2 : 65536;
+        b->data = realloc(b->data, b->allocated);
+        if (!b->data) {
+            fprintf(stderr, "Out of memory\n");
+            exit(1);
+        }
+    }
+    b->data[b->size++] = (unsigned char)x;
+}
+
+static void put_word(BUFFER *b, int x) {
+    put_byte(b, x);
+    put_byte(b, x >> 8);
+}
+
+static void put_long(BUFFER *b, long x) {
+    put_word(b, (int)(x & 0xFFFF));
+    put_word(b, (int)(x >> 16));
+}
+
+static void put_zeros(BUFFER *b, int n) {
+    while (n-- > 0)
+        put_byte(b, 0);
+}
+
+static void set_long(BUFFER *b, long pos, long x) {
+    b->data[pos] = (unsigned char)x;
+    b->data[pos + 1] = (unsigned char)(x >> 8);
+    b->data[pos + 2] = (unsigned char)(x >> 16);
+    b->data[pos + 3] = (unsigned char)(x >> 24);
+}
+
+/* Writes the compressed blocks for one channel of a test case. Each block
+ * decodes to at most 0x8000 bytes of PCM.
+ */
+static void put_compressed_channel(BUFFER *b, const TEST_CASE *tc) {
+    long frames_per_block = tc->bits == 16 ? 0x4000 : 0x8000;
+    long n_blocks = (tc->length + frames_per_block - 1) / frames_per_block;
+    long i;
+
+    while (n_blocks-- > 0) {
+        int size = 200 + random_bits() % 9000;
+        put_word(b, size);
+        for (i = 0; i < size; i++) {
+            unsigned int x = random_bits();
+            if (tc->bias == 1)
+                x &= 0x11;
+            else if (tc->bias == 2)
+                x |= 0xEE;
+            put_byte(b, x);
+        }
+    }
+}
+
+static void build_module(BUFFER *b) {
+    long sample_offsets, pattern_offset, sample_header;
+    int n, c;
+
+    put_byte(b, 'I');
+    put_byte(b, 'M');
+    put_byte(b, 'P');
+    put_byte(b, 'M');
+    put_zeros(b, 26);
+    put_word(b, 0x1004);
+    put_word(b, N_ORDERS);
+    put_word(b, 0);
+    put_word(b, N_TEST_CASES);
+    put_word(b, 1);
+    put_word(b, 0x0215);
+    put_word(b, 0x0215);
+    put_word(b, 1 | 8); /* stereo, linear slides */
+    put_word(b, 0);
+    put_byte(b, 128); /* global volume */
+    put_byte(b, 48);  /* mixing volume */
+    put_byte(b, 6);   /* speed */
+    put_byte(b, 125); /* tempo */
+    put_byte(b, 128); /* pan separation */
+    put_byte(b, 0);
+    put_word(b, 0);
+    put_long(b, 0);
+    put_long(b, 0);
+    for (c = 0; c < 64; c++)
+        put_byte(b, 32);
+    for (c = 0; c < 64; c++)
+        put_byte(b, 64);
+
+    put_byte(b, 0);
+    put_byte(b, 255);
+
+    sample_offsets = b->size;
+    put_zeros(b, 4 * N_TEST_CASES);
+    pattern_offset = b->size;
+    put_zeros(b, 4);
+
+    set_long(b, pattern_offset, b->size);
+    put_word(b, N_ROWS);
+    put_word(b, N_ROWS);
+    put_zeros(b, 4);
+    put_zeros(b, N_ROWS);
+
+    for (n = 0; n < N_TEST_CASES; n++) {
+        const TEST_CASE *tc = &test_case[n];
+        int flags = 1 | 8;
+        int convert = 1;
+
+        if (tc->bits == 16)
+            flags |= 2;
+        if (tc->stereo)
+            flags |= 4;
+        if (tc->it215)
+            convert |= 4;
+
+        sample_header = b->size;
+        set_long(b, sample_offsets + 4 * n, sample_header);
+        put_byte(b, 'I');
+        put_byte(b, 'M');
+        put_byte(b, 'P');
+        put_byte(b, 'S');
+        put_zeros(b, 13);
+        put_byte(b, 64); /* global volume */
+        put_byte(b, flags);
+        put_byte(b, 64); /* default volume */
+        put_zeros(b, 26);
+        put_byte(b, convert);
+        put_byte(b, 32); /* default pan */
+        put_long(b, tc->length);
+        put_long(b, 0);
+        put_long(b, 0);
+        put_long(b, 8363);
+        put_long(b, 0);
+        put_long(b, 0);
+        put_long(b, 0); /* filled in below */
+        put_zeros(b, 4);
+
+        set_long(b, sample_header + 72, b->size);
+        random_state = 88172645463325252ULL + n;
+        put_compressed_channel(b, tc);
+        if (tc->stereo)
+            put_compressed_channel(b, tc);
+    }
+}
+
+/* FNV-1a over the samples, each taken least significant byte first. */
+static unsigned LONG_LONG hash_sample(const IT_SAMPLE *sample) {
+    unsigned LONG_LONG hash = 14695981039346656037ULL;
+    long i, n = sample->length;
+
+    if (sample->flags & IT_SAMPLE_STEREO)
+        n *= 2;
+
+    for (i = 0; i < n; i++) {
+        if (sample->flags & IT_SAMPLE_16BIT) {
+            int x = ((const short *)sample->data)[i];
+            hash = (hash ^ (x & 0xFF)) * 1099511628211ULL;
+            hash = (hash ^ ((x >> 8) & 0xFF)) * 1099511628211ULL;
+        } else {
+            int x = ((const signed char *)sample->data)[i];
+            hash = (hash ^ (x & 0xFF)) * 1099511628211ULL;
+        }
+    }
+
+    return hash;
+}
+
+static void serial_for(void *pool_data, int n, void (*job)(void *, int),
+                       void *job_data) {
+    int i;
+    (void)pool_data;
+    for (i = 0; i < n; i++)
+        job(job_data, i);
+}
+
+/* Returns the number of samples that did not decode as expected. */
+static int check_module(const BUFFER *b, const char *how, int print) {
+    DUMBFILE *f = dumbfile_open_memory((const char *)b->data, b->size);
+    DUH *duh = f ? dumb_read_it_quick(f) : NULL;
+    DUMB_IT_SIGDATA *sigdata = duh_get_it_sigdata(duh);
+    int n, failed = 0;
+
+    if (f)
+        dumbfile_close(f);
+
+    if (!sigdata || sigdata->n_samples != N_TEST_CASES) {
+        printf("%s: the module failed to load\n", how);
+        unload_duh(duh);
+        return N_TEST_CASES;
+    }
+
+    for (n = 0; n < N_TEST_CASES; n++) {
+        const IT_SAMPLE *sample = &sigdata->sample[n];
+        unsigned LONG_LONG hash = hash_sample(sample);
+
+        if (print)
+            printf("0x%016llXULL\n", hash);
+        else if (!sample->data || sample->length != test_case[n].length ||
+                 hash != test_case[n].expected) {
+            printf("%s: sample %d (%d-bit%s, %s) decoded differently\n", how,
+                   n, test_case[n].bits, test_case[n].stereo ? " stereo" : "",
+                   test_case[n].it215 ? "IT215" : "IT214");
+            failed++;
+        }
+    }
+
+    unload_duh(duh);
+    return failed;
+}
+
+int main(int argc, char **argv) {
+    BUFFER b = {NULL, 0, 0};
+    int print = argc > 1 && !strcmp(argv[1], "-p");
+    int failed;
+
+    build_module(&b);
+
+    failed = check_module(&b, "serial", print);
+    if (!print) {
+        dumb_it_load_parallel_for = &serial_for;
+        failed += check_module(&b, "deferred", 0);
+        dumb_it_load_parallel_for = NULL;
+    }
+
+    free(b.data);
+    dumb_exit();
+
+    if (!print)
+        printf("%d of %d samples decoded as expected\n",
+               2 * N_TEST_CASES - failed, 2 * N_TEST_CASES);
+    return failed != 0;
+}
@@ -0,0 +1,325 @@
+/*  _______         ____    __         ___    ___
+ * \    _  \       \    /  \  /       \   \  /   /       '   '  '
+ *  |  | \  \       |  |    ||         |   \/   |         .      .
+ *  |  |  |  |      |  |    ||         ||\  /|  |
+ *  |  |  |  |      |  |    ||         || \/ |  |         '  '  '
+ *  |  |  |  |      |  |    ||         ||    |  |         .      .
+ *  |  |_/  /        \  \__//          ||    |  |
+ * /_______/ynamic    \____/niversal  /__\  /____\usic   /|  .  . ibliotheque
+ *                                                      /  \
+ *                                                     / .  \
+ * itunroll.c - Checks that short loops unrolled      / / \  \
+ *              into the float sample copies play    | <  /   \_
+ *              exactly as they do when the voice    |  \/ /\   /
+ *              wraps around them.                    \_  /  > /
+ *                                                      | \ / /
+ *                                                      |  ' /
+ *                                                       \__/
+ */
+
+/* An IT module is built in memory, each of its five channels playing a short
+ * chip loop, forward or ping-pong, one of them stereo. The notes slide up and
+ * down and fade out and back in, so that the step keeps changing under the
+ * loops and silent voices are moved on without being mixed. The module is
+ * rendered at every resampling quality with float sample copies, once with
+ * short loops unrolled and once without, and the two renders must be
+ * identical.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "dumb.h"
+#include "internal/dumb.h"
+
+#define N_SAMPLES 5
+#define N_ROWS 64
+#define N_FRAMES (3 * 44100)
+#define BLOCK 1024
+
+typedef struct BUFFER {
+    unsigned char *data;
+    long size, allocated;
+} BUFFER;
+
+static void put_byte(BUFFER *b, int x) {
+    if (b->size == b->allocated) {
+        b->allocated = b->allocated ? b->allocated * 2 : 65536;
+        b->data = realloc(b->data, b->allocated);
+        if (!b->data) {
+            fprintf(stderr, "Out of memory\n");
+            exit(1);
+        }
+    }
+    b->data[b->size++] = (unsigned char)x;
+}
+
+static void put_word(BUFFER *b, int x) {
+    put_byte(b, x);
+    put_byte(b, x >> 8);
+}
+
+static void put_long(BUFFER *b, long x) {
+    put_word(b, (int)(x & 0xFFFF));
+    put_word(b, (int)(x >> 16));
+}
+
+static void put_zeros(BUFFER *b, int n) {
+    while (n-- > 0)
+        put_byte(b, 0);
+}
+
+static void set_long(BUFFER *b, long pos, long x) {
+    b->data[pos] = (unsigned char)x;
+    b->data[pos + 1] = (unsigned char)(x >> 8);
+    b->data[pos + 2] = (unsigned char)(x >> 16);
+    b->data[pos + 3] = (unsigned char)(x >> 24);
+}
+
+typedef struct TEST_SAMPLE {
+    int loop_length; /* in frames, after LOOP_START frames of silence */
+    int pingpong;
+    int stereo;
+    long C5_speed;
+} TEST_SAMPLE;
+
+#define LOOP_START 3
+
+static const TEST_SAMPLE test_sample[N_SAMPLES] = {
+    {8, 0, 0, 8363},    {22, 1, 0, 11025}, {34, 0, 0, 22050},
+    {64, 1, 0, 44100},  {12, 1, 1, 16000},
+};
+
+/* A different wave for each sample, and another for the right channel. */
+static int wave(int n, int i) {
+    int length = test_sample[n % N_SAMPLES].loop_length;
+
+    switch (n) {
+    case 0: /* square */
+        return i < length / 2 ? 0x60 : -0x60;
+    case 1: /* saw */
+        return i * 200 / length - 100;
+    case 2: /* pulse */
+        return i < length / 4 ? 0x70 : -0x70;
+    case 3: /* triangle */
+        return (i < length / 2 ? i : length - i) * 400 / length - 100;
+    default: /* stepped saw, and a square on the right */
+        return n == 4 ? (i / 3) * 40 - 80 : (i < length / 2 ? 0x50 : -0x50);
+    }
+}
+
+static void put_sample_data(BUFFER *b, int n) {
+    int i;
+
+    put_zeros(b, LOOP_START);
+    for (i = 0; i < test_sample[n].loop_length; i++)
+        put_byte(b, wave(n, i));
+    if (test_sample[n].stereo) {
+        put_zeros(b, LOOP_START);
+        for (i = 0; i < test_sample[n].loop_length; i++)
+            put_byte(b, wave(n + N_SAMPLES, i));
+    }
+}
+
+/* Every eight rows each channel starts a note, then slides it for four rows,
+ * fades it out in one row and back in during the next.
+ */
+static void put_pattern_data(BUFFER *b) {
+    int row, c;
+
+    for (row = 0; row < N_ROWS; row++) {
+        for (c = 0; c < N_SAMPLES; c++) {
+            int phase = row % 8;
+            put_byte(b, (c + 1) | 128);
+            if (phase == 0) {
+                put_byte(b, 1 | 2); /* note, instrument */
+                put_byte(b, 48 + 7 * c + 5 * (row / 8) % 24);
+                put_byte(b, c + 1);
+            } else {
+                put_byte(b, 8); /* command */
+                if (phase <= 4) {
+                    put_byte(b, (c + row / 8) & 1 ? 5 : 6); /* E, F */
+                    put_byte(b, 0x06);
+                } else {
+                    put_byte(b, 4); /* D */
+                    put_byte(b, phase == 5 ? 0x0F : phase == 6 ? 0xF0 : 0);
+                }
+            }
+        }
+        put_byte(b, 0);
+    }
+}
+
+static void build_module(BUFFER *b) {
+    long sample_offsets, pattern_offset, pattern_start, sample_header;
+    int n, c;
+
+    put_byte(b, 'I');
+    put_byte(b, 'M');
+    put_byte(b, 'P');
+    put_byte(b, 'M');
+    put_zeros(b, 26);
+    put_word(b, 0x1004);
+    put_word(b, 2);
+    put_word(b, 0);
+    put_word(b, N_SAMPLES);
+    put_word(b, 1);
+    put_word(b, 0x0214);
+    put_word(b, 0x0214);
+    put_word(b, 1 | 8); /* stereo, linear slides */
+    put_word(b, 0);
+    put_byte(b, 128); /* global volume */
+    put_byte(b, 48);  /* mixing volume */
+    put_byte(b, 6);   /* speed */
+    put_byte(b, 125); /* tempo */
+    put_byte(b, 128); /* pan separation */
+    put_byte(b, 0);
+    put_word(b, 0);
+    put_long(b, 0);
+    put_long(b, 0);
+    for (c = 0; c < 64; c++)
+        put_byte(b, c & 1 ? 16 : 48);
+    for (c = 0; c < 64; c++)
+        put_byte(b, 64);
+
+    put_byte(b, 0);
+    put_byte(b, 255);
+
+    sample_offsets = b->size;
+    put_zeros(b, 4 * N_SAMPLES);
+    pattern_offset = b->size;
+    put_zeros(b, 4);
+
+    set_long(b, pattern_offset, b->size);
+    pattern_start = b->size;
+    put_word(b, 0); /* filled in below */
+    put_word(b, N_ROWS);
+    put_zeros(b, 4);
+    put_pattern_data(b);
+    b->data[pattern_start] = (unsigned char)(b->size - pattern_start - 8);
+    b->data[pattern_start + 1] =
+        (unsigned char)((b->size - pattern_start - 8) >> 8);
+
+    for (n = 0; n < N_SAMPLES; n++) {
+        const TEST_SAMPLE *ts = &test_sample[n];
+        int flags = 1 | 16;
+
+        if (ts->pingpong)
+            flags |= 64;
+        if (ts->stereo)
+            flags |= 4;
+
+        sample_header = b->size;
+        set_long(b, sample_offsets + 4 * n, sample_header);
+        put_byte(b, 'I');
+        put_byte(b, 'M');
+        put_byte(b, 'P');
+        put_byte(b, 'S');
+        put_zeros(b, 13);
+        put_byte(b, 64); /* global volume */
+        put_byte(b, flags);
+        put_byte(b, 64); /* default volume */
+        put_zeros(b, 26);
+        put_byte(b, 1);  /* signed */
+        put_byte(b, 32); /* default pan */
+        put_long(b, LOOP_START + ts->loop_length);
+        put_long(b, LOOP_START);
+        put_long(b, LOOP_START + ts->loop_length);
+        put_long(b, ts->C5_speed);
+        put_long(b, 0);
+        put_long(b, 0);
+        put_long(b, 0); /* filled in below */
+        put_zeros(b, 4);
+
+        set_long(b, sample_header + 72, b->size);
+        put_sample_data(b, n);
+    }
+}
+
+/* Renders the module, returning a malloc'd buffer of N_FRAMES stereo
+ * frames, or NULL on failure.
+ */
+static sample_t *render(const BUFFER *b, int quality) {
+    DUMBFILE *f = dumbfile_open_memory((const char *)b->data, b->size);
+    DUH *duh = f ? dumb_read_it_quick(f) : NULL;
+    DUH_SIGRENDERER *sr;
+    sample_t *out = calloc(N_FRAMES * 2, sizeof(*out));
+    sample_t **buf = allocate_sample_buffer(2, BLOCK);
+    long total = 0;
+
+    if (f)
+        dumbfile_close(f);
+
+    dumb_resampling_quality = quality;
+    sr = duh ? duh_start_sigrenderer(duh, 0, 2, 0) : NULL;
+    if (!sr || !out || !buf) {
+        free(out);
+        out = NULL;
+    }
+
+    while (out && total < N_FRAMES) {
+        long n = MIN(BLOCK, N_FRAMES - total);
+        dumb_silence(buf[0], n * 2);
+        n = duh_sigrenderer_generate_samples(sr, 1.0f, 65536.0f / 44100, n,
+                                             buf);
+        if (n <= 0)
+            break;
+        memcpy(out + total * 2, buf[0], n * 2 * sizeof(*out));
+        total += n;
+    }
+
+    duh_end_sigrenderer(sr);
+    unload_duh(duh);
+    destroy_sample_buffer(buf);
+    return out;
+}
+
+/* Returns nonzero if the renders differ at the given quality. */
+static int check_quality(const BUFFER *b, int quality) {
+    sample_t *wrapped, *unrolled;
+    long i, first = -1;
+    int failed;
+
+    dumb_it_min_unrolled_loop = 0;
+    wrapped = render(b, quality);
+    dumb_it_min_unrolled_loop = 1024;
+    unrolled = render(b, quality);
+
+    failed = !wrapped || !unrolled;
+    for (i = 0; !failed && i < N_FRAMES * 2; i++) {
+        if (wrapped[i] != unrolled[i]) {
+            first = i / 2;
+            failed = 1;
+        }
+    }
+
+    if (!wrapped || !unrolled)
+        printf("quality %d: the module failed to render\n", quality);
+    else if (failed)
+        printf("quality %d: the renders first differ at frame %ld\n",
+               quality, first);
+
+    free(wrapped);
+    free(unrolled);
+    return failed;
+}
+
+int main(void) {
+    BUFFER b = {NULL, 0, 0};
+    int quality, failed = 0;
+
+    build_module(&b);
+    dumb_it_max_float_sample_memory = 16 * 1024 * 1024;
+
+    for (quality = 0; quality < DUMB_RQ_N_LEVELS; quality++)
+        failed += check_quality(&b, quality);
+
+    free(b.data);
+    dumb_exit();
+
+    printf("%d of %d qualities rendered the same with and without "
+           "unrolling\n",
+           DUMB_RQ_N_LEVELS - failed, DUMB_RQ_N_LEVELS);
+    return failed != 0;
+}